@@ -0,0 +1,86 @@
+/*-------------------------------------------------------
+                    Net Bit Classes
+                    ===============
+
+Netlist passes work on single net bits. A bit is keyed by
+the symbol of its net and the bit index, and bits that are
+one electrical net (joined, or simplified into a plain wi-
+re) are kept in equivalence classes by a union find.
+
+Example Usage:
+
+    BitClasses classes;
+    classes.unite(bit_key(a.id(), 3), bit_key(b.id(), 0));
+    classes.find(bit_key(a.id(), 3)) == classes.find(bit_key(b.id(), 0));     // true
+
+Used by ModuleDef::eliminate_aliases(...) and the optimi-
+zer of the flattened emission.
+
+---------------------------------------------------------*/
+
+#ifndef BIT_CLASSES_H
+#define BIT_CLASSES_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <wire.h>
+
+using namespace std;
+
+inline uint64_t bit_key(Symbol net, int bit){
+    return ((uint64_t)net << 32) | (uint32_t)bit;
+}
+
+inline Symbol key_net(uint64_t key){
+    return (Symbol)(key >> 32);
+}
+
+inline int key_bit(uint64_t key){
+    return (int)(uint32_t)key;
+}
+
+class BitClasses{
+    /*------------------------------------------------------------------------------------------
+    A union find over net bits. Bits are numbered in the order they are first seen and a class
+    is represented by its oldest bit, so the results never depend on hashing.
+
+    Usefull methods:
+        1. find(key) : Index of the class of a bit, adding the bit if it is new.
+        2. unite(a, b) : Merges the classes of two bits, returns the index of the merged class.
+        3. contains(key) : True if the bit was seen.
+        4. keys : The bits in the order they were first seen, find(keys[i]) is a class index.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        uint32_t find(uint64_t key){
+            pair<unordered_map<uint64_t, uint32_t>::iterator, bool> found = this->index.emplace(key, this->parent.size());
+            if(found.second){
+                this->parent.push_back(this->parent.size());
+                this->keys.push_back(key);
+            }
+            return this->root(found.first->second);
+        }
+        uint32_t root(uint32_t i){
+            while(this->parent[i] != i){
+                this->parent[i] = this->parent[this->parent[i]];
+                i = this->parent[i];
+            }
+            return i;
+        }
+        uint32_t unite(uint64_t a, uint64_t b){
+            uint32_t root_a = this->find(a), root_b = this->find(b);
+            this->parent[max(root_a, root_b)] = min(root_a, root_b);
+            return min(root_a, root_b);
+        }
+        bool contains(uint64_t key) const { return this->index.count(key) != 0; }
+        size_t size() const { return this->keys.size(); }
+
+        vector<uint64_t> keys;
+
+    private:
+        unordered_map<uint64_t, uint32_t> index;
+        vector<uint32_t> parent;
+};
+
+#endif
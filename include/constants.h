@@ -1,22 +1,37 @@
 #ifndef GATE_CONSTANTS_H
 #define GATE_CONSTANTS_H
 
-#define NAND_DELAY 1
-#define NOT_DELAY 1
-#define AND_DELAY 2
-#define OR_DELAY 2
-#define NOR_DELAY 2
-#define XOR_DELAY 3
-#define FLIP_FLOP_DELAY (2 + 4*NOT_DELAY)
+/*------------------------------------------------------------------------------------------
+Gate delays (time units) and transistor counts. These are typed constants, so they can be used
+in the compile time gate traits (see Gate<Op, Width> in verilog.h).
+------------------------------------------------------------------------------------------*/
 
+constexpr int NAND_DELAY = 1;
+constexpr int NOT_DELAY = 1;
+constexpr int AND_DELAY = 2;
+constexpr int OR_DELAY = 2;
+constexpr int NOR_DELAY = 2;
+constexpr int XOR_DELAY = 3;
+constexpr int FLIP_FLOP_DELAY = 2 + 4*NOT_DELAY;
 
-#define NOT_TRANSISTORS 2
-#define NAND_TRANSISTORS 4
-#define NOR_TRANSISTORS 4
-#define AND_TRANSISTORS 6
-#define OR_TRANSISTORS 6
-#define XOR_TRANSISTORS 8
-#define TRANSMISSION_GATE_TRANSISTORS 2
-#define FLIP_FLOP_TRANSISTORS (4*TRANSMISSION_GATE_TRANSISTORS + 5*NOT_TRANSISTORS) 
+
+constexpr int NOT_TRANSISTORS = 2;
+constexpr int NAND_TRANSISTORS = 4;
+constexpr int NOR_TRANSISTORS = 4;
+constexpr int AND_TRANSISTORS = 6;
+constexpr int OR_TRANSISTORS = 6;
+constexpr int XOR_TRANSISTORS = 8;
+constexpr int TRANSMISSION_GATE_TRANSISTORS = 2;
+constexpr int FLIP_FLOP_TRANSISTORS = 4*TRANSMISSION_GATE_TRANSISTORS + 5*NOT_TRANSISTORS;
+
+/*------------------------------------------------------------------------------------------
+Worst delays through the cells the pipelined generators are built of, used to place pipeline
+registers by delay. They follow the wiring of FULL_ADDER (S = A^B^Cin, Cout = AB + BC + CA) and
+CLA_STAR (S = CS1 + PS.CS0) in src/verilog.cpp. CLA_STAR_TRANSISTORS prices a prefix network.
+------------------------------------------------------------------------------------------*/
+
+constexpr int FULL_ADDER_DELAY = 2*XOR_DELAY > AND_DELAY + 2*OR_DELAY ? 2*XOR_DELAY : AND_DELAY + 2*OR_DELAY;
+constexpr int CLA_STAR_DELAY = AND_DELAY + OR_DELAY;
+constexpr int CLA_STAR_TRANSISTORS = 2*(AND_TRANSISTORS + OR_TRANSISTORS);
 
 #endif
@@ -0,0 +1,91 @@
+/*-------------------------------------------------------
+                Double Buffered File Sink
+                =========================
+
+An output stream that writes to a file through two buff-
+ers. While the generator keeps emitting modules into one
+buffer, a background thread writes the other one to disk,
+so writing overlaps with emission and memory stays bounded
+by the two buffers, no matter how large the design is.
+
+Example Usage:
+
+    FileSink out("generated_codes/wtm.v");
+    if(out.is_open()){
+        wtm.write_verilog(out);
+        out.close();
+    }
+
+---------------------------------------------------------*/
+
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+class DoubleBuffer : public streambuf{
+    /*------------------------------------------------------------------------------------------
+    The stream buffer behind FileSink. One buffer is filled by the stream, the other one is
+    written to disk by the writer thread. When the active buffer is full, the buffers are swap-
+    ped, waiting only if the writer thread is still busy with the previous one.
+
+    Usefull methods:
+        1. open(file_name) : Opens the file and starts the writer thread.
+        2. close() : Flushes both buffers, stops the writer thread and closes the file.
+                Returns false if any write failed.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        DoubleBuffer(size_t buffer_size = 1 << 20);
+        ~DoubleBuffer();
+
+        bool open(string file_name);
+        bool close();
+        bool is_open() const;
+
+    protected:
+        int_type overflow(int_type c) override;
+        streamsize xsputn(const char* s, streamsize n) override;
+        int sync() override;
+
+    private:
+        void hand_over();
+        void writer_loop();
+
+        FILE* file = nullptr;
+        vector<char> buffers[2];
+        int active = 0;
+
+        size_t pending_size = 0;
+        bool pending = false;
+        bool stopping = false;
+        bool failed = false;
+
+        mutex lock;
+        condition_variable cv;
+        thread writer;
+};
+
+class FileSink : public ostream{
+    /*------------------------------------------------------------------------------------------
+    An ostream writing to a file through a DoubleBuffer.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        FileSink(string file_name, size_t buffer_size = 1 << 20);
+        ~FileSink();
+
+        bool is_open() const;
+        bool close();
+
+    private:
+        DoubleBuffer buffer;
+};
+
+#endif
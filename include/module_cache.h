@@ -0,0 +1,84 @@
+/*-------------------------------------------------------
+                The On-Disk Module Cache
+                ========================
+
+A persistent, content addressed cache of elaborated mod-
+ules. Every unique module written by write_verilog(...)
+is stored in the cache directory under a hash of the ge-
+nerator version and its ModuleKey, together with its po-
+rts, transistor count and the keys of the modules it in-
+stantiates.
+
+A later elaboration looks the module key up in the cache
+before building a module (see Chip::reuse_module). On a
+hit the cached module and its dependencies are spliced
+into the registry and the whole subtree is skipped.
+
+Spliced modules are opaque: they carry the text, ports
+and aggregates but not the netlist inside.
+
+Example Usage:
+
+    ModuleCache::global().open(".dotv_cache");
+    WALLACE_TREE_MULTIPLIER_PIPELINED wtm(...);   // Hits the cache
+    wtm.write_verilog(out);                       // Stores misses
+
+The cache can also be enabled with the environment vari-
+able DOTV_CACHE=<directory>.
+
+Bump GENERATOR_VERSION whenever a generator, the gate
+delays or the text format changes, old entries are then
+simply never hit again.
+
+---------------------------------------------------------*/
+
+#ifndef MODULE_CACHE_H
+#define MODULE_CACHE_H
+
+#include <verilog.h>
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <atomic>
+
+using namespace std;
+
+constexpr int GENERATOR_VERSION = 4;
+
+class ModuleCache{
+    /*------------------------------------------------------------------------------------------
+    Usefull methods:
+        1. global() : The cache used by reuse_module(...) and write_verilog(...).
+        2. open(directory) : Enables the cache, creating the directory if needed.
+        3. load(key) : Splices the cached module and its dependencies into the registry. Returns
+                nullptr on a miss.
+        4. store(module, text) : Writes one module entry.
+        5. hits(), misses() : Lookup counters.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        ModuleCache();
+
+        static ModuleCache& global();
+
+        bool open(string directory);
+        void close();
+        bool enabled() const;
+
+        shared_ptr<const ModuleDef> load(const ModuleKey& key);
+        bool store(const ModuleDef& module, const string& text);
+
+        size_t hits() const;
+        size_t misses() const;
+
+    private:
+        string path(const ModuleKey& key) const;
+
+        string directory;
+        atomic<bool> active;
+        atomic<size_t> hit_count;
+        atomic<size_t> miss_count;
+};
+
+uint64_t module_hash(const ModuleKey& key);
+
+#endif
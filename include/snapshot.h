@@ -0,0 +1,226 @@
+/*-------------------------------------------------------
+                    Design Snapshots
+                    ================
+
+A snapshot is an elaborated design saved to one binary
+file: every unique module with its ports, nets, instan-
+ces, bindings, transistor and delay metadata. Every re-
+ference inside the file is an index or an offset, never
+a pointer, so the file is mapped into memory as it is
+and read in place. Opening a snapshot costs one mmap,
+not one allocation per module or net.
+
+File layout (all integers in native byte order, every
+section 8 byte aligned):
+
+    SnapshotHeader      magic, versions, section table
+    modules             SnapshotModule[], dependencies
+                        before the modules using them,
+                        the top module is the last one
+    ports               SnapshotPort[]
+    nets                SnapshotNet[], unique net refs
+    net_lists           uint32_t[], indices into nets
+    instances           SnapshotInstance[]
+    overrides           SnapshotOverride[], sorted
+    assigns             SnapshotAssign[]
+    dependencies        uint32_t[], indices into modules
+    params              int32_t[], module key parameters
+    symbols             SnapshotString[], net names
+    strings             char[], every text of the file
+
+Example Usage:
+
+    Snapshot::save("wtm_64.snap", *wtm.module_def());
+
+    Snapshot snapshot;
+    if(snapshot.open("wtm_64.snap")){
+        const SnapshotModule& top = snapshot.top();
+        cout << snapshot.text(top.name) << " : " << top.total_transistors;
+        snapshot.write_verilog(cout);               // The same text as wtm.write_verilog(cout)
+    }
+
+Bump SNAPSHOT_VERSION whenever a record changes.
+
+---------------------------------------------------------*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <verilog.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <iostream>
+
+using namespace std;
+
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotString{
+    /*------------------------------------------------------------------------------------------
+    A text in the strings section. The strings section is limited to 4 GB.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct SnapshotRange{
+    /*------------------------------------------------------------------------------------------
+    count records of a section starting at record first.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t first;
+    uint32_t count;
+};
+
+struct SnapshotSection{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SnapshotNet{
+    /*------------------------------------------------------------------------------------------
+    A wire (see wire.h): the symbol of its name, its form and its bit range.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t symbol;
+    uint32_t form;
+    int32_t msb;
+    int32_t lsb;
+};
+
+struct SnapshotPort{
+    uint32_t net;
+    int32_t type;
+};
+
+struct SnapshotAssign{
+    uint32_t net;
+    int32_t value;
+};
+
+struct SnapshotInstance{
+    /*------------------------------------------------------------------------------------------
+    A placed submodule, bindings is a range of net_lists.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t module;
+    SnapshotRange bindings;
+    SnapshotString name;
+};
+
+struct SnapshotOverride{
+    /*------------------------------------------------------------------------------------------
+    The instantiation syntax a chip gave for instance number instance, see InstanceTable. Only
+    a few instances have one, so they are kept apart, sorted by instance.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t instance;
+    SnapshotString generate;
+};
+
+struct SnapshotModule{
+    /*------------------------------------------------------------------------------------------
+    A unique module, see ModuleDef. delay is the delay of a primitive (see constants.h), 0 for
+    joins and modules built out of submodules. wires and regs are ranges of net_lists. text is
+    the verilog definition of modules that are not described by their netlist alone (hand writ-
+    ten definitions, native verilog extras, behaviours, modules loaded from the module cache),
+    it is empty for the others. generate_code.out skips the module cache with --snapshot, so its
+    snapshots hold the records of every module whatever the cache holds.
+    -----------------------------------------------------------------------------------------*/
+    SnapshotString name;
+    SnapshotString generator;
+    SnapshotRange params;
+    uint32_t op;
+    int32_t width;
+    int32_t delay;
+    int32_t transistors;
+    int32_t total_transistors;
+    int32_t depth;
+    int64_t total_instances;
+    SnapshotRange ports;
+    SnapshotRange wires;
+    SnapshotRange regs;
+    SnapshotRange assigns;
+    SnapshotRange instances;
+    SnapshotRange dependencies;
+    SnapshotString text;
+};
+
+struct SnapshotHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t generator_version;
+    uint64_t file_size;
+    SnapshotSection modules;
+    SnapshotSection ports;
+    SnapshotSection nets;
+    SnapshotSection net_lists;
+    SnapshotSection instances;
+    SnapshotSection overrides;
+    SnapshotSection assigns;
+    SnapshotSection dependencies;
+    SnapshotSection params;
+    SnapshotSection symbols;
+    SnapshotSection strings;
+};
+
+class Snapshot{
+    /*------------------------------------------------------------------------------------------
+    A read only view of a snapshot file, see the top of this file. The records returned are
+    pointers into the mapping, they stay valid until close().
+
+    Usefull methods:
+        1. save(file_name, module) : Writes the snapshot of a module and everything below it.
+        2. open(file_name), close() : Maps and unmaps a snapshot. open() checks the header and
+                the section bounds and returns false for files that do not match.
+        3. top(), module(i), num_modules() : The modules, dependencies first.
+        4. ports(m), instances(m), assigns(m), dependencies(m), params(m) : The records of a
+                module, as pointers to its first record, the count is in the module.
+        5. net(i), net_list(range) : The nets and the net index lists (bindings, wires, regs).
+        5b. generate(instance) : The instantiation syntax of instance number instance, usually
+                empty.
+        6. text(s), symbol(i) : A text of the file and the name of a net symbol, in place.
+        7. to_wire(net) : A net as a wire, its name is interned in the SymbolTable.
+        8. write_verilog(out) : Writes the design the way Chip::write_verilog(out) does. Modules
+                without a text are rendered from their records, one module at a time.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        Snapshot();
+        ~Snapshot();
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        static bool save(const string& file_name, const ModuleDef& module);
+
+        bool open(const string& file_name);
+        void close();
+        bool is_open() const { return this->data != NULL; }
+
+        const SnapshotHeader& header() const { return *this->at<SnapshotHeader>(0); }
+        size_t num_modules() const { return this->header().modules.count; }
+        const SnapshotModule& module(size_t i) const { return this->section<SnapshotModule>(this->header().modules)[i]; }
+        const SnapshotModule& top() const { return this->module(this->num_modules() - 1); }
+
+        const SnapshotPort* ports(const SnapshotModule& m) const { return this->section<SnapshotPort>(this->header().ports) + m.ports.first; }
+        const SnapshotInstance* instances(const SnapshotModule& m) const { return this->section<SnapshotInstance>(this->header().instances) + m.instances.first; }
+        const SnapshotAssign* assigns(const SnapshotModule& m) const { return this->section<SnapshotAssign>(this->header().assigns) + m.assigns.first; }
+        const uint32_t* dependencies(const SnapshotModule& m) const { return this->section<uint32_t>(this->header().dependencies) + m.dependencies.first; }
+        const int32_t* params(const SnapshotModule& m) const { return this->section<int32_t>(this->header().params) + m.params.first; }
+
+        const SnapshotNet& net(uint32_t i) const { return this->section<SnapshotNet>(this->header().nets)[i]; }
+        const uint32_t* net_list(const SnapshotRange& range) const { return this->section<uint32_t>(this->header().net_lists) + range.first; }
+        string_view generate(uint32_t instance) const;
+
+        string_view text(const SnapshotString& s) const { return string_view(this->at<char>(this->header().strings.offset + s.offset), s.size); }
+        string_view symbol(uint32_t i) const { return this->text(this->section<SnapshotString>(this->header().symbols)[i]); }
+        wire to_wire(const SnapshotNet& net) const;
+
+        void write_verilog(ostream& out) const;
+
+    private:
+        template <typename T> const T* at(uint64_t offset) const { return (const T*)(this->data + offset); }
+        template <typename T> const T* section(const SnapshotSection& s) const { return this->at<T>(s.offset); }
+        bool check() const;
+
+        const char* data;
+        size_t size;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*-------------------------------------------------------
+                Elaboration Statistics
+                ======================
+
+Scoped timers and counters on the expensive paths of the
+library: constructor elaboration, add_submodule(...) co-
+pies, interning, define_headers(...), num_transistors()
+and the render and write phases of write_verilog(...).
+
+Phase times are wall clock: a phase is counted while at
+least one thread is inside it, so nested and parallel
+scopes of the same phase are not counted twice. Phases
+can nest in each other, add_submodule(...) for example
+includes the intern(...) of the submodule.
+
+Example Usage:
+
+    WALLACE_TREE_MULTIPLIER_PIPELINED wtm(...);
+    wtm.write_verilog(out);
+    cout << Stats::global().snapshot().report();
+
+The counters are process wide. Chips share their modules
+through the registry and the batch mode of main.cpp ela-
+borates configurations concurrently, so the numbers are
+never those of one chip alone.
+
+Instrumentation is compiled in by default. Build with
+-DDOTV_STATS=0 (make STATS=0) to compile every timer and
+counter out, snapshot() then reports zeros.
+
+---------------------------------------------------------*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+#ifndef DOTV_STATS
+#define DOTV_STATS 1
+#endif
+
+enum Counter{
+    INSTANCES_CREATED,      // add_submodule(...) calls
+    UNIQUE_MODULES,         // modules registered
+    WIRES_DECLARED,         // add_wire(...) and declare(...) calls
+    BYTES_EMITTED,          // verilog bytes written by write_verilog(...)
+    PEAK_TREE_SIZE,         // most Chip objects alive at once
+    JOINS_REMOVED,          // JOIN instances dropped by alias elimination
+    NUM_COUNTERS
+};
+
+enum Phase{
+    PHASE_ELABORATE,        // generator constructors
+    PHASE_ADD_SUBMODULE,    // add_submodule(...) and merge(...)
+    PHASE_INTERN,           // ModuleDef::intern(...)
+    PHASE_DEFINE_HEADERS,   // define_headers()
+    PHASE_NUM_TRANSISTORS,  // num_transistors()
+    PHASE_RENDER,           // rendering the module texts
+    PHASE_WRITE,            // writing the texts to the stream
+    NUM_PHASES
+};
+
+struct ElaborationStats{
+    /*------------------------------------------------------------------------------------------
+    A snapshot of the counters and phase times.
+    -----------------------------------------------------------------------------------------*/
+    uint64_t counters[NUM_COUNTERS] = {};
+    double seconds[NUM_PHASES] = {};
+
+    static const char* counter_name(Counter counter);
+    static const char* phase_name(Phase phase);
+    string report() const;
+};
+
+class Stats{
+    /*------------------------------------------------------------------------------------------
+    The process wide counters. Modules are shared between chips through the registry, so the
+    counters are not per chip.
+
+    Usefull methods:
+        1. global() : The shared counters.
+        2. add(counter, n) : Adds n to a counter.
+        3. enter(phase), leave(phase) : Marks a scope of a phase, see ScopedTimer.
+        4. alive(n) : Adds n (+1 or -1) to the live Chip count, updating PEAK_TREE_SIZE.
+        5. snapshot() : Returns the current values.
+        6. reset() : Zeros every counter.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        static Stats& global();
+
+        void add(Counter counter, uint64_t n){
+            this->counters[counter].fetch_add(n, memory_order_relaxed);
+        }
+        void alive(int64_t n);
+        void enter(Phase phase);
+        void leave(Phase phase);
+
+        ElaborationStats snapshot() const;
+        void reset();
+
+        static uint64_t now(){
+            return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        atomic<uint64_t> counters[NUM_COUNTERS] = {};
+        atomic<int64_t> live{0};
+        atomic<int> active[NUM_PHASES] = {};
+        atomic<uint64_t> started[NUM_PHASES] = {};
+        atomic<uint64_t> nanoseconds[NUM_PHASES] = {};
+};
+
+class ScopedTimer{
+    /*------------------------------------------------------------------------------------------
+    Counts the time until the end of the scope towards a phase.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        ScopedTimer(Phase phase) : phase(phase) { Stats::global().enter(phase); }
+        ~ScopedTimer(){ Stats::global().leave(this->phase); }
+
+    private:
+        Phase phase;
+};
+
+class TreeCounter{
+    /*------------------------------------------------------------------------------------------
+    A Chip member that keeps the live Chip count, whichever way the chip is made or copied. With
+    DOTV_STATS=0 it does nothing, it has no data either way so the Chip layout does not change.
+    -----------------------------------------------------------------------------------------*/
+    public:
+#if DOTV_STATS
+        TreeCounter(){ Stats::global().alive(1); }
+        TreeCounter(const TreeCounter&){ Stats::global().alive(1); }
+        TreeCounter& operator=(const TreeCounter&){ return *this; }
+        ~TreeCounter(){ Stats::global().alive(-1); }
+#endif
+};
+
+#define DOTV_CONCAT_(a, b) a##b
+#define DOTV_CONCAT(a, b) DOTV_CONCAT_(a, b)
+
+#if DOTV_STATS
+#define DOTV_TIMER(phase) ScopedTimer DOTV_CONCAT(dotv_timer_, __LINE__)(phase)
+#define DOTV_COUNT(counter, n) Stats::global().add(counter, n)
+#else
+#define DOTV_TIMER(phase)
+#define DOTV_COUNT(counter, n)
+#endif
+
+#endif
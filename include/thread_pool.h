@@ -0,0 +1,77 @@
+/*-------------------------------------------------------
+                Work Stealing Thread Pool
+                =========================
+
+A small thread pool used to elaborate and emit independ-
+ent parts of a design on all cores. Every worker owns a
+task queue, idle workers steal from the others, and the
+thread waiting on a parallel_for(...) keeps running tasks
+too, so nested parallel loops never dead lock.
+
+Results are merged by the caller in index order, so the
+generated code is identical to a serial build. The number
+of threads can be set with the environment variable
+DOTV_THREADS, DOTV_THREADS=1 runs everything serially.
+
+Example Usage:
+
+    vector<Chip> parts(n_bits);
+    ThreadPool::global().parallel_for(n_bits, [&](size_t bit){
+        ... wire up parts[bit] ...
+    });
+    for(...) this->merge(parts[bit]);
+
+---------------------------------------------------------*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+class ThreadPool{
+    /*------------------------------------------------------------------------------------------
+    Usefull methods:
+        1. global() : The pool shared by all generators.
+        2. size() : Number of threads running tasks, including the calling thread.
+        3. parallel_for(count, body) : Runs body(i) for every i in [0, count) and returns when
+                all of them are done. The first exception thrown by body is rethrown.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        ThreadPool(int num_threads);
+        ~ThreadPool();
+
+        static ThreadPool& global();
+
+        int size() const;
+        void parallel_for(size_t count, const function<void(size_t)>& body);
+
+    private:
+        struct Queue{
+            mutex lock;
+            deque<function<void()>> tasks;
+        };
+
+        void push(function<void()> task);
+        bool run_one();
+        void worker_loop(int index);
+
+        vector<unique_ptr<Queue>> queues;
+        vector<thread> workers;
+
+        mutex sleep_lock;
+        condition_variable wake;
+        atomic<long> queued;
+        bool stop = false;
+};
+
+#endif
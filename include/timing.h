@@ -0,0 +1,86 @@
+/*-------------------------------------------------------
+                Static Timing Analysis
+                ======================
+
+Computes arrival times through an elaborated design with
+the gate delays of constants.h, without a simulator. The
+analysis walks the hierarchy of the ModuleDef netlist: a
+gate adds its delay to the latest of its inputs, a flip-
+flop ends every path reaching its input and starts a new
+one FLIP_FLOP_DELAY (clock to output) after the clock.
+The netlist is analysed as elaborated, logic no output
+depends on included (--optimize removes it).
+
+Paths are grouped by pipeline stage, the number of regis-
+ters they passed before they were launched. Stage 1 runs
+from the inputs to the first registers, the last stage
+ends at the outputs.
+
+Example Usage:
+
+    WALLACE_TREE_MULTIPLIER_PIPELINED wtm("wtm", {"A", "B", "clk"}, "P", 64, 4);
+    TimingReport timing = analyze_timing(*wtm.module_def());
+    cout << timing.period << " " << timing.latency;
+    cout << timing.report();
+
+        [TIMING] WALLACE_TREE_MULTIPLIER_64_BIT
+        [TIMING] stage 1            26 units       1076 registers   WTM_LEVEL_4_FLIP_FLOP_0[0]
+        ...
+        [TIMING] stage 5             6 units          0 registers   P[0]
+        [TIMING] clock period       40 units
+        [TIMING] latency             4 cycles
+
+Combinational submodules (no flipflop anywhere below them)
+are analysed once into a delay from every input bit to
+every output bit they depend on, so a FULL_ADDER used a
+thousand times is walked once.
+
+---------------------------------------------------------*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <verilog.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct StageTiming{
+    /*------------------------------------------------------------------------------------------
+    The paths of one pipeline stage. worst is the latest arrival at a register input or an out-
+    put (-1 if no path ends in this stage), endpoint names it, example "WTM_CLA.CLA_PIPELINED_
+    OUT[7]" or "P[15]". registers is the number of flipflop bits capturing this stage.
+    -----------------------------------------------------------------------------------------*/
+    int worst = -1;
+    string endpoint;
+    long long registers = 0;
+};
+
+struct TimingReport{
+    /*------------------------------------------------------------------------------------------
+    The result of analyze_timing(...).
+
+        1. module (string) : Name of the analysed module.
+        2. stages (vector<StageTiming>) : stages[0] is stage 1, launched at the inputs. stages[i]
+                is launched at the i-th register of a path.
+        3. period (int) : The shortest clock period, the worst path over all the stages.
+        4. latency (int) : Registers between the inputs and the outputs, in clock cycles. 0 for
+                combinational designs.
+        5. registers (long long) : Every flipflop bit, also the ones holding a constant.
+
+    Usefull methods:
+        1. report() : A printable table, one [TIMING] line per stage.
+    -----------------------------------------------------------------------------------------*/
+    string module;
+    vector<StageTiming> stages;
+    int period = 0;
+    int latency = 0;
+    long long registers = 0;
+
+    string report() const;
+};
+
+TimingReport analyze_timing(const ModuleDef& module);
+
+#endif
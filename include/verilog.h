@@ -39,23 +39,29 @@ plimented.
 #define CHIP_OUTPUTS 1
 #define CHIP_INPUTS_REG 2
 #define CHIP_OUTPUTS_REG 3
+#define CHIP_INOUT 4
 
 #define BLOCK true
 #define N_BLOCK false
 
-#define wire string
-#define reg string
-
 #include <constants.h>
+#include <wire.h>
+#include <stats.h>
 #include <stdlib.h>
 #include <vector>
 #include <iostream>
 #include <set>
 #include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <shared_mutex>
+#include <string>
+#include <climits>
 
 using namespace std;
 
 wire wire_name(wire full_name);
+string module_name(string definition);
 
 class BehaviourModel{
     /*------------------------------------------------------------------------------------------
@@ -121,7 +127,7 @@ class BehaviourModel{
         ~BehaviourModel(){};
         int num_transistors = 0;
 
-        string code();
+        string code() const;
         void add(string lhs, string rhs, bool is_blocking);
 
     protected:
@@ -130,6 +136,297 @@ class BehaviourModel{
 };
 
 
+class Chip;
+struct ModuleDef;
+
+/*------------------------------------------------------------------------------------------
+                                    The Netlist IR
+                                    ==============
+
+Every generator produces an in-memory netlist: one ModuleDef per unique module holding its
+ports, nets, constant assigns, behaviours and submodule instances with their port bindings.
+Connectivity can be queried directly from the ModuleDef, and Verilog text is just one backend
+(see verilog_definition(...) in src/netlist.cpp).
+------------------------------------------------------------------------------------------*/
+
+enum class Op : uint8_t {
+    /*------------------------------------------------------------------------------------------
+    The function of a primitive module. Modules built out of submodules are Op::NONE.
+    -----------------------------------------------------------------------------------------*/
+    NONE, AND, OR, XOR, NAND, NOR, NOT, JOIN, FLIP_FLOP
+};
+
+struct ModuleKey{
+    /*------------------------------------------------------------------------------------------
+    Identifies a unique module by its generator and parameter tuple.
+    example:
+        {"CARRY_SAVE_ADDER", {37}}
+        {"CARRY_LOOK_AHEAD_ADDER_PIPELINED", {128, 4}}
+    -----------------------------------------------------------------------------------------*/
+    string generator;
+    vector<int> params;
+
+    bool operator==(const ModuleKey& other) const{
+        return generator == other.generator && params == other.params;
+    }
+};
+
+struct ModuleKeyHash{
+    size_t operator()(const ModuleKey& key) const{
+        size_t seed = hash<string>()(key.generator);
+        for(vector<int>::const_iterator i = key.params.begin(); i != key.params.end(); i++){
+            seed ^= hash<int>()(*i) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
+
+struct Port{
+    /*------------------------------------------------------------------------------------------
+    A module port. net is a declaration carrying the width, type is one of CHIP_INPUTS,
+    CHIP_OUTPUTS, CHIP_INPUTS_REG, CHIP_OUTPUTS_REG or CHIP_INOUT.
+    -----------------------------------------------------------------------------------------*/
+    wire net;
+    int type;
+
+    bool is_output() const { return type == CHIP_OUTPUTS || type == CHIP_OUTPUTS_REG; }
+    bool is_inout() const { return type == CHIP_INOUT; }
+    bool is_reg() const { return type == CHIP_INPUTS_REG || type == CHIP_OUTPUTS_REG; }
+};
+
+struct Assign{
+    /*------------------------------------------------------------------------------------------
+    A constant continuous assignment, example "assign carry[0] = 0;"
+    -----------------------------------------------------------------------------------------*/
+    wire lhs;
+    int value;
+};
+
+class InstanceTable{
+    /*------------------------------------------------------------------------------------------
+                                    The Instance Table
+                                    ==================
+
+    The submodules placed inside a module, stored as a structure of arrays. Only the instance
+    specific parts live here, the module definitions are shared between all instances. For
+    instance i:
+
+        1. type(i) : Index into types(), the unique modules in the order of their first use.
+                module(i) is the shared ModuleDef itself.
+        2. name(i) : Instance name, kept in one character pool for the whole table.
+        3. bindings(i), num_bindings(i) : Nets connected to the module ports, in port order. The
+                bindings of all the instances are one flat net array.
+        4. generate(i) : Optional instantiation syntax given by the chip. When empty the instan-
+                tiation is written from the bindings.
+
+    A placed gate costs three integers and its bindings, and walking the instances of a module
+    walks a few contiguous arrays.
+
+    Usefull methods:
+        1. add(name, module, inputs, outputs, generate) : Places an instance, its bindings are
+                the inputs followed by the outputs.
+        2. append(other) : Moves the instances of another table to the end of this one.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        size_t size() const { return type_ids.size(); }
+        bool empty() const { return type_ids.empty(); }
+
+        void add(string_view name, const shared_ptr<const ModuleDef>& module, const vector<wire>& inputs, const vector<wire>& outputs, const string& generate);
+        void append(InstanceTable&& other);
+
+        uint32_t type(size_t i) const { return type_ids[i]; }
+        const ModuleDef* module(size_t i) const { return type_table[type_ids[i]].get(); }
+        const vector<shared_ptr<const ModuleDef>>& types() const { return type_table; }
+        string_view name(size_t i) const;
+        const wire* bindings(size_t i) const { return nets.data() + net_offsets[i]; }
+        size_t num_bindings(size_t i) const { return net_offsets[i + 1] - net_offsets[i]; }
+        const string& generate(size_t i) const;
+
+    protected:
+        uint32_t find_type(const shared_ptr<const ModuleDef>& module);
+
+        vector<uint32_t> type_ids;
+        vector<uint32_t> name_offsets = {0};
+        vector<uint32_t> net_offsets = {0};
+        string names;
+        vector<wire> nets;
+
+        vector<shared_ptr<const ModuleDef>> type_table;
+        unordered_map<const ModuleDef*, uint32_t> type_index;
+        unordered_map<uint32_t, string> overrides;
+        uint32_t last_type = 0;
+};
+
+struct Connection{
+    /*------------------------------------------------------------------------------------------
+    One use of a net: port number port of submodule number instance.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t instance;
+    uint32_t port;
+};
+
+struct ModuleDef{
+    /*------------------------------------------------------------------------------------------
+                                    The Module Definition
+                                    =====================
+
+    An immutable module definition shared (flyweight) by every instance of a module. There is
+    exactly one ModuleDef for every unique module, no matter how many times it is instantiated,
+    so memory scales with the number of unique modules and not with the instances.
+
+        1. name (string), key (ModuleKey) : Module name, example "CARRY_SAVE_ADDER_37_BIT", and
+                the registry key it was elaborated under, example {"CARRY_SAVE_ADDER", {37}}
+        2. op (Op), width (int) : Function and bit width for primitive modules. from_cache is
+                set for modules spliced in from the on-disk cache (see module_cache.h), they only
+                carry ports, text and aggregates, not the netlist.
+        3. ports (vector<Port>) : Inputs followed by outputs, in declaration order
+        4. wires, regs (vector<wire>) : Declared nets
+        5. assigns (vector<Assign>) : Constant assignments
+        6. extras (vector<string>) : Native verilog code embedded with Chip::verilog(...)
+        7. behaviours (vector<BehaviourModel>) : Behaviour models
+        8. submodules (InstanceTable) : Instances placed inside this module
+        9. dependencies (vector<const ModuleDef*>) : Unique modules instantiated inside this
+                module, in the order of their first use (the types of submodules).
+        10. transistors (int) : Transistors in the module itself, excluding submodules
+        11. definition (string) : Hand written module definition syntax string. It is empty for
+                modules rendered from the netlist by verilog_definition(...) at emission.
+
+    Per module aggregates are computed once when the module is interned, by summing the cached
+    totals of the submodules, so they never walk the hierarchy again:
+
+        12. total_transistors (int) : Transistors for one instance, including all submodules
+        13. total_instances (long long) : Number of instances in the fully flattened hierarchy
+        14. depth (int) : Hierarchy depth, 0 for modules without submodules
+        15. fingerprint (size_t) : Hash of the contents of modules keyed by their name alone
+                (user defined chips), 0 for the others. See content_fingerprint(chip).
+
+    Usefull methods:
+        1. intern(const Chip& chip) : Returns the shared definition for the chip's module,
+                creating it only the first time the module key is seen. Throws invalid_argument
+                for a user defined chip named like a different, already registered one.
+        2. num_transistors() : Returns the transistor count for one instance
+        3. connections(net) : Every (instance, port) the net is bound to, in O(1).
+        4. find_port(net) : Index of the port with the given name, or -1.
+        5. is_primitive() : True for modules with a known function (gates, joins, flipflops).
+        6. eliminate_aliases(removed) : A copy without JOIN instances, the nets they tie are
+                merged and the bindings rewritten. Throws for modules loaded from the module
+                cache. See src/alias.cpp.
+    -----------------------------------------------------------------------------------------*/
+    string name;
+    ModuleKey key;
+    Op op = Op::NONE;
+    int width = 1;
+    bool from_cache = false;
+
+    vector<Port> ports;
+    vector<wire> wires;
+    vector<reg> regs;
+    vector<Assign> assigns;
+    vector<string> extras;
+    vector<BehaviourModel> behaviours;
+    InstanceTable submodules;
+    vector<const ModuleDef*> dependencies;
+
+    int transistors = 0;
+    string definition;
+
+    int total_transistors = 0;
+    long long total_instances = 0;
+    int depth = 0;
+    size_t fingerprint = 0;
+
+    static shared_ptr<const ModuleDef> intern(const Chip& chip);
+    static size_t content_fingerprint(const Chip& chip);
+    int num_transistors() const;
+
+    const vector<Connection>& connections(Symbol net) const;
+    int find_port(Symbol net) const;
+    bool is_primitive() const { return op != Op::NONE; }
+    shared_ptr<const ModuleDef> eliminate_aliases(size_t& removed) const;
+
+    protected:
+        void index_connections();
+
+        unordered_map<Symbol, vector<Connection>> net_connections;
+};
+
+struct EmitOptions{
+    /*------------------------------------------------------------------------------------------
+    Options of Chip::write_verilog(...).
+
+        1. flatten (bool) : Inline submodules into their parents instead of instantiating them.
+                Gates become continuous assigns, flipflops become always blocks on regs and the
+                nets of inlined modules get unique names built from the instance path, example
+                "CSA_3__FA_7__w1".
+        2. max_depth (int), max_instances (long long) : Only modules at most this deep and with
+                at most this many instances in their flattened hierarchy are inlined, bigger ones
+                stay instances and are emitted (flattened in turn) as separate modules. By default
+                the whole design becomes one module.
+        3. eliminate_joins (bool) : Resolve the JOIN and JOIN_N_BIT instances of every module in-
+                to net aliases and drop them, see ModuleDef::eliminate_aliases(...). write_verilog
+                returns the removed count, it is also the JOINS_REMOVED counter of the stats.
+                Flattened modules already turn joins into plain assigns. A design with modules
+                loaded from the module cache throws invalid_argument, their joins are unknown.
+        4. optimize (bool) : Optimize the flattened modules (implies flatten). Constants are pro-
+                pagated through the gates and flipflops, gates with a constant or repeated input
+                are reduced to a wire or an inverter (a full adder with a zero input becomes a
+                half adder), joins are merged into single nets and logic no output depends on is
+                removed. The module header reports the new transistor count and critical path, with
+                the clock to output delay of the flipflops like the static timing analysis.
+        5. retime (bool) : Retime the optimized flat modules (implies optimize). The flipflops
+                are moved across the gates to the shortest clock period, the number of registers
+                on every path from an input to an output (the latency) stays the same. The module
+                header reports the clock period and the register count before and after.
+
+    Modules that are not described by a netlist (native verilog extras, behaviours other than
+    flipflops, modules loaded from the module cache) are never inlined.
+    -----------------------------------------------------------------------------------------*/
+    bool flatten = false;
+    int max_depth = INT_MAX;
+    long long max_instances = LLONG_MAX;
+    bool eliminate_joins = false;
+    bool optimize = false;
+    bool retime = false;
+};
+
+void verilog_header(string& out, const ModuleDef& module, int transistors = -1, int critical_path = -1, const string& note = "");
+string verilog_definition(const ModuleDef& module);
+void verilog_instance(string& out, const InstanceTable& instances, size_t i);
+bool can_flatten(const ModuleDef& module);
+string verilog_flat_definition(const ModuleDef& module, const EmitOptions& options, vector<const ModuleDef*>& kept);
+string blif_definition(const ModuleDef& module, const EmitOptions& options);
+string aiger_definition(const ModuleDef& module, const EmitOptions& options);
+
+class ModuleRegistry{
+    /*------------------------------------------------------------------------------------------
+                                    The Module Registry
+                                    ===================
+
+    Holds every unique module elaborated so far, keyed by ModuleKey with O(1) lookup. It is fill-
+    ed once during elaboration: a generator whose key is already registered does not need to bu-
+    ild its module body again.
+
+    Usefull methods:
+        1. global() : The registry shared by all chips.
+        2. find(key) : Returns the registered module, or nullptr.
+        3. insert(key, module) : Registers a module and returns the registered one. If the key is
+                already taken, the previously registered module is kept and returned.
+
+    The registry is safe to use from the elaboration threads. Two threads may build the same
+    module at once, the first one to insert it wins and both end up sharing it.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        static ModuleRegistry& global();
+
+        shared_ptr<const ModuleDef> find(const ModuleKey& key) const;
+        shared_ptr<const ModuleDef> insert(const ModuleKey& key, shared_ptr<const ModuleDef> module);
+        size_t size() const;
+
+    protected:
+        mutable shared_mutex lock;
+        unordered_map<ModuleKey, shared_ptr<const ModuleDef>, ModuleKeyHash> modules;
+};
+
 class Chip{
     /*------------------------------------------------------------------------------------------
                                         The Chip Module
@@ -143,7 +440,9 @@ class Chip{
 
     Every instance of a Chip Module has:
         1. name (string) : A name
-        2. submodules (vector<Chip>) : A list of submodules automatically added
+        2. submodules (InstanceTable) : A table of submodule instances automatically added.
+                                Instances only hold the instance name, the port bindings and
+                                the type of the shared ModuleDef.
         3. definition (string) : A module definition syntax string
                                 example:
 
@@ -153,8 +452,9 @@ class Chip{
                                     assign c = a & b;
                                 endmodule
 
-        4. generate (string) : A generate string (or module instantiation syntax string) 
-                                example:
+        4. generate (string) : An optional generate string (or module instantiation syntax
+                                string). Chips normally leave it empty, the instantiation is
+                                then written from the port bindings. example:
                                 
                                 AND_GATE and_instance(input_1, input_2, output);
 
@@ -164,22 +464,24 @@ class Chip{
                                 
                                     MyChip my_chip_1(inputs, outputs);
 
-                                    inputs and outputs are instance specific
+                                    inputs and outputs are instance specific. They are bound to
+                                    the declared ports in order, inputs first.
         
-        7. input_names, output_names (vector<string>) : Generic input name (Static)
+        7. ports (vector<Port>) : Generic ports (Static)
                                 These are generic name used in module definition
                                 example:
                                     MyChip my_chip_1(inputs, outputs);
 
                                 will generate headers as:
-                                    module MyChip (input_names, output_names);
+                                    module MyChip (input ports, output ports);
                                         ...
                                     endmodule
         
         8. Transistors : Number of transistors used to make current module.
     
     Some usefull methods:
-        1. add_submodule(Chip sub_chip) : Adds the passed chip as submodule
+        1. add_submodule(const Chip& sub_chip) : Adds the passed chip as submodule. The sub-
+                chip's definition is interned, it is not copied into the parent.
 
         2. add_wire(wire new_wire) : Adds the passed wire as wire
 
@@ -187,8 +489,9 @@ class Chip{
                 example declare("my_input", CHIP_INPUTS);
                         declare("my_output", CHIP_OUTPUT);
 
-        4. define_headers() : Returns a set of module definition by reecursively iterating
-                through sub modules.
+        4. define_headers() : Returns the unique module definitions used by this chip (inclu-
+                ding itself), dependency ordered: every module comes after all the modules it
+                instantiates.
 
         5. auto_gen(string head) : Automatically generates the module definition.
                 example:
@@ -200,16 +503,61 @@ class Chip{
                     
                     populated automatically.
 
+        5b. lazy_gen(string head) : Like auto_gen(head), but only registers the module. The
+                definition text is rendered when the design is emitted, in parallel for all the
+                unique modules (see write_verilog(...)). Used by the built-in generators.
+
         6. verilog(string e) : Embeds native verilog code specified.
                 example
                     this->verilog("assign c = a~b;")
-                will insert the code snippet in the module.
+                will insert the code snippet in the module. The snippet is opaque to the netlist,
+                prefer assign(...) and submodules where possible.
+
+        6b. assign(wire lhs, int value) : Ties a net to a constant.
+                example
+                    this->assign(carry[0], 0);
 
         7. generate_verilog() : Generates the verilog code for the current chip as string.
 
+        7b. write_verilog(ostream& out) : Streams the verilog code for the current chip to out,
+                module by module, without building the whole design as one string. The module
+                texts are rendered in batches on the thread pool and written in dependency order.
+                example:
+                    FileSink out("my_chip.v");          // See file_sink.h
+                    my_chip.write_verilog(out);
+
+        7c. write_verilog(out, options), generate_verilog(options) : The same with EmitOptions,
+                write_verilog returns the JOIN instances removed by options.eliminate_joins.
+                example a single flat module:
+                    EmitOptions options;
+                    options.flatten = true;
+                    my_chip.write_verilog(out, options);
+
+        7d. write_blif(out, options), write_aiger(out, options) : Streams the design flattened
+                down to its gates and flipflops as a BLIF model or a binary AIGER file, for logic
+                optimization and equivalence checking tools. options.optimize is applied first.
+                example:
+                    FileSink out("my_chip.aig");
+                    my_chip.write_aiger(out);
+
         8. num_transistors() : Returns the transistor count for one instance
 
-        NOTE : All wires/ports/reg are of type string  
+        9. reuse_module(ModuleKey key) : Sets the module key of this chip. Returns true if the
+                module was already elaborated, so the constructor can skip building the body.
+                example:
+                    this->inputs = input_wires;
+                    if(this->reuse_module({"FULL_ADDER", {}})) return;
+
+        10. merge(Chip& part) : Moves the wires, regs, assigns, extras, behaviours and submodules
+                of part into this chip. Generators wire independent parts (bits of a level, gro-
+                ups of a tree) into separate parts on the thread pool (see thread_pool.h) and me-
+                rge them in order, so the result is the same as a serial build.
+
+        The elaboration counters and phase times are process wide, not per chip, see
+        Stats::global() in stats.h.
+
+        NOTE : All wires/ports/reg are of type wire (see wire.h), an interned name with an
+               optional bit slice. Strings like "A[3]" still convert to wires.
     -----------------------------------------------------------------------------------------*/
 
     public:
@@ -221,33 +569,50 @@ class Chip{
 
         int transistors = 0;
 
-        void add_submodule(Chip sub);
+        void add_submodule(const Chip& sub);
         void add_submodule(BehaviourModel behaviour);
         void add_wire(wire new_wire);
         void add_reg(reg new_reg);
         void declare(wire e, int type);
 	    void declare(wire e, int type, int width);
         void verilog(string e);
+        void assign(wire lhs, int value);
         int num_transistors();
 
-        set<string> define_headers();
+        bool reuse_module(ModuleKey key);
+        shared_ptr<const ModuleDef> module_def() const;
+
+        vector<const ModuleDef*> define_headers();
         string auto_gen(string head);
-        string generate_verilog();
+        void lazy_gen(string head);
+        string generate_verilog(const EmitOptions& options = EmitOptions());
+        size_t write_verilog(ostream& out, const EmitOptions& options = EmitOptions());
+        void write_blif(ostream& out, const EmitOptions& options = EmitOptions());
+        void write_aiger(ostream& out, const EmitOptions& options = EmitOptions());
         
     protected:
-        vector<Chip> submodules;
+        friend struct ModuleDef;
+
+        void merge(Chip& part);
+
+        InstanceTable submodules;
         vector<wire> inputs;
         vector<wire> outputs;
         vector<wire> wires;
-        vector<wire> extras;
-        vector<wire> input_names;
-        vector<bool> is_input_reg;
-        vector<wire> output_names;
-        vector<bool> is_output_reg; 
+        vector<Assign> assigns;
+        vector<string> extras;
+        vector<Port> ports;
         vector<reg>  regs;
         vector<BehaviourModel> behaviours;
 
+        string type_name;
+        Op op = Op::NONE;
+        ModuleKey key;
+        mutable shared_ptr<const ModuleDef> module;
+
         int n_bits = 1;
+
+        TreeCounter tree_counter;
 };
 
 
@@ -255,82 +620,231 @@ class Chip{
 /*------------------------------------------------------------------------------------------
                                     Some Basic Logic Gates
                                     ======================
-------------------------------------------------------------------------------------------*/
 
-class JOIN : public Chip{
-    public:
-        JOIN(string name, wire a, wire b);
-};
+All the gates are one templated family. Gate<Op::AND, 8> is an 8 bit AND gate: its module name,
+definition text, delay and transistor count are computed at compile time, so placing a gate
+only stores its port bindings. GateN<Op::AND> is the same gate with a width known only at run
+time, its definition is rendered once when the design is emitted.
 
-class JOIN_N_BIT : public Chip{
-    public:
-        JOIN_N_BIT(string name, wire a, wire b, int n_bits);
-};
+    Gate<Op::XOR> xor_1("xor_1", {"A", "B"}, "S");              // XOR_GATE
+    Gate<Op::AND, 8> and_8("and_8", {"A", "B"}, "C");           // AND_GATE_8_BIT
+    GateN<Op::OR> or_n("or_n", {"A", "B"}, "C", n_bits);        // OR_GATE_<n_bits>_BIT
+    Gate<Op::NOT> not_1("not_1", "A", "B");                     // NOT_GATE
+    Gate<Op::JOIN> joint("joint", "A", "B");                    // JOIN
 
-class AND : public Chip{
-    public:
-        AND(string name, vector<wire> input_wires, wire output_wires);    
-};
-
-class AND_N_BIT : public Chip{
-    public:
-        
-        AND_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits); 
-};
+The class names AND, AND_N_BIT, ... are aliases of these templates.
+------------------------------------------------------------------------------------------*/
 
-class XOR : public Chip{
-    public:
-        XOR(wire name, vector<wire> input_wires, wire output_wire);  
+struct GateInfo{
+    /*------------------------------------------------------------------------------------------
+    Compile time traits of a gate.
+        1. name : Module name, example "AND_GATE"
+        2. key : Registry generator, example "AND" (and "AND_N_BIT" for the n bit gates)
+        3. expression : The assign expression, example "c = a & b"
+        4. delay : Gate delay, see constants.h
+        5. transistors : Transistors per bit, see constants.h
+    -----------------------------------------------------------------------------------------*/
+    const char* name;
+    const char* key;
+    const char* expression;
+    int delay;
+    int transistors;
 };
 
-class XOR_N_BIT : public Chip{
-    public:     
-        XOR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits);
+constexpr GateInfo gate_info(Op op){
+    switch(op){
+        case Op::AND  : return {"AND_GATE",  "AND",  "c = a & b",    AND_DELAY,  AND_TRANSISTORS};
+        case Op::OR   : return {"OR_GATE",   "OR",   "c = a | b",    OR_DELAY,   OR_TRANSISTORS};
+        case Op::XOR  : return {"XOR_GATE",  "XOR",  "c = a ^ b",    XOR_DELAY,  XOR_TRANSISTORS};
+        case Op::NAND : return {"NAND_GATE", "NAND", "c = ~(a & b)", NAND_DELAY, NAND_TRANSISTORS};
+        case Op::NOR  : return {"NOR_GATE",  "NOR",  "c = ~(a | b)", NOR_DELAY,  NOR_TRANSISTORS};
+        case Op::NOT  : return {"NOT_GATE",  "NOT",  "out = ~in",    NOT_DELAY,  NOT_TRANSISTORS};
+        case Op::JOIN : return {"JOIN",      "JOIN", "",             0,          0};
+        default       : return {"",          "",     "",             0,          0};
+    }
+}
+
+constexpr bool is_gate(Op op){
+    return op != Op::NONE && op != Op::FLIP_FLOP;
+}
+
+struct GateText{
+    /*------------------------------------------------------------------------------------------
+    A small fixed capacity string which can be built at compile time.
+    -----------------------------------------------------------------------------------------*/
+    char text[256] = {};
+    int size = 0;
+
+    constexpr void append(const char* s){
+        while(*s) this->text[this->size++] = *s++;
+    }
+    constexpr void append(int value){
+        char digits[12] = {};
+        int n = 0;
+        do{ digits[n++] = '0' + value % 10; value /= 10; } while(value > 0);
+        while(n > 0) this->text[this->size++] = digits[--n];
+    }
+    string str() const{
+        return string(this->text, this->size);
+    }
 };
 
-class OR : public Chip{
-        public:
-        OR(string name, vector<wire> input_wires, wire output_wire);  
-};
+constexpr GateText gate_type_name(Op op, int width, bool n_bit){
+    /*------------------------------------------------------------------------------------------
+    Returns the module name, example "AND_GATE" or "AND_GATE_8_BIT".
+    -----------------------------------------------------------------------------------------*/
+    GateText out;
+    out.append(gate_info(op).name);
+    if(n_bit){
+        out.append("_");
+        out.append(width);
+        out.append("_BIT");
+    }
+    return out;
+}
+
+constexpr GateText gate_text(Op op, const char* name, int width){
+    /*------------------------------------------------------------------------------------------
+    Returns the module definition of a gate, example
 
-class OR_N_BIT : public Chip{
+        module AND_GATE_8_BIT(a, b, c);
+             input [7:0] a, b;
+             output [7:0] c;
+             assign #2 c = a & b;
+        endmodule
+    -----------------------------------------------------------------------------------------*/
+    GateInfo info = gate_info(op);
+    GateText range;
+    if(width > 1){
+        range.append("[");
+        range.append(width - 1);
+        range.append(":0] ");
+    }
+
+    GateText out;
+    out.append("module ");
+    out.append(name);
+    if(op == Op::JOIN){
+        out.append("(a, a);\n\t inout ");
+        out.append(range.text);
+        out.append("a;\nendmodule");
+        return out;
+    }
+    if(op == Op::NOT){
+        out.append("(in, out);\n\t input ");
+        out.append(range.text);
+        out.append("in;\n\t output ");
+        out.append(range.text);
+        out.append("out;\n");
+    }
+    else{
+        out.append("(a, b, c);\n\t input ");
+        out.append(range.text);
+        out.append("a, b;\n\t output ");
+        out.append(range.text);
+        out.append("c;\n");
+    }
+    out.append("\t assign #");
+    out.append(info.delay);
+    out.append(" ");
+    out.append(info.expression);
+    out.append(";\nendmodule");
+    return out;
+}
+
+shared_ptr<const ModuleDef> gate_module(Op op, int width, bool n_bit, const char* definition);
+
+template<Op GateOp, int Width = 1>
+class Gate : public Chip{
+    /*------------------------------------------------------------------------------------------
+    A gate of a width fixed at compile time. Widths above 1 are the n bit gates.
+    -----------------------------------------------------------------------------------------*/
     public:
-        OR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits);
-       
-};
+        static_assert(is_gate(GateOp), "Gate needs a gate op.");
+        static_assert(Width >= 1, "Gate width must be positive.");
 
-class NAND : public Chip{
-    public:
-        NAND(string name, vector<wire> input_wires, wire output_wire);
-        
-};
+        static constexpr GateInfo info = gate_info(GateOp);
+        static constexpr int delay = info.delay;
+        static constexpr int transistor_count = info.transistors * Width;
+        static constexpr GateText type = gate_type_name(GateOp, Width, Width > 1);
+        static constexpr GateText text = gate_text(GateOp, type.text, Width);
 
-class NAND_N_BIT : public Chip{
-    public:
-        NAND_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits);
-        
-};
+        Gate(string name, vector<wire> input_wires, wire output_wire){
+            static_assert(GateOp != Op::NOT && GateOp != Op::JOIN, "NOT and JOIN take two wires.");
+            this->name = name;
+            this->inputs = input_wires;
+            this->outputs.push_back(output_wire);
+            this->n_bits = Width;
+            this->module = Gate::shared();
+        }
 
-class NOR : public Chip{
-    public:
-        NOR(string name, vector<wire> input_wires, wire output_wire);  
-};
+        Gate(string name, wire a, wire b){
+            static_assert(GateOp == Op::NOT || GateOp == Op::JOIN, "Only NOT and JOIN take two wires.");
+            this->name = name;
+            this->inputs.push_back(a);
+            if(GateOp == Op::JOIN) this->inputs.push_back(b);
+            else this->outputs.push_back(b);
+            this->n_bits = Width;
+            this->module = Gate::shared();
+        }
 
-class NOR_N_BIT : public Chip{
-    public:
-        NOR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits);
+        static const shared_ptr<const ModuleDef>& shared(){
+            /*------------------------------------------------------------------------------------------
+            The module is looked up in the registry once per (GateOp, Width).
+            -----------------------------------------------------------------------------------------*/
+            static const shared_ptr<const ModuleDef> module = gate_module(GateOp, Width, Width > 1, text.text);
+            return module;
+        }
 };
 
-class NOT : public Chip{
+template<Op GateOp>
+class GateN : public Chip{
+    /*------------------------------------------------------------------------------------------
+    An n bit gate of a width known only at run time.
+    -----------------------------------------------------------------------------------------*/
     public:
-        NOT(string name, wire input_wire, wire output_wire); 
-};
+        static_assert(is_gate(GateOp), "GateN needs a gate op.");
 
-class NOT_N_BIT : public Chip{
-    public:
-        NOT_N_BIT(string name, wire input_wire, wire output_wire, int n_bits);
+        GateN(string name, vector<wire> input_wires, wire output_wire, int n_bits){
+            static_assert(GateOp != Op::NOT && GateOp != Op::JOIN, "NOT and JOIN take two wires.");
+            this->name = name;
+            this->inputs = input_wires;
+            this->outputs.push_back(output_wire);
+            this->n_bits = n_bits;
+            this->module = gate_module(GateOp, n_bits, true, nullptr);
+        }
+
+        GateN(string name, wire a, wire b, int n_bits){
+            static_assert(GateOp == Op::NOT || GateOp == Op::JOIN, "Only NOT and JOIN take two wires.");
+            this->name = name;
+            this->inputs.push_back(a);
+            if(GateOp == Op::JOIN) this->inputs.push_back(b);
+            else this->outputs.push_back(b);
+            this->n_bits = n_bits;
+            this->module = gate_module(GateOp, n_bits, true, nullptr);
+        }
 };
 
+/*------------------------------------------------------------------------------------------
+JOIN shorts two wires: "module JOIN(a, a); inout a; endmodule".
+    Disclaimer : IThe trick to join 2 wires is taken from this page. 
+    https://groups.google.com/g/comp.lang.verilog/c/b3-6XMA8KA4/m/b-7zIz0bW6gJ
+------------------------------------------------------------------------------------------*/
+typedef Gate<Op::JOIN> JOIN;
+typedef GateN<Op::JOIN> JOIN_N_BIT;
+typedef Gate<Op::AND> AND;
+typedef GateN<Op::AND> AND_N_BIT;
+typedef Gate<Op::XOR> XOR;
+typedef GateN<Op::XOR> XOR_N_BIT;
+typedef Gate<Op::OR> OR;
+typedef GateN<Op::OR> OR_N_BIT;
+typedef Gate<Op::NAND> NAND;
+typedef GateN<Op::NAND> NAND_N_BIT;
+typedef Gate<Op::NOR> NOR;
+typedef GateN<Op::NOR> NOR_N_BIT;
+typedef Gate<Op::NOT> NOT;
+typedef GateN<Op::NOT> NOT_N_BIT;
+
 
 /*------------------------------------------------------------------------------------------
                                 CARRY RIPPLE ADDER DEFINITION
@@ -348,15 +862,81 @@ class FULL_ADDER : public Chip{
         FULL_ADDER(string name, vector<wire> input_wires, vector<wire> ouput_wires);
 };
 
+class HALF_ADDER : public Chip{
+    public:
+        HALF_ADDER(string name, vector<wire> input_wires, vector<wire> ouput_wires);
+};
+
 /*------------------------------------------------------------------------------------------
                             CARRY LOOK AHEAD ADDER DEFINITION
                             =================================
                           See src/verilog.cpp for implimentation
+
+The carries are a parallel prefix over the n_bits + 1 states of the adder (state 0 is the carry
+in, always kill), computed by a network of CLA_STAR operators. The network is one of
+
+    KOGGE_STONE       log2(n) levels, a star on every state of every level. The default.
+    SKLANSKY          log2(n) levels, n/2 stars a level, fanout n/2 + 1.
+    BRENT_KUNG        2 log2(n) - 1 levels, about 2n stars, fanout 2.
+    HAN_CARLSON       log2(n) + 1 levels, Kogge-Stone on the odd states.
+    LADNER_FISCHER    log2(n) + 1 levels, Sklansky on the odd states.
+    SPARSE            Kogge-Stone on every fourth state, filled in by two more levels.
+
+prefix_network(n_bits, topology) returns the network with its star count, transistors and depth.
+
+    CARRY_LOOK_AHEAD_ADDER cla("cla", {"A", "B"}, "S", 64, PrefixTopology::SKLANSKY);
 ------------------------------------------------------------------------------------------*/
 
+enum class PrefixTopology : uint8_t {
+    KOGGE_STONE, SKLANSKY, BRENT_KUNG, HAN_CARLSON, LADNER_FISCHER, SPARSE
+};
+
+struct PrefixInfo{
+    /*------------------------------------------------------------------------------------------
+    Names of a prefix topology.
+        1. name : Command line name, example "brent_kung"
+        2. suffix : Appended to the module names, example "_BRENT_KUNG" ("" for Kogge-Stone, so
+                the default adders keep their names)
+    -----------------------------------------------------------------------------------------*/
+    const char* name;
+    const char* suffix;
+};
+
+constexpr PrefixInfo prefix_info(PrefixTopology topology){
+    switch(topology){
+        case PrefixTopology::SKLANSKY       : return {"sklansky",       "_SKLANSKY"};
+        case PrefixTopology::BRENT_KUNG     : return {"brent_kung",     "_BRENT_KUNG"};
+        case PrefixTopology::HAN_CARLSON    : return {"han_carlson",    "_HAN_CARLSON"};
+        case PrefixTopology::LADNER_FISCHER : return {"ladner_fischer", "_LADNER_FISCHER"};
+        case PrefixTopology::SPARSE         : return {"sparse",         "_SPARSE"};
+        default                             : return {"kogge_stone",    ""};
+    }
+}
+
+struct PrefixNetwork{
+    /*------------------------------------------------------------------------------------------
+    A prefix network, see prefix_network(...).
+        1. partners : partners[level][i] is the state combined into state i at that level by a
+                CLA_STAR, -1 if state i is only passed down.
+        2. stars : CLA_STAR operators in the network.
+        3. transistors : stars*CLA_STAR_TRANSISTORS.
+        4. depth : Delay through the network, levels*CLA_STAR_DELAY.
+        5. max_fanout : Most loads on one state of a level, the stars taking it as partner and
+                its own bit of the next level.
+    -----------------------------------------------------------------------------------------*/
+    vector<vector<int>> partners;
+    long long stars = 0;
+    long long transistors = 0;
+    int depth = 0;
+    int max_fanout = 0;
+};
+
+PrefixNetwork prefix_network(int n_bits, PrefixTopology topology);
+bool parse_prefix_topology(const string& name, PrefixTopology* topology);
+
 class CARRY_LOOK_AHEAD_ADDER : public Chip{
     public:
-        CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_wires, wire output_wire, int n_bits);
+        CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_wires, wire output_wire, int n_bits, PrefixTopology topology = PrefixTopology::KOGGE_STONE);
 };
 
 class CLA_STAR : public Chip{
@@ -383,11 +963,28 @@ class FLIP_FLOP_N_BIT : public Chip{
 /*------------------------------------------------------------------------------------------
                             CARRY LOOK AHEAD ADDER WITH PIPELINING
                             ======================================
+
+A register stage is placed after every pipeline_k prefix levels. With a clock_period (in the
+delay units of constants.h) pipeline_k is ignored and the register stages are placed by delay
+instead: a stage is closed only when the next prefix level would not fit in the period, so the
+adder has the fewest register stages that meet it. input_delay is the time into the first stage
+at which A and B arrive, example the logic in front of the adder in the same stage. A prefix
+level is one level of the topology's network, see CARRY_LOOK_AHEAD_ADDER.
+
+    CARRY_LOOK_AHEAD_ADDER_PIPELINED cla("cla", {"A", "B", "CLK"}, "S", 64, 1, 20);
 ------------------------------------------------------------------------------------------*/
 
 class CARRY_LOOK_AHEAD_ADDER_PIPELINED : public Chip{
     public:
-        CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k);
+        CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k, int clock_period = 0, int input_delay = 0,
+                                         PrefixTopology topology = PrefixTopology::KOGGE_STONE);
+        typedef struct register_plan{
+            vector<bool> registers;
+            int stages = 0;
+            long long register_bits = 0;
+        } RegisterPlan;
+
+        static bool plan_registers(int n_bits, int clock_period, int input_delay, RegisterPlan *plan, PrefixTopology topology = PrefixTopology::KOGGE_STONE);
 };
 
 /*------------------------------------------------------------------------------------------
@@ -399,22 +996,50 @@ class CARRY_SAVE_ADDER : public Chip{
     public:
         CARRY_SAVE_ADDER(string name, vector<wire> input_wires, vector<wire> output_wires, int n_bits);
 };
-#endif
 
 
 /*------------------------------------------------------------------------------------------
                             WALLACE TREE MULTIPLIER WITH PIPELINING
                             =======================================
+
+Registers are placed after every pipeline_k carry save levels, the final adder counts its own
+levels. With a clock_period pipeline_k is ignored and the register stages of the carry save
+levels and of the final adder are placed together by delay, for the lowest latency and then the
+fewest register bits that meet the period. topology is the prefix network of the final adder.
+
+schedule picks the reduction of the partial products:
+
+    WALLACE    The rows are grouped three at a time into carry save adders, see make_csa(...).
+    DADDA      Every column is reduced to the next height of 2, 3, 4, 6, 9, 13, ... with the
+               fewest full and half adders, see dadda_level(...). Same levels, fewer adders.
+
+    WALLACE_TREE_MULTIPLIER_PIPELINED wtm("wtm", {"A", "B", "CLK"}, "P", 64, 1, 30);
+    WALLACE_TREE_MULTIPLIER_PIPELINED dadda("wtm", {"A", "B", "CLK"}, "P", 64, 4, 0, PrefixTopology::KOGGE_STONE,
+                                            ReductionSchedule::DADDA);
 ------------------------------------------------------------------------------------------*/
 
+enum class ReductionSchedule : uint8_t {
+    WALLACE, DADDA
+};
+
 class WALLACE_TREE_MULTIPLIER_PIPELINED : public Chip{
     public:
-        WALLACE_TREE_MULTIPLIER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k);
+        WALLACE_TREE_MULTIPLIER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k, int clock_period = 0,
+                                          PrefixTopology topology = PrefixTopology::KOGGE_STONE,
+                                          ReductionSchedule schedule = ReductionSchedule::WALLACE);
         typedef struct cut_wire{
             wire wire_id;
             int shift=0;
             int length=0;
         } CutWire;
 
-        void make_csa(string name, CutWire w1, CutWire w2, CutWire w3, CutWire *o1, CutWire *o2);
+        static void make_csa(string name, CutWire w1, CutWire w2, CutWire w3, CutWire *o1, CutWire *o2, Chip *part);
+        static vector<int> dadda_level(vector<int> heights, vector<int> *full_adders, vector<int> *half_adders);
+        static int plan_registers(vector<CutWire> partial_products, int clock_period, vector<bool> *registers, PrefixTopology topology = PrefixTopology::KOGGE_STONE,
+                                  ReductionSchedule schedule = ReductionSchedule::WALLACE);
+
+    private:
+        vector<CutWire> make_dadda(vector<CutWire> partial_products, int pipeline_k, int clock_period, const vector<bool>& registers);
 };
+
+#endif
@@ -0,0 +1,166 @@
+/*-------------------------------------------------------
+                Wires and the Symbol Table
+                ==========================
+
+Wires used to be plain strings, so every port binding and
+every slice like "A[3]" was a separately allocated string.
+
+Now every wire name is interned once in a SymbolTable and
+a wire is just a compact value: a symbol id plus an optio-
+nal bit slice or declared range. Slicing a wire, copying
+it into port lists and comparing two wires never allocate.
+The names themselves live in an Arena which is freed all
+at once.
+
+Example Usage:
+
+    wire A = "A";                        // A
+    wire bus("bus", 8);                  // [7:0] bus (declaration)
+    wire bit = A[3];                     // A[3]
+    wire low = bus.slice(3, 0);          // bus[3:0]
+    wire old = "carry[7:0]";             // Strings are still accepted and parsed
+
+    string s = "assign " + bit + " = 0;";
+
+---------------------------------------------------------*/
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+
+typedef uint32_t Symbol;
+
+class Arena{
+    /*------------------------------------------------------------------------------------------
+    A bump allocator. Memory is handed out from large blocks and only freed all at once, either
+    by release() or when the arena is destroyed.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        Arena(size_t block_size = 1 << 16);
+
+        char* allocate(size_t size);
+        void release();
+        size_t bytes() const;
+
+    private:
+        vector<unique_ptr<char[]>> blocks;
+        size_t block_size;
+        size_t used;
+        size_t total = 0;
+};
+
+class SymbolTable{
+    /*------------------------------------------------------------------------------------------
+    Interns wire names into compact integer ids. Symbol 0 is the empty name.
+
+    The table is shared by the elaboration threads. Names are stored in fixed size chunks that
+    never move, so name(id) does not need a lock, and every thread keeps a small cache of the
+    names it already interned so that common names like "CLK" do not contend on the lock.
+
+    Usefull methods:
+        1. global() : The table shared by all wires.
+        2. intern(name) : Returns the id for a name, adding it if it is new.
+        3. name(id) : Returns the name of an id.
+        4. release() : Frees all the names at once. Every existing wire becomes invalid.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        SymbolTable();
+
+        static SymbolTable& global();
+
+        Symbol intern(string_view name);
+        string_view name(Symbol id) const;
+        size_t size() const;
+        void release();
+
+    private:
+        static const size_t CHUNK_BITS = 12;
+        static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+        static const size_t MAX_CHUNKS = 1 << 16;
+
+        Symbol insert(string_view name);
+
+        mutex lock;
+        Arena arena;
+        unique_ptr<unique_ptr<string_view[]>[]> chunks;
+        atomic<uint32_t> count;
+        atomic<uint64_t> generation;
+        unordered_map<string_view, Symbol> ids;
+};
+
+class wire{
+    /*------------------------------------------------------------------------------------------
+                                            The Wire
+                                            ========
+
+    A wire is a reference to a net by its interned name, in one of four forms:
+
+        NAME  : A            - the whole net
+        BIT   : A[3]         - a single bit
+        RANGE : A[7:4]       - a bit range
+        DECL  : [7:0] A      - a declaration of a net with a range
+
+    Usefull methods:
+        1. operator[](bit) : Returns a single bit of the wire.
+        2. slice(hi, lo) : Returns a bit range of the wire.
+        3. name() : The interned net name, without any slice.
+        4. width() : Width in bits, or 1 for plain names.
+        5. str() : The verilog text, example "A[3]".
+        6. declaration() : The declaration text, example "[7:0] A".
+    -----------------------------------------------------------------------------------------*/
+    public:
+        enum Form : uint8_t {NAME, BIT, RANGE, DECL};
+
+        wire();
+        wire(const char* text);
+        wire(const string& text);
+        wire(string_view name, int width);
+
+        wire operator[](int bit) const;
+        wire slice(int hi, int lo) const;
+
+        Symbol id() const { return symbol; }
+        Form form() const { return kind; }
+        int msb() const { return hi; }
+        int lsb() const { return lo; }
+        int width() const;
+        bool empty() const { return symbol == 0; }
+
+        string_view name() const;
+        string str() const;
+        string declaration() const;
+        void write(string& out) const;
+
+        bool operator==(const wire& other) const;
+        bool operator!=(const wire& other) const { return !(*this == other); }
+
+    private:
+        void parse(string_view text);
+
+        Symbol symbol = 0;
+        int32_t hi = 0;
+        int32_t lo = 0;
+        Form kind = NAME;
+};
+
+typedef wire reg;
+
+string operator+(const string& lhs, const wire& rhs);
+string operator+(string&& lhs, const wire& rhs);
+string operator+(const wire& lhs, const string& rhs);
+string operator+(const char* lhs, const wire& rhs);
+string operator+(const wire& lhs, const char* rhs);
+ostream& operator<<(ostream& out, const wire& w);
+
+#endif
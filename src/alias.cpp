@@ -0,0 +1,300 @@
+#include <verilog.h>
+#include <bit_classes.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                    Alias Elimination
+                                    =================
+
+JOIN and JOIN_N_BIT only short two nets, "module JOIN(a, a); inout a; endmodule". Every bit
+tied together by a chain of joins is one net, so the joins of a module are resolved into net
+equivalence classes (a union find over the net bits), every class is given one canonical bit
+and every remaining binding is rewritten to use the canonical bits:
+
+    JOIN_N_BIT_4 j (W1[4:1], PP[3:0]);                   (removed)
+    CSA_6_BIT csa (W1, W2, W3, ...);         =>          CSA_6_BIT csa ({W1[5], PP[3:0], W1[0]}, W2, ...);
+
+Bindings that do not map onto one contiguous slice become concatenations. The ports of the
+module can not be renamed, so a class holding a port uses the port bit. If a class holds an
+input and an output port, the output gets a plain assign from the input. Classes that short
+two inputs, or hold an inout, are left alone along with their joins.
+------------------------------------------------------------------------------------------*/
+
+typedef unordered_map<Symbol, pair<int, int>> Ranges;
+
+static bool expand(const wire& net, const Ranges& ranges, vector<uint64_t>& out){
+    /*------------------------------------------------------------------------------------------
+    Appends the bits a reference covers, least significant first. Returns false for nets that
+    are not declared in the module, example a concatenation.
+    ------------------------------------------------------------------------------------------*/
+    Ranges::const_iterator range = ranges.find(net.id());
+    if(range == ranges.end()){
+        return false;
+    }
+    int hi = net.msb(), lo = net.lsb();
+    if(net.form() == wire::NAME || net.form() == wire::DECL){
+        hi = range->second.first;
+        lo = range->second.second;
+    }
+    for(int bit = lo; bit <= hi; bit++){
+        out.push_back(bit_key(net.id(), bit));
+    }
+    return true;
+}
+
+static wire collapse(const vector<uint64_t>& bits, const Ranges& ranges, unordered_set<Symbol>& used){
+    /*------------------------------------------------------------------------------------------
+    Returns the shortest reference to the given bits (least significant first): a whole net, a
+    bit, a slice or a concatenation of those. The nets it names are added to used.
+    ------------------------------------------------------------------------------------------*/
+    vector<wire> parts;
+    size_t end = bits.size();
+    while(end > 0){
+        size_t start = end - 1;
+        while(start > 0 && key_net(bits[start - 1]) == key_net(bits[end - 1])
+                        && key_bit(bits[start - 1]) + (int)(end - start) == key_bit(bits[end - 1])){
+            start--;
+        }
+        Symbol net = key_net(bits[start]);
+        int hi = key_bit(bits[end - 1]), lo = key_bit(bits[start]);
+        const pair<int, int>& range = ranges.at(net);
+        wire name(SymbolTable::global().name(net), 1);
+        if(hi == range.first && lo == range.second){
+            parts.push_back(name);
+        }
+        else{
+            parts.push_back(hi == lo ? name[hi] : name.slice(hi, lo));
+        }
+        used.insert(net);
+        end = start;
+    }
+    if(parts.size() == 1){
+        return parts.front();
+    }
+    string text = "{";
+    for(vector<wire>::iterator i = parts.begin(); i != parts.end(); i++){
+        text += (i == parts.begin() ? "" : ", ") + *i;
+    }
+    return wire(text + "}", 1);
+}
+
+shared_ptr<const ModuleDef> ModuleDef::eliminate_aliases(size_t& removed) const{
+    /*------------------------------------------------------------------------------------------
+    Returns a copy of the module with its JOIN instances resolved away, see the top of this file.
+    The copy is not registered, it is meant for emission only.
+
+    Param : removed (size_t), set to the number of JOIN instances removed.
+    Returns : module (shared_ptr<const ModuleDef>), or nullptr when the module has no joins to
+              remove, or is not described by its netlist alone (see can_flatten(...)).
+    Throws : invalid_argument for modules loaded from the module cache, their joins are unknown.
+    ------------------------------------------------------------------------------------------*/
+    removed = 0;
+    if(this->from_cache){
+        throw invalid_argument(this->name + " was loaded from the module cache without its netlist, its JOIN instances can not be removed.");
+    }
+    if(this->op != Op::NONE || !can_flatten(*this)){
+        return nullptr;
+    }
+    bool has_joins = false;
+    for(vector<const ModuleDef*>::const_iterator i = this->dependencies.begin(); i != this->dependencies.end(); i++){
+        has_joins |= (*i)->op == Op::JOIN;
+    }
+    if(!has_joins){
+        return nullptr;
+    }
+
+    Ranges ranges;
+    for(vector<Port>::const_iterator i = this->ports.begin(); i != this->ports.end(); i++){
+        ranges[i->net.id()] = i->net.form() == wire::DECL ? make_pair(i->net.msb(), i->net.lsb()) : make_pair(0, 0);
+    }
+    for(vector<wire>::const_iterator i = this->wires.begin(); i != this->wires.end(); i++){
+        ranges[i->id()] = i->form() == wire::DECL ? make_pair(i->msb(), i->lsb()) : make_pair(0, 0);
+    }
+    for(vector<reg>::const_iterator i = this->regs.begin(); i != this->regs.end(); i++){
+        ranges[i->id()] = i->form() == wire::DECL ? make_pair(i->msb(), i->lsb()) : make_pair(0, 0);
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Tie the bits of every join together. Joins between nets of different widths or nets that
+    are not declared here are kept as they are.
+    ------------------------------------------------------------------------------------------*/
+    BitClasses classes;
+    vector<bool> resolvable(this->submodules.size(), false);
+    vector<uint64_t> side_a, side_b;
+    for(size_t i = 0; i < this->submodules.size(); i++){
+        if(this->submodules.module(i)->op != Op::JOIN || this->submodules.num_bindings(i) != 2){
+            continue;
+        }
+        side_a.clear();
+        side_b.clear();
+        const wire* bindings = this->submodules.bindings(i);
+        if(!expand(bindings[0], ranges, side_a) || !expand(bindings[1], ranges, side_b) || side_a.size() != side_b.size()){
+            continue;
+        }
+        for(size_t bit = 0; bit < side_a.size(); bit++){
+            classes.unite(side_a[bit], side_b[bit]);
+        }
+        resolvable[i] = true;
+    }
+
+    unordered_set<Symbol> aliased;
+    for(vector<uint64_t>::iterator bit = classes.keys.begin(); bit != classes.keys.end(); bit++){
+        aliased.insert(key_net(*bit));
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Pick the canonical bit of every class: an input port, else an output port, else a bit driven
+    inside the module, else the first bit seen.
+    ------------------------------------------------------------------------------------------*/
+    enum Role {INPUT, OUTPUT, DRIVEN, OTHER, INOUT};
+    unordered_map<uint64_t, Role> roles;
+    for(vector<Port>::const_iterator i = this->ports.begin(); i != this->ports.end(); i++){
+        vector<uint64_t> covered;
+        expand(wire(i->net.name(), 1), ranges, covered);
+        for(vector<uint64_t>::iterator bit = covered.begin(); bit != covered.end(); bit++){
+            roles[*bit] = i->is_inout() ? INOUT : i->is_output() ? OUTPUT : INPUT;
+        }
+    }
+    for(size_t i = 0; i < this->submodules.size(); i++){
+        const ModuleDef* sub = this->submodules.module(i);
+        const wire* bindings = this->submodules.bindings(i);
+        for(size_t p = 0; p < this->submodules.num_bindings(i) && p < sub->ports.size(); p++){
+            vector<uint64_t> covered;
+            if(sub->ports.at(p).is_output() && aliased.count(bindings[p].id()) && expand(bindings[p], ranges, covered)){
+                for(vector<uint64_t>::iterator bit = covered.begin(); bit != covered.end(); bit++){
+                    roles.emplace(*bit, DRIVEN);
+                }
+            }
+        }
+    }
+    for(vector<Assign>::const_iterator i = this->assigns.begin(); i != this->assigns.end(); i++){
+        vector<uint64_t> covered;
+        expand(i->lhs, ranges, covered);
+        for(vector<uint64_t>::iterator bit = covered.begin(); bit != covered.end(); bit++){
+            roles.emplace(*bit, DRIVEN);
+        }
+    }
+
+    size_t count = classes.keys.size();
+    vector<uint32_t> canonical(count);
+    vector<Role> best(count, OTHER);
+    vector<int> inputs(count, 0);
+    vector<bool> conflict(count, false);
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t root = classes.find(classes.keys[i]);
+        unordered_map<uint64_t, Role>::iterator found = roles.find(classes.keys[i]);
+        Role role = found == roles.end() ? OTHER : found->second;
+        inputs[root] += role == INPUT;
+        conflict[root] = conflict[root] || role == INOUT;
+        if(root == i || role < best[root]){
+            canonical[root] = i;
+            best[root] = role;
+        }
+    }
+    for(uint32_t i = 0; i < count; i++){
+        conflict[i] = conflict[i] || inputs[i] > 1;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Translates a reference to the canonical bits. References left unchanged are returned as
+    they are, so untouched bindings keep their original text.
+    ------------------------------------------------------------------------------------------*/
+    unordered_set<Symbol> used;
+    vector<uint64_t> covered;
+    auto rewrite = [&](const wire& net) -> wire{
+        covered.clear();
+        if(!aliased.count(net.id()) || !expand(net, ranges, covered)){
+            used.insert(net.id());
+            return net;
+        }
+        bool changed = false;
+        for(vector<uint64_t>::iterator bit = covered.begin(); bit != covered.end(); bit++){
+            if(!classes.contains(*bit)){
+                continue;
+            }
+            uint32_t root = classes.find(*bit);
+            if(conflict[root]){
+                continue;
+            }
+            uint64_t target = classes.keys[canonical[root]];
+            changed |= target != *bit;
+            *bit = target;
+        }
+        if(!changed){
+            used.insert(net.id());
+            return net;
+        }
+        return collapse(covered, ranges, used);
+    };
+
+    shared_ptr<ModuleDef> module = make_shared<ModuleDef>();
+    module->name = this->name;
+    module->key = this->key;
+    module->op = this->op;
+    module->width = this->width;
+    module->ports = this->ports;
+    module->regs = this->regs;
+
+    for(size_t i = 0; i < this->submodules.size(); i++){
+        if(resolvable[i]){
+            covered.clear();
+            expand(this->submodules.bindings(i)[0], ranges, covered);
+            bool kept = false;
+            for(vector<uint64_t>::iterator bit = covered.begin(); bit != covered.end(); bit++){
+                kept |= conflict[classes.find(*bit)];
+            }
+            if(!kept){
+                removed++;
+                continue;
+            }
+        }
+        const wire* bindings = this->submodules.bindings(i);
+        vector<wire> rewritten;
+        for(size_t p = 0; p < this->submodules.num_bindings(i); p++){
+            rewritten.push_back(rewrite(bindings[p]));
+        }
+        module->submodules.add(this->submodules.name(i), this->submodules.types().at(this->submodules.type(i)), rewritten, {}, "");
+    }
+    for(vector<Assign>::const_iterator i = this->assigns.begin(); i != this->assigns.end(); i++){
+        module->assigns.push_back({rewrite(i->lhs), i->value});
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Output port bits that were tied to another canonical bit are driven from it.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = this->ports.begin(); i != this->ports.end(); i++){
+        if(!i->is_output()){
+            continue;
+        }
+        wire port(i->net.name(), 1);
+        wire source = rewrite(port);
+        if(source != port){
+            module->extras.push_back("assign " + port + " = " + source + ";");
+        }
+    }
+
+    for(vector<wire>::const_iterator i = this->wires.begin(); i != this->wires.end(); i++){
+        if(used.count(i->id())){
+            module->wires.push_back(*i);
+        }
+    }
+
+    module->transistors = this->transistors;
+    module->total_transistors = this->total_transistors;
+    module->total_instances = this->total_instances - removed;
+    module->depth = this->depth;
+    const vector<shared_ptr<const ModuleDef>>& types = module->submodules.types();
+    for(vector<shared_ptr<const ModuleDef>>::const_iterator type = types.begin(); type != types.end(); type++){
+        module->dependencies.push_back(type->get());
+    }
+    module->index_connections();
+    return module;
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <verilog.h>
+#include <file_sink.h>
+#include <thread_pool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                    Elaboration Benchmark
+                                    =====================
+
+Times the construction, generate_verilog() and the file write of the library generators over
+a sweep of sizes and pipeline steps, and prints one CSV row per configuration:
+
+    generator,n_bits,k,threads,construct_ms,generate_ms,write_ms,peak_rss_kb,allocations,
+    allocated_bytes,bytes_emitted,transistors
+
+Every configuration runs in its own forked process, so the module registry starts empty and
+peak_rss_kb is the peak of that configuration alone. allocations and allocated_bytes count
+every operator new from the start of construction to the end of the file write.
+
+Usage : ./bench.out [max_bits]        (default 1024)
+------------------------------------------------------------------------------------------*/
+
+static atomic<size_t> allocations(0);
+static atomic<size_t> allocated_bytes(0);
+
+/*------------------------------------------------------------------------------------------
+The counting operators are kept out of line, GCC otherwise sees the malloc and free of the
+inlined pair and reports them as mismatched (-Wmismatched-new-delete).
+------------------------------------------------------------------------------------------*/
+__attribute__((noinline)) void* operator new(size_t size){
+    allocations++;
+    allocated_bytes += size;
+    void* ptr = malloc(size ? size : 1);
+    if(ptr == NULL){
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept{
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept{
+    free(ptr);
+}
+
+typedef struct{
+    const char* name;
+    bool pipelined;
+    Chip* (*build)(int n, int k);
+} Generator;
+
+static const Generator generators[] = {
+    {"wtm", true, [](int n, int k) -> Chip*{
+        return new WALLACE_TREE_MULTIPLIER_PIPELINED("bench", {"input_1", "input_2", "clk"}, "outputs", n, k);
+    }},
+    {"cla_pipelined", true, [](int n, int k) -> Chip*{
+        return new CARRY_LOOK_AHEAD_ADDER_PIPELINED("bench", {"input_1", "input_2", "clk"}, "outputs", n, k);
+    }},
+    {"cla", false, [](int n, int) -> Chip*{
+        return new CARRY_LOOK_AHEAD_ADDER("bench", {"input_1", "input_2"}, "outputs", n);
+    }},
+    {"cra", false, [](int n, int) -> Chip*{
+        return new CARRY_RIPPLE_ADDER("bench", {"input_1", "input_2"}, "outputs", n);
+    }},
+    {"csa", false, [](int n, int) -> Chip*{
+        return new CARRY_SAVE_ADDER("bench", {"input_1", "input_2", "input_3"}, {"sum", "carry"}, n);
+    }},
+};
+
+static double milliseconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void run(const Generator& generator, int n, int k){
+    /*------------------------------------------------------------------------------------------
+    Measures one configuration and prints its CSV row. Runs in the forked child.
+    ------------------------------------------------------------------------------------------*/
+    size_t threads = ThreadPool::global().size();
+    allocations = 0;
+    allocated_bytes = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    unique_ptr<Chip> chip(generator.build(n, k));
+    double construct_ms = milliseconds_since(start);
+
+    start = chrono::steady_clock::now();
+    size_t bytes_emitted = chip->generate_verilog().size();
+    double generate_ms = milliseconds_since(start);
+
+    string file_name = "generated_codes/bench_" + to_string(getpid()) + ".v";
+    start = chrono::steady_clock::now();
+    {
+        FileSink out(file_name);
+        chip->write_verilog(out);
+        out.close();
+    }
+    double write_ms = milliseconds_since(start);
+    remove(file_name.c_str());
+
+    size_t total_allocations = allocations;
+    size_t total_bytes = allocated_bytes;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%s,%d,%d,%zu,%.3f,%.3f,%.3f,%ld,%zu,%zu,%zu,%d\n",
+           generator.name, n, k, threads, construct_ms, generate_ms, write_ms, usage.ru_maxrss,
+           total_allocations, total_bytes, bytes_emitted, chip->num_transistors());
+    fflush(stdout);
+}
+
+int main(int argc, char * argv[]){
+    int max_bits = argc > 1 ? atoi(argv[1]) : 1024;
+    if(max_bits < 8){
+        cout<<"Usage "<<argv[0]<<" [max_bits]\n  Example: "<<argv[0]<<" 256\n";
+        return 1;
+    }
+    vector<int> k_values = {1, 2, 4};
+
+    printf("generator,n_bits,k,threads,construct_ms,generate_ms,write_ms,peak_rss_kb,allocations,allocated_bytes,bytes_emitted,transistors\n");
+    fflush(stdout);
+
+    int failed = 0;
+    for(size_t g = 0; g < sizeof(generators)/sizeof(generators[0]); g++){
+        for(int n = 8; n <= max_bits; n *= 2){
+            for(vector<int>::iterator k = k_values.begin(); k != k_values.end(); k++){
+                if(!generators[g].pipelined && k != k_values.begin()){
+                    break;
+                }
+                /*------------------------------------------------------------------------------
+                The parent never touches the library, so the child starts with an empty registry
+                and no thread pool.
+                ------------------------------------------------------------------------------*/
+                pid_t child = fork();
+                if(child == 0){
+                    run(generators[g], n, generators[g].pipelined ? *k : 1);
+                    _exit(0);
+                }
+                int status;
+                waitpid(child, &status, 0);
+                if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                    fprintf(stderr, "[ERROR] %s n=%d k=%d failed\n", generators[g].name, n, *k);
+                    failed++;
+                }
+            }
+        }
+    }
+    return failed != 0;
+}
@@ -0,0 +1,206 @@
+#include <file_sink.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                    Double Buffer
+                                    =============
+------------------------------------------------------------------------------------------*/
+
+DoubleBuffer::DoubleBuffer(size_t buffer_size){
+    /*------------------------------------------------------------------------------------------
+    The class constructor.
+
+    Param: buffer_size (size_t), size of each of the two buffers in bytes.
+    ------------------------------------------------------------------------------------------*/
+    this->buffers[0].resize(buffer_size);
+    this->buffers[1].resize(buffer_size);
+    this->setp(this->buffers[0].data(), this->buffers[0].data() + buffer_size);
+}
+
+DoubleBuffer::~DoubleBuffer(){
+    this->close();
+}
+
+bool DoubleBuffer::open(string file_name){
+    /*------------------------------------------------------------------------------------------
+    Opens (and truncates) the file and starts the writer thread.
+
+    Param: file_name (string), output file.
+    Returns: true if the file could be opened.
+    ------------------------------------------------------------------------------------------*/
+    this->file = fopen(file_name.c_str(), "wb");
+    if(!this->file){
+        return false;
+    }
+    this->stopping = false;
+    this->failed = false;
+    this->writer = thread(&DoubleBuffer::writer_loop, this);
+    return true;
+}
+
+bool DoubleBuffer::is_open() const{
+    return this->file != nullptr;
+}
+
+void DoubleBuffer::writer_loop(){
+    /*------------------------------------------------------------------------------------------
+    Runs on the writer thread. Waits for a full buffer, writes it to disk and signals that the
+    buffer is free again.
+    ------------------------------------------------------------------------------------------*/
+    unique_lock<mutex> guard(this->lock);
+    while(true){
+        this->cv.wait(guard, [this]{ return this->pending || this->stopping; });
+        if(!this->pending){
+            return;
+        }
+
+        const char* data = this->buffers[1 - this->active].data();
+        size_t size = this->pending_size;
+
+        guard.unlock();
+        bool ok = fwrite(data, 1, size, this->file) == size;
+        guard.lock();
+
+        this->failed = this->failed || !ok;
+        this->pending = false;
+        this->cv.notify_all();
+    }
+}
+
+void DoubleBuffer::hand_over(){
+    /*------------------------------------------------------------------------------------------
+    Hands the active buffer over to the writer thread and continues with the other one.
+    ------------------------------------------------------------------------------------------*/
+    size_t size = this->pptr() - this->pbase();
+    if(size == 0){
+        return;
+    }
+
+    unique_lock<mutex> guard(this->lock);
+    this->cv.wait(guard, [this]{ return !this->pending; });
+
+    this->pending_size = size;
+    this->pending = true;
+    this->active = 1 - this->active;
+    this->cv.notify_all();
+    guard.unlock();
+
+    vector<char>& next = this->buffers[this->active];
+    this->setp(next.data(), next.data() + next.size());
+}
+
+DoubleBuffer::int_type DoubleBuffer::overflow(int_type c){
+    /*------------------------------------------------------------------------------------------
+    Called when the active buffer is full.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->file){
+        return traits_type::eof();
+    }
+    this->hand_over();
+    if(!traits_type::eq_int_type(c, traits_type::eof())){
+        *this->pptr() = traits_type::to_char_type(c);
+        this->pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+streamsize DoubleBuffer::xsputn(const char* s, streamsize n){
+    /*------------------------------------------------------------------------------------------
+    Copies large writes (whole module definitions) into the buffers in chunks.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->file){
+        return 0;
+    }
+    streamsize written = 0;
+    while(written < n){
+        streamsize space = this->epptr() - this->pptr();
+        if(space == 0){
+            this->hand_over();
+            continue;
+        }
+        streamsize chunk = min(space, n - written);
+        memcpy(this->pptr(), s + written, chunk);
+        this->pbump(chunk);
+        written += chunk;
+    }
+    return written;
+}
+
+int DoubleBuffer::sync(){
+    /*------------------------------------------------------------------------------------------
+    Hands the current buffer over. The data reaches the disk once the writer thread is done.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->file){
+        return -1;
+    }
+    this->hand_over();
+    return 0;
+}
+
+bool DoubleBuffer::close(){
+    /*------------------------------------------------------------------------------------------
+    Writes out everything that is left, stops the writer thread and closes the file.
+
+    Returns: true if all the data was written successfully.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->file){
+        return !this->failed;
+    }
+    this->hand_over();
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->cv.notify_all();
+    this->writer.join();
+
+    bool ok = !this->failed && fclose(this->file) == 0;
+    this->file = nullptr;
+    return ok;
+}
+
+/*------------------------------------------------------------------------------------------
+                                        File Sink
+                                        =========
+------------------------------------------------------------------------------------------*/
+
+FileSink::FileSink(string file_name, size_t buffer_size) : ostream(nullptr), buffer(buffer_size){
+    /*------------------------------------------------------------------------------------------
+    The class constructor. Opens the file, the stream is in a failed state if it can not be op-
+    ened.
+
+    Param: file_name (string), output file.
+    Param: buffer_size (size_t), size of each of the two buffers in bytes.
+    ------------------------------------------------------------------------------------------*/
+    this->rdbuf(&this->buffer);
+    if(!this->buffer.open(file_name)){
+        this->setstate(ios_base::failbit);
+    }
+}
+
+FileSink::~FileSink(){
+    this->close();
+}
+
+bool FileSink::is_open() const{
+    return this->buffer.is_open();
+}
+
+bool FileSink::close(){
+    /*------------------------------------------------------------------------------------------
+    Flushes and closes the file. Returns false if anything could not be written.
+    ------------------------------------------------------------------------------------------*/
+    bool ok = this->buffer.close();
+    if(!ok){
+        this->setstate(ios_base::badbit);
+    }
+    return ok;
+}
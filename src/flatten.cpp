@@ -0,0 +1,1652 @@
+#include <verilog.h>
+#include <bit_classes.h>
+#include <stdlib.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                    Flattened Emission
+                                    ==================
+
+Renders a module with its submodules inlined (see EmitOptions in verilog.h). The netlist of an
+inlined module is copied into its parent with every port replaced by the net bound to it and
+every other net renamed after the instance path. Gates become continuous assigns:
+
+    AND_GATE FA_1__and_1 (A[1], B[1], w);      =>      assign #2 FA_1__w = A[1] & B[1];
+
+JOIN has no direction, it only ties two nets together. It becomes an assign from the side that
+is driven (by a gate, a flipflop, a constant or an input port) to the side that is not.
+
+With EmitOptions::optimize the collected statements are optimized before they are rendered,
+see Flattener::render_optimized(). With EmitOptions::retime the flipflops are also moved, see
+Flattener::retime(...). The same statements are also exported as BLIF and AIGER, see blif_de-
+finition(...) and aiger_definition(...).
+------------------------------------------------------------------------------------------*/
+
+bool can_flatten(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Returns true if the module is fully described by its netlist, so that it can be inlined or
+    rendered flat. Primitive gates and flipflops always can.
+    ------------------------------------------------------------------------------------------*/
+    if(module.from_cache){
+        return false;
+    }
+    if(is_gate(module.op) || module.op == Op::FLIP_FLOP){
+        return true;
+    }
+    if(module.op != Op::NONE || !module.extras.empty() || !module.behaviours.empty()){
+        return false;
+    }
+    for(size_t i = 0; i < module.submodules.size(); i++){
+        if(!module.submodules.generate(i).empty()){
+            return false;
+        }
+    }
+    return true;
+}
+
+static string identifier(string_view name){
+    /*------------------------------------------------------------------------------------------
+    Replaces the characters that can not appear in a verilog identifier.
+    ------------------------------------------------------------------------------------------*/
+    string out(name);
+    for(string::iterator i = out.begin(); i != out.end(); i++){
+        if(!isalnum((unsigned char)*i) && *i != '_'){
+            *i = '_';
+        }
+    }
+    return out;
+}
+
+typedef struct{
+    Op op;
+    uint64_t a, b, out;
+    bool removed;
+} GateBit;
+
+typedef struct{
+    size_t cell;
+    uint64_t d, clk, q;
+    bool removed;
+} FlopBit;
+
+struct BitNetlist{
+    /*------------------------------------------------------------------------------------------
+    The flat module split into single bits, see Flattener::lower(...). Nets are classes of bits,
+    value is 0 or 1 for constant classes and -1 otherwise, canonical is the bit that names a
+    class. drivers lists the gates (2 i) and flipflops (2 i + 1) driving each class and roots are
+    the bits read from outside, the output ports and the inputs of kept instances.
+    ------------------------------------------------------------------------------------------*/
+    BitClasses classes;
+    vector<int8_t> value;
+    vector<GateBit> gates;
+    vector<FlopBit> flops;
+    vector<uint64_t> roots;
+    vector<vector<uint32_t>> drivers;
+    vector<bool> gate_live;
+    vector<bool> flop_live;
+    vector<uint32_t> canonical;
+
+    uint32_t node(uint64_t key){
+        uint32_t n = this->classes.find(key);
+        if(this->value.size() < this->classes.size()){
+            this->value.resize(this->classes.size(), -1);
+        }
+        return n;
+    }
+
+    void merge(uint64_t a, uint64_t b){
+        uint32_t node_b = this->node(b), node_a = this->node(a);
+        int8_t known = max(this->value[node_a], this->value[node_b]);
+        this->value[this->classes.unite(a, b)] = known;
+    }
+};
+
+class Flattener{
+    /*------------------------------------------------------------------------------------------
+    Collects the statements of one flat module.
+    ------------------------------------------------------------------------------------------*/
+    public:
+        Flattener(const ModuleDef& top, const EmitOptions& options, vector<const ModuleDef*>& kept);
+        string render();
+        string render_blif();
+        string render_aiger();
+
+    private:
+        typedef struct{
+            const ModuleDef* module;
+            const wire* bindings;
+            string prefix;
+            unordered_map<Symbol, wire> nets;
+        } Scope;
+
+        typedef struct{
+            Op op;          // a gate, FLIP_FLOP or JOIN
+            wire a, b;      // gate inputs, flipflop data and clock, the two sides of a join
+            wire out;       // gate output, flipflop output
+            wire state;     // the reg holding the flipflop state
+        } Cell;
+
+        typedef struct{
+            const ModuleDef* module;
+            string name;
+            vector<wire> bindings;
+        } Instance;
+
+        void inline_module(Scope& scope);
+        void place(Scope& scope, size_t i);
+        wire map(Scope& scope, const wire& net);
+        wire renamed(Scope& scope, const wire& declaration);
+        string unique_name(const string& name);
+        void declare(const wire& net, bool is_reg);
+        bool inlines(const ModuleDef& module) const;
+
+        void bits(const wire& net, vector<uint64_t>& out) const;
+        size_t count_driven(const wire& net) const;
+        void drive(const wire& net);
+        void resolve_joins(string& assigns);
+
+        void collect();
+        void lower(BitNetlist& netlist, bool fold);
+        void mark(BitNetlist& netlist);
+        string retime(BitNetlist& netlist);
+        string bit_name(uint64_t key) const;
+        void check_exportable(const string& format) const;
+
+        string render_plain();
+        string render_optimized();
+
+        const ModuleDef& top;
+        const EmitOptions& options;
+        vector<const ModuleDef*>& kept;
+        unordered_set<const ModuleDef*> kept_seen;
+
+        unordered_set<string> names;
+        unordered_map<Symbol, pair<int, int>> ranges;
+        unordered_set<Symbol> vectors;
+        unordered_set<uint64_t> driven;
+        vector<pair<wire, wire>> joins;
+
+        vector<pair<wire, bool>> declarations;
+        vector<Assign> constants;
+        vector<Cell> cells;
+        vector<Instance> instances;
+};
+
+Flattener::Flattener(const ModuleDef& top, const EmitOptions& options, vector<const ModuleDef*>& kept)
+    : top(top), options(options), kept(kept){
+    /*------------------------------------------------------------------------------------------
+    The nets of the top module keep their names, the top scope maps every net to itself.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = top.ports.begin(); i != top.ports.end(); i++){
+        this->names.insert(string(i->net.name()));
+        this->ranges[i->net.id()] = {i->net.msb(), i->net.lsb()};
+        if(i->net.form() == wire::DECL){
+            this->vectors.insert(i->net.id());
+        }
+    }
+    for(vector<wire>::const_iterator i = top.wires.begin(); i != top.wires.end(); i++){
+        this->names.insert(string(i->name()));
+        this->ranges[i->id()] = {i->msb(), i->lsb()};
+        this->declarations.push_back({*i, false});
+        if(i->form() == wire::DECL){
+            this->vectors.insert(i->id());
+        }
+    }
+    for(vector<reg>::const_iterator i = top.regs.begin(); i != top.regs.end(); i++){
+        this->names.insert(string(i->name()));
+        this->ranges[i->id()] = {i->msb(), i->lsb()};
+        this->declarations.push_back({*i, true});
+        if(i->form() == wire::DECL){
+            this->vectors.insert(i->id());
+        }
+    }
+    this->constants = top.assigns;
+}
+
+bool Flattener::inlines(const ModuleDef& module) const{
+    return can_flatten(module) && module.depth <= this->options.max_depth && module.total_instances <= this->options.max_instances;
+}
+
+string Flattener::unique_name(const string& name){
+    /*------------------------------------------------------------------------------------------
+    Returns name, or name with a numeric suffix if it is already taken.
+    ------------------------------------------------------------------------------------------*/
+    string candidate = name;
+    for(int suffix = 1; !this->names.insert(candidate).second; suffix++){
+        candidate = name + "_" + to_string(suffix);
+    }
+    return candidate;
+}
+
+void Flattener::declare(const wire& net, bool is_reg){
+    this->ranges[net.id()] = {net.msb(), net.lsb()};
+    this->declarations.push_back({net, is_reg});
+    if(net.form() == wire::DECL){
+        this->vectors.insert(net.id());
+    }
+}
+
+wire Flattener::map(Scope& scope, const wire& net){
+    /*------------------------------------------------------------------------------------------
+    Translates a net of an inlined module into the flat module. Ports become (a slice of) the
+    net bound to them, every other net gets the unique name made on its first use.
+    ------------------------------------------------------------------------------------------*/
+    if(net.empty() || scope.bindings == nullptr){
+        return net;
+    }
+    int port = scope.module->find_port(net.id());
+    if(port >= 0){
+        const wire& bound = scope.bindings[port];
+        int offset = scope.module->ports.at(port).net.lsb();
+        if(net.form() == wire::BIT){
+            return bound[net.msb() - offset];
+        }
+        if(net.form() == wire::RANGE){
+            return bound.slice(net.msb() - offset, net.lsb() - offset);
+        }
+        return bound;
+    }
+
+    unordered_map<Symbol, wire>::iterator found = scope.nets.find(net.id());
+    if(found == scope.nets.end()){
+        wire renamed(this->unique_name(scope.prefix + identifier(net.name())), 1);
+        found = scope.nets.emplace(net.id(), renamed).first;
+    }
+    if(net.form() == wire::BIT){
+        return found->second[net.msb()];
+    }
+    if(net.form() == wire::RANGE){
+        return found->second.slice(net.msb(), net.lsb());
+    }
+    return found->second;
+}
+
+wire Flattener::renamed(Scope& scope, const wire& declaration){
+    /*------------------------------------------------------------------------------------------
+    Returns the declaration of an inlined net under its unique name, with the same range.
+    ------------------------------------------------------------------------------------------*/
+    string_view name = this->map(scope, wire(declaration.name(), 1)).name();
+    if(declaration.form() != wire::DECL){
+        return wire(name, 1);
+    }
+    return wire("[" + to_string(declaration.msb()) + ":" + to_string(declaration.lsb()) + "] " + string(name));
+}
+
+void Flattener::inline_module(Scope& scope){
+    /*------------------------------------------------------------------------------------------
+    Copies the nets, constants and instances of an inlined module into the flat module.
+    ------------------------------------------------------------------------------------------*/
+    const ModuleDef& module = *scope.module;
+    for(vector<wire>::const_iterator i = module.wires.begin(); i != module.wires.end(); i++){
+        this->declare(this->renamed(scope, *i), false);
+    }
+    for(vector<reg>::const_iterator i = module.regs.begin(); i != module.regs.end(); i++){
+        this->declare(this->renamed(scope, *i), true);
+    }
+    for(vector<Assign>::const_iterator i = module.assigns.begin(); i != module.assigns.end(); i++){
+        this->constants.push_back({this->map(scope, i->lhs), i->value});
+    }
+    for(size_t i = 0; i < module.submodules.size(); i++){
+        this->place(scope, i);
+    }
+}
+
+void Flattener::place(Scope& scope, size_t i){
+    /*------------------------------------------------------------------------------------------
+    Places submodule i of the scope: as an assign for gates, as an always block for flipflops,
+    inlined for small modules and as an instance otherwise.
+    ------------------------------------------------------------------------------------------*/
+    const InstanceTable& table = scope.module->submodules;
+    const ModuleDef* sub = table.module(i);
+    size_t count = table.num_bindings(i);
+
+    vector<wire> bound(count);
+    for(size_t p = 0; p < count; p++){
+        bound[p] = this->map(scope, table.bindings(i)[p]);
+    }
+    string prefix = scope.prefix + identifier(table.name(i)) + "__";
+
+    if(!this->inlines(*sub) || count != sub->ports.size()){
+        if(this->kept_seen.insert(sub).second){
+            this->kept.push_back(sub);
+        }
+        this->instances.push_back({sub, this->unique_name(prefix.substr(0, prefix.size() - 2)), bound});
+        return;
+    }
+
+    if(sub->op == Op::JOIN){
+        this->cells.push_back({Op::JOIN, bound.at(0), bound.at(1), wire(), wire()});
+        return;
+    }
+    if(sub->op == Op::FLIP_FLOP){
+        wire state(this->unique_name(prefix + "OUT"), sub->width);
+        this->declare(state, true);
+        this->cells.push_back({Op::FLIP_FLOP, bound.at(0), bound.at(1), bound.at(2), wire(state.name(), 1)});
+        return;
+    }
+    if(is_gate(sub->op)){
+        this->cells.push_back({sub->op, bound.at(0), bound.size() > 2 ? bound.at(1) : wire(), bound.back(), wire()});
+        return;
+    }
+
+    Scope inner;
+    inner.module = sub;
+    inner.bindings = bound.data();
+    inner.prefix = prefix;
+    this->inline_module(inner);
+}
+
+void Flattener::bits(const wire& net, vector<uint64_t>& out) const{
+    /*------------------------------------------------------------------------------------------
+    The (net, bit) pairs a reference covers. Plain names cover the declared range of the net.
+    ------------------------------------------------------------------------------------------*/
+    int hi = net.msb(), lo = net.lsb();
+    if(net.form() == wire::NAME || net.form() == wire::DECL){
+        unordered_map<Symbol, pair<int, int>>::const_iterator range = this->ranges.find(net.id());
+        hi = range == this->ranges.end() ? 0 : range->second.first;
+        lo = range == this->ranges.end() ? 0 : range->second.second;
+    }
+    for(int bit = lo; bit <= hi; bit++){
+        out.push_back(((uint64_t)net.id() << 32) | (uint32_t)bit);
+    }
+}
+
+size_t Flattener::count_driven(const wire& net) const{
+    vector<uint64_t> covered;
+    this->bits(net, covered);
+    size_t count = 0;
+    for(vector<uint64_t>::iterator i = covered.begin(); i != covered.end(); i++){
+        count += this->driven.count(*i);
+    }
+    return count;
+}
+
+void Flattener::drive(const wire& net){
+    vector<uint64_t> covered;
+    this->bits(net, covered);
+    this->driven.insert(covered.begin(), covered.end());
+}
+
+void Flattener::resolve_joins(string& assigns){
+    /*------------------------------------------------------------------------------------------
+    Turns every JOIN into an assign from its driven side. Joins can chain, so the pass repeats
+    until no join can be oriented any more. The rest tie nets nothing drives, their direction
+    does not matter.
+    ------------------------------------------------------------------------------------------*/
+    vector<bool> done(this->joins.size(), false);
+    for(bool progress = true; progress; ){
+        progress = false;
+        for(size_t i = 0; i < this->joins.size(); i++){
+            if(done[i]) continue;
+            size_t a = this->count_driven(this->joins[i].first);
+            size_t b = this->count_driven(this->joins[i].second);
+            if(a == 0 && b == 0) continue;
+            const wire& from = a >= b ? this->joins[i].first : this->joins[i].second;
+            const wire& to = a >= b ? this->joins[i].second : this->joins[i].first;
+            assigns += "\tassign " + to + " = " + from + ";\n";
+            this->drive(to);
+            done[i] = progress = true;
+        }
+    }
+    for(size_t i = 0; i < this->joins.size(); i++){
+        if(!done[i]){
+            assigns += "\tassign " + this->joins[i].second + " = " + this->joins[i].first + ";\n";
+        }
+    }
+}
+
+static string gate_expression(Op op, const string& a, const string& b){
+    /*------------------------------------------------------------------------------------------
+    The continuous assign expression of a gate. Example : "a & b"
+    ------------------------------------------------------------------------------------------*/
+    switch(op){
+        case Op::AND  : return a + " & " + b;
+        case Op::OR   : return a + " | " + b;
+        case Op::XOR  : return a + " ^ " + b;
+        case Op::NAND : return "~(" + a + " & " + b + ")";
+        case Op::NOR  : return "~(" + a + " | " + b + ")";
+        case Op::NOT  : return "~" + a;
+        default : return a;
+    }
+}
+
+void Flattener::collect(){
+    /*------------------------------------------------------------------------------------------
+    Inlines the submodules of the top module, collecting their statements.
+    ------------------------------------------------------------------------------------------*/
+    Scope scope;
+    scope.module = &this->top;
+    scope.bindings = nullptr;
+    for(size_t i = 0; i < this->top.submodules.size(); i++){
+        this->place(scope, i);
+    }
+}
+
+string Flattener::render(){
+    /*------------------------------------------------------------------------------------------
+    Flattens the top module and returns its definition.
+    ------------------------------------------------------------------------------------------*/
+    this->collect();
+    return this->options.optimize || this->options.retime ? this->render_optimized() : this->render_plain();
+}
+
+string Flattener::render_plain(){
+    /*------------------------------------------------------------------------------------------
+    Renders the statements as they are. Inputs, constants and the outputs of gates, flipflops
+    and kept instances are driven, the joins are turned into assigns from their driven side.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        if(!i->is_output()){
+            this->drive(wire(i->net.name(), 1));
+        }
+    }
+    for(vector<Assign>::const_iterator i = this->constants.begin(); i != this->constants.end(); i++){
+        this->drive(i->lhs);
+    }
+
+    string assigns, behaviours;
+    for(vector<Cell>::const_iterator i = this->cells.begin(); i != this->cells.end(); i++){
+        if(i->op == Op::JOIN){
+            this->joins.push_back({i->a, i->b});
+        }
+        else if(i->op == Op::FLIP_FLOP){
+            behaviours += "\talways @(posedge " + i->b + ")\n\tbegin\n\t\t" + i->state
+                        + " <= #" + to_string(FLIP_FLOP_DELAY) + " " + i->a + ";\n\tend\n";
+            assigns += "\tassign " + i->out + " = " + i->state + ";\n";
+            this->drive(i->out);
+        }
+        else{
+            assigns += "\tassign #" + to_string(gate_info(i->op).delay) + " " + i->out + " = " + gate_expression(i->op, i->a.str(), i->b.str()) + ";\n";
+            this->drive(i->out);
+        }
+    }
+    string instances;
+    for(vector<Instance>::const_iterator i = this->instances.begin(); i != this->instances.end(); i++){
+        instances += "\t" + i->module->name + " " + i->name + " (";
+        for(size_t p = 0; p < i->bindings.size(); p++){
+            instances += (p == 0 ? "" : ", ") + i->bindings[p];
+            if(p < i->module->ports.size() && i->module->ports.at(p).is_output()){
+                this->drive(i->bindings[p]);
+            }
+        }
+        instances += ");\n";
+    }
+    this->resolve_joins(assigns);
+
+    string out;
+    verilog_header(out, this->top);
+
+    out += "\n\t// Wires\n\n";
+    for(vector<pair<wire, bool>>::const_iterator i = this->declarations.begin(); i != this->declarations.end(); i++){
+        if(!i->second){
+            out += "\twire " + i->first.declaration() + ";\n";
+        }
+    }
+
+    out += "\n\t// Regs\n\n";
+    for(vector<pair<wire, bool>>::const_iterator i = this->declarations.begin(); i != this->declarations.end(); i++){
+        if(i->second){
+            out += "\treg " + i->first.declaration() + ";\n";
+        }
+    }
+
+    out += "\n\t// Extras\n\n";
+    for(vector<Assign>::const_iterator i = this->constants.begin(); i != this->constants.end(); i++){
+        out += "\tassign " + i->lhs + " = " + to_string(i->value) + ";\n";
+    }
+
+    out += "\n\t// Assigns\n\n";
+    out += assigns;
+
+    out += "\n\t// Sub Modules\n\n";
+    out += instances;
+
+    out += "\n\t// Behaviours\n\n";
+    out += behaviours;
+
+    out += "\nendmodule\n";
+    return out;
+}
+
+/*------------------------------------------------------------------------------------------
+                            Constant Propagation and Dead Logic
+                            ===================================
+
+The optimizer works on single bits. Every gate and flipflop is split into one cell per bit and
+the nets are kept in equivalence classes (see bit_classes.h), so that joins and gates reduced
+to a wire simply merge two classes. A class either has a constant value or is unknown.
+
+Gates with a constant or a repeated input are reduced until nothing changes:
+
+    a & 0 = 0       a & 1 = a       a | 1 = 1       a | 0 = a       a & a = a | a = a
+    a ^ 0 = a       a ^ 1 = ~a      a ^ a = 0       ~(a & 1) = ~a   ~(a | 0) = ~a
+
+A full adder with a zero carry in is left with the XOR and the AND of a half adder, with two
+zero inputs it is a plain wire. A flipflop with a constant input holds that constant once the
+pipeline is filled, so the constant is propagated through it as well.
+
+The remaining cells are kept only if an output port, a flipflop that is kept or an instance
+that is kept reads them. Every class is written under one name, preferably an input port, the
+state reg of a flipflop or an output port, in that order.
+------------------------------------------------------------------------------------------*/
+
+enum Reduction {KEEP, CONSTANT_0, CONSTANT_1, WIRE_A, WIRE_B, INVERT_A, INVERT_B};
+
+static Reduction reduce(Op op, int a, int b, bool same){
+    /*------------------------------------------------------------------------------------------
+    Simplifies one gate bit.
+
+    Param : op (Op), the gate.
+    Param : a, b (int), the values of the inputs, 0, 1 or -1 if unknown.
+    Param : same (bool), true if both inputs are the same net.
+    Returns : reduction (Reduction), what the gate reduces to.
+    ------------------------------------------------------------------------------------------*/
+    switch(op){
+        case Op::NOT :
+            return a < 0 ? KEEP : a ? CONSTANT_0 : CONSTANT_1;
+        case Op::AND :
+            if(a == 0 || b == 0) return CONSTANT_0;
+            if(a == 1 && b == 1) return CONSTANT_1;
+            if(a == 1) return WIRE_B;
+            if(b == 1 || same) return WIRE_A;
+            return KEEP;
+        case Op::OR :
+            if(a == 1 || b == 1) return CONSTANT_1;
+            if(a == 0 && b == 0) return CONSTANT_0;
+            if(a == 0) return WIRE_B;
+            if(b == 0 || same) return WIRE_A;
+            return KEEP;
+        case Op::XOR :
+            if(a >= 0 && b >= 0) return a ^ b ? CONSTANT_1 : CONSTANT_0;
+            if(same) return CONSTANT_0;
+            if(a == 0) return WIRE_B;
+            if(b == 0) return WIRE_A;
+            if(a == 1) return INVERT_B;
+            if(b == 1) return INVERT_A;
+            return KEEP;
+        case Op::NAND :
+            if(a == 0 || b == 0) return CONSTANT_1;
+            if(a == 1 && b == 1) return CONSTANT_0;
+            if(a == 1) return INVERT_B;
+            if(b == 1 || same) return INVERT_A;
+            return KEEP;
+        case Op::NOR :
+            if(a == 1 || b == 1) return CONSTANT_0;
+            if(a == 0 && b == 0) return CONSTANT_1;
+            if(a == 0) return INVERT_B;
+            if(b == 0 || same) return INVERT_A;
+            return KEEP;
+        default :
+            return KEEP;
+    }
+}
+
+void Flattener::lower(BitNetlist& netlist, bool fold){
+    /*------------------------------------------------------------------------------------------
+    Splits the collected statements into single bits, see above.
+
+    Param : netlist (BitNetlist), filled with the bit level gates, flipflops and net classes.
+    Param : fold (bool), propagate the constants and reduce the gates, else the gates are kept
+            as they are and only the joins are merged.
+    ------------------------------------------------------------------------------------------*/
+    /*------------------------------------------------------------------------------------------
+    Split everything into bits. The output of a flipflop is the same net as its state reg.
+    ------------------------------------------------------------------------------------------*/
+    vector<uint64_t> a, b, out, state;
+    for(vector<Assign>::const_iterator i = this->constants.begin(); i != this->constants.end(); i++){
+        out.clear();
+        this->bits(i->lhs, out);
+        for(size_t bit = 0; bit < out.size(); bit++){
+            netlist.value[netlist.node(out[bit])] = bit < 31 ? (i->value >> bit) & 1 : 0;
+        }
+    }
+    for(size_t i = 0; i < this->cells.size(); i++){
+        const Cell& cell = this->cells[i];
+        a.clear(); b.clear(); out.clear(); state.clear();
+        this->bits(cell.a, a);
+        this->bits(cell.op == Op::JOIN ? cell.b : cell.out, out);
+        if(cell.op == Op::JOIN){
+            for(size_t bit = 0; bit < a.size() && bit < out.size(); bit++){
+                netlist.merge(a[bit], out[bit]);
+            }
+            continue;
+        }
+        this->bits(cell.b.empty() ? cell.a : cell.b, b);
+        if(cell.op == Op::FLIP_FLOP){
+            this->bits(cell.state, state);
+            for(size_t bit = 0; bit < state.size() && bit < a.size() && bit < out.size(); bit++){
+                netlist.merge(out[bit], state[bit]);
+                netlist.flops.push_back({i, a[bit], b.front(), state[bit], false});
+            }
+            continue;
+        }
+        for(size_t bit = 0; bit < out.size() && bit < a.size() && bit < b.size(); bit++){
+            netlist.gates.push_back({cell.op, a[bit], b[bit], out[bit], false});
+            netlist.node(out[bit]);
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Propagate constants until nothing changes.
+    ------------------------------------------------------------------------------------------*/
+    for(bool changed = fold; changed; ){
+        changed = false;
+        for(vector<GateBit>::iterator gate = netlist.gates.begin(); gate != netlist.gates.end(); gate++){
+            if(gate->removed){
+                continue;
+            }
+            uint32_t in_a = netlist.node(gate->a), in_b = netlist.node(gate->b);
+            switch(reduce(gate->op, netlist.value[in_a], netlist.value[in_b], in_a == in_b)){
+                case KEEP : continue;
+                case CONSTANT_0 : netlist.value[netlist.node(gate->out)] = 0; break;
+                case CONSTANT_1 : netlist.value[netlist.node(gate->out)] = 1; break;
+                case WIRE_A : netlist.merge(gate->out, gate->a); break;
+                case WIRE_B : netlist.merge(gate->out, gate->b); break;
+                case INVERT_A : gate->op = Op::NOT; gate->b = gate->a; changed = true; continue;
+                case INVERT_B : gate->op = Op::NOT; gate->a = gate->b; changed = true; continue;
+            }
+            gate->removed = changed = true;
+        }
+        for(vector<FlopBit>::iterator flop = netlist.flops.begin(); flop != netlist.flops.end(); flop++){
+            if(!flop->removed && netlist.value[netlist.node(flop->d)] >= 0){
+                netlist.value[netlist.node(flop->q)] = netlist.value[netlist.node(flop->d)];
+                flop->removed = changed = true;
+            }
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Mark what the outputs, the kept flipflops and the kept instances read.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        if(i->is_output()){
+            this->bits(wire(i->net.name(), 1), netlist.roots);
+        }
+    }
+    for(vector<Instance>::const_iterator i = this->instances.begin(); i != this->instances.end(); i++){
+        for(size_t p = 0; p < i->bindings.size(); p++){
+            if(p >= i->module->ports.size() || !i->module->ports.at(p).is_output()){
+                this->bits(i->bindings[p], netlist.roots);
+            }
+        }
+    }
+    this->mark(netlist);
+}
+
+void Flattener::mark(BitNetlist& netlist){
+    /*------------------------------------------------------------------------------------------
+    Finds the drivers of every class, marks the gates and flipflops the roots depend on and
+    names every class. Called by lower(...) and again after retime(...) rebuilt the netlist.
+
+    Param : netlist (BitNetlist), with the gates, flipflops and roots filled in.
+    ------------------------------------------------------------------------------------------*/
+    vector<uint64_t> out;
+    for(vector<uint64_t>::iterator i = netlist.roots.begin(); i != netlist.roots.end(); i++){
+        netlist.node(*i);
+    }
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        out.clear();
+        this->bits(wire(i->net.name(), 1), out);
+        for(vector<uint64_t>::iterator bit = out.begin(); bit != out.end(); bit++){
+            netlist.node(*bit);
+        }
+    }
+
+    size_t count = netlist.classes.size();
+    netlist.drivers.assign(count, vector<uint32_t>());
+    for(uint32_t i = 0; i < netlist.gates.size(); i++){
+        if(!netlist.gates[i].removed){
+            netlist.drivers[netlist.node(netlist.gates[i].out)].push_back(i << 1);
+        }
+    }
+    for(uint32_t i = 0; i < netlist.flops.size(); i++){
+        if(!netlist.flops[i].removed){
+            netlist.drivers[netlist.node(netlist.flops[i].q)].push_back((i << 1) | 1);
+        }
+    }
+    vector<bool> live(count, false);
+    netlist.gate_live.assign(netlist.gates.size(), false);
+    netlist.flop_live.assign(netlist.flops.size(), false);
+    vector<uint32_t> stack;
+    for(vector<uint64_t>::iterator i = netlist.roots.begin(); i != netlist.roots.end(); i++){
+        stack.push_back(netlist.node(*i));
+    }
+    while(!stack.empty()){
+        uint32_t n = stack.back();
+        stack.pop_back();
+        if(live[n]){
+            continue;
+        }
+        live[n] = true;
+        for(vector<uint32_t>::iterator d = netlist.drivers[n].begin(); d != netlist.drivers[n].end(); d++){
+            if(*d & 1){
+                netlist.flop_live[*d >> 1] = true;
+                stack.push_back(netlist.node(netlist.flops[*d >> 1].d));
+                stack.push_back(netlist.node(netlist.flops[*d >> 1].clk));
+            }
+            else{
+                netlist.gate_live[*d >> 1] = true;
+                stack.push_back(netlist.node(netlist.gates[*d >> 1].a));
+                stack.push_back(netlist.node(netlist.gates[*d >> 1].b));
+            }
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Name every class: input ports first, then flipflop state regs, then output ports, then the
+    first bit seen.
+    ------------------------------------------------------------------------------------------*/
+    unordered_map<Symbol, int> ranks;
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        ranks[i->net.id()] = i->is_output() ? 2 : 0;
+    }
+    for(vector<FlopBit>::const_iterator i = netlist.flops.begin(); i != netlist.flops.end(); i++){
+        ranks[key_net(i->q)] = 1;
+    }
+    netlist.canonical.assign(count, 0);
+    vector<int> best(count, 3);
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t root = netlist.classes.root(i);
+        unordered_map<Symbol, int>::iterator found = ranks.find(key_net(netlist.classes.keys[i]));
+        int rank = found == ranks.end() ? 3 : found->second;
+        if(root == i || rank < best[root]){
+            netlist.canonical[root] = i;
+            best[root] = rank;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Retiming
+                                        ========
+
+With EmitOptions::retime the optimized bit netlist is retimed (Leiserson and Saxe) before it
+is rendered: the flipflops are moved across the gates so that the clock period is as short as
+possible, without changing the number of registers on any path from an input to an output.
+
+The netlist becomes a graph with one vertex per gate plus a host vertex standing for the ports,
+so the design has to be flattened completely. An edge runs from the gate (or the input) driving
+a net to every gate (or output) reading it, weighted by the flipflops the net passes on the way.
+A retiming r moves r(v) registers from the outputs of v to its inputs, edge u -> v then holds
+
+    w_r(e) = w(e) + r(v) - r(u)
+
+registers. FEAS finds an r for a period c: arrival times are computed over the edges without a
+register (a register starts its path FLIP_FLOP_DELAY late), and every gate arriving after c is
+retimed by one, until nothing arrives late. A binary search on c finds the shortest period.
+
+The flipflops are then rebuilt: each driving net gets one shift register, as long as its most
+delayed fanout needs, and every reader taps it at its own depth. The registers are not minimi-
+zed beyond that sharing.
+------------------------------------------------------------------------------------------*/
+
+typedef struct{
+    uint32_t from, to;      // vertices, 0 is the host
+    int weight;             // flipflops on the edge
+    uint32_t source;        // class of the net driving the edge
+    size_t sink;            // the gate (to != 0) or the root (to == 0) reading it
+    int input;              // the gate input read: 0 a, 1 b, 2 both
+} RetimeEdge;
+
+string Flattener::retime(BitNetlist& netlist){
+    /*------------------------------------------------------------------------------------------
+    Retimes the netlist for the shortest clock period, see above. The netlist is replaced by the
+    retimed one.
+
+    Param : netlist (BitNetlist), a netlist from lower(...) without kept instances.
+    Returns : note (string), example "Retimed : clock period 40 -> 31, registers 1076 -> 1412",
+              empty if the netlist has no flipflop to move.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->instances.empty()){
+        throw invalid_argument("Retiming " + this->top.name + " needs a fully flattened design, "
+                               + this->instances.front().module->name + " is still an instance.");
+    }
+    size_t count = netlist.classes.size();
+    long long registers_before = 0;
+    uint64_t clock = 0;
+    for(size_t i = 0; i < netlist.flops.size(); i++){
+        if(netlist.flop_live[i]){
+            registers_before++;
+            clock = netlist.flops[i].clk;
+        }
+    }
+    if(registers_before == 0){
+        return "";
+    }
+
+    /*------------------------------------------------------------------------------------------
+    The graph. A net is traced back through the flipflops to the gate or input driving it,
+    constants are no edges.
+    ------------------------------------------------------------------------------------------*/
+    vector<uint32_t> vertex(netlist.gates.size(), 0), gate_of(1, 0);
+    vector<int> delay(1, 0);
+    for(uint32_t i = 0; i < netlist.gates.size(); i++){
+        if(netlist.gate_live[i]){
+            vertex[i] = gate_of.size();
+            gate_of.push_back(i);
+            delay.push_back(gate_info(netlist.gates[i].op).delay);
+        }
+    }
+    size_t vertices = gate_of.size();
+    auto trace = [&](uint64_t key, RetimeEdge& edge) -> bool{
+        edge.weight = 0;
+        for(uint32_t n = netlist.node(key); ; n = netlist.node(key)){
+            if(netlist.value[n] >= 0){
+                return false;
+            }
+            if(netlist.drivers[n].empty() || !(netlist.drivers[n].front() & 1)){
+                edge.from = netlist.drivers[n].empty() ? 0 : vertex[netlist.drivers[n].front() >> 1];
+                edge.source = n;
+                return true;
+            }
+            if(++edge.weight > (int)netlist.flops.size()){
+                throw invalid_argument(this->top.name + " has a loop of flipflops without logic, it can not be retimed.");
+            }
+            key = netlist.flops[netlist.drivers[n].front() >> 1].d;
+        }
+    };
+    vector<RetimeEdge> edges;
+    RetimeEdge edge;
+    for(uint32_t v = 1; v < vertices; v++){
+        const GateBit& gate = netlist.gates[gate_of[v]];
+        bool same = netlist.node(gate.a) == netlist.node(gate.b);
+        edge.to = v;
+        edge.sink = gate_of[v];
+        if(trace(gate.a, edge)){
+            edge.input = same ? 2 : 0;
+            edges.push_back(edge);
+        }
+        if(!same && trace(gate.b, edge)){
+            edge.input = 1;
+            edges.push_back(edge);
+        }
+    }
+    for(size_t i = 0; i < netlist.roots.size(); i++){
+        edge.to = 0;
+        edge.sink = i;
+        if(trace(netlist.roots[i], edge)){
+            edges.push_back(edge);
+        }
+    }
+    vector<vector<uint32_t>> outgoing(vertices);
+    for(uint32_t i = 0; i < edges.size(); i++){
+        outgoing[edges[i].from].push_back(i);
+    }
+
+    /*------------------------------------------------------------------------------------------
+    The clock period of a retiming, -1 if it is not legal (a negative weight or a loop without a
+    register). arrival is left with the arrival time at every vertex.
+    ------------------------------------------------------------------------------------------*/
+    vector<int> arrival(vertices), pending(vertices);
+    vector<uint32_t> order;
+    auto weight = [&](const RetimeEdge& e, const vector<int>& r) -> int{
+        return e.weight + r[e.to] - r[e.from];
+    };
+    auto clock_period = [&](const vector<int>& r) -> int{
+        arrival.assign(vertices, 0);
+        pending.assign(vertices, 0);
+        for(vector<RetimeEdge>::iterator e = edges.begin(); e != edges.end(); e++){
+            int w = weight(*e, r);
+            if(w < 0){
+                return -1;
+            }
+            if(w == 0){
+                pending[e->to]++;
+            }
+            else if(e->to != 0){
+                arrival[e->to] = max(arrival[e->to], FLIP_FLOP_DELAY);
+            }
+        }
+        order.clear();
+        for(uint32_t v = 0; v < vertices; v++){
+            if(pending[v] == 0){
+                order.push_back(v);
+            }
+        }
+        int period = FLIP_FLOP_DELAY;
+        for(size_t i = 0; i < order.size(); i++){
+            uint32_t v = order[i];
+            arrival[v] += delay[v];
+            period = max(period, arrival[v]);
+            for(vector<uint32_t>::iterator e = outgoing[v].begin(); e != outgoing[v].end(); e++){
+                if(weight(edges[*e], r) == 0){
+                    arrival[edges[*e].to] = max(arrival[edges[*e].to], arrival[v]);
+                    if(--pending[edges[*e].to] == 0){
+                        order.push_back(edges[*e].to);
+                    }
+                }
+            }
+        }
+        return order.size() == vertices ? period : -1;
+    };
+
+    /*------------------------------------------------------------------------------------------
+    FEAS needs at most one pass per vertex. A register moves at least one gate per pass though,
+    so twice the most gates on a path (registers ignored) is enough unless the registers form a
+    loop, and a period that is still not met after that is not feasible.
+    ------------------------------------------------------------------------------------------*/
+    size_t passes = vertices;
+    vector<int> depth(vertices, 1);
+    pending.assign(vertices, 0);
+    for(vector<RetimeEdge>::iterator e = edges.begin(); e != edges.end(); e++){
+        pending[e->to] += e->from != 0;
+    }
+    order.clear();
+    for(uint32_t v = 1; v < vertices; v++){
+        if(pending[v] == 0){
+            order.push_back(v);
+        }
+    }
+    for(size_t i = 0; i < order.size(); i++){
+        for(vector<uint32_t>::iterator e = outgoing[order[i]].begin(); e != outgoing[order[i]].end(); e++){
+            uint32_t to = edges[*e].to;
+            depth[to] = max(depth[to], depth[order[i]] + 1);
+            if(to != 0 && --pending[to] == 0){
+                order.push_back(to);
+            }
+        }
+    }
+    if(order.size() == vertices - 1){
+        passes = min(passes, 2*(size_t)depth[0] + 2);
+    }
+    auto feasible = [&](int period, vector<int>& r) -> bool{
+        r.assign(vertices, 0);
+        for(size_t pass = 0; pass < passes; pass++){
+            int reached = clock_period(r);
+            if(reached < 0){
+                return false;
+            }
+            if(reached <= period){
+                return true;
+            }
+            for(uint32_t v = 0; v < vertices; v++){
+                r[v] += arrival[v] > period;
+            }
+        }
+        return false;
+    };
+
+    vector<int> best(vertices, 0), trial;
+    int period_before = clock_period(best);
+    if(period_before < 0){
+        throw invalid_argument(this->top.name + " has a path from an input to an output without a register, it can not be retimed.");
+    }
+    int low = FLIP_FLOP_DELAY, high = period_before;
+    for(uint32_t v = 1; v < vertices; v++){
+        low = max(low, delay[v]);
+    }
+    while(low < high){
+        int middle = (low + high)/2;
+        if(feasible(middle, trial)){
+            high = clock_period(trial);
+            best = trial;
+        }
+        else{
+            low = middle + 1;
+        }
+    }
+    for(uint32_t v = 1; v < vertices; v++){
+        best[v] -= best[0];
+    }
+    best[0] = 0;
+
+    /*------------------------------------------------------------------------------------------
+    Rebuild the netlist. Every class keeps its canonical bit, except the outputs of gates that
+    also hold an output port: the gate gets a fresh net, so a register can be placed between it
+    and the port.
+    ------------------------------------------------------------------------------------------*/
+    const uint64_t UNSET = UINT64_MAX;
+    vector<bool> rooted(count, false);
+    for(vector<uint64_t>::iterator i = netlist.roots.begin(); i != netlist.roots.end(); i++){
+        rooted[netlist.node(*i)] = true;
+    }
+    BitNetlist retimed;
+    vector<uint64_t> keys(count, UNSET);
+    auto key_of = [&](uint32_t n) -> uint64_t{
+        if(keys[n] == UNSET){
+            keys[n] = netlist.classes.keys[netlist.canonical[n]];
+            if(rooted[n] && !netlist.drivers[n].empty() && !(netlist.drivers[n].front() & 1)){
+                wire net(this->unique_name(identifier(this->bit_name(keys[n])) + "_D"), 1);
+                this->declare(net, false);
+                keys[n] = bit_key(net.id(), 0);
+            }
+            retimed.node(keys[n]);
+            retimed.value[retimed.node(keys[n])] = netlist.value[n];
+        }
+        return keys[n];
+    };
+
+    vector<int> length(count, 0);
+    vector<vector<uint64_t>> chains(count);
+    for(vector<RetimeEdge>::iterator e = edges.begin(); e != edges.end(); e++){
+        length[e->source] = max(length[e->source], weight(*e, best));
+    }
+    long long registers_after = 0;
+    for(uint32_t n = 0; n < count; n++){
+        if(length[n] == 0){
+            continue;
+        }
+        wire net(this->unique_name(identifier(this->bit_name(netlist.classes.keys[netlist.canonical[n]])) + "_RETIMED"), length[n]);
+        this->declare(net, true);
+        for(int bit = 0; bit < length[n]; bit++){
+            chains[n].push_back(bit_key(net.id(), bit));
+            retimed.node(chains[n].back());
+            retimed.flops.push_back({this->cells.size() + n, bit == 0 ? key_of(n) : chains[n][bit - 1], key_of(netlist.node(clock)), chains[n][bit], false});
+        }
+        registers_after += length[n];
+    }
+    auto tap = [&](const RetimeEdge& e) -> uint64_t{
+        int w = weight(e, best);
+        return w == 0 ? key_of(e.source) : chains[e.source][w - 1];
+    };
+
+    for(uint32_t v = 1; v < vertices; v++){
+        const GateBit& gate = netlist.gates[gate_of[v]];
+        uint32_t in_a = netlist.node(gate.a), in_b = netlist.node(gate.b);
+        retimed.gates.push_back({gate.op, netlist.value[in_a] >= 0 ? key_of(in_a) : UNSET, netlist.value[in_b] >= 0 ? key_of(in_b) : UNSET,
+                                 key_of(netlist.node(gate.out)), false});
+    }
+    for(vector<RetimeEdge>::iterator e = edges.begin(); e != edges.end(); e++){
+        if(e->to != 0){
+            GateBit& gate = retimed.gates[vertex[e->sink] - 1];
+            if(e->input != 1){
+                gate.a = tap(*e);
+            }
+            if(e->input != 0){
+                gate.b = tap(*e);
+            }
+        }
+        else{
+            retimed.merge(netlist.roots[e->sink], tap(*e));
+        }
+    }
+    for(vector<uint64_t>::iterator i = netlist.roots.begin(); i != netlist.roots.end(); i++){
+        uint32_t n = netlist.node(*i);
+        if(netlist.value[n] >= 0){
+            retimed.merge(*i, key_of(n));
+        }
+    }
+    vector<uint64_t> bits;
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        if(!i->is_output()){
+            this->bits(wire(i->net.name(), 1), bits);
+        }
+    }
+    for(vector<uint64_t>::iterator i = bits.begin(); i != bits.end(); i++){
+        retimed.merge(*i, key_of(netlist.node(*i)));
+    }
+    retimed.roots = netlist.roots;
+    this->mark(retimed);
+    netlist = move(retimed);
+
+    return "Retimed : clock period " + to_string(period_before) + " -> " + to_string(high)
+           + ", registers " + to_string(registers_before) + " -> " + to_string(registers_after);
+}
+
+string Flattener::render_optimized(){
+    /*------------------------------------------------------------------------------------------
+    Optimizes the statements and renders them, see above.
+    ------------------------------------------------------------------------------------------*/
+    BitNetlist netlist;
+    this->lower(netlist, true);
+    string note = this->options.retime ? this->retime(netlist) : "";
+    size_t count = netlist.classes.size();
+    vector<uint64_t> out;
+    vector<uint32_t> stack;
+
+    /*------------------------------------------------------------------------------------------
+    Writes a list of bits (least significant first) as one reference: a net, a bit, a slice, a
+    constant or a concatenation of those.
+    ------------------------------------------------------------------------------------------*/
+    unordered_set<Symbol> used;
+    auto reference = [&](const vector<uint64_t>& bits) -> string{
+        vector<string> parts;
+        size_t end = bits.size();
+        while(end > 0){
+            uint32_t last = netlist.node(bits[end - 1]);
+            size_t start = end - 1;
+            if(netlist.value[last] >= 0){
+                string literal = netlist.value[last] ? "1" : "0";
+                while(start > 0 && netlist.value[netlist.node(bits[start - 1])] >= 0){
+                    literal += netlist.value[netlist.node(bits[--start])] ? "1" : "0";
+                }
+                parts.push_back(to_string(end - start) + "'b" + literal);
+                end = start;
+                continue;
+            }
+            uint64_t high = netlist.classes.keys[netlist.canonical[last]];
+            while(start > 0){
+                uint32_t next = netlist.node(bits[start - 1]);
+                uint64_t key = netlist.classes.keys[netlist.canonical[next]];
+                if(netlist.value[next] >= 0 || key_net(key) != key_net(high) || key_bit(key) + (int)(end - start) != key_bit(high)){
+                    break;
+                }
+                start--;
+            }
+            Symbol net = key_net(high);
+            int hi = key_bit(high), lo = hi - (int)(end - start) + 1;
+            string name(SymbolTable::global().name(net));
+            const pair<int, int>& range = this->ranges.at(net);
+            if(!this->vectors.count(net) || (hi == range.first && lo == range.second)){
+                parts.push_back(name);
+            }
+            else{
+                parts.push_back(name + "[" + to_string(hi) + (hi == lo ? "" : ":" + to_string(lo)) + "]");
+            }
+            used.insert(net);
+            end = start;
+        }
+        if(parts.size() == 1){
+            return parts.front();
+        }
+        string text = "{";
+        for(vector<string>::iterator i = parts.begin(); i != parts.end(); i++){
+            text += (i == parts.begin() ? "" : ", ") + *i;
+        }
+        return text + "}";
+    };
+    auto single = [&](uint64_t key) -> string{
+        return reference(vector<uint64_t>(1, key));
+    };
+
+    /*------------------------------------------------------------------------------------------
+    Render the kept logic and collect the transistor count.
+    ------------------------------------------------------------------------------------------*/
+    int transistors = 0;
+    string extras, assigns, instances, behaviours;
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        if(!i->is_output()){
+            continue;
+        }
+        out.clear();
+        this->bits(wire(i->net.name(), 1), out);
+        for(size_t end = out.size(); end > 0; ){
+            uint32_t n = netlist.node(out[end - 1]);
+            if(netlist.value[n] < 0 && netlist.classes.keys[netlist.canonical[n]] == out[end - 1]){
+                end--;
+                continue;
+            }
+            size_t start = end - 1;
+            while(start > 0){
+                uint32_t next = netlist.node(out[start - 1]);
+                if(netlist.value[next] < 0 && netlist.classes.keys[netlist.canonical[next]] == out[start - 1]){
+                    break;
+                }
+                start--;
+            }
+            vector<uint64_t> run(out.begin() + start, out.begin() + end);
+            string lhs = (run.size() == out.size() || !this->vectors.count(i->net.id())) ? string(i->net.name())
+                       : string(i->net.name()) + "[" + to_string(key_bit(run.back())) + (run.size() == 1 ? "" : ":" + to_string(key_bit(run.front()))) + "]";
+            extras += "\tassign " + lhs + " = " + reference(run) + ";\n";
+            end = start;
+        }
+    }
+    for(size_t i = 0; i < netlist.gates.size(); i++){
+        if(!netlist.gate_live[i]){
+            continue;
+        }
+        GateInfo info = gate_info(netlist.gates[i].op);
+        assigns += "\tassign #" + to_string(info.delay) + " " + single(netlist.gates[i].out) + " = "
+                 + gate_expression(netlist.gates[i].op, single(netlist.gates[i].a), single(netlist.gates[i].b)) + ";\n";
+        transistors += info.transistors;
+    }
+    for(vector<Instance>::const_iterator i = this->instances.begin(); i != this->instances.end(); i++){
+        instances += "\t" + i->module->name + " " + i->name + " (";
+        for(size_t p = 0; p < i->bindings.size(); p++){
+            out.clear();
+            this->bits(i->bindings[p], out);
+            instances += (p == 0 ? "" : ", ") + reference(out);
+        }
+        instances += ");\n";
+        transistors += i->module->num_transistors();
+    }
+    for(size_t first = 0; first < netlist.flops.size(); ){
+        size_t last = first;
+        while(last < netlist.flops.size() && netlist.flops[last].cell == netlist.flops[first].cell){
+            last++;
+        }
+        vector<uint64_t> q, d;
+        for(size_t i = first; i < last; i++){
+            if(netlist.flop_live[i]){
+                q.push_back(netlist.flops[i].q);
+                d.push_back(netlist.flops[i].d);
+            }
+        }
+        if(!q.empty()){
+            behaviours += "\talways @(posedge " + single(netlist.flops[first].clk) + ")\n\tbegin\n\t\t" + reference(q)
+                        + " <= #" + to_string(FLIP_FLOP_DELAY) + " " + reference(d) + ";\n\tend\n";
+            transistors += q.size()*FLIP_FLOP_TRANSISTORS;
+        }
+        first = last;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    The critical path is the longest chain of gate delays from an input, a flipflop or a kept
+    instance to an output, a flipflop or a kept instance. Kept instances count as zero delay, a
+    flipflop output arrives FLIP_FLOP_DELAY (clock to output) after the clock, the same as the
+    static timing analysis (timing.h) and the clock period of retime(...).
+    ------------------------------------------------------------------------------------------*/
+    vector<uint64_t> endpoints = netlist.roots;
+    for(size_t i = 0; i < netlist.flops.size(); i++){
+        if(netlist.flop_live[i]){
+            endpoints.push_back(netlist.flops[i].d);
+        }
+    }
+    vector<int> arrival(count, -1);
+    int critical_path = 0;
+    for(vector<uint64_t>::iterator root = endpoints.begin(); root != endpoints.end(); root++){
+        stack.assign(1, netlist.node(*root));
+        while(!stack.empty()){
+            uint32_t n = stack.back();
+            if(arrival[n] >= 0){
+                stack.pop_back();
+                continue;
+            }
+            int time = 0;
+            bool ready = true;
+            for(vector<uint32_t>::iterator d = netlist.drivers[n].begin(); d != netlist.drivers[n].end(); d++){
+                if(*d & 1){
+                    time = max(time, FLIP_FLOP_DELAY);
+                    continue;
+                }
+                const GateBit& gate = netlist.gates[*d >> 1];
+                uint32_t in_a = netlist.node(gate.a), in_b = netlist.node(gate.b);
+                if(arrival[in_a] < 0 || arrival[in_b] < 0){
+                    ready = false;
+                    if(arrival[in_a] < 0) stack.push_back(in_a);
+                    if(arrival[in_b] < 0) stack.push_back(in_b);
+                    continue;
+                }
+                time = max(time, max(arrival[in_a], arrival[in_b]) + gate_info(gate.op).delay);
+            }
+            if(ready){
+                arrival[n] = time;
+                stack.pop_back();
+            }
+        }
+    }
+    for(vector<uint64_t>::iterator root = endpoints.begin(); root != endpoints.end(); root++){
+        critical_path = max(critical_path, arrival[netlist.node(*root)]);
+    }
+
+    string text;
+    verilog_header(text, this->top, transistors, critical_path, note);
+
+    text += "\n\t// Wires\n\n";
+    for(vector<pair<wire, bool>>::const_iterator i = this->declarations.begin(); i != this->declarations.end(); i++){
+        if(!i->second && used.count(i->first.id())){
+            text += "\twire " + i->first.declaration() + ";\n";
+        }
+    }
+
+    text += "\n\t// Regs\n\n";
+    for(vector<pair<wire, bool>>::const_iterator i = this->declarations.begin(); i != this->declarations.end(); i++){
+        if(i->second && used.count(i->first.id())){
+            text += "\treg " + i->first.declaration() + ";\n";
+        }
+    }
+
+    text += "\n\t// Extras\n\n";
+    text += extras;
+
+    text += "\n\t// Assigns\n\n";
+    text += assigns;
+
+    text += "\n\t// Sub Modules\n\n";
+    text += instances;
+
+    text += "\n\t// Behaviours\n\n";
+    text += behaviours;
+
+    text += "\nendmodule\n";
+    return text;
+}
+
+/*------------------------------------------------------------------------------------------
+                                    BLIF and AIGER Export
+                                    =====================
+
+Both formats describe the flat bit level network, so the design is always flattened down to
+the gates, and EmitOptions::optimize and retime are applied first if they are set. The flip-
+flops become latches, initialised to 0.
+
+BLIF keeps every gate as a .names table and every flipflop as a rising edge .latch:
+
+    .names A[1] B[1] FA_1__w                    (assign #2 FA_1__w = A[1] & B[1];)
+    11 1
+    .latch FF_0__d FF_0__OUT[3] re CLK 0
+
+AIGER (binary, "aig") only has two input ANDs and inverters. OR, NAND and NOR become one AND
+with inverted inputs or output, XOR becomes three ANDs. Structurally identical ANDs are shared.
+AIGER latches have no clock, the clock stays an input of the model that nothing reads.
+------------------------------------------------------------------------------------------*/
+
+string Flattener::bit_name(uint64_t key) const{
+    /*------------------------------------------------------------------------------------------
+    The name of a single bit, example "A[3]", or "c" for a net declared without a range.
+    ------------------------------------------------------------------------------------------*/
+    string name(SymbolTable::global().name(key_net(key)));
+    if(this->vectors.count(key_net(key))){
+        name += "[" + to_string(key_bit(key)) + "]";
+    }
+    return name;
+}
+
+void Flattener::check_exportable(const string& format) const{
+    /*------------------------------------------------------------------------------------------
+    Both exporters need a design without submodules left.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->instances.empty()){
+        throw invalid_argument(format + " export of " + this->top.name + " needs a fully flattened design, "
+                               + this->instances.front().module->name + " can not be flattened.");
+    }
+}
+
+string Flattener::render_blif(){
+    /*------------------------------------------------------------------------------------------
+    Flattens the top module and returns it as a BLIF model, see above.
+    ------------------------------------------------------------------------------------------*/
+    this->collect();
+    this->check_exportable("BLIF");
+    BitNetlist netlist;
+    this->lower(netlist, this->options.optimize || this->options.retime);
+    if(this->options.retime){
+        this->retime(netlist);
+    }
+
+    vector<bool> is_input(netlist.classes.size(), false), declared(netlist.classes.size(), false);
+    string inputs, outputs, extras, latches, gates;
+    vector<uint64_t> bits;
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        bits.clear();
+        this->bits(wire(i->net.name(), 1), bits);
+        for(vector<uint64_t>::iterator bit = bits.begin(); bit != bits.end(); bit++){
+            (i->is_output() ? outputs : inputs) += " " + this->bit_name(*bit);
+            if(!i->is_output()){
+                is_input[netlist.node(*bit)] = true;
+            }
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Every net read is named after the canonical bit of its class. Constant and undriven classes
+    get a constant table the first time they are read.
+    ------------------------------------------------------------------------------------------*/
+    auto source = [&](uint64_t key) -> string{
+        uint32_t n = netlist.node(key);
+        string name = this->bit_name(netlist.classes.keys[netlist.canonical[n]]);
+        bool constant = netlist.value[n] >= 0 || (netlist.drivers[n].empty() && !is_input[n]);
+        if(constant && !declared[n]){
+            extras += ".names " + name + (netlist.value[n] == 1 ? "\n1\n" : "\n");
+        }
+        declared[n] = true;
+        return name;
+    };
+
+    for(size_t i = 0; i < netlist.flops.size(); i++){
+        if(netlist.flop_live[i]){
+            const FlopBit& flop = netlist.flops[i];
+            latches += ".latch " + source(flop.d) + " " + this->bit_name(netlist.classes.keys[netlist.canonical[netlist.node(flop.q)]])
+                     + " re " + source(flop.clk) + " 0\n";
+        }
+    }
+    for(size_t i = 0; i < netlist.gates.size(); i++){
+        if(!netlist.gate_live[i]){
+            continue;
+        }
+        const GateBit& gate = netlist.gates[i];
+        string out = this->bit_name(netlist.classes.keys[netlist.canonical[netlist.node(gate.out)]]);
+        switch(gate.op){
+            case Op::AND  : gates += ".names " + source(gate.a) + " " + source(gate.b) + " " + out + "\n11 1\n"; break;
+            case Op::OR   : gates += ".names " + source(gate.a) + " " + source(gate.b) + " " + out + "\n1- 1\n-1 1\n"; break;
+            case Op::XOR  : gates += ".names " + source(gate.a) + " " + source(gate.b) + " " + out + "\n10 1\n01 1\n"; break;
+            case Op::NAND : gates += ".names " + source(gate.a) + " " + source(gate.b) + " " + out + "\n0- 1\n-0 1\n"; break;
+            case Op::NOR  : gates += ".names " + source(gate.a) + " " + source(gate.b) + " " + out + "\n00 1\n"; break;
+            default       : gates += ".names " + source(gate.a) + " " + out + "\n0 1\n"; break;
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Output bits merged into another class are buffered from it.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        if(!i->is_output()){
+            continue;
+        }
+        bits.clear();
+        this->bits(wire(i->net.name(), 1), bits);
+        for(vector<uint64_t>::iterator bit = bits.begin(); bit != bits.end(); bit++){
+            uint32_t n = netlist.node(*bit);
+            if(netlist.classes.keys[netlist.canonical[n]] == *bit && netlist.value[n] < 0){
+                source(*bit);
+                continue;
+            }
+            if(netlist.value[n] >= 0){
+                extras += ".names " + this->bit_name(*bit) + (netlist.value[n] == 1 ? "\n1\n" : "\n");
+            }
+            else{
+                extras += ".names " + source(*bit) + " " + this->bit_name(*bit) + "\n1 1\n";
+            }
+        }
+    }
+
+    return ".model " + this->top.name + "\n.inputs" + inputs + "\n.outputs" + outputs + "\n"
+           + latches + gates + extras + ".end\n";
+}
+
+static void aiger_number(string& out, uint32_t x){
+    /*------------------------------------------------------------------------------------------
+    Appends an unsigned number in the 7 bit variable length code of the binary AIGER format.
+    ------------------------------------------------------------------------------------------*/
+    while(x & ~0x7fU){
+        out += (char)((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    out += (char)x;
+}
+
+string Flattener::render_aiger(){
+    /*------------------------------------------------------------------------------------------
+    Flattens the top module and returns it as a binary AIGER file, see above.
+    ------------------------------------------------------------------------------------------*/
+    this->collect();
+    this->check_exportable("AIGER");
+    BitNetlist netlist;
+    this->lower(netlist, this->options.optimize || this->options.retime);
+    if(this->options.retime){
+        this->retime(netlist);
+    }
+    size_t count = netlist.classes.size();
+
+    /*------------------------------------------------------------------------------------------
+    Variables 1 to I are the input bits and I + 1 to I + L the latches, the ANDs follow.
+    ------------------------------------------------------------------------------------------*/
+    const uint32_t UNSET = UINT32_MAX;
+    vector<uint32_t> literal(count, UNSET);
+    vector<uint64_t> inputs, outputs, bits;
+    vector<uint32_t> latches;
+    for(vector<Port>::const_iterator i = this->top.ports.begin(); i != this->top.ports.end(); i++){
+        this->bits(wire(i->net.name(), 1), i->is_output() ? outputs : inputs);
+    }
+    for(size_t i = 0; i < inputs.size(); i++){
+        uint32_t n = netlist.node(inputs[i]);
+        if(literal[n] == UNSET){
+            literal[n] = 2*(i + 1);
+        }
+    }
+    for(uint32_t i = 0; i < netlist.flops.size(); i++){
+        if(netlist.flop_live[i] && literal[netlist.node(netlist.flops[i].q)] == UNSET){
+            literal[netlist.node(netlist.flops[i].q)] = 2*(inputs.size() + latches.size() + 1);
+            latches.push_back(i);
+        }
+    }
+    for(uint32_t n = 0; n < count; n++){
+        if(netlist.value[n] >= 0){
+            literal[n] = netlist.value[n];
+        }
+    }
+
+    vector<pair<uint32_t, uint32_t>> ands;
+    unordered_map<uint64_t, uint32_t> shared;
+    uint32_t first = 2*(inputs.size() + latches.size() + 1);
+    auto make_and = [&](uint32_t a, uint32_t b) -> uint32_t{
+        if(a < b){
+            swap(a, b);
+        }
+        if(b == 0 || a == (b ^ 1)){
+            return 0;
+        }
+        if(b == 1 || a == b){
+            return a;
+        }
+        pair<unordered_map<uint64_t, uint32_t>::iterator, bool> found = shared.emplace(((uint64_t)a << 32) | b, first + 2*ands.size());
+        if(found.second){
+            ands.push_back({a, b});
+        }
+        return found.first->second;
+    };
+    auto gate_literal = [&](Op op, uint32_t a, uint32_t b) -> uint32_t{
+        switch(op){
+            case Op::AND  : return make_and(a, b);
+            case Op::NAND : return make_and(a, b) ^ 1;
+            case Op::OR   : return make_and(a ^ 1, b ^ 1) ^ 1;
+            case Op::NOR  : return make_and(a ^ 1, b ^ 1);
+            case Op::XOR  : return make_and(make_and(a, b) ^ 1, make_and(a ^ 1, b ^ 1) ^ 1);
+            default       : return a ^ 1;
+        }
+    };
+
+    /*------------------------------------------------------------------------------------------
+    Resolves the literal of a class depth first, so every AND comes after its inputs. Undriven
+    classes (and the inputs of a combinational loop, which the generators never build) are 0.
+    ------------------------------------------------------------------------------------------*/
+    vector<bool> expanded(count, false);
+    vector<uint32_t> stack;
+    auto resolve = [&](uint64_t key) -> uint32_t{
+        stack.assign(1, netlist.node(key));
+        while(!stack.empty()){
+            uint32_t n = stack.back();
+            if(literal[n] != UNSET){
+                stack.pop_back();
+                continue;
+            }
+            const GateBit* gate = NULL;
+            for(vector<uint32_t>::iterator d = netlist.drivers[n].begin(); d != netlist.drivers[n].end() && gate == NULL; d++){
+                if(!(*d & 1)){
+                    gate = &netlist.gates[*d >> 1];
+                }
+            }
+            if(gate == NULL){
+                literal[n] = 0;
+                stack.pop_back();
+                continue;
+            }
+            uint32_t in_a = netlist.node(gate->a), in_b = netlist.node(gate->b);
+            if(!expanded[n] && (literal[in_a] == UNSET || literal[in_b] == UNSET)){
+                expanded[n] = true;
+                stack.push_back(in_a);
+                stack.push_back(in_b);
+                continue;
+            }
+            literal[n] = gate_literal(gate->op, literal[in_a] == UNSET ? 0 : literal[in_a], literal[in_b] == UNSET ? 0 : literal[in_b]);
+            stack.pop_back();
+        }
+        return literal[netlist.node(key)];
+    };
+
+    string latch_lines, output_lines, body, symbols;
+    for(vector<uint32_t>::iterator i = latches.begin(); i != latches.end(); i++){
+        latch_lines += to_string(resolve(netlist.flops[*i].d)) + "\n";
+    }
+    for(vector<uint64_t>::iterator i = outputs.begin(); i != outputs.end(); i++){
+        output_lines += to_string(resolve(*i)) + "\n";
+    }
+    for(size_t i = 0; i < ands.size(); i++){
+        uint32_t lhs = first + 2*i;
+        aiger_number(body, lhs - ands[i].first);
+        aiger_number(body, ands[i].first - ands[i].second);
+    }
+    for(size_t i = 0; i < inputs.size(); i++){
+        symbols += "i" + to_string(i) + " " + this->bit_name(inputs[i]) + "\n";
+    }
+    for(size_t i = 0; i < latches.size(); i++){
+        symbols += "l" + to_string(i) + " " + this->bit_name(netlist.classes.keys[netlist.canonical[netlist.node(netlist.flops[latches[i]].q)]]) + "\n";
+    }
+    for(size_t i = 0; i < outputs.size(); i++){
+        symbols += "o" + to_string(i) + " " + this->bit_name(outputs[i]) + "\n";
+    }
+
+    string header = "aig " + to_string(inputs.size() + latches.size() + ands.size()) + " " + to_string(inputs.size()) + " "
+                  + to_string(latches.size()) + " " + to_string(outputs.size()) + " " + to_string(ands.size()) + "\n";
+    return header + latch_lines + output_lines + body + symbols + "c\n" + this->top.name + "\n";
+}
+
+string verilog_flat_definition(const ModuleDef& module, const EmitOptions& options, vector<const ModuleDef*>& kept){
+    /*------------------------------------------------------------------------------------------
+    Renders a module definition with its submodules inlined.
+
+    Param : module (ModuleDef), a module for which can_flatten(module) holds.
+    Param : options (EmitOptions), the inlining thresholds.
+    Param : kept (vector<const ModuleDef*>), the modules still instantiated by the flat module
+            are appended here, they have to be emitted as well.
+    Returns : definition (string)
+    ------------------------------------------------------------------------------------------*/
+    Flattener flattener(module, options, kept);
+    return flattener.render();
+}
+
+static EmitOptions export_options(const ModuleDef& module, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    The exporters always flatten the whole design.
+    ------------------------------------------------------------------------------------------*/
+    if(module.from_cache){
+        throw invalid_argument(module.name + " was loaded from the module cache without its netlist and can not be exported.");
+    }
+    if(module.op != Op::NONE || !can_flatten(module)){
+        throw invalid_argument(module.name + " is not described by its netlist and can not be exported.");
+    }
+    EmitOptions flat = options;
+    flat.flatten = true;
+    flat.max_depth = INT_MAX;
+    flat.max_instances = LLONG_MAX;
+    return flat;
+}
+
+string blif_definition(const ModuleDef& module, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Renders a module, flattened down to its gates and flipflops, as a BLIF model.
+
+    Param : module (ModuleDef), a module for which can_flatten(module) holds.
+    Param : options (EmitOptions), optimize and retime are applied, the inlining thresholds are
+            ignored.
+    Returns : model (string), from .model to .end
+    ------------------------------------------------------------------------------------------*/
+    EmitOptions flat = export_options(module, options);
+    vector<const ModuleDef*> kept;
+    Flattener flattener(module, flat, kept);
+    return flattener.render_blif();
+}
+
+string aiger_definition(const ModuleDef& module, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Renders a module, flattened down to its gates and flipflops, as a binary AIGER file.
+
+    Param : module (ModuleDef), a module for which can_flatten(module) holds.
+    Param : options (EmitOptions), optimize and retime are applied, the inlining thresholds are
+            ignored.
+    Returns : file (string), binary, with the symbol table and a comment.
+    ------------------------------------------------------------------------------------------*/
+    EmitOptions flat = export_options(module, options);
+    vector<const ModuleDef*> kept;
+    Flattener flattener(module, flat, kept);
+    return flattener.render_aiger();
+}
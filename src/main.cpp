@@ -1,80 +1,512 @@
 #include <iostream>
 #include <verilog.h>
+#include <file_sink.h>
+#include <module_cache.h>
+#include <snapshot.h>
+#include <timing.h>
+#include <thread_pool.h>
 #include <stdio.h>
-#include <fstream> 
+#include <stdlib.h>
+#include <climits>
+#include <fstream>
+#include <sstream>
 #include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
 
 using namespace std;
 
-int generate_file(string file_name, string contents){
+static mutex print_lock;
+
+typedef struct{
+    string generator;
+    int n;
+    int k;
+    int period;
+    PrefixTopology topology;
+    ReductionSchedule schedule;
+} Config;
+
+typedef struct{
+    const char* name;
+    bool pipelined;
+    int prefix_width;
+    unique_ptr<Chip> (*build)(int n, int k, int period, PrefixTopology topology, ReductionSchedule schedule);
+} Generator;
+
+/*------------------------------------------------------------------------------------------
+The generators that can be selected with -g. Non pipelined generators ignore k and the clock
+period, pipelined generators ignore k when they are given a clock period. prefix_width is the
+width of the CLA inside in multiples of n, 0 for the generators without one, they ignore the
+prefix topology. Only wtm has a reduction schedule.
+------------------------------------------------------------------------------------------*/
+static const Generator generators[] = {
+    {"wtm", true, 2, [](int n, int k, int period, PrefixTopology topology, ReductionSchedule schedule) -> unique_ptr<Chip>{
+        return unique_ptr<Chip>(new WALLACE_TREE_MULTIPLIER_PIPELINED("Sample Adder", {"input_1", "input_2", "clk"}, "outputs", n, k, period, topology, schedule));
+    }},
+    {"cla_pipelined", true, 1, [](int n, int k, int period, PrefixTopology topology, ReductionSchedule) -> unique_ptr<Chip>{
+        return unique_ptr<Chip>(new CARRY_LOOK_AHEAD_ADDER_PIPELINED("Sample Adder", {"input_1", "input_2", "clk"}, "outputs", n, k, period, 0, topology));
+    }},
+    {"cla", false, 1, [](int n, int, int, PrefixTopology topology, ReductionSchedule) -> unique_ptr<Chip>{
+        return unique_ptr<Chip>(new CARRY_LOOK_AHEAD_ADDER("Sample Adder", {"input_1", "input_2"}, "outputs", n, topology));
+    }},
+    {"cra", false, 0, [](int n, int, int, PrefixTopology, ReductionSchedule) -> unique_ptr<Chip>{
+        return unique_ptr<Chip>(new CARRY_RIPPLE_ADDER("Sample Adder", {"input_1", "input_2"}, "outputs", n));
+    }},
+    {"csa", false, 0, [](int n, int, int, PrefixTopology, ReductionSchedule) -> unique_ptr<Chip>{
+        return unique_ptr<Chip>(new CARRY_SAVE_ADDER("Sample Adder", {"input_1", "input_2", "input_3"}, {"sum", "carry"}, n));
+    }},
+};
+
+static const Generator* find_generator(string name){
+    for(size_t i = 0; i < sizeof(generators)/sizeof(generators[0]); i++){
+        if(name == generators[i].name){
+            return &generators[i];
+        }
+    }
+    return NULL;
+}
+
+int generate_file(string file_name, Chip& chip, const EmitOptions& options){
     /*------------------------------------------------------------------------------------------
-    Writes/Rewrites the given contents to the given file. 
+    Writes/Rewrites the verilog code of the given chip to the given file. The code is streamed
+    module by module through a double buffered FileSink.
 
-    Param : file_name (string), file_name of the output file.
-    Param : contents (string), contents of the file to be written.
+    Param : file_name (string), file_name of the output file. Files ending in .blif and .aig get
+            the BLIF and AIGER netlist instead.
+    Param : chip (Chip), the top level chip to be written.
+    Param : options (EmitOptions), example a flattened netlist.
 
     Return : 1 if successful, 0 if not.
     ------------------------------------------------------------------------------------------*/
-    ofstream fout; 
-    fout.open(file_name);
-    if(fout){
-        fout << contents << endl; 
-        fout.close();
-        cout<<"[INFO] Code "<<file_name<<" written successfully!"<<endl;
-    }
-    else{
-        cout<<"[ERROR] Unable to write file!"<<endl;
+    FileSink fout(file_name);
+    size_t joins_removed = 0;
+    if(fout.is_open() && file_name.size() > 5 && file_name.substr(file_name.size() - 5) == ".blif"){
+        chip.write_blif(fout, options);
+    }
+    else if(fout.is_open() && file_name.size() > 4 && file_name.substr(file_name.size() - 4) == ".aig"){
+        chip.write_aiger(fout, options);
+    }
+    else if(fout.is_open()){
+        joins_removed = chip.write_verilog(fout, options);
+        fout << endl;
+    }
+    lock_guard<mutex> guard(print_lock);
+    if(!fout.is_open() || !fout.close()){
+        cout<<"[ERROR] Unable to write file "<<file_name<<"!"<<endl;
         return 0;
-    } 
+    }
+    cout<<"[INFO] Code "<<file_name<<" written successfully!"<<endl;
+    if(options.eliminate_joins && !options.flatten && file_name.substr(file_name.size() - 2) == ".v"){
+        cout<<"[INFO] "<<joins_removed<<" JOIN instances removed from "<<file_name<<endl;
+    }
     return 1;
 }
 
+int save_snapshot(string file_name, Chip& chip){
+    /*------------------------------------------------------------------------------------------
+    Saves the elaborated chip next to its verilog file, example generated_codes/wtm_64_bits_k_4.snap
+
+    Param : file_name (string), file_name of the verilog file.
+    Param : chip (Chip), the top level chip.
+
+    Return : 1 if successful, 0 if not.
+    ------------------------------------------------------------------------------------------*/
+    file_name = file_name.substr(0, file_name.size() - 2) + ".snap";
+    bool saved = Snapshot::save(file_name, *chip.module_def());
+    lock_guard<mutex> guard(print_lock);
+    if(!saved){
+        cout<<"[ERROR] Unable to write file "<<file_name<<"!"<<endl;
+        return 0;
+    }
+    cout<<"[INFO] Snapshot "<<file_name<<" written successfully!"<<endl;
+    return 1;
+}
+
+string file_name(const Config& config, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Output file of a configuration. Example : generated_codes/wtm_64_bits_k_4.v,
+    generated_codes/wtm_64_bits_period_30.v for a clock period, or
+    generated_codes/wtm_64_bits_k_4_sklansky.v for a prefix topology other than Kogge-Stone, or
+    generated_codes/wtm_64_bits_k_4_dadda.v for the Dadda schedule, or
+    generated_codes/wtm_64_bits_k_4_nojoin.v without JOIN instances, or
+    generated_codes/wtm_64_bits_k_4_flat.v when flattened,
+    generated_codes/wtm_64_bits_k_4_flat_depth_2.v or _flat_size_1000.v when partially flattened and
+    generated_codes/wtm_64_bits_k_4_flat_opt.v when optimized and
+    generated_codes/wtm_64_bits_k_4_flat_opt_retimed.v when retimed.
+    ------------------------------------------------------------------------------------------*/
+    string name = "generated_codes/" + config.generator + "_" + to_string(config.n) + "_bits";
+    if(find_generator(config.generator)->pipelined && config.period > 0){
+        name += "_period_" + to_string(config.period);
+    }
+    else if(find_generator(config.generator)->pipelined){
+        name += "_k_" + to_string(config.k);
+    }
+    if(config.topology != PrefixTopology::KOGGE_STONE){
+        name += "_" + string(prefix_info(config.topology).name);
+    }
+    if(config.schedule == ReductionSchedule::DADDA){
+        name += "_dadda";
+    }
+    if(options.eliminate_joins && !options.flatten){
+        name += "_nojoin";
+    }
+    if(options.flatten){
+        name += "_flat";
+    }
+    if(options.flatten && options.max_depth != INT_MAX){
+        name += "_depth_" + to_string(options.max_depth);
+    }
+    if(options.flatten && options.max_instances != LLONG_MAX){
+        name += "_size_" + to_string(options.max_instances);
+    }
+    if(options.optimize){
+        name += "_opt";
+    }
+    if(options.retime){
+        name += "_retimed";
+    }
+    return name + ".v";
+}
+
+bool parse_values(string text, vector<int>& values){
+    /*------------------------------------------------------------------------------------------
+    Parses a comma separated list of values and ranges.
+
+    Param : text (string), example "8,16,32", "1:4" (1, 2, 3, 4), "8:1024:*2" (8, 16, ... 1024)
+            or "4:16:4" (4, 8, 12, 16).
+    Param : values (vector<int>), parsed values are appended to it.
+    Returns : true if the text is valid.
+    ------------------------------------------------------------------------------------------*/
+    stringstream list(text);
+    string item;
+    while(getline(list, item, ',')){
+        vector<string> parts;
+        stringstream range(item);
+        string part;
+        while(getline(range, part, ':')){
+            parts.push_back(part);
+        }
+        try{
+            if(parts.size() == 1){
+                values.push_back(stoi(parts.at(0)));
+                continue;
+            }
+            if(parts.size() != 2 && parts.size() != 3){
+                return false;
+            }
+            int low = stoi(parts.at(0));
+            int high = stoi(parts.at(1));
+            bool multiply = parts.size() == 3 && parts.at(2).size() > 0 && parts.at(2).at(0) == '*';
+            int step = parts.size() == 3 ? stoi(multiply ? parts.at(2).substr(1) : parts.at(2)) : 1;
+            if(low < 1 || (multiply && step < 2) || (!multiply && step < 1)){
+                return false;
+            }
+            for(int value = low; value <= high; value = multiply ? value*step : value + step){
+                values.push_back(value);
+            }
+        }
+        catch(exception& e){
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+bool read_configs(string file_name, string generator, const vector<int>& periods, const vector<PrefixTopology>& topologies, vector<Config>& configs){
+    /*------------------------------------------------------------------------------------------
+    Reads configurations from a file, one "n [k [generator]]" per line. Lines starting with # are
+    comments, any other line that does not parse fails the whole file. Every line is generated for each of the clock periods (-p, k is then ignored) and
+    prefix topologies (-t) of the command line, as far as its generator has them.
+    ------------------------------------------------------------------------------------------*/
+    ifstream in(file_name);
+    if(!in.is_open()){
+        return false;
+    }
+    string line;
+    while(getline(in, line)){
+        stringstream fields(line);
+        Config config;
+        config.generator = generator;
+        config.k = 1;
+        config.period = 0;
+        config.topology = PrefixTopology::KOGGE_STONE;
+        config.schedule = ReductionSchedule::WALLACE;
+        size_t start = line.find_first_not_of(" \t\r");
+        if(start == string::npos || line.at(start) == '#'){
+            continue;
+        }
+        string k_field, extra;
+        if(!(fields >> config.n)){
+            return false;
+        }
+        if(fields >> k_field){
+            stringstream k_stream(k_field);
+            if(!(k_stream >> config.k) || !k_stream.eof()){
+                return false;
+            }
+            fields >> config.generator;
+        }
+        if(fields >> extra){
+            return false;
+        }
+        const Generator* builder = find_generator(config.generator);
+        if(builder == NULL){
+            return false;
+        }
+        vector<int> line_periods(1, 0);
+        if(builder->pipelined && !periods.empty()){
+            line_periods = periods;
+        }
+        vector<PrefixTopology> line_topologies(1, PrefixTopology::KOGGE_STONE);
+        if(builder->prefix_width > 0){
+            line_topologies = topologies;
+        }
+        for(vector<int>::iterator period = line_periods.begin(); period != line_periods.end(); period++){
+            for(vector<PrefixTopology>::iterator topology = line_topologies.begin(); topology != line_topologies.end(); topology++){
+                config.period = *period;
+                config.topology = *topology;
+                configs.push_back(config);
+            }
+        }
+    }
+    return true;
+}
+
 void invalid_args(char* name){
     /*------------------------------------------------------------------------------------------
     Displays the error message and usage format.
     ------------------------------------------------------------------------------------------*/
-    cout<<"Invalid arguments\n  Usage "<<name<<" [-n num_bits] [-k pipeline_steps] \n  Example: "<<name<<" -n 64 -k 4\n";
+    cout<<"Invalid arguments\n"
+        <<"  Usage "<<name<<" [-n num_bits] [-k pipeline_steps] [-p clock_period] [-g generator] [-t prefix_topology] [-f config_file] [-c cache_directory] [--stats] [--dadda] [--flat] [--flat-depth depth] [--flat-size instances] [--eliminate-joins] [--optimize] [--retime] [--snapshot] [--blif] [--aiger] [--timing] \n"
+        <<"  num_bits, pipeline_steps and clock_period can be lists and ranges like 8,16,32 or 1:4 or 8:1024:*2\n"
+        <<"  clock_period places the pipeline registers by delay (constants.h units) instead of every k levels\n"
+        <<"  generator is one of wtm (default), cla_pipelined, cla, cra and csa\n"
+        <<"  prefix_topology is a list of kogge_stone (default), sklansky, brent_kung, han_carlson, ladner_fischer\n"
+        <<"  and sparse, the prefix network of the CLA in cla, cla_pipelined and wtm\n"
+        <<"  config_file has one \"num_bits pipeline_steps [generator]\" per line, -p and -t apply to every line\n"
+        <<"  --stats prints the elaboration counters and phase times of the whole run, all configurations together\n"
+        <<"  --dadda reduces the wtm partial products with the Dadda schedule instead of rows of three\n"
+        <<"  --flat writes a single flat module, --flat-depth and --flat-size only inline smaller modules\n"
+        <<"  --eliminate-joins merges the nets tied by JOIN instances and drops the instances\n"
+        <<"  --optimize writes a flat module with the constants propagated and the dead logic removed\n"
+        <<"  --retime also moves the flipflops across the gates for the shortest clock period, same latency\n"
+        <<"  --snapshot also saves the elaborated design as a binary snapshot (.snap), see snapshot.h\n"
+        <<"  --blif and --aiger also write the flat gate netlist as .blif and binary AIGER (.aig)\n"
+        <<"  --timing prints the worst path of every pipeline stage, the clock period and the latency\n"
+        <<"  Example: "<<name<<" -n 64 -k 4\n"
+        <<"  Example: "<<name<<" -n 8:1024:*2 -k 1:4 -g wtm\n"
+        <<"  Example: "<<name<<" -n 64 -g cla -t kogge_stone,brent_kung,sparse\n";
 }
 
 int main(int argc, char * argv[]){
     /*------------------------------------------------------------------------------------------
     Input Validation
     ------------------------------------------------------------------------------------------*/
-    if(argc != 5){
+    string n_str, k_str = "1", period_str, topology_str, generator = "wtm", config_file, cache_directory;
+    bool show_stats = false, snapshot = false, blif = false, aiger = false, timing = false, dadda = false;
+    EmitOptions options;
+    for(int i = 1; i < argc; i += 2){
+        if(!strcmp(argv[i], "--stats") || !strcmp(argv[i], "--flat") || !strcmp(argv[i], "--eliminate-joins") || !strcmp(argv[i], "--optimize") || !strcmp(argv[i], "--retime") || !strcmp(argv[i], "--snapshot")
+            || !strcmp(argv[i], "--blif") || !strcmp(argv[i], "--aiger") || !strcmp(argv[i], "--timing") || !strcmp(argv[i], "--dadda")){
+            show_stats |= !strcmp(argv[i], "--stats");
+            snapshot |= !strcmp(argv[i], "--snapshot");
+            blif |= !strcmp(argv[i], "--blif");
+            aiger |= !strcmp(argv[i], "--aiger");
+            timing |= !strcmp(argv[i], "--timing");
+            dadda |= !strcmp(argv[i], "--dadda");
+            options.flatten |= !strcmp(argv[i], "--flat");
+            options.eliminate_joins |= !strcmp(argv[i], "--eliminate-joins");
+            options.retime |= !strcmp(argv[i], "--retime");
+            options.optimize |= !strcmp(argv[i], "--optimize") || options.retime;
+            options.flatten |= options.optimize;
+            i--;
+        }
+        else if(i + 1 >= argc){
+            invalid_args(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else if(!strcmp(argv[i], "-n")) n_str = argv[i + 1];
+        else if(!strcmp(argv[i], "-k")) k_str = argv[i + 1];
+        else if(!strcmp(argv[i], "-p")) period_str = argv[i + 1];
+        else if(!strcmp(argv[i], "-g")) generator = argv[i + 1];
+        else if(!strcmp(argv[i], "-t")) topology_str = argv[i + 1];
+        else if(!strcmp(argv[i], "-f")) config_file = argv[i + 1];
+        else if(!strcmp(argv[i], "-c")) cache_directory = argv[i + 1];
+        else if(!strcmp(argv[i], "--flat-depth") || !strcmp(argv[i], "--flat-size")){
+            try{
+                if(!strcmp(argv[i], "--flat-depth")) options.max_depth = stoi(argv[i + 1]);
+                else options.max_instances = stoll(argv[i + 1]);
+            }
+            catch(exception& e){
+                invalid_args(argv[0]);
+                return EXIT_FAILURE;
+            }
+            options.flatten = true;
+        }
+        else{
+            invalid_args(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(find_generator(generator) == NULL || (n_str.empty() && config_file.empty())){
         invalid_args(argv[0]);
-        return 0;
+        return EXIT_FAILURE;
     }
 
-    if(strcmp(argv[1], "-n") || strcmp(argv[3], "-k")){
+    /*------------------------------------------------------------------------------------------
+    The prefix topologies, a comma separated list of names.
+    ------------------------------------------------------------------------------------------*/
+    vector<PrefixTopology> topologies;
+    stringstream topology_list(topology_str);
+    string topology_name;
+    while(getline(topology_list, topology_name, ',')){
+        PrefixTopology topology;
+        if(!parse_prefix_topology(topology_name, &topology)){
+            invalid_args(argv[0]);
+            return EXIT_FAILURE;
+        }
+        topologies.push_back(topology);
+    }
+    if(topologies.empty()){
+        topologies.assign(1, PrefixTopology::KOGGE_STONE);
+    }
+    vector<int> periods;
+    if(!period_str.empty() && !parse_values(period_str, periods)){
         invalid_args(argv[0]);
-        return 0;
+        return EXIT_FAILURE;
     }
 
-    string n_str = argv[2];
-    string k_str = argv[4];
-    int n, k;
-    try{
-        n = stoi(n_str);
-        k = stoi(k_str);
+    /*------------------------------------------------------------------------------------------
+    Every combination of the given sizes, pipeline steps (or clock periods) and prefix topologies
+    is one configuration. Non pipelined generators only get one configuration per size and
+    topology.
+    ------------------------------------------------------------------------------------------*/
+    vector<Config> configs;
+    if(!n_str.empty()){
+        vector<int> n_values, k_values, period_values = periods;
+        vector<PrefixTopology> n_topologies = topologies;
+        if(!parse_values(n_str, n_values) || !parse_values(k_str, k_values)){
+            invalid_args(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if(!period_values.empty()){
+            k_values.resize(1);
+        }
+        else{
+            period_values.push_back(0);
+        }
+        if(!find_generator(generator)->pipelined){
+            k_values.resize(1);
+            period_values.assign(1, 0);
+        }
+        if(find_generator(generator)->prefix_width == 0){
+            n_topologies.assign(1, PrefixTopology::KOGGE_STONE);
+        }
+        for(vector<int>::iterator n = n_values.begin(); n != n_values.end(); n++){
+            for(vector<int>::iterator k = k_values.begin(); k != k_values.end(); k++){
+                for(vector<int>::iterator period = period_values.begin(); period != period_values.end(); period++){
+                    for(vector<PrefixTopology>::iterator topology = n_topologies.begin(); topology != n_topologies.end(); topology++){
+                        configs.push_back({generator, *n, *k, *period, *topology, ReductionSchedule::WALLACE});
+                    }
+                }
+            }
+        }
     }
-    catch(exception e){
-        invalid_args(argv[0]);
-        return 0;
+    if(!config_file.empty() && !read_configs(config_file, generator, periods, topologies, configs)){
+        cout<<"[ERROR] Unable to read the configuration file "<<config_file<<endl;
+        return EXIT_FAILURE;
+    }
+    for(vector<Config>::iterator config = configs.begin(); config != configs.end(); config++){
+        if(dadda && config->generator == "wtm"){
+            config->schedule = ReductionSchedule::DADDA;
+        }
     }
 
     /*------------------------------------------------------------------------------------------
-    Create instances of the chips.
+    The optional module cache. Modules generated by an earlier run are loaded from it instead of
+    being elaborated again.
     ------------------------------------------------------------------------------------------*/
-    WALLACE_TREE_MULTIPLIER_PIPELINED wtm("Sample Adder",
-                                         {"input_1", "input_2", "clk"},
-                                         "outputs",
-                                         n, k);
+    if(!cache_directory.empty() && !ModuleCache::global().open(cache_directory)){
+        cout<<"[ERROR] Unable to open the cache directory "<<cache_directory<<endl;
+        return EXIT_FAILURE;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Cached modules are opaque, they carry no netlist to flatten. The passes that need the netlist
+    elaborate every module.
+    ------------------------------------------------------------------------------------------*/
+    bool needs_netlist = options.flatten || options.eliminate_joins || snapshot || blif || aiger || timing;
+    if(needs_netlist && ModuleCache::global().enabled()){
+        ModuleCache::global().close();
+        cout<<"[INFO] Module cache skipped, the requested passes need the netlist of every module."<<endl;
+    }
 
+    /*------------------------------------------------------------------------------------------
+    Create the chips and write them to files. File save location ./generated_codes/
+
+    The configurations are generated concurrently on the thread pool. They share the module
+    registry, so a CSA or CLA used by several configurations is elaborated only once. Each chip
+    is dropped once its file is written, only the shared module definitions are kept.
+    ------------------------------------------------------------------------------------------*/
+    vector<char> config_failed(configs.size(), 0);
+    ThreadPool::global().parallel_for(configs.size(), [&](size_t i){
+        const Config& config = configs.at(i);
+        bool written = true;
+        try{
+            const Generator* builder = find_generator(config.generator);
+            unique_ptr<Chip> chip = builder->build(config.n, config.k, config.period, config.topology, config.schedule);
+            written = generate_file(file_name(config, options), *chip, options) && written;
+            if(snapshot){
+                written = save_snapshot(file_name(config, EmitOptions()), *chip) && written;
+            }
+            string base = file_name(config, options);
+            base = base.substr(0, base.size() - 2);
+            if(blif){
+                written = generate_file(base + ".blif", *chip, options) && written;
+            }
+            if(aiger){
+                written = generate_file(base + ".aig", *chip, options) && written;
+            }
+            if(!topology_str.empty() && builder->prefix_width > 0){
+                int width = builder->prefix_width*config.n;
+                PrefixNetwork network = prefix_network(width, config.topology);
+                lock_guard<mutex> guard(print_lock);
+                cout<<"[INFO] "<<prefix_info(config.topology).name<<" prefix network, "<<width<<" bits: "<<network.partners.size()<<" levels, "
+                    <<network.depth<<" units, "<<network.stars<<" CLA stars, "<<network.transistors<<" transistors, fanout "<<network.max_fanout<<endl;
+            }
+            if(timing){
+                string report = analyze_timing(*chip->module_def()).report();
+                lock_guard<mutex> guard(print_lock);
+                cout<<report;
+            }
+        }
+        catch(exception& e){
+            lock_guard<mutex> guard(print_lock);
+            cout<<"[ERROR] "<<file_name(config, options)<<" : "<<e.what()<<endl;
+            written = false;
+        }
+        config_failed.at(i) = !written;
+    });
 
     /*------------------------------------------------------------------------------------------
-    Generate Verilog and write it to file. File save location ./generated_codes/
+    A configuration failed if any of its files failed, it is counted once.
     ------------------------------------------------------------------------------------------*/
-    generate_file("generated_codes/wtm_" + to_string(n) + "_bits_k_" + to_string(k) + ".v", wtm.generate_verilog());
-   
-    return 1;
+    size_t failed = 0;
+    for(vector<char>::iterator i = config_failed.begin(); i != config_failed.end(); i++){
+        failed += *i;
+    }
+    if(configs.size() > 1){
+        cout<<"[INFO] "<<configs.size() - failed<<" of "<<configs.size()<<" configurations written."<<endl;
+    }
+    if(ModuleCache::global().enabled()){
+        cout<<"[INFO] Module cache: "<<ModuleCache::global().hits()<<" hits, "<<ModuleCache::global().misses()<<" misses"<<endl;
+    }
+    if(show_stats){
+        cout<<Stats::global().snapshot().report();
+    }
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
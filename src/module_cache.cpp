@@ -0,0 +1,255 @@
+#include <module_cache.h>
+#include <verilog.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+uint64_t module_hash(const ModuleKey& key){
+    /*------------------------------------------------------------------------------------------
+    FNV-1a hash of the generator version and the module key.
+
+    Param : key (ModuleKey), generator and parameters of the module.
+    Returns : hash (uint64_t)
+    ------------------------------------------------------------------------------------------*/
+    string text = to_string(GENERATOR_VERSION) + " " + key.generator;
+    for(vector<int>::const_iterator i = key.params.begin(); i != key.params.end(); i++){
+        text += " " + to_string(*i);
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    for(string::iterator i = text.begin(); i != text.end(); i++){
+        hash ^= (unsigned char)*i;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void write_key(ostream& out, const ModuleKey& key){
+    out << key.generator << " " << key.params.size();
+    for(vector<int>::const_iterator i = key.params.begin(); i != key.params.end(); i++){
+        out << " " << *i;
+    }
+    out << "\n";
+}
+
+static bool read_key(istream& in, ModuleKey& key){
+    size_t count;
+    if(!(in >> key.generator >> count)){
+        return false;
+    }
+    key.params.clear();
+    for(size_t i = 0; i < count; i++){
+        int param;
+        if(!(in >> param)){
+            return false;
+        }
+        key.params.push_back(param);
+    }
+    return true;
+}
+
+ModuleCache::ModuleCache(){
+    this->active = false;
+    this->hit_count = 0;
+    this->miss_count = 0;
+}
+
+ModuleCache& ModuleCache::global(){
+    /*------------------------------------------------------------------------------------------
+    Returns the shared cache. It starts enabled if DOTV_CACHE is set.
+    ------------------------------------------------------------------------------------------*/
+    static ModuleCache cache;
+    static bool from_env = [](){
+        const char* env = getenv("DOTV_CACHE");
+        if(env != NULL && env[0] != '\0'){
+            cache.open(env);
+        }
+        return true;
+    }();
+    (void)from_env;
+    return cache;
+}
+
+bool ModuleCache::open(string directory){
+    /*------------------------------------------------------------------------------------------
+    Enables the cache in the given directory, creating it if needed.
+
+    Param : directory (string), the cache directory.
+    Returns : true if the directory is usable.
+    ------------------------------------------------------------------------------------------*/
+    mkdir(directory.c_str(), 0755);
+    struct stat info;
+    if(stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)){
+        this->active = false;
+        return false;
+    }
+    this->directory = directory;
+    this->active = true;
+    return true;
+}
+
+void ModuleCache::close(){
+    this->active = false;
+}
+
+bool ModuleCache::enabled() const{
+    return this->active;
+}
+
+size_t ModuleCache::hits() const{
+    return this->hit_count;
+}
+
+size_t ModuleCache::misses() const{
+    return this->miss_count;
+}
+
+string ModuleCache::path(const ModuleKey& key) const{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.dotv", (unsigned long long)module_hash(key));
+    return this->directory + "/" + name;
+}
+
+shared_ptr<const ModuleDef> ModuleCache::load(const ModuleKey& key){
+    /*------------------------------------------------------------------------------------------
+    Looks the module up in the cache. On a hit the module is registered, after all of its depen-
+    dencies (taken from the registry, or loaded from the cache as well). A truncated or damaged
+    entry is a miss and is removed, so the next write_verilog(...) stores it again.
+
+    Param : key (ModuleKey), generator and parameters of the module.
+    Returns : module (shared_ptr<const ModuleDef>), the registered module, or nullptr on a miss.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->active){
+        return nullptr;
+    }
+    ifstream in(this->path(key), ios::binary);
+    if(!in.is_open()){
+        this->miss_count++;
+        return nullptr;
+    }
+
+    string tag;
+    int version;
+    ModuleKey stored_key;
+    in >> tag >> version >> tag;
+    if(!in || version != GENERATOR_VERSION || !read_key(in, stored_key)){
+        remove(this->path(key).c_str());
+        this->miss_count++;
+        return nullptr;
+    }
+    if(!(stored_key == key)){
+        this->miss_count++;
+        return nullptr;
+    }
+
+    shared_ptr<ModuleDef> module = make_shared<ModuleDef>();
+    module->key = key;
+    module->from_cache = true;
+
+    int op;
+    size_t count;
+    in >> tag >> module->name;
+    in >> tag >> op >> module->width;
+    in >> tag >> module->transistors >> module->total_transistors >> module->total_instances >> module->depth;
+    module->op = (Op)op;
+
+    in >> tag >> count;
+    for(size_t i = 0; in && i < count; i++){
+        int type, width;
+        string name;
+        in >> type >> width >> name;
+        module->ports.push_back({wire(name, width), type});
+    }
+
+    in >> tag >> count;
+    for(size_t i = 0; in && i < count; i++){
+        ModuleKey dependency;
+        if(!read_key(in, dependency)){
+            break;
+        }
+        shared_ptr<const ModuleDef> found = ModuleRegistry::global().find(dependency);
+        if(!found){
+            found = this->load(dependency);
+        }
+        if(!found){
+            this->miss_count++;
+            return nullptr;
+        }
+        module->dependencies.push_back(found.get());
+    }
+
+    size_t size = 0;
+    in >> tag >> size;
+    in.get();
+    if(in){
+        module->definition.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    if(!in || tag != "text" || module->definition.size() != size){
+        remove(this->path(key).c_str());
+        this->miss_count++;
+        return nullptr;
+    }
+
+    this->hit_count++;
+    return ModuleRegistry::global().insert(key, module);
+}
+
+bool ModuleCache::store(const ModuleDef& module, const string& text){
+    /*------------------------------------------------------------------------------------------
+    Writes the cache entry of one module, unless it is already there. The entry is written to a
+    temporary file first and renamed, so concurrent writers never leave a partial entry.
+
+    Param : module (ModuleDef), an interned module.
+    Param : text (string), its verilog definition.
+    Returns : true if the entry was written.
+    ------------------------------------------------------------------------------------------*/
+    if(!this->active || module.from_cache || module.key.generator.empty()){
+        return false;
+    }
+    if(module.key.generator.find_first_of(" \t\n") != string::npos){
+        return false;
+    }
+    string file_name = this->path(module.key);
+    struct stat info;
+    if(stat(file_name.c_str(), &info) == 0){
+        return false;
+    }
+
+    ostringstream out;
+    out << "dotv-module-cache " << GENERATOR_VERSION << "\n";
+    out << "key ";
+    write_key(out, module.key);
+    out << "name " << module.name << "\n";
+    out << "op " << (int)module.op << " " << module.width << "\n";
+    out << "transistors " << module.transistors << " " << module.total_transistors << " "
+        << module.total_instances << " " << module.depth << "\n";
+    out << "ports " << module.ports.size() << "\n";
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        out << i->type << " " << i->net.width() << " " << i->net.name() << "\n";
+    }
+    out << "dependencies " << module.dependencies.size() << "\n";
+    for(vector<const ModuleDef*>::const_iterator i = module.dependencies.begin(); i != module.dependencies.end(); i++){
+        write_key(out, (*i)->key);
+    }
+    out << "text " << text.size() << "\n" << text;
+
+    string temp_name = file_name + ".tmp." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id()));
+    ofstream file(temp_name, ios::binary);
+    file << out.str();
+    file.close();
+    if(!file || rename(temp_name.c_str(), file_name.c_str()) != 0){
+        remove(temp_name.c_str());
+        return false;
+    }
+    return true;
+}
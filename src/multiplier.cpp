@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <stdio.h>
 #include <bits/stdc++.h> 
+#include <thread_pool.h>
+#include <stats.h>
 
 using namespace std;
 
@@ -19,7 +21,10 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
                                                                     vector<wire> input_wires,
                                                                     wire output_wire,
                                                                     int n_bits,
-                                                                    int pipeline_k){
+                                                                    int pipeline_k,
+                                                                    int clock_period,
+                                                                    PrefixTopology topology,
+                                                                    ReductionSchedule schedule){
 
     /*------------------------------------------------------------------------------------------
     First we do the basic setups and input/output declaration.
@@ -29,10 +34,20 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
         CLK : 1 bit clock
         P : 2 x n_bit output product
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
     this->n_bits = n_bits;
+    vector<int> key = clock_period > 0 ? vector<int>{n_bits, 0, clock_period} : vector<int>{n_bits, pipeline_k};
+    if(topology != PrefixTopology::KOGGE_STONE || schedule != ReductionSchedule::WALLACE){
+        key.push_back((int)topology);
+        key.push_back((int)schedule);
+    }
+    if(this->reuse_module({"WALLACE_TREE_MULTIPLIER_PIPELINED", key})) return;
+    if(clock_period < 0 || (clock_period == 0 && pipeline_k < 1)){
+        throw invalid_argument("Wallace tree multiplier needs pipeline_k >= 1 or a positive clock period.");
+    }
 
     this->declare("A", CHIP_INPUTS);
     this->declare("B", CHIP_INPUTS);
@@ -56,18 +71,23 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
     ------------------------------------------------------------------------------------------*/
     vector<WALLACE_TREE_MULTIPLIER_PIPELINED::CutWire> partial_products;
 
-    for(int n=0; n<n_bits; n++){
+    wire A = "A";
+    wire B = "B";
+    partial_products.resize(n_bits);
+    vector<Chip> parts(n_bits);
+    ThreadPool::global().parallel_for(n_bits, [&](size_t row){
         /*------------------------------------------------------------------------------------------
-        For each bit compute the initial partial products and append it to the partial products 
-        vector.
+        For each bit compute the initial partial products and put it in the partial products vector.
+        The rows are independent, so they are wired into separate parts on the thread pool.
         ------------------------------------------------------------------------------------------*/
-        wire partial_product = "WTM_PP_0_" + to_string(n);
-        this->add_wire("[" + to_string(n_bits - 1) + ":0] " + partial_product);
+        int n = row;
+        wire partial_product("WTM_PP_0_" + to_string(n), n_bits);
+        parts.at(n).add_wire(partial_product);
         for(int i=0; i <n_bits; i++){
             AND curr_and("WTM_PP_AND_" + to_string(n) + "_" + to_string(i),
-                        {"A[" + to_string(i) + "]", "B[" + to_string(n) + "]"},
-                        partial_product + "[" + to_string(i) + "]");
-            this->add_submodule(curr_and);
+                        {A[i], B[n]},
+                        partial_product[i]);
+            parts.at(n).add_submodule(curr_and);
         }
 
         WALLACE_TREE_MULTIPLIER_PIPELINED::CutWire current_cutwire;
@@ -75,7 +95,28 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
         current_cutwire.shift = n;
         current_cutwire.length= n_bits;
 
-        partial_products.push_back(current_cutwire);
+        partial_products.at(n) = current_cutwire;
+    });
+    for(int n=0; n<n_bits; n++){
+        this->merge(parts.at(n));
+    }
+
+    /*------------------------------------------------------------------------------------------
+    With a clock period, the levels to register after and the arrival time at the final CLA are
+    planned up front, see WALLACE_TREE_MULTIPLIER_PIPELINED::plan_registers(...).
+    ------------------------------------------------------------------------------------------*/
+    vector<bool> planned_registers;
+    int cla_delay = 0;
+    if(clock_period > 0){
+        cla_delay = plan_registers(partial_products, clock_period, &planned_registers, topology, schedule);
+    }
+
+    /*------------------------------------------------------------------------------------------
+    The Dadda schedule reduces the columns down to two rows, the loop below is then skipped. See
+    WALLACE_TREE_MULTIPLIER_PIPELINED::make_dadda(...).
+    ------------------------------------------------------------------------------------------*/
+    if(schedule == ReductionSchedule::DADDA){
+        partial_products = this->make_dadda(partial_products, pipeline_k, clock_period, planned_registers);
     }
 
     int current_level = 1;
@@ -94,24 +135,32 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
         
         See WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(...) for mode details.
         ------------------------------------------------------------------------------------------*/
-        for(int i=0; i < partial_products.size()/3; i++){
-            
-            WALLACE_TREE_MULTIPLIER_PIPELINED::CutWire o1, o2;
+        int groups = partial_products.size()/3;
+        vector<WALLACE_TREE_MULTIPLIER_PIPELINED::CutWire> group_outputs(2*groups);
+        vector<Chip> group_parts(groups);
+        ThreadPool::global().parallel_for(groups, [&](size_t i){
             make_csa("WTM_LEVEL_" + to_string(current_level) + "_GROUP_" + to_string(i),
                     partial_products.at(i*3),
                     partial_products.at(i*3+1),
                     partial_products.at(i*3+2),
-                    &o1, &o2);
-            
-            next_level_partial_products.push_back(o1);
-            next_level_partial_products.push_back(o2);
+                    &group_outputs.at(2*i), &group_outputs.at(2*i+1),
+                    &group_parts.at(i));
+        });
+
+        /*------------------------------------------------------------------------------------------
+        The groups are merged back in order, so the result does not depend on the thread count.
+        ------------------------------------------------------------------------------------------*/
+        for(int i=0; i < groups; i++){
+            this->merge(group_parts.at(i));
+            next_level_partial_products.push_back(group_outputs.at(2*i));
+            next_level_partial_products.push_back(group_outputs.at(2*i+1));
         }
 
         /*------------------------------------------------------------------------------------------
         If there were any left over partial products (not included in any groups of 3), we just add
         them to the next level.
         ------------------------------------------------------------------------------------------*/
-        for(int i=(partial_products.size()/3)*3; i<partial_products.size(); i++){
+        for(size_t i=(partial_products.size()/3)*3; i<partial_products.size(); i++){
             next_level_partial_products.push_back(partial_products.at(i));
         }
 
@@ -123,19 +172,24 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
 
 
         /*------------------------------------------------------------------------------------------
-        If current level is a multiple of k, pass the partial products through a FlipFlop
+        If current level is a multiple of k (or planned), pass the partial products through a FlipFlop
         ------------------------------------------------------------------------------------------*/        
-        if(current_level != 0 && current_level%pipeline_k==0){
-            for(int i=0; i< partial_products.size(); i++){
-                wire curr_output_wire = "WTM_LEVEL_" + to_string(current_level) + "_FLIP_FLOP_" + to_string(i) + "_WIRE";
-                this->add_wire("[" + to_string(partial_products.at(i).length - 1) + ":0] " + curr_output_wire);
+        bool register_level = clock_period > 0 ? planned_registers.at(current_level) : current_level%pipeline_k==0;
+        if(current_level != 0 && register_level){
+            vector<Chip> stage_parts(partial_products.size());
+            ThreadPool::global().parallel_for(partial_products.size(), [&](size_t i){
+                wire curr_output_wire("WTM_LEVEL_" + to_string(current_level) + "_FLIP_FLOP_" + to_string(i) + "_WIRE", partial_products.at(i).length);
+                stage_parts.at(i).add_wire(curr_output_wire);
                 
                 FLIP_FLOP_N_BIT curr_flipflop("WTM_LEVEL_" + to_string(current_level) + "_FLIP_FLOP_" + to_string(i),
                                              {partial_products.at(i).wire_id , "CLK"},
                                              curr_output_wire, partial_products.at(i).length);
                 
                 partial_products.at(i).wire_id = curr_output_wire;
-                this->add_submodule(curr_flipflop);               
+                stage_parts.at(i).add_submodule(curr_flipflop);               
+            });
+            for(size_t i=0; i< partial_products.size(); i++){
+                this->merge(stage_parts.at(i));
             }
         }
 
@@ -150,42 +204,42 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
     final_cut_1 = partial_products.at(0);
     final_cut_2 = partial_products.at(1);
 
-    wire final_1 = "WTM_FINAL_1";
-    wire final_2 = "WTM_FINAL_2";
+    wire final_1("WTM_FINAL_1", 2*this->n_bits);
+    wire final_2("WTM_FINAL_2", 2*this->n_bits);
 
-    this->add_wire("[" + to_string(2*this->n_bits - 1) + ":0]" + final_1);
-    this->add_wire("[" + to_string(2*this->n_bits - 1) + ":0]" + final_2);
+    this->add_wire(final_1);
+    this->add_wire(final_2);
 
     /*------------------------------------------------------------------------------------------
     Pad zeros as needed to the Least Significant Bits.
     ------------------------------------------------------------------------------------------*/ 
     if(final_cut_1.shift > 0){
-        this->verilog("assign " + final_1 + "[" + to_string(final_cut_1.shift - 1) + ":0] = 0;" );
+        this->assign(final_1.slice(final_cut_1.shift - 1, 0), 0);
     }
     if(final_cut_2.shift > 0){
-        this->verilog("assign " + final_2 + "[" + to_string(final_cut_2.shift - 1) + ":0] = 0;" );
+        this->assign(final_2.slice(final_cut_2.shift - 1, 0), 0);
     }
 
     /*------------------------------------------------------------------------------------------
     Pad zeros as needed to the Most Significant Bits.
     ------------------------------------------------------------------------------------------*/ 
     if(final_cut_1.length < 2*n_bits){
-        this->verilog("assign " + final_1 + "[" + to_string(2*n_bits - 1) + ":" + to_string(final_cut_1.length) + "] = 0;");
+        this->assign(final_1.slice(2*n_bits - 1, final_cut_1.length), 0);
     }
     if(final_cut_2.length < 2*n_bits){
-        this->verilog("assign " + final_2 + "[" + to_string(2*n_bits - 1) + ":" + to_string(final_cut_2.length) + "] = 0;");
+        this->assign(final_2.slice(2*n_bits - 1, final_cut_2.length), 0);
     }
     
     /*------------------------------------------------------------------------------------------
     Join the new wires to the partial products wire.
     ------------------------------------------------------------------------------------------*/ 
     JOIN_N_BIT joint_1("WTM_FINAL_JOINT_1",
-                       final_1 + "["+ to_string(min(final_cut_1.length + final_cut_1.shift - 1, 2*n_bits -1)) + ":" + to_string(final_cut_1.shift) + "]",
-                       final_cut_1.wire_id + "[" + to_string(min(final_cut_1.length, 2*n_bits) -1)  + ":0]", min(final_cut_1.length, 2*n_bits));
+                       final_1.slice(min(final_cut_1.length + final_cut_1.shift - 1, 2*n_bits -1), final_cut_1.shift),
+                       final_cut_1.wire_id.slice(min(final_cut_1.length, 2*n_bits) -1, 0), min(final_cut_1.length, 2*n_bits));
 
     JOIN_N_BIT joint_2("WTM_FINAL_JOINT_2",
-                       final_2 + "["+ to_string(min(final_cut_2.length + final_cut_2.shift - 1, 2*n_bits -1)) + ":" + to_string(final_cut_2.shift) + "]",
-                       final_cut_2.wire_id + "[" + to_string(min(final_cut_2.length, 2*n_bits) -1)  + ":0]", min(final_cut_2.length, 2*n_bits));
+                       final_2.slice(min(final_cut_2.length + final_cut_2.shift - 1, 2*n_bits -1), final_cut_2.shift),
+                       final_cut_2.wire_id.slice(min(final_cut_2.length, 2*n_bits) -1, 0), min(final_cut_2.length, 2*n_bits));
 
     
     /*------------------------------------------------------------------------------------------
@@ -195,7 +249,7 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
     CARRY_LOOK_AHEAD_ADDER_PIPELINED final_cla("WTM_CLA",
                                     {final_1, final_2, "CLK"},
                                     "P",
-                                    2*n_bits, pipeline_k);
+                                    2*n_bits, pipeline_k, clock_period, cla_delay, topology);
 
     this->add_submodule(joint_1);
     this->add_submodule(joint_2);   
@@ -203,21 +257,324 @@ WALLACE_TREE_MULTIPLIER_PIPELINED::WALLACE_TREE_MULTIPLIER_PIPELINED(string name
 
 
     /*------------------------------------------------------------------------------------------
-    Now we use the auto_gen function to create the module definition.
+    Now we use the lazy_gen function to create the module definition.
     ------------------------------------------------------------------------------------------*/ 
-    this->definition = this->auto_gen("module WALLACE_TREE_MULTIPLIER_" + to_string(n_bits) + "_BIT");
-    this->generate = "WALLACE_TREE_MULTIPLIER_" + to_string(n_bits) + "_BIT " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
+    string suffix = string(prefix_info(topology).suffix) + (schedule == ReductionSchedule::DADDA ? "_DADDA" : "");
+    if(clock_period > 0){
+        this->lazy_gen("module WALLACE_TREE_MULTIPLIER_" + to_string(n_bits) + "_BIT_PERIOD_" + to_string(clock_period) + suffix);
+        return;
+    }
+    this->lazy_gen("module WALLACE_TREE_MULTIPLIER_" + to_string(n_bits) + "_BIT" + suffix);
+}
+
+
+int WALLACE_TREE_MULTIPLIER_PIPELINED::plan_registers(vector<CutWire> partial_products, int clock_period, vector<bool> *registers, PrefixTopology topology, ReductionSchedule schedule){
+    /*------------------------------------------------------------------------------------------
+    Places the register stages of the carry save levels and the final CLA by delay.
+
+    The partial products take an AND_DELAY, every carry save level a FULL_ADDER_DELAY. A stage
+    can be closed after any level, and a register stage after level L costs the bits of all the
+    partial products left after L. The levels are a chain, so the cheapest placement is found by
+    a small dynamic program over the last register stage: best[L] is the (stages, register bits)
+    of the cheapest placement closing a stage after level L. The final CLA starts with what is
+    left of the last stage, see CARRY_LOOK_AHEAD_ADDER_PIPELINED::plan_registers(...).
+
+    Param: partial_products (vector<CutWire>), the first partial products, only the shifts and
+           lengths are used.
+    Param: clock_period (int), the period every stage has to meet.
+    Param: registers (&vector<bool>), (*registers)[L] is set for a register stage after level L.
+    Param: topology (PrefixTopology), the prefix network of the final CLA.
+    Param: schedule (ReductionSchedule), the reduction of the partial products.
+    Returns : The arrival time at the inputs of the final CLA.
+    ------------------------------------------------------------------------------------------*/
+
+    /*------------------------------------------------------------------------------------------
+    Replay the grouping of the levels on the shapes alone, see make_csa(...) and dadda_level(...).
+    ------------------------------------------------------------------------------------------*/
+    int n_bits = partial_products.size();
+    vector<long long> level_bits(1, 0);
+    vector<int> heights(2*n_bits, 0);
+    for(vector<CutWire>::iterator row = partial_products.begin(); row != partial_products.end(); row++){
+        for(int i = 0; i < row->length; i++){
+            heights.at(row->shift + i)++;
+        }
+    }
+    while(schedule == ReductionSchedule::DADDA && *max_element(heights.begin(), heights.end()) > 2){
+        vector<int> full_adders, half_adders;
+        heights = dadda_level(heights, &full_adders, &half_adders);
+        level_bits.push_back(accumulate(heights.begin(), heights.end(), 0LL));
+    }
+    while(schedule == ReductionSchedule::WALLACE && partial_products.size() > 2){
+        vector<CutWire> next_level;
+        for(size_t i = 0; i + 2 < partial_products.size(); i += 3){
+            vector<int> lengths;
+            CutWire out;
+            out.shift = partial_products.at(i).shift;
+            for(size_t j = i; j < i + 3; j++){
+                lengths.push_back(partial_products.at(j).length + partial_products.at(j).shift);
+                out.shift = min(out.shift, partial_products.at(j).shift);
+            }
+            sort(lengths.begin(), lengths.end());
+            out.length = lengths.at(2) - out.shift;
+            next_level.push_back(out);
+            out.length += lengths.at(2) == lengths.at(1) ? 1 : 0;
+            next_level.push_back(out);
+        }
+        for(size_t i = (partial_products.size()/3)*3; i < partial_products.size(); i++){
+            next_level.push_back(partial_products.at(i));
+        }
+        partial_products = next_level;
+
+        long long bits = 0;
+        for(vector<CutWire>::iterator i = partial_products.begin(); i != partial_products.end(); i++){
+            bits += i->length;
+        }
+        level_bits.push_back(bits);
+    }
+    int levels = level_bits.size() - 1;
+
+    /*------------------------------------------------------------------------------------------
+    The arrival time after level to, in a stage starting after level from (0 for the inputs).
+    ------------------------------------------------------------------------------------------*/
+    auto arrival = [&](int from, int to){
+        return (from == 0 ? AND_DELAY : FLIP_FLOP_DELAY) + (to - from)*FULL_ADDER_DELAY;
+    };
+
+    typedef pair<int, long long> Cost;
+    const Cost infeasible(INT_MAX, LLONG_MAX);
+    vector<Cost> best(levels + 1, infeasible);
+    vector<int> previous(levels + 1, -1);
+    best.at(0) = Cost(0, 0);
+    for(int to = 1; to <= levels; to++){
+        for(int from = 0; from < to; from++){
+            if(best.at(from) == infeasible || arrival(from, to) > clock_period){
+                continue;
+            }
+            Cost cost(best.at(from).first + 1, best.at(from).second + level_bits.at(to));
+            if(cost < best.at(to)){
+                best.at(to) = cost;
+                previous.at(to) = from;
+            }
+        }
+    }
+
+    Cost total = infeasible;
+    int last = -1;
+    for(int from = 0; from <= levels; from++){
+        CARRY_LOOK_AHEAD_ADDER_PIPELINED::RegisterPlan cla;
+        if(best.at(from) == infeasible || !CARRY_LOOK_AHEAD_ADDER_PIPELINED::plan_registers(2*n_bits, clock_period, arrival(from, levels), &cla, topology)){
+            continue;
+        }
+        Cost cost(best.at(from).first + cla.stages + 1, best.at(from).second + cla.register_bits);
+        if(cost < total){
+            total = cost;
+            last = from;
+        }
+    }
+    if(last < 0){
+        throw invalid_argument("Clock period " + to_string(clock_period) + " is too short for a " + to_string(n_bits) + " bit Wallace tree multiplier.");
+    }
+
+    registers->assign(levels + 1, false);
+    for(int level = last; level > 0; level = previous.at(level)){
+        registers->at(level) = true;
+    }
+    return arrival(last, levels);
+}
+
+
+vector<int> WALLACE_TREE_MULTIPLIER_PIPELINED::dadda_level(vector<int> heights, vector<int> *full_adders, vector<int> *half_adders){
+    /*------------------------------------------------------------------------------------------
+    Plans one level of the Dadda schedule. The target height is the largest of 2, 3, 4, 6, 9,
+    13, ... (each 3/2 of the one before) below the tallest column. Going from the least signifi-
+    cant column up, a column counts its own bits and the carries the column below it sends in
+    this level; a full adder takes it 2 bits closer to the target, a half adder 1 bit. Only the
+    bits above the target are reduced, which is the fewest adders for the level.
+
+    Param: heights (vector<int>), bits in every column, column i has the weight 2^i.
+    Param: full_adders, half_adders (&vector<int>), adders placed in every column.
+    Returns : The heights after the level. The carry of the last column is dropped, the product
+              fits in the columns.
+    ------------------------------------------------------------------------------------------*/
+    int tallest = *max_element(heights.begin(), heights.end());
+    int target = 2;
+    while(target*3/2 < tallest){
+        target = target*3/2;
+    }
+
+    full_adders->assign(heights.size(), 0);
+    half_adders->assign(heights.size(), 0);
+    int carries = 0;
+    for(size_t column = 0; column < heights.size(); column++){
+        int height = heights.at(column) + carries;
+        while(height > target){
+            if(height == target + 1){
+                half_adders->at(column)++;
+                height--;
+            }
+            else{
+                full_adders->at(column)++;
+                height -= 2;
+            }
+        }
+        heights.at(column) = height;
+        carries = full_adders->at(column) + half_adders->at(column);
+    }
+    return heights;
+}
+
+
+vector<WALLACE_TREE_MULTIPLIER_PIPELINED::CutWire> WALLACE_TREE_MULTIPLIER_PIPELINED::make_dadda(vector<CutWire> partial_products, int pipeline_k,
+                                                                                                int clock_period, const vector<bool>& registers){
+    /*------------------------------------------------------------------------------------------
+    Wires the Dadda reduction of the partial products. The bits are kept per column, every level
+    places the adders of dadda_level(...) on the first bits of each column. The next level of a
+    column is its bits left over, its sums and the carries of the column below.
+
+    Param: partial_products (vector<CutWire>), the first partial products.
+    Param: pipeline_k (int), register after every pipeline_k levels, without a clock period.
+    Param: clock_period (int), > 0 if the stages were planned by plan_registers(...).
+    Param: registers (vector<bool>), registers[L] is set for a register stage after level L.
+    Returns : The two rows left, 2 x n_bits wide, for the final CLA.
+    ------------------------------------------------------------------------------------------*/
+    int width = 2*this->n_bits;
+    vector<vector<wire>> columns(width);
+    for(vector<CutWire>::iterator row = partial_products.begin(); row != partial_products.end(); row++){
+        for(int i = 0; i < row->length; i++){
+            columns.at(row->shift + i).push_back(row->wire_id[i]);
+        }
+    }
+    vector<int> heights(width);
+    for(int column = 0; column < width; column++){
+        heights.at(column) = columns.at(column).size();
+    }
+
+    int current_level = 1;
+    while(*max_element(heights.begin(), heights.end()) > 2){
+        vector<int> full_adders, half_adders;
+        heights = dadda_level(heights, &full_adders, &half_adders);
+
+        /*------------------------------------------------------------------------------------------
+        The columns of one level only read the previous level, so they are wired in parallel and
+        merged in order.
+        ------------------------------------------------------------------------------------------*/
+        string level_name = "WTM_LEVEL_" + to_string(current_level) + "_COLUMN_";
+        vector<wire> sums(width), carries(width);
+        vector<Chip> parts(width);
+        ThreadPool::global().parallel_for(width, [&](size_t column){
+            int adders = full_adders.at(column) + half_adders.at(column);
+            if(adders == 0){
+                return;
+            }
+            wire sum(level_name + to_string(column) + "_SUM", adders);
+            wire carry(level_name + to_string(column) + "_CARRY", adders);
+            parts.at(column).add_wire(sum);
+            parts.at(column).add_wire(carry);
+
+            const vector<wire>& bits = columns.at(column);
+            int bit = 0;
+            for(int i = 0; i < adders; i++){
+                if(i < full_adders.at(column)){
+                    FULL_ADDER adder(level_name + to_string(column) + "_FA_" + to_string(i),
+                                    {bits.at(bit), bits.at(bit + 1), bits.at(bit + 2)},
+                                    {sum[i], carry[i]});
+                    parts.at(column).add_submodule(adder);
+                    bit += 3;
+                }
+                else{
+                    HALF_ADDER adder(level_name + to_string(column) + "_HA_" + to_string(i),
+                                    {bits.at(bit), bits.at(bit + 1)},
+                                    {sum[i], carry[i]});
+                    parts.at(column).add_submodule(adder);
+                    bit += 2;
+                }
+            }
+            sums.at(column) = sum;
+            carries.at(column) = carry;
+        });
+
+        vector<vector<wire>> next_columns(width);
+        for(int column = 0; column < width; column++){
+            this->merge(parts.at(column));
+            int used = 3*full_adders.at(column) + 2*half_adders.at(column);
+            next_columns.at(column).assign(columns.at(column).begin() + used, columns.at(column).end());
+            for(int i = 0; i < full_adders.at(column) + half_adders.at(column); i++){
+                next_columns.at(column).push_back(sums.at(column)[i]);
+            }
+            for(int i = 0; column > 0 && i < full_adders.at(column - 1) + half_adders.at(column - 1); i++){
+                next_columns.at(column).push_back(carries.at(column - 1)[i]);
+            }
+        }
+        columns = next_columns;
+
+        /*------------------------------------------------------------------------------------------
+        If current level is a multiple of k (or planned), pass the bits of every column through
+        FlipFlops.
+        ------------------------------------------------------------------------------------------*/
+        bool register_level = clock_period > 0 ? registers.at(current_level) : current_level%pipeline_k==0;
+        if(register_level){
+            vector<Chip> stage_parts(width);
+            ThreadPool::global().parallel_for(width, [&](size_t column){
+                vector<wire>& bits = columns.at(column);
+                if(bits.empty()){
+                    return;
+                }
+                string flipflop_name = "WTM_LEVEL_" + to_string(current_level) + "_FLIP_FLOP_" + to_string(column);
+                wire curr_output_wire(flipflop_name + "_WIRE", bits.size());
+                stage_parts.at(column).add_wire(curr_output_wire);
+                for(size_t i = 0; i < bits.size(); i++){
+                    FLIP_FLOP curr_flipflop(flipflop_name + "_" + to_string(i),
+                                           {bits.at(i), "CLK"},
+                                           curr_output_wire[i]);
+                    stage_parts.at(column).add_submodule(curr_flipflop);
+                    bits.at(i) = curr_output_wire[i];
+                }
+            });
+            for(int column = 0; column < width; column++){
+                this->merge(stage_parts.at(column));
+            }
+        }
+
+        current_level++;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    At most two bits are left in every column, they are joined to two rows. Missing bits are zero.
+    ------------------------------------------------------------------------------------------*/
+    vector<CutWire> rows(2);
+    for(int r = 0; r < 2; r++){
+        rows.at(r).wire_id = wire("WTM_DADDA_ROW_" + to_string(r + 1), width);
+        rows.at(r).shift = 0;
+        rows.at(r).length = width;
+        this->add_wire(rows.at(r).wire_id);
+        for(int column = 0; column < width; column++){
+            if(r < (int)columns.at(column).size()){
+                JOIN joint("WTM_DADDA_ROW_" + to_string(r + 1) + "_JOINT_" + to_string(column),
+                           rows.at(r).wire_id[column],
+                           columns.at(column).at(r));
+                this->add_submodule(joint);
+            }
+            else{
+                this->assign(rows.at(r).wire_id[column], 0);
+            }
+        }
+    }
+    return rows;
 }
 
 
-void WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(string name, CutWire w1, CutWire w2, CutWire w3, CutWire *o1, CutWire *o2){
+void WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(string name, CutWire w1, CutWire w2, CutWire w3, CutWire *o1, CutWire *o2, Chip *part){
     /*------------------------------------------------------------------------------------------
     Given 3 input CutWires, this function wires a Carry Save Adder most optimally to output 2
     CutWires, one for the Sum and the other for the Carry.
 
+    The wires and submodules go into part, so that the groups of one level can be wired in par-
+    allel and merged in order afterwards.
+
     Param: name (string), a unbique identifier to remove any conflicts
     Param: w1, w2, w3 (CutWire), partial products.
     Param: o1, o2 (&CutWire), poiters to next level outputs, i.e Sum and Carry from this level.
+    Param: part (&Chip), the wires and submodules are added here.
     ------------------------------------------------------------------------------------------*/ 
     
     int new_shift, new_width;
@@ -241,61 +598,61 @@ void WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(string name, CutWire w1, CutWir
     /*------------------------------------------------------------------------------------------
     Declare new wires with appropriate sizes for inputs to the CSA (Carry Save Adder).
     ------------------------------------------------------------------------------------------*/ 
-    wire wire_1 = name + "_WIRE_1";
-    wire wire_2 = name + "_WIRE_2";
-    wire wire_3 = name + "_WIRE_3";
+    wire wire_1(name + "_WIRE_1", new_width);
+    wire wire_2(name + "_WIRE_2", new_width);
+    wire wire_3(name + "_WIRE_3", new_width);
 
-    this->add_wire("[" + to_string(new_width - 1) + ":0] " + wire_1);
-    this->add_wire("[" + to_string(new_width - 1) + ":0] " + wire_2);
-    this->add_wire("[" + to_string(new_width - 1) + ":0] " + wire_3);
+    part->add_wire(wire_1);
+    part->add_wire(wire_2);
+    part->add_wire(wire_3);
 
 
     /*------------------------------------------------------------------------------------------
     Join the appropriate parts of the partial products to the new wires.
     ------------------------------------------------------------------------------------------*/ 
     JOIN_N_BIT join_1(name + "_JOIN_1",
-                        wire_1 + "[" + to_string(l1 - new_shift - 1) + ":" + to_string(w1.shift - new_shift) + "]",
+                        wire_1.slice(l1 - new_shift - 1, w1.shift - new_shift),
                         w1.wire_id,
                         w1.length);
 
     JOIN_N_BIT join_2(name + "_JOIN_2",
-                        wire_2 + "[" + to_string(l2 - new_shift - 1) + ":" + to_string(w2.shift - new_shift) + "]",
+                        wire_2.slice(l2 - new_shift - 1, w2.shift - new_shift),
                         w2.wire_id,
                         w2.length);        
     
     JOIN_N_BIT join_3(name + "_JOIN_3",
-                        wire_3 + "[" + to_string(l3 - new_shift - 1) + ":" + to_string(w3.shift - new_shift) + "]",
+                        wire_3.slice(l3 - new_shift - 1, w3.shift - new_shift),
                         w3.wire_id,
                         w3.length);
 
-    this->add_submodule(join_1);
-    this->add_submodule(join_2);
-    this->add_submodule(join_3);
+    part->add_submodule(join_1);
+    part->add_submodule(join_2);
+    part->add_submodule(join_3);
 
     /*------------------------------------------------------------------------------------------
     Pad zeros to the LSB.
     ------------------------------------------------------------------------------------------*/ 
     if(w1.shift - new_shift > 0){
-        this->verilog("assign " + wire_1 + "[" + to_string(w1.shift - new_shift - 1) + ":0] = 0;" );
+        part->assign(wire_1.slice(w1.shift - new_shift - 1, 0), 0);
     }
     if(w2.shift - new_shift > 0){
-        this->verilog("assign " + wire_2 + "[" + to_string(w2.shift - new_shift - 1) + ":0] = 0;" );
+        part->assign(wire_2.slice(w2.shift - new_shift - 1, 0), 0);
     }
     if(w3.shift - new_shift > 0){
-        this->verilog("assign " + wire_3 + "[" + to_string(w3.shift - new_shift - 1) + ":0] = 0;" );
+        part->assign(wire_3.slice(w3.shift - new_shift - 1, 0), 0);
     }
     
     /*------------------------------------------------------------------------------------------
     Pad zeros to the MSB.
     ------------------------------------------------------------------------------------------*/ 
     if(l1 - new_shift < new_width){
-        this->verilog("assign " + wire_1 + "[" + to_string(new_width - 1) + ":" + to_string(l1- new_shift) + "] = 0;");
+        part->assign(wire_1.slice(new_width - 1, l1 - new_shift), 0);
     }
     if(l2 - new_shift < new_width){
-        this->verilog("assign " + wire_2 + "[" + to_string(new_width - 1) + ":" + to_string(l2- new_shift) + "] = 0;");
+        part->assign(wire_2.slice(new_width - 1, l2 - new_shift), 0);
     }
     if(l3 - new_shift < new_width){
-        this->verilog("assign " + wire_3 + "[" + to_string(new_width - 1) + ":" + to_string(l3- new_shift) + "] = 0;");
+        part->assign(wire_3.slice(new_width - 1, l3 - new_shift), 0);
     }
 
 
@@ -312,19 +669,19 @@ void WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(string name, CutWire w1, CutWir
         Length of Sum = new_width
         Length of Carry = new_width + 1
         ------------------------------------------------------------------------------------------*/ 
-        o1->wire_id = name + "_SUM_WIRE";
+        o1->wire_id = wire(name + "_SUM_WIRE", new_width);
         o1->shift = new_shift;
         o1->length = new_width;
 
-        o2->wire_id = name + "_CARRY_WIRE";
+        o2->wire_id = wire(name + "_CARRY_WIRE", new_width + 1);
         o2->shift = new_shift;
         o2->length = new_width + 1;
 
         CARRY_SAVE_ADDER adder(name + "_CSA",
                               {wire_1, wire_2, wire_3},
-                              {o1->wire_id, o2->wire_id + "[" + to_string(new_width - 1) + ":0]", o2->wire_id + "[" + to_string(new_width) + "]"}, new_width);
+                              {o1->wire_id, o2->wire_id.slice(new_width - 1, 0), o2->wire_id[new_width]}, new_width);
 
-        this->add_submodule(adder);
+        part->add_submodule(adder);
     }
     else{
         /*------------------------------------------------------------------------------------------
@@ -336,23 +693,23 @@ void WALLACE_TREE_MULTIPLIER_PIPELINED::make_csa(string name, CutWire w1, CutWir
         Length of Sum = new_width
         Length of Carry = new_width
         ------------------------------------------------------------------------------------------*/ 
-        o1->wire_id = name + "_SUM_WIRE";
+        o1->wire_id = wire(name + "_SUM_WIRE", new_width);
         o1->shift = new_shift;
         o1->length = new_width;
 
-        o2->wire_id = name + "_CARRY_WIRE";
+        o2->wire_id = wire(name + "_CARRY_WIRE", new_width);
         o2->shift = new_shift;
         o2->length = new_width;
 
         wire dangle = name + "_DANGLE";
-        this->add_wire(dangle);
+        part->add_wire(dangle);
         CARRY_SAVE_ADDER adder(name + "_CSA",
                               {wire_1, wire_2, wire_3},
                               {o1->wire_id, o2->wire_id, dangle}, new_width);
 
-        this->add_submodule(adder);
+        part->add_submodule(adder);
     }
 
-    this->add_wire("["+ to_string(o1->length - 1) +":0]"+ o1->wire_id);
-    this->add_wire("["+ to_string(o2->length - 1) +":0]"+ o2->wire_id);
+    part->add_wire(o1->wire_id);
+    part->add_wire(o2->wire_id);
 }
\ No newline at end of file
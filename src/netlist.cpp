@@ -0,0 +1,572 @@
+#include <verilog.h>
+#include <stats.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                    The Module Registry
+                                    ===================
+------------------------------------------------------------------------------------------*/
+
+ModuleRegistry& ModuleRegistry::global(){
+    /*------------------------------------------------------------------------------------------
+    Returns the registry shared by all chips.
+    ------------------------------------------------------------------------------------------*/
+    static ModuleRegistry registry;
+    return registry;
+}
+
+shared_ptr<const ModuleDef> ModuleRegistry::find(const ModuleKey& key) const{
+    /*------------------------------------------------------------------------------------------
+    Params : key (ModuleKey), generator and parameters of the module.
+    Returns : module (shared_ptr<const ModuleDef>), the registered module or nullptr.
+    ------------------------------------------------------------------------------------------*/
+    shared_lock<shared_mutex> guard(this->lock);
+    unordered_map<ModuleKey, shared_ptr<const ModuleDef>, ModuleKeyHash>::const_iterator found = this->modules.find(key);
+    if(found == this->modules.end()){
+        return nullptr;
+    }
+    return found->second;
+}
+
+shared_ptr<const ModuleDef> ModuleRegistry::insert(const ModuleKey& key, shared_ptr<const ModuleDef> module){
+    /*------------------------------------------------------------------------------------------
+    Registers a module under the given key. If the key is already registered, the old module is
+    kept so that every instance keeps pointing to the same definition.
+
+    Params : key (ModuleKey), generator and parameters of the module.
+    Params : module (shared_ptr<const ModuleDef>), the module definition.
+    Returns : module (shared_ptr<const ModuleDef>), the registered module.
+    ------------------------------------------------------------------------------------------*/
+    unique_lock<shared_mutex> guard(this->lock);
+    pair<unordered_map<ModuleKey, shared_ptr<const ModuleDef>, ModuleKeyHash>::iterator, bool> result = this->modules.emplace(key, module);
+    if(result.second){
+        DOTV_COUNT(UNIQUE_MODULES, 1);
+    }
+    return result.first->second;
+}
+
+size_t ModuleRegistry::size() const{
+    shared_lock<shared_mutex> guard(this->lock);
+    return this->modules.size();
+}
+
+/*------------------------------------------------------------------------------------------
+                                    The Instance Table
+                                    ==================
+------------------------------------------------------------------------------------------*/
+
+uint32_t InstanceTable::find_type(const shared_ptr<const ModuleDef>& module){
+    /*------------------------------------------------------------------------------------------
+    Returns the type id of a module, adding it to the types on its first use. Generators place
+    runs of the same module, so the last type is checked before the index.
+    ------------------------------------------------------------------------------------------*/
+    if(this->last_type < this->type_table.size() && this->type_table[this->last_type] == module){
+        return this->last_type;
+    }
+    pair<unordered_map<const ModuleDef*, uint32_t>::iterator, bool> type = this->type_index.emplace(module.get(), this->type_table.size());
+    if(type.second){
+        this->type_table.push_back(module);
+    }
+    this->last_type = type.first->second;
+    return this->last_type;
+}
+
+void InstanceTable::add(string_view name, const shared_ptr<const ModuleDef>& module, const vector<wire>& inputs, const vector<wire>& outputs, const string& generate){
+    /*------------------------------------------------------------------------------------------
+    Places an instance at the end of the table.
+
+    Param : name (string_view), the instance name.
+    Param : module (shared_ptr<const ModuleDef>), the interned module.
+    Param : inputs, outputs (vector<wire>), the nets bound to the ports, inputs first.
+    Param : generate (string), optional instantiation syntax, empty for none.
+    ------------------------------------------------------------------------------------------*/
+    if(!generate.empty()){
+        this->overrides.emplace(this->type_ids.size(), generate);
+    }
+    this->type_ids.push_back(this->find_type(module));
+    this->names.append(name);
+    this->name_offsets.push_back(this->names.size());
+    this->nets.insert(this->nets.end(), inputs.begin(), inputs.end());
+    this->nets.insert(this->nets.end(), outputs.begin(), outputs.end());
+    this->net_offsets.push_back(this->nets.size());
+}
+
+void InstanceTable::append(InstanceTable&& other){
+    /*------------------------------------------------------------------------------------------
+    Moves every instance of other to the end of this table, in order. The types of other are
+    renumbered into this table and the offsets of its names and bindings are shifted.
+    ------------------------------------------------------------------------------------------*/
+    if(this->empty()){
+        *this = std::move(other);
+        other = InstanceTable();
+        return;
+    }
+    vector<uint32_t> remap(other.type_table.size());
+    for(size_t t = 0; t < other.type_table.size(); t++){
+        remap[t] = this->find_type(other.type_table[t]);
+    }
+
+    size_t first = this->size();
+    uint32_t name_base = this->names.size();
+    uint32_t net_base = this->nets.size();
+    for(size_t i = 0; i < other.size(); i++){
+        this->type_ids.push_back(remap[other.type_ids[i]]);
+        this->name_offsets.push_back(name_base + other.name_offsets[i + 1]);
+        this->net_offsets.push_back(net_base + other.net_offsets[i + 1]);
+    }
+    this->names += other.names;
+    this->nets.insert(this->nets.end(), other.nets.begin(), other.nets.end());
+    for(unordered_map<uint32_t, string>::iterator i = other.overrides.begin(); i != other.overrides.end(); i++){
+        this->overrides.emplace(first + i->first, std::move(i->second));
+    }
+    other = InstanceTable();
+}
+
+string_view InstanceTable::name(size_t i) const{
+    return string_view(this->names.data() + this->name_offsets[i], this->name_offsets[i + 1] - this->name_offsets[i]);
+}
+
+const string& InstanceTable::generate(size_t i) const{
+    static const string none;
+    if(this->overrides.empty()){
+        return none;
+    }
+    unordered_map<uint32_t, string>::const_iterator found = this->overrides.find(i);
+    return found == this->overrides.end() ? none : found->second;
+}
+
+/*------------------------------------------------------------------------------------------
+                                    The Module Definition
+                                    =====================
+------------------------------------------------------------------------------------------*/
+
+shared_ptr<const ModuleDef> ModuleDef::intern(const Chip& chip){
+    /*------------------------------------------------------------------------------------------
+    Returns the shared module definition for the given chip. The netlist is built only when a
+    module key is seen for the first time, every later instance just gets the same pointer.
+
+    Chips that never called reuse_module(...) (for example user defined chips) are keyed by their
+    module name. Their contents are fingerprinted, two such chips with the same name but dif-
+    ferent contents would otherwise share the first definition.
+
+    Params : chip (Chip), a fully constructed chip.
+    Returns : module (shared_ptr<const ModuleDef>), the shared definition.
+    Throws : invalid_argument if a different chip was already registered under the same name.
+    ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_INTERN);
+    if(chip.module){
+        return chip.module;
+    }
+
+    string name = chip.type_name.empty() ? module_name(chip.definition) : chip.type_name;
+    ModuleKey key = chip.key;
+    size_t fingerprint = 0;
+    if(key.generator.empty()){
+        key.generator = name;
+        fingerprint = ModuleDef::content_fingerprint(chip);
+    }
+
+    ModuleRegistry& registry = ModuleRegistry::global();
+    shared_ptr<const ModuleDef> found = registry.find(key);
+    if(found){
+        if(found->fingerprint != fingerprint){
+            throw invalid_argument("Module " + name + " is already defined with different contents, give the chip another name.");
+        }
+        chip.module = found;
+        return found;
+    }
+
+    shared_ptr<ModuleDef> module = make_shared<ModuleDef>();
+    module->name = name;
+    module->key = key;
+    module->fingerprint = fingerprint;
+    module->op = chip.op;
+    module->width = chip.n_bits;
+
+    /*------------------------------------------------------------------------------------------
+    Ports are kept inputs first, which is also the order instances bind them in.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<Port>::const_iterator i = chip.ports.begin(); i != chip.ports.end(); i++){
+        if(!i->is_output()) module->ports.push_back(*i);
+    }
+    for(vector<Port>::const_iterator i = chip.ports.begin(); i != chip.ports.end(); i++){
+        if(i->is_output()) module->ports.push_back(*i);
+    }
+
+    module->wires = chip.wires;
+    module->regs = chip.regs;
+    module->assigns = chip.assigns;
+    module->extras = chip.extras;
+    module->behaviours = chip.behaviours;
+    module->submodules = chip.submodules;
+
+    module->transistors = chip.transistors;
+    for(vector<BehaviourModel>::const_iterator i = chip.behaviours.begin(); i != chip.behaviours.end(); i++){
+        module->transistors += i->num_transistors;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Keep a list of unique dependencies so that header collection only has to visit each unique
+    module once. The instance table already holds them in the order of their first use.
+    ------------------------------------------------------------------------------------------*/
+    const vector<shared_ptr<const ModuleDef>>& types = chip.submodules.types();
+    for(vector<shared_ptr<const ModuleDef>>::const_iterator type = types.begin(); type != types.end(); type++){
+        module->dependencies.push_back(type->get());
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Compute the aggregates from the cached totals of the submodules.
+    ------------------------------------------------------------------------------------------*/
+    module->total_transistors = module->transistors;
+    for(size_t i = 0; i < chip.submodules.size(); i++){
+        const ModuleDef* sub = chip.submodules.module(i);
+        module->total_transistors += sub->total_transistors;
+        module->total_instances += 1 + sub->total_instances;
+        module->depth = max(module->depth, sub->depth + 1);
+    }
+
+    module->index_connections();
+
+    /*------------------------------------------------------------------------------------------
+    Primitive gates come with a hand written definition, everything else is rendered from the
+    netlist by the verilog backend when the design is emitted.
+    ------------------------------------------------------------------------------------------*/
+    module->definition = chip.definition;
+
+    chip.module = registry.insert(key, module);
+    if(chip.module->fingerprint != fingerprint){
+        throw invalid_argument("Module " + name + " is already defined with different contents, give the chip another name.");
+    }
+    return chip.module;
+}
+
+size_t ModuleDef::content_fingerprint(const Chip& chip){
+    /*------------------------------------------------------------------------------------------
+    Hashes everything the module definition of a chip is built from: ports, nets, assigns,
+    native verilog, behaviours and the instances with their modules and bindings.
+
+    Params : chip (Chip), a fully constructed chip.
+    Returns : fingerprint (size_t), equal for chips with the same contents.
+    ------------------------------------------------------------------------------------------*/
+    size_t seed = 0;
+    auto mix = [&seed](size_t value){
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    };
+    auto mix_text = [&mix](const string& text){
+        mix(hash<string>()(text));
+    };
+    for(vector<Port>::const_iterator i = chip.ports.begin(); i != chip.ports.end(); i++){
+        mix_text(i->net.declaration());
+        mix(i->type);
+    }
+    for(vector<wire>::const_iterator i = chip.wires.begin(); i != chip.wires.end(); i++){
+        mix_text(i->declaration());
+    }
+    for(vector<reg>::const_iterator i = chip.regs.begin(); i != chip.regs.end(); i++){
+        mix_text(i->declaration());
+    }
+    for(vector<Assign>::const_iterator i = chip.assigns.begin(); i != chip.assigns.end(); i++){
+        mix_text(i->lhs.str());
+        mix(i->value);
+    }
+    for(vector<string>::const_iterator i = chip.extras.begin(); i != chip.extras.end(); i++){
+        mix_text(*i);
+    }
+    for(vector<BehaviourModel>::const_iterator i = chip.behaviours.begin(); i != chip.behaviours.end(); i++){
+        mix_text(i->code());
+    }
+    mix_text(chip.definition);
+    for(size_t i = 0; i < chip.submodules.size(); i++){
+        mix(hash<const ModuleDef*>()(chip.submodules.module(i)));
+        mix(hash<string_view>()(chip.submodules.name(i)));
+        const wire* bindings = chip.submodules.bindings(i);
+        for(size_t p = 0; p < chip.submodules.num_bindings(i); p++){
+            mix_text(bindings[p].str());
+        }
+        mix_text(chip.submodules.generate(i));
+    }
+    return seed;
+}
+
+int ModuleDef::num_transistors() const{
+    /*------------------------------------------------------------------------------------------
+    Returns the transistors required to create one instance of this module. The count is cached
+    when the module is interned.
+
+    Params : None
+    Returns : total (int), transitor count.
+    ------------------------------------------------------------------------------------------*/
+    return this->total_transistors;
+}
+
+void ModuleDef::index_connections(){
+    /*------------------------------------------------------------------------------------------
+    Builds the net to (instance, port) index once, so connectivity queries do not have to scan
+    the submodules.
+    ------------------------------------------------------------------------------------------*/
+    for(uint32_t i = 0; i < this->submodules.size(); i++){
+        const wire* bindings = this->submodules.bindings(i);
+        uint32_t count = this->submodules.num_bindings(i);
+        for(uint32_t p = 0; p < count; p++){
+            this->net_connections[bindings[p].id()].push_back({i, p});
+        }
+    }
+}
+
+const vector<Connection>& ModuleDef::connections(Symbol net) const{
+    /*------------------------------------------------------------------------------------------
+    Returns every submodule port the net (or any slice of it) is bound to.
+
+    Param : net (Symbol), the net name, example wire("carry").id()
+    Returns : connections (vector<Connection>), empty if the net is not used by any instance.
+    ------------------------------------------------------------------------------------------*/
+    static const vector<Connection> none;
+    unordered_map<Symbol, vector<Connection>>::const_iterator found = this->net_connections.find(net);
+    if(found == this->net_connections.end()){
+        return none;
+    }
+    return found->second;
+}
+
+int ModuleDef::find_port(Symbol net) const{
+    /*------------------------------------------------------------------------------------------
+    Param : net (Symbol), a port name.
+    Returns : index (int), the index into ports, or -1 if there is no such port.
+    ------------------------------------------------------------------------------------------*/
+    for(size_t i = 0; i < this->ports.size(); i++){
+        if(this->ports.at(i).net.id() == net){
+            return i;
+        }
+    }
+    return -1;
+}
+
+shared_ptr<const ModuleDef> gate_module(Op op, int width, bool n_bit, const char* definition){
+    /*------------------------------------------------------------------------------------------
+    Returns the shared module of a gate, registering it the first time.
+
+    Param : op (Op), the gate function.
+    Param : width (int), bit width.
+    Param : n_bit (bool), true for the n bit gates, example AND_GATE_8_BIT instead of AND_GATE.
+    Param : definition (const char*), the compile time definition text, or nullptr to render it
+            at emission.
+    Returns : module (shared_ptr<const ModuleDef>), the shared definition.
+    ------------------------------------------------------------------------------------------*/
+    GateInfo info = gate_info(op);
+    ModuleKey key = n_bit ? ModuleKey{string(info.key) + "_N_BIT", {width}} : ModuleKey{info.key, {}};
+
+    ModuleRegistry& registry = ModuleRegistry::global();
+    shared_ptr<const ModuleDef> found = registry.find(key);
+    if(found){
+        return found;
+    }
+
+    shared_ptr<ModuleDef> module = make_shared<ModuleDef>();
+    module->name = gate_type_name(op, width, n_bit).str();
+    module->key = key;
+    module->op = op;
+    module->width = width;
+    if(op == Op::JOIN){
+        module->ports.push_back({wire("a", width), CHIP_INOUT});
+        module->ports.push_back({wire("a", width), CHIP_INOUT});
+    }
+    else if(op == Op::NOT){
+        module->ports.push_back({wire("in", width), CHIP_INPUTS});
+        module->ports.push_back({wire("out", width), CHIP_OUTPUTS});
+    }
+    else{
+        module->ports.push_back({wire("a", width), CHIP_INPUTS});
+        module->ports.push_back({wire("b", width), CHIP_INPUTS});
+        module->ports.push_back({wire("c", width), CHIP_OUTPUTS});
+    }
+    module->transistors = info.transistors * width;
+    module->total_transistors = module->transistors;
+    if(definition != nullptr){
+        module->definition = definition;
+    }
+    return registry.insert(key, module);
+}
+
+/*------------------------------------------------------------------------------------------
+                                    The Verilog Backend
+                                    ===================
+------------------------------------------------------------------------------------------*/
+
+static string port_declaration(const wire& port){
+    /*------------------------------------------------------------------------------------------
+    Formats a port declaration. Example : "[7: 0] A" or "CLK"
+    ------------------------------------------------------------------------------------------*/
+    if(port.form() == wire::DECL){
+        return "[" + to_string(port.msb()) + ": " + to_string(port.lsb()) + "] " + string(port.name());
+    }
+    return string(port.name());
+}
+
+void verilog_instance(string& out, const InstanceTable& instances, size_t i){
+    /*------------------------------------------------------------------------------------------
+    Appends the instantiation syntax of one submodule. Example : "AND_GATE and_1 (a, b, c);"
+
+    Param : out (string), the text is appended here.
+    Param : instances (InstanceTable), the submodules of a module.
+    Param : i (size_t), index of the submodule.
+    ------------------------------------------------------------------------------------------*/
+    const string& generate = instances.generate(i);
+    if(!generate.empty()){
+        out += generate;
+        return;
+    }
+    out += instances.module(i)->name;
+    out += ' ';
+    out += instances.name(i);
+    out += " (";
+    const wire* bindings = instances.bindings(i);
+    for(size_t p = 0; p < instances.num_bindings(i); p++){
+        if(p != 0){
+            out += ", ";
+        }
+        bindings[p].write(out);
+    }
+    out += ");";
+}
+
+void verilog_header(string& out, const ModuleDef& module, int transistors, int critical_path, const string& note){
+    /*------------------------------------------------------------------------------------------
+    Appends the module line, the transistor count and the port declarations of a module.
+
+    Param : out (string), the text is appended here.
+    Param : module (ModuleDef), an interned module.
+    Param : transistors (int), optional, the count to report instead of the module's own.
+    Param : critical_path (int), optional, a critical path delay to report.
+    Param : note (string), optional, one more comment line for the header.
+    ------------------------------------------------------------------------------------------*/
+    out += "module " + module.name + " (";
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        if(i != module.ports.begin()){
+            out += ", ";
+        }
+        out.append(i->net.name());
+    }
+    out += ");";
+
+    out += "\n\t// Transistor count : " + to_string(transistors < 0 ? module.num_transistors() : transistors) + "\n";
+    if(critical_path >= 0){
+        out += "\t// Critical path : " + to_string(critical_path) + "\n";
+    }
+    if(!note.empty()){
+        out += "\t// " + note + "\n";
+    }
+
+    out += "\n\t// Inputs\n\n";
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        if(i->is_inout()){
+            out += "\tinout " + port_declaration(i->net) + ";\n";
+        }
+        else if(!i->is_output()){
+            out += (i->is_reg() ? "\tinput reg " : "\tinput ") + port_declaration(i->net) + ";\n";
+        }
+    }
+
+    out += "\n\t// Outputs\n\n";
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        if(i->is_output()){
+            out += (i->is_reg() ? "\toutput reg " : "\toutput ") + port_declaration(i->net) + ";\n";
+        }
+    }
+}
+
+string verilog_definition(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Renders a module definition from the netlist. Primitive gates get their fixed definition.
+
+    Param : module (ModuleDef), an interned module.
+    Returns : definition (string), example
+    """
+    module MY_CHIP (my_input_1, my_input_2, my_output);
+        // Transistor count : 42
+
+        // Inputs
+        input [7: 0] my_input_1;
+        input [7: 0] my_input_2;
+
+        // Outputs
+        output [7: 0] my_output;
+
+        // Wires
+        wire my_wire_1;
+        wire [7:0] my_wide_wire;
+
+        // Regs
+        reg a;
+
+        // Extras
+        assign my_wire_1 = 0;
+
+        // Sub Modules
+        AND_GATE my_and_1 (my_input_1[0], my_input_2[0], my_wire_1);
+        ...
+
+        // Behaviours
+        always @(posedge my_input_1)
+        begin
+            a <= ~my_input_2;
+        end
+
+    endmodule
+    """
+    ------------------------------------------------------------------------------------------*/
+    if(is_gate(module.op)){
+        return gate_text(module.op, module.name.c_str(), module.width).str();
+    }
+
+    string out;
+    verilog_header(out, module);
+
+    out += "\n\t// Wires\n\n";
+    for(vector<wire>::const_iterator i = module.wires.begin(); i != module.wires.end(); i++){
+        out += "\twire " + i->declaration() + ";\n";
+    }
+
+    out += "\n\t// Regs\n\n";
+    for(vector<reg>::const_iterator i = module.regs.begin(); i != module.regs.end(); i++){
+        out += "\treg " + i->declaration() + ";\n";
+    }
+
+    out += "\n\t// Extras\n\n";
+    for(vector<Assign>::const_iterator i = module.assigns.begin(); i != module.assigns.end(); i++){
+        out += "\tassign " + i->lhs + " = " + to_string(i->value) + ";\n";
+    }
+    for(vector<string>::const_iterator i = module.extras.begin(); i != module.extras.end(); i++){
+        out += "\t" + *i + "\n";
+    }
+
+    out += "\n\t// Sub Modules\n\n";
+    for(size_t i = 0; i < module.submodules.size(); i++){
+        out += '\t';
+        verilog_instance(out, module.submodules, i);
+        out += '\n';
+    }
+
+    out += "\n\t// Behaviours\n\n";
+    for(vector<BehaviourModel>::const_iterator i = module.behaviours.begin(); i != module.behaviours.end(); i++){
+        string code = i->code();
+        size_t index = 0;
+        while(string::npos != (index = code.find('\n', index))){
+            code.replace(index, 1, "\n\t");
+            index +=2;
+        }
+        out += "\t" + code + "\n";
+    }
+
+    out += "\nendmodule\n";
+    return out;
+}
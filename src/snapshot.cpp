@@ -0,0 +1,373 @@
+#include <snapshot.h>
+#include <verilog.h>
+#include <module_cache.h>
+#include <thread_pool.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'D', 'O', 'T', 'V', 'S', 'N', 'A', 'P'};
+
+static bool has_netlist(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    True if the text of the module is rendered from its records alone, see verilog_definition.
+    ------------------------------------------------------------------------------------------*/
+    return module.definition.empty() && module.extras.empty() && module.behaviours.empty();
+}
+
+static void collect_modules(const ModuleDef* module, unordered_map<const ModuleDef*, uint32_t>& index, vector<const ModuleDef*>& modules){
+    /*------------------------------------------------------------------------------------------
+    Depth first walk over the unique dependencies, a module is appended after all of its depen-
+    dencies.
+    ------------------------------------------------------------------------------------------*/
+    if(index.count(module)){
+        return;
+    }
+    index[module] = UINT32_MAX;
+    for(vector<const ModuleDef*>::const_iterator dep = module->dependencies.begin(); dep != module->dependencies.end(); dep++){
+        collect_modules(*dep, index, modules);
+    }
+    index[module] = modules.size();
+    modules.push_back(module);
+}
+
+struct NetHash{
+    size_t operator()(const SnapshotNet& net) const{
+        uint64_t seed = ((uint64_t)net.symbol << 32) | net.form;
+        seed ^= ((uint64_t)(uint32_t)net.msb << 32 | (uint32_t)net.lsb) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        return hash<uint64_t>()(seed);
+    }
+};
+
+struct NetEqual{
+    bool operator()(const SnapshotNet& a, const SnapshotNet& b) const{
+        return a.symbol == b.symbol && a.form == b.form && a.msb == b.msb && a.lsb == b.lsb;
+    }
+};
+
+class SnapshotWriter{
+    /*------------------------------------------------------------------------------------------
+    Builds the sections of a snapshot in memory. Nets and symbols are stored once, every later
+    use refers to the first one.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        vector<SnapshotModule> modules;
+        vector<SnapshotPort> ports;
+        vector<SnapshotNet> nets;
+        vector<uint32_t> net_lists;
+        vector<SnapshotInstance> instances;
+        vector<SnapshotOverride> overrides;
+        vector<SnapshotAssign> assigns;
+        vector<uint32_t> dependencies;
+        vector<int32_t> params;
+        vector<SnapshotString> symbols;
+        string strings;
+
+        SnapshotString text(string_view value){
+            SnapshotString s = {(uint32_t)this->strings.size(), (uint32_t)value.size()};
+            this->strings.append(value.data(), value.size());
+            return s;
+        }
+
+        uint32_t net(const wire& value){
+            pair<unordered_map<Symbol, uint32_t>::iterator, bool> symbol = this->symbol_index.emplace(value.id(), this->symbols.size());
+            if(symbol.second){
+                this->symbols.push_back(this->text(value.name()));
+            }
+            SnapshotNet record = {symbol.first->second, (uint32_t)value.form(), value.msb(), value.lsb()};
+            pair<unordered_map<SnapshotNet, uint32_t, NetHash, NetEqual>::iterator, bool> found = this->net_index.emplace(record, this->nets.size());
+            if(!found.second){
+                return found.first->second;
+            }
+            this->nets.push_back(record);
+            return this->nets.size() - 1;
+        }
+
+        SnapshotRange net_list(const wire* values, size_t count){
+            SnapshotRange range = {(uint32_t)this->net_lists.size(), (uint32_t)count};
+            for(size_t i = 0; i < count; i++){
+                this->net_lists.push_back(this->net(values[i]));
+            }
+            return range;
+        }
+
+    private:
+        unordered_map<Symbol, uint32_t> symbol_index;
+        unordered_map<SnapshotNet, uint32_t, NetHash, NetEqual> net_index;
+};
+
+template <typename T>
+static void write_section(string& file, SnapshotSection& section, const T* records, size_t count){
+    file.resize((file.size() + 7) & ~(size_t)7, '\0');
+    section.offset = file.size();
+    section.count = count;
+    file.append((const char*)records, count*sizeof(T));
+}
+
+bool Snapshot::save(const string& file_name, const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Writes the snapshot of a module and every module below it. The file is written to a tempo-
+    rary file first and renamed, so a reader never maps a partial snapshot.
+
+    Param : file_name (string), the snapshot file.
+    Param : module (ModuleDef), the top module, example *chip.module_def()
+    Returns : true if the file was written.
+    ------------------------------------------------------------------------------------------*/
+    unordered_map<const ModuleDef*, uint32_t> index;
+    vector<const ModuleDef*> modules;
+    collect_modules(&module, index, modules);
+
+    SnapshotWriter writer;
+    for(size_t m = 0; m < modules.size(); m++){
+        const ModuleDef* def = modules.at(m);
+        SnapshotModule record;
+        memset(&record, 0, sizeof(record));
+        record.name = writer.text(def->name);
+        record.generator = writer.text(def->key.generator);
+        record.params = {(uint32_t)writer.params.size(), (uint32_t)def->key.params.size()};
+        writer.params.insert(writer.params.end(), def->key.params.begin(), def->key.params.end());
+        record.op = (uint32_t)def->op;
+        record.width = def->width;
+        record.delay = def->op == Op::FLIP_FLOP ? FLIP_FLOP_DELAY : gate_info(def->op).delay;
+        record.transistors = def->transistors;
+        record.total_transistors = def->total_transistors;
+        record.depth = def->depth;
+        record.total_instances = def->total_instances;
+
+        record.ports = {(uint32_t)writer.ports.size(), (uint32_t)def->ports.size()};
+        for(vector<Port>::const_iterator i = def->ports.begin(); i != def->ports.end(); i++){
+            writer.ports.push_back({writer.net(i->net), i->type});
+        }
+        record.wires = writer.net_list(def->wires.data(), def->wires.size());
+        record.regs = writer.net_list(def->regs.data(), def->regs.size());
+        record.assigns = {(uint32_t)writer.assigns.size(), (uint32_t)def->assigns.size()};
+        for(vector<Assign>::const_iterator i = def->assigns.begin(); i != def->assigns.end(); i++){
+            writer.assigns.push_back({writer.net(i->lhs), i->value});
+        }
+
+        record.instances = {(uint32_t)writer.instances.size(), (uint32_t)def->submodules.size()};
+        for(size_t i = 0; i < def->submodules.size(); i++){
+            SnapshotInstance instance;
+            instance.module = index.at(def->submodules.module(i));
+            instance.bindings = writer.net_list(def->submodules.bindings(i), def->submodules.num_bindings(i));
+            instance.name = writer.text(def->submodules.name(i));
+            if(!def->submodules.generate(i).empty()){
+                writer.overrides.push_back({(uint32_t)writer.instances.size(), writer.text(def->submodules.generate(i))});
+            }
+            writer.instances.push_back(instance);
+        }
+        record.dependencies = {(uint32_t)writer.dependencies.size(), (uint32_t)def->dependencies.size()};
+        for(vector<const ModuleDef*>::const_iterator i = def->dependencies.begin(); i != def->dependencies.end(); i++){
+            writer.dependencies.push_back(index.at(*i));
+        }
+
+        if(!has_netlist(*def)){
+            record.text = writer.text(def->definition.empty() ? verilog_definition(*def) : def->definition);
+        }
+        writer.modules.push_back(record);
+    }
+    if(writer.strings.size() > UINT32_MAX){
+        return false;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.generator_version = GENERATOR_VERSION;
+
+    string file((const char*)&header, sizeof(header));
+    write_section(file, header.modules, writer.modules.data(), writer.modules.size());
+    write_section(file, header.ports, writer.ports.data(), writer.ports.size());
+    write_section(file, header.nets, writer.nets.data(), writer.nets.size());
+    write_section(file, header.net_lists, writer.net_lists.data(), writer.net_lists.size());
+    write_section(file, header.instances, writer.instances.data(), writer.instances.size());
+    write_section(file, header.overrides, writer.overrides.data(), writer.overrides.size());
+    write_section(file, header.assigns, writer.assigns.data(), writer.assigns.size());
+    write_section(file, header.dependencies, writer.dependencies.data(), writer.dependencies.size());
+    write_section(file, header.params, writer.params.data(), writer.params.size());
+    write_section(file, header.symbols, writer.symbols.data(), writer.symbols.size());
+    write_section(file, header.strings, writer.strings.data(), writer.strings.size());
+    header.file_size = file.size();
+    memcpy(&file[0], &header, sizeof(header));
+
+    string temp_name = file_name + ".tmp." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id()));
+    ofstream out(temp_name, ios::binary);
+    out.write(file.data(), file.size());
+    out.close();
+    if(!out || rename(temp_name.c_str(), file_name.c_str()) != 0){
+        remove(temp_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+Snapshot::Snapshot(){
+    this->data = NULL;
+    this->size = 0;
+}
+
+Snapshot::~Snapshot(){
+    this->close();
+}
+
+bool Snapshot::open(const string& file_name){
+    /*------------------------------------------------------------------------------------------
+    Maps a snapshot into memory, read only.
+
+    Param : file_name (string), the snapshot file.
+    Returns : true if the file is a snapshot of this library version.
+    ------------------------------------------------------------------------------------------*/
+    this->close();
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)){
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED){
+        return false;
+    }
+    this->data = (const char*)mapped;
+    this->size = info.st_size;
+    if(!this->check()){
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void Snapshot::close(){
+    if(this->data != NULL){
+        munmap((void*)this->data, this->size);
+    }
+    this->data = NULL;
+    this->size = 0;
+}
+
+bool Snapshot::check() const{
+    /*------------------------------------------------------------------------------------------
+    Checks the header and that every section lies inside the file. The records themselves are
+    not walked, that is what keeps open() independent of the design size.
+    ------------------------------------------------------------------------------------------*/
+    const SnapshotHeader& header = this->header();
+    if(memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION
+        || header.generator_version != GENERATOR_VERSION || header.file_size != this->size || header.modules.count == 0){
+        return false;
+    }
+    const pair<const SnapshotSection*, size_t> sections[] = {
+        {&header.modules, sizeof(SnapshotModule)}, {&header.ports, sizeof(SnapshotPort)},
+        {&header.nets, sizeof(SnapshotNet)}, {&header.net_lists, sizeof(uint32_t)},
+        {&header.instances, sizeof(SnapshotInstance)}, {&header.overrides, sizeof(SnapshotOverride)},
+        {&header.assigns, sizeof(SnapshotAssign)},
+        {&header.dependencies, sizeof(uint32_t)}, {&header.params, sizeof(int32_t)},
+        {&header.symbols, sizeof(SnapshotString)}, {&header.strings, sizeof(char)},
+    };
+    for(size_t i = 0; i < sizeof(sections)/sizeof(sections[0]); i++){
+        const SnapshotSection& s = *sections[i].first;
+        if(s.offset % 8 != 0 || s.offset > this->size || s.count > (this->size - s.offset)/sections[i].second){
+            return false;
+        }
+    }
+    return true;
+}
+
+wire Snapshot::to_wire(const SnapshotNet& net) const{
+    /*------------------------------------------------------------------------------------------
+    Returns the net as a wire, example "A[3]" or the declaration "[7:0] A".
+    ------------------------------------------------------------------------------------------*/
+    wire name(this->symbol(net.symbol), 1);
+    switch(net.form){
+        case wire::BIT : return name[net.msb];
+        case wire::RANGE : return name.slice(net.msb, net.lsb);
+        case wire::DECL : return wire(this->symbol(net.symbol), net.msb - net.lsb + 1);
+        default : return name;
+    }
+}
+
+string_view Snapshot::generate(uint32_t instance) const{
+    /*------------------------------------------------------------------------------------------
+    Returns the instantiation syntax the chip gave for an instance, or an empty text.
+
+    Param : instance (uint32_t), index into the instances section, example m.instances.first + j
+    ------------------------------------------------------------------------------------------*/
+    const SnapshotOverride* first = this->section<SnapshotOverride>(this->header().overrides);
+    const SnapshotOverride* last = first + this->header().overrides.count;
+    const SnapshotOverride* found = lower_bound(first, last, instance, [](const SnapshotOverride& o, uint32_t i){
+        return o.instance < i;
+    });
+    return found != last && found->instance == instance ? this->text(found->generate) : string_view();
+}
+
+void Snapshot::write_verilog(ostream& out) const{
+    /*------------------------------------------------------------------------------------------
+    Writes the modules in dependency order. Stored texts are written straight from the mapping,
+    the other modules are rebuilt one at a time from their records and rendered by verilog_de-
+    finition(...), against shells of their submodules that only carry names and ports.
+    ------------------------------------------------------------------------------------------*/
+    out << "// Generated code\n// Sooryakiran P\n// ME17B174\n";
+    vector<shared_ptr<const ModuleDef>> shells;
+    for(size_t m = 0; m < this->num_modules(); m++){
+        const SnapshotModule& record = this->module(m);
+        shared_ptr<ModuleDef> shell = make_shared<ModuleDef>();
+        shell->name = string(this->text(record.name));
+        shell->op = (Op)record.op;
+        shell->width = record.width;
+        shell->transistors = record.transistors;
+        shell->total_transistors = record.total_transistors;
+        shell->total_instances = record.total_instances;
+        shell->depth = record.depth;
+        const SnapshotPort* ports = this->ports(record);
+        for(uint32_t p = 0; p < record.ports.count; p++){
+            shell->ports.push_back({this->to_wire(this->net(ports[p].net)), ports[p].type});
+        }
+        shells.push_back(shell);
+
+        if(record.text.size > 0){
+            out << "\n" << this->text(record.text) << "\n";
+            continue;
+        }
+        ModuleDef module(*shell);
+        const uint32_t* wires = this->net_list(record.wires);
+        for(uint32_t i = 0; i < record.wires.count; i++){
+            module.wires.push_back(this->to_wire(this->net(wires[i])));
+        }
+        const uint32_t* regs = this->net_list(record.regs);
+        for(uint32_t i = 0; i < record.regs.count; i++){
+            module.regs.push_back(this->to_wire(this->net(regs[i])));
+        }
+        const SnapshotAssign* assigns = this->assigns(record);
+        for(uint32_t i = 0; i < record.assigns.count; i++){
+            module.assigns.push_back({this->to_wire(this->net(assigns[i].net)), assigns[i].value});
+        }
+        const SnapshotInstance* instances = this->instances(record);
+        vector<wire> bindings;
+        for(uint32_t i = 0; i < record.instances.count; i++){
+            const uint32_t* nets = this->net_list(instances[i].bindings);
+            bindings.clear();
+            for(uint32_t p = 0; p < instances[i].bindings.count; p++){
+                bindings.push_back(this->to_wire(this->net(nets[p])));
+            }
+            module.submodules.add(this->text(instances[i].name), shells.at(instances[i].module), bindings, {},
+                                  string(this->generate(record.instances.first + i)));
+        }
+        out << "\n" << verilog_definition(module) << "\n";
+    }
+}
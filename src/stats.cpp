@@ -0,0 +1,99 @@
+#include <stats.h>
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+Stats& Stats::global(){
+    static Stats stats;
+    return stats;
+}
+
+void Stats::alive(int64_t n){
+    /*------------------------------------------------------------------------------------------
+    Updates the live Chip count and its peak.
+    ------------------------------------------------------------------------------------------*/
+    int64_t count = this->live.fetch_add(n, memory_order_relaxed) + n;
+    uint64_t peak = this->counters[PEAK_TREE_SIZE].load(memory_order_relaxed);
+    while(count > 0 && (uint64_t)count > peak && !this->counters[PEAK_TREE_SIZE].compare_exchange_weak(peak, count, memory_order_relaxed)){
+    }
+}
+
+void Stats::enter(Phase phase){
+    /*------------------------------------------------------------------------------------------
+    The first thread to enter a phase starts its clock.
+    ------------------------------------------------------------------------------------------*/
+    if(this->active[phase].fetch_add(1) == 0){
+        this->started[phase].store(Stats::now());
+    }
+}
+
+void Stats::leave(Phase phase){
+    /*------------------------------------------------------------------------------------------
+    The last thread to leave a phase stops its clock. The start is read before leaving, no other
+    thread can restart the clock while this one is still inside.
+    ------------------------------------------------------------------------------------------*/
+    uint64_t end = Stats::now();
+    uint64_t start = this->started[phase].load();
+    if(this->active[phase].fetch_sub(1) == 1){
+        this->nanoseconds[phase].fetch_add(end - start, memory_order_relaxed);
+    }
+}
+
+ElaborationStats Stats::snapshot() const{
+    ElaborationStats result;
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        result.counters[i] = this->counters[i].load();
+    }
+    for(int i = 0; i < NUM_PHASES; i++){
+        result.seconds[i] = this->nanoseconds[i].load() * 1e-9;
+    }
+    return result;
+}
+
+void Stats::reset(){
+    /*------------------------------------------------------------------------------------------
+    Zeros every counter and phase time. The peak tree size restarts from the chips alive now.
+    ------------------------------------------------------------------------------------------*/
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        this->counters[i] = 0;
+    }
+    for(int i = 0; i < NUM_PHASES; i++){
+        this->nanoseconds[i] = 0;
+    }
+    this->counters[PEAK_TREE_SIZE] = max<int64_t>(this->live.load(), 0);
+}
+
+const char* ElaborationStats::counter_name(Counter counter){
+    static const char* names[NUM_COUNTERS] = {
+        "instances created", "unique modules", "wires declared", "bytes emitted", "peak tree size", "joins removed"
+    };
+    return names[counter];
+}
+
+const char* ElaborationStats::phase_name(Phase phase){
+    static const char* names[NUM_PHASES] = {
+        "elaborate", "add_submodule", "intern", "define_headers", "num_transistors", "render", "write"
+    };
+    return names[phase];
+}
+
+string ElaborationStats::report() const{
+    /*------------------------------------------------------------------------------------------
+    Returns a printable table of the counters and phase times.
+    ------------------------------------------------------------------------------------------*/
+    string text;
+    char line[128];
+    if(!DOTV_STATS){
+        return "[STATS] Instrumentation is disabled (built with DOTV_STATS=0)\n";
+    }
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        snprintf(line, sizeof(line), "[STATS] %-18s %14llu\n", counter_name((Counter)i), (unsigned long long)this->counters[i]);
+        text += line;
+    }
+    for(int i = 0; i < NUM_PHASES; i++){
+        snprintf(line, sizeof(line), "[STATS] %-18s %12.3f s\n", phase_name((Phase)i), this->seconds[i]);
+        text += line;
+    }
+    return text;
+}
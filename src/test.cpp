@@ -0,0 +1,1784 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <verilog.h>
+#include <snapshot.h>
+#include <module_cache.h>
+#include <timing.h>
+#include <stats.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <functional>
+#include <memory>
+#include <random>
+#include <array>
+#include <stdexcept>
+#include <algorithm>
+#include <ctype.h>
+#include <filesystem>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                        Tests
+                                        =====
+
+End to end checks of the library and of generate_code.out, one line per test. A test throws
+runtime_error with the reason when it fails.
+
+    1. Snapshots : A saved and reopened design writes the verilog of the chip, and the
+            --snapshot of generate_code.out does not depend on the module cache.
+    2. Netlist export : The BLIF and the AIGER export of every generator are simulated on
+            random operands, every output has to be the sum or the product of the operands
+            some fixed number of cycles (the latency) earlier.
+    3. Flattening : The verilog written hierarchical, flat and partially flat is simulated,
+            all three compute the same function with the same latency and critical path.
+    4. JOIN elimination : The verilog without JOIN instances is simulated against the verilog
+            with them, the removed count is checked, with a cold and a warm module cache.
+    5. Optimization : The optimized verilog, BLIF and AIGER keep the latency, and the critical
+            path in the module header is the one of the optimized verilog.
+    6. Retiming : The retimed verilog, BLIF and AIGER keep the latency, the clock period in
+            the module header is the one of the retimed verilog and is not longer than before.
+    7. Static timing analysis : The clock period and the latency of analyze_timing(...) are
+            the longest path and the simulated latency of the verilog.
+    8. Clock period placement : Adders and multipliers pipelined for a clock period simulate
+            correctly and meet it.
+    9. Prefix topologies : Adders and multipliers on every prefix network simulate correctly,
+            the networks have the documented fanout and star count.
+    10. Dadda reduction : Dadda multipliers simulate correctly, with fewer gates than Wallace.
+    11. Module cache : Runs of generate_code.out with a cold, a warm and a corrupt cache write
+            the same verilog as a run without it, the warm run hits every module.
+    12. Batch mode : Configuration files are read with -t applied to every line, bad files
+            and failed configurations exit with EXIT_FAILURE.
+    13. Statistics : With DOTV_STATS=1 the counters follow an elaboration and its verilog, with
+            DOTV_STATS=0 they stay zero.
+    14. User chips : Chips keyed by their module name share it only with identical contents.
+
+The simulators run 64 random streams at once, one per bit of a uint64_t.
+
+Tests that run generate_code.out write to generated_codes/ like the generator itself.
+
+Usage : ./test.out            (make test)
+------------------------------------------------------------------------------------------*/
+
+typedef struct{
+    string name;
+    function<void()> run;
+} Test;
+
+typedef struct{
+    string name;
+    char op;                // '+' for the adders, 'x' for the multipliers
+    bool pipelined;
+    function<Chip*()> build;
+} Design;
+
+static void check(bool condition, const string& message){
+    if(!condition){
+        throw runtime_error(message);
+    }
+}
+
+static string read_file(const string& file_name){
+    ifstream in(file_name, ios::binary);
+    check(in.is_open(), "unable to read " + file_name);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+static string temporary_directory(const string& name){
+    /*------------------------------------------------------------------------------------------
+    Returns an empty directory under generated_codes/, unique to this process.
+    ------------------------------------------------------------------------------------------*/
+    string directory = "generated_codes/test_" + name + "_" + to_string(getpid());
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    return directory;
+}
+
+static int run_generator(const string& arguments, string* output = NULL){
+    /*------------------------------------------------------------------------------------------
+    Runs ./generate_code.out with the given arguments.
+
+    Param : arguments (string), example "-n 8 -k 2 --snapshot".
+    Param : output (string*), optional, receives everything the generator printed.
+    Returns : The exit status of the generator, -1 if it did not exit normally.
+    ------------------------------------------------------------------------------------------*/
+    string command = "./generate_code.out " + arguments + " 2>&1";
+    FILE* pipe = popen(command.c_str(), "r");
+    check(pipe != NULL, "unable to run " + command);
+    string text;
+    char buffer[4096];
+    size_t count;
+    while((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0){
+        text.append(buffer, count);
+    }
+    int status = pclose(pipe);
+    if(output != NULL){
+        *output = text;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static vector<Design> designs(){
+    /*------------------------------------------------------------------------------------------
+    A small design of every generator.
+    ------------------------------------------------------------------------------------------*/
+    return {
+        {"cra n=8", '+', false, []() -> Chip*{
+            return new CARRY_RIPPLE_ADDER("test", {"input_1", "input_2"}, "outputs", 8);
+        }},
+        {"cla n=16", '+', false, []() -> Chip*{
+            return new CARRY_LOOK_AHEAD_ADDER("test", {"input_1", "input_2"}, "outputs", 16);
+        }},
+        {"cla_pipelined n=16 k=2", '+', true, []() -> Chip*{
+            return new CARRY_LOOK_AHEAD_ADDER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 16, 2);
+        }},
+        {"wtm n=8 k=2", 'x', true, []() -> Chip*{
+            return new WALLACE_TREE_MULTIPLIER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 8, 2);
+        }},
+    };
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Snapshots
+                                        =========
+------------------------------------------------------------------------------------------*/
+
+static string snapshot_verilog(const string& file_name){
+    Snapshot snapshot;
+    check(snapshot.open(file_name), "unable to open " + file_name);
+    ostringstream out;
+    snapshot.write_verilog(out);
+    return out.str();
+}
+
+void add_snapshot_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    all.push_back({"csa n=8", '+', false, []() -> Chip*{
+        return new CARRY_SAVE_ADDER("test", {"input_1", "input_2", "input_3"}, {"sum", "carry"}, 8);
+    }});
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"snapshot round trip, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            ostringstream expected;
+            chip->write_verilog(expected);
+
+            string file_name = "generated_codes/test_" + to_string(getpid()) + ".snap";
+            check(Snapshot::save(file_name, *chip->module_def()), "unable to write " + file_name);
+            string loaded = snapshot_verilog(file_name);
+            remove(file_name.c_str());
+            check(loaded == expected.str(), "the snapshot verilog differs from the chip");
+        }});
+    }
+
+    tests.push_back({"snapshot of generate_code.out, cold and warm module cache", []() {
+        string cache = temporary_directory("cache");
+        check(run_generator("-n 8 -k 2 --snapshot") == EXIT_SUCCESS, "generate_code.out failed");
+        string cold = read_file("generated_codes/wtm_8_bits_k_2.snap");
+        check(snapshot_verilog("generated_codes/wtm_8_bits_k_2.snap") + "\n" == read_file("generated_codes/wtm_8_bits_k_2.v"),
+              "the snapshot verilog differs from the verilog file");
+
+        check(run_generator("-n 8 -k 2 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        check(run_generator("-n 8 -k 2 -c " + cache + " --snapshot") == EXIT_SUCCESS, "generate_code.out failed");
+        string warm = read_file("generated_codes/wtm_8_bits_k_2.snap");
+        filesystem::remove_all(cache);
+        check(warm == cold, "the snapshot depends on the module cache");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                    Netlist Export
+                                    ==============
+------------------------------------------------------------------------------------------*/
+
+static const int LANES = 64;
+static const int CYCLES = 40;
+
+class Netlist{
+    /*------------------------------------------------------------------------------------------
+    A synchronous gate netlist, every flipflop on the one clock.
+
+    Usefull methods:
+        1. inputs, outputs : Names of the port bits, example "A[3]", in port order.
+        2. step(in) : Applies one value per input, returns the outputs of this cycle and then
+                clocks the flipflops.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        virtual ~Netlist() {}
+        virtual vector<uint64_t> step(const vector<uint64_t>& in) = 0;
+
+        vector<string> inputs;
+        vector<string> outputs;
+};
+
+class BlifNetlist : public Netlist{
+    public:
+        BlifNetlist(const string& text);
+        vector<uint64_t> step(const vector<uint64_t>& in) override;
+
+    protected:
+        struct Table{
+            int output;
+            vector<int> fanin;
+            vector<string> rows;
+            bool on_set = true;
+        };
+        int signal(const string& name);
+
+        unordered_map<string, int> signals;
+        vector<Table> tables;
+        vector<int> input_ids;
+        vector<int> output_ids;
+        vector<pair<int, int>> latches;
+        vector<uint64_t> values;
+};
+
+int BlifNetlist::signal(const string& name){
+    unordered_map<string, int>::iterator it = this->signals.find(name);
+    if(it != this->signals.end()){
+        return it->second;
+    }
+    int id = this->signals.size();
+    this->signals[name] = id;
+    return id;
+}
+
+BlifNetlist::BlifNetlist(const string& text){
+    /*------------------------------------------------------------------------------------------
+    Parses the single model of write_blif(...) and sorts its tables fanin first.
+
+    Param : text (string), the BLIF file.
+    ------------------------------------------------------------------------------------------*/
+    istringstream in(text);
+    string line;
+    vector<Table> parsed;
+    vector<uint64_t> initial;
+    while(getline(in, line)){
+        istringstream fields(line);
+        vector<string> tokens;
+        string token;
+        while(fields >> token){
+            tokens.push_back(token);
+        }
+        if(tokens.empty() || tokens[0][0] == '#'){
+            continue;
+        }
+        if(tokens[0] == ".inputs" || tokens[0] == ".outputs"){
+            bool is_input = tokens[0] == ".inputs";
+            for(vector<string>::iterator name = tokens.begin() + 1; name != tokens.end(); name++){
+                (is_input ? this->inputs : this->outputs).push_back(*name);
+                (is_input ? this->input_ids : this->output_ids).push_back(this->signal(*name));
+            }
+        }
+        else if(tokens[0] == ".latch"){
+            if(tokens.size() < 3){
+                throw runtime_error("malformed line \"" + line + "\"");
+            }
+            this->latches.push_back({this->signal(tokens[1]), this->signal(tokens[2])});
+            string init = tokens.size() == 4 ? tokens[3] : tokens.size() == 6 ? tokens[5] : "0";
+            initial.push_back(init == "1" ? ~0ULL : 0);
+        }
+        else if(tokens[0] == ".names"){
+            if(tokens.size() < 2){
+                throw runtime_error("malformed line \"" + line + "\"");
+            }
+            Table table;
+            table.output = this->signal(tokens.back());
+            for(size_t i = 1; i + 1 < tokens.size(); i++){
+                table.fanin.push_back(this->signal(tokens[i]));
+            }
+            parsed.push_back(table);
+        }
+        else if(tokens[0][0] != '.'){
+            if(parsed.empty()){
+                throw runtime_error("cover row outside of a table \"" + line + "\"");
+            }
+            Table& table = parsed.back();
+            string row = table.fanin.empty() ? "" : tokens[0];
+            if(row.size() != table.fanin.size()){
+                throw runtime_error("cover row \"" + line + "\" does not match its table");
+            }
+            table.rows.push_back(row);
+            table.on_set = tokens.back() == "1";
+        }
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Depth first over the drivers, a table is emitted after every table driving it.
+    ------------------------------------------------------------------------------------------*/
+    vector<int> driver(this->signals.size(), -1);
+    for(size_t t = 0; t < parsed.size(); t++){
+        if(driver[parsed[t].output] != -1){
+            throw runtime_error("net driven twice");
+        }
+        driver[parsed[t].output] = t;
+    }
+    vector<char> state(parsed.size(), 0);
+    for(size_t root = 0; root < parsed.size(); root++){
+        vector<pair<int, size_t>> stack = {{(int)root, 0}};
+        while(!stack.empty()){
+            int t = stack.back().first;
+            size_t& next = stack.back().second;
+            if(next == 0 && state[t] != 0){
+                stack.pop_back();
+                continue;
+            }
+            state[t] = 1;
+            if(next < parsed[t].fanin.size()){
+                int d = driver[parsed[t].fanin[next++]];
+                if(d != -1 && state[d] == 1){
+                    throw runtime_error("combinational loop");
+                }
+                if(d != -1 && state[d] == 0){
+                    stack.push_back({d, 0});
+                }
+                continue;
+            }
+            state[t] = 2;
+            this->tables.push_back(parsed[t]);
+            stack.pop_back();
+        }
+    }
+
+    this->values.assign(this->signals.size(), 0);
+    for(size_t i = 0; i < this->latches.size(); i++){
+        this->values[this->latches[i].second] = initial[i];
+    }
+}
+
+vector<uint64_t> BlifNetlist::step(const vector<uint64_t>& in){
+    for(size_t i = 0; i < this->input_ids.size(); i++){
+        this->values[this->input_ids[i]] = in[i];
+    }
+    for(vector<Table>::iterator table = this->tables.begin(); table != this->tables.end(); table++){
+        uint64_t value = 0;
+        for(vector<string>::iterator row = table->rows.begin(); row != table->rows.end(); row++){
+            uint64_t match = ~0ULL;
+            for(size_t i = 0; i < row->size(); i++){
+                uint64_t bit = this->values[table->fanin[i]];
+                match &= (*row)[i] == '1' ? bit : (*row)[i] == '0' ? ~bit : ~0ULL;
+            }
+            value |= match;
+        }
+        this->values[table->output] = table->on_set ? value : ~value;
+    }
+    vector<uint64_t> out;
+    for(vector<int>::iterator id = this->output_ids.begin(); id != this->output_ids.end(); id++){
+        out.push_back(this->values[*id]);
+    }
+    vector<uint64_t> next;
+    for(vector<pair<int, int>>::iterator latch = this->latches.begin(); latch != this->latches.end(); latch++){
+        next.push_back(this->values[latch->first]);
+    }
+    for(size_t i = 0; i < this->latches.size(); i++){
+        this->values[this->latches[i].second] = next[i];
+    }
+    return out;
+}
+
+class AigerNetlist : public Netlist{
+    public:
+        AigerNetlist(const string& data);
+        vector<uint64_t> step(const vector<uint64_t>& in) override;
+
+    protected:
+        uint64_t literal(unsigned lit) const { return this->values[lit >> 1] ^ (lit & 1 ? ~0ULL : 0); }
+
+        unsigned num_inputs = 0;
+        vector<unsigned> latch_next;
+        vector<unsigned> output_lits;
+        vector<array<unsigned, 3>> ands;
+        vector<uint64_t> values;
+};
+
+AigerNetlist::AigerNetlist(const string& data){
+    /*------------------------------------------------------------------------------------------
+    Parses the binary AIGER file of write_aiger(...) with its symbol table.
+
+    Param : data (string), the AIGER file.
+    ------------------------------------------------------------------------------------------*/
+    size_t pos = 0;
+    function<string()> line = [&]() -> string{
+        size_t end = data.find('\n', pos);
+        if(end == string::npos){
+            throw runtime_error("truncated file");
+        }
+        string text = data.substr(pos, end - pos);
+        pos = end + 1;
+        return text;
+    };
+    istringstream header(line());
+    string magic;
+    unsigned max_var, num_latches, num_outputs, num_ands;
+    if(!(header >> magic >> max_var >> this->num_inputs >> num_latches >> num_outputs >> num_ands) || magic != "aig"){
+        throw runtime_error("not a binary AIGER file");
+    }
+    vector<uint64_t> initial;
+    for(unsigned i = 0; i < num_latches; i++){
+        istringstream fields(line());
+        unsigned next, init = 0;
+        fields >> next >> init;
+        this->latch_next.push_back(next);
+        initial.push_back(init == 1 ? ~0ULL : 0);
+    }
+    for(unsigned i = 0; i < num_outputs; i++){
+        this->output_lits.push_back(stoul(line()));
+    }
+    function<unsigned()> delta = [&]() -> unsigned{
+        unsigned x = 0;
+        for(int shift = 0; pos < data.size(); shift += 7){
+            unsigned char byte = data[pos++];
+            x |= (unsigned)(byte & 0x7f) << shift;
+            if(!(byte & 0x80)){
+                return x;
+            }
+        }
+        throw runtime_error("truncated and gates");
+    };
+    for(unsigned i = 0; i < num_ands; i++){
+        unsigned lhs = 2*(this->num_inputs + num_latches + i + 1);
+        unsigned rhs0 = lhs - delta();
+        unsigned rhs1 = rhs0 - delta();
+        this->ands.push_back({lhs, rhs0, rhs1});
+    }
+
+    this->inputs.assign(this->num_inputs, "");
+    this->outputs.assign(num_outputs, "");
+    while(pos < data.size()){
+        string symbol = line();
+        if(symbol == "c"){
+            break;
+        }
+        size_t space = symbol.find(' ');
+        if(space == string::npos || space < 2){
+            throw runtime_error("malformed symbol \"" + symbol + "\"");
+        }
+        unsigned index = stoul(symbol.substr(1, space - 1));
+        if(symbol[0] == 'i' && index < this->num_inputs){
+            this->inputs[index] = symbol.substr(space + 1);
+        }
+        else if(symbol[0] == 'o' && index < num_outputs){
+            this->outputs[index] = symbol.substr(space + 1);
+        }
+    }
+
+    this->values.assign(max_var + 1, 0);
+    for(unsigned i = 0; i < num_latches; i++){
+        this->values[this->num_inputs + 1 + i] = initial[i];
+    }
+}
+
+vector<uint64_t> AigerNetlist::step(const vector<uint64_t>& in){
+    for(unsigned i = 0; i < this->num_inputs; i++){
+        this->values[i + 1] = in[i];
+    }
+    for(vector<array<unsigned, 3>>::iterator gate = this->ands.begin(); gate != this->ands.end(); gate++){
+        this->values[(*gate)[0] >> 1] = this->literal((*gate)[1]) & this->literal((*gate)[2]);
+    }
+    vector<uint64_t> out;
+    for(vector<unsigned>::iterator lit = this->output_lits.begin(); lit != this->output_lits.end(); lit++){
+        out.push_back(this->literal(*lit));
+    }
+    vector<uint64_t> next;
+    for(vector<unsigned>::iterator lit = this->latch_next.begin(); lit != this->latch_next.end(); lit++){
+        next.push_back(this->literal(*lit));
+    }
+    for(size_t i = 0; i < next.size(); i++){
+        this->values[this->num_inputs + 1 + i] = next[i];
+    }
+    return out;
+}
+
+static void split_port(const string& name, string* base, int* bit){
+    /*------------------------------------------------------------------------------------------
+    Splits a port bit name, example "A[3]" into "A" and 3, "CLK" into "CLK" and 0.
+    ------------------------------------------------------------------------------------------*/
+    size_t bracket = name.find('[');
+    *base = name.substr(0, bracket);
+    *bit = bracket == string::npos ? 0 : atoi(name.c_str() + bracket + 1);
+}
+
+int simulate(Netlist& netlist, char op){
+    /*------------------------------------------------------------------------------------------
+    Drives the two multi bit inputs of the netlist with random operands and looks for the
+    latency after which the multi bit output is their sum (op '+') or product (op 'x'), both
+    taken modulo the output width. Single bit inputs (the clock) are held at 0.
+
+    Param : netlist (Netlist), a freshly parsed netlist, its flipflops at their initial value.
+    Param : op (char), '+' or 'x'.
+
+    Return : The latency in cycles, throws runtime_error if there is none.
+    ------------------------------------------------------------------------------------------*/
+    vector<string> bases;
+    vector<int> widths;
+    vector<int> input_operand, input_bit;
+    for(vector<string>::iterator name = netlist.inputs.begin(); name != netlist.inputs.end(); name++){
+        string base;
+        int bit;
+        split_port(*name, &base, &bit);
+        size_t b = 0;
+        while(b < bases.size() && bases[b] != base){
+            b++;
+        }
+        if(b == bases.size()){
+            bases.push_back(base);
+            widths.push_back(0);
+        }
+        widths[b]++;
+        input_operand.push_back(b);
+        input_bit.push_back(bit);
+    }
+    vector<int> operands;
+    for(size_t b = 0; b < bases.size(); b++){
+        if(widths[b] > 1){
+            operands.push_back(b);
+        }
+    }
+    if(operands.size() != 2 || netlist.outputs.empty()){
+        throw runtime_error("expected two operands and one result");
+    }
+    string result;
+    vector<int> output_bit;
+    for(vector<string>::iterator name = netlist.outputs.begin(); name != netlist.outputs.end(); name++){
+        int bit;
+        split_port(*name, &result, &bit);
+        output_bit.push_back(bit);
+    }
+    int width = netlist.outputs.size();
+    uint64_t mask = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+
+    mt19937_64 random(width);
+    vector<array<uint64_t, LANES>> a(CYCLES), b(CYCLES), out(CYCLES);
+    for(int t = 0; t < CYCLES; t++){
+        vector<uint64_t> in(netlist.inputs.size(), 0);
+        for(int lane = 0; lane < LANES; lane++){
+            a[t][lane] = random() & ((1ULL << widths[operands[0]]) - 1);
+            b[t][lane] = random() & ((1ULL << widths[operands[1]]) - 1);
+            for(size_t i = 0; i < in.size(); i++){
+                uint64_t value = input_operand[i] == operands[0] ? a[t][lane] : input_operand[i] == operands[1] ? b[t][lane] : 0;
+                in[i] |= ((value >> input_bit[i]) & 1) << lane;
+            }
+        }
+        vector<uint64_t> bits = netlist.step(in);
+        for(int lane = 0; lane < LANES; lane++){
+            out[t][lane] = 0;
+            for(size_t i = 0; i < bits.size(); i++){
+                out[t][lane] |= ((bits[i] >> lane) & 1) << output_bit[i];
+            }
+        }
+    }
+
+    for(int latency = 0; latency < CYCLES/2; latency++){
+        bool matches = true;
+        for(int t = latency; t < CYCLES && matches; t++){
+            for(int lane = 0; lane < LANES && matches; lane++){
+                uint64_t x = a[t - latency][lane], y = b[t - latency][lane];
+                matches = out[t][lane] == ((op == 'x' ? x*y : x + y) & mask);
+            }
+        }
+        if(matches){
+            return latency;
+        }
+    }
+    throw runtime_error(result + " is not the " + (op == 'x' ? "product" : "sum") + " of " + bases[operands[0]] + " and " + bases[operands[1]]);
+}
+
+int export_latency(Chip& chip, char op, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Simulates the BLIF and the AIGER export of the chip, both have to have the same latency.
+
+    Return : The latency in cycles.
+    ------------------------------------------------------------------------------------------*/
+    ostringstream blif, aiger;
+    chip.write_blif(blif, options);
+    chip.write_aiger(aiger, options);
+    BlifNetlist blif_netlist(blif.str());
+    AigerNetlist aiger_netlist(aiger.str());
+    int latency = simulate(blif_netlist, op);
+    check(simulate(aiger_netlist, op) == latency, "the BLIF and the AIGER netlist have different latencies");
+    return latency;
+}
+
+void add_export_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"BLIF and AIGER simulation, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            int latency = export_latency(*chip, design.op, EmitOptions());
+            check((latency > 0) == design.pipelined, "latency " + to_string(latency));
+        }});
+    }
+
+    tests.push_back({"BLIF and AIGER of generate_code.out, cold and warm module cache", []() {
+        string cache = temporary_directory("cache");
+        check(run_generator("-n 8 -k 2 --blif --aiger") == EXIT_SUCCESS, "generate_code.out failed");
+        string blif = read_file("generated_codes/wtm_8_bits_k_2.blif");
+        string aiger = read_file("generated_codes/wtm_8_bits_k_2.aig");
+        check(run_generator("-n 8 -k 2 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        check(run_generator("-n 8 -k 2 -c " + cache + " --blif --aiger") == EXIT_SUCCESS, "generate_code.out failed");
+        bool same = read_file("generated_codes/wtm_8_bits_k_2.blif") == blif && read_file("generated_codes/wtm_8_bits_k_2.aig") == aiger;
+        filesystem::remove_all(cache);
+        check(same, "the netlists depend on the module cache");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Flattening
+                                        ==========
+------------------------------------------------------------------------------------------*/
+
+class VerilogNetlist : public Netlist{
+    /*------------------------------------------------------------------------------------------
+    The structural verilog written by the library, elaborated down to bits: module instances
+    (bound by position), continuous assigns of gate expressions and constants, and always
+    blocks of flipflops. The top module is the last module of the text.
+
+    Usefull methods:
+        1. step(in) : See Netlist.
+        2. num_modules(), num_gates() : The modules defined in the text, the elaborated gates.
+        3. period() : The longest path between the inputs, the flipflops and the outputs, with
+                the #delays of the text, a flipflop output arriving at its clock to output delay.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        VerilogNetlist(const string& text);
+        vector<uint64_t> step(const vector<uint64_t>& in) override;
+        size_t num_modules() const { return this->modules.size(); }
+        size_t num_gates() const { return this->gates.size(); }
+        int period() const;
+
+    protected:
+        struct Expr{
+            char kind;          // 'n' net, 'c' constant, '{' concatenation, '~' not, '&' '|' '^'
+            string name;
+            int msb = -1, lsb = -1;
+            string bits;        // constants, most significant first, empty for unsized
+            vector<Expr> args;
+        };
+        struct Statement{
+            char kind;          // 'd' declaration, 'a' assign, 'f' flipflop, 'i' instance
+            string name;        // declared net or instance type
+            int msb = 0, lsb = 0;
+            bool is_input = false, is_output = false;
+            int delay = 0;
+            vector<Expr> args;  // assign and flipflop: lhs, rhs. instance: bindings
+        };
+        struct Module{
+            string name;
+            vector<string> ports;
+            vector<Statement> statements;
+        };
+        struct Net{
+            vector<int> bits;
+            int lsb = 0;
+        };
+        struct Gate{
+            char op;
+            int a, b, out, delay;
+        };
+
+        Expr expression();
+        Expr primary();
+        void elaborate(const Module& module, const vector<vector<int>>& bindings, bool top);
+        vector<int> evaluate(const Expr& expr, unordered_map<string, Net>& scope, int delay);
+        int node();
+        int find(int x);
+        void unite(int a, int b);
+
+        vector<string> tokens;
+        size_t pos = 0;
+        vector<Module> modules;
+        unordered_map<string, size_t> module_index;
+
+        vector<int> parent;
+        vector<Gate> gates;
+        vector<pair<int, int>> flops;
+        vector<int> flop_delay;
+        vector<int> input_nodes, output_nodes;
+        vector<uint64_t> values;
+};
+
+int VerilogNetlist::node(){
+    this->parent.push_back(this->parent.size());
+    return this->parent.size() - 1;
+}
+
+int VerilogNetlist::find(int x){
+    while(this->parent[x] != x){
+        this->parent[x] = this->parent[this->parent[x]];
+        x = this->parent[x];
+    }
+    return x;
+}
+
+void VerilogNetlist::unite(int a, int b){
+    a = this->find(a);
+    b = this->find(b);
+    check(a > 1 || b > 1 || a == b, "net tied to 0 and 1");
+    if(a <= 1){
+        swap(a, b);
+    }
+    this->parent[a] = b;
+}
+
+VerilogNetlist::Expr VerilogNetlist::primary(){
+    string token = this->tokens.at(this->pos++);
+    Expr expr;
+    if(token == "("){
+        expr = this->expression();
+        this->pos++;
+    }
+    else if(token == "~"){
+        expr.kind = '~';
+        expr.args.push_back(this->primary());
+    }
+    else if(token == "{"){
+        expr.kind = '{';
+        do{
+            expr.args.push_back(this->expression());
+        } while(this->tokens.at(this->pos++) == ",");
+    }
+    else if(isdigit(token[0])){
+        expr.kind = 'c';
+        size_t quote = token.find('\'');
+        if(quote == string::npos){
+            expr.bits = "";
+            expr.msb = stoi(token);
+        }
+        else{
+            expr.bits = token.substr(quote + 2);
+            expr.bits.insert(0, max(0, stoi(token.substr(0, quote)) - (int)expr.bits.size()), '0');
+        }
+    }
+    else{
+        expr.kind = 'n';
+        expr.name = token;
+        if(this->tokens.at(this->pos) == "["){
+            expr.msb = expr.lsb = stoi(this->tokens.at(this->pos + 1));
+            this->pos += 2;
+            if(this->tokens.at(this->pos) == ":"){
+                expr.lsb = stoi(this->tokens.at(this->pos + 1));
+                this->pos += 2;
+            }
+            this->pos++;
+        }
+    }
+    return expr;
+}
+
+VerilogNetlist::Expr VerilogNetlist::expression(){
+    Expr expr = this->primary();
+    while(this->tokens.at(this->pos) == "&" || this->tokens.at(this->pos) == "|" || this->tokens.at(this->pos) == "^"){
+        Expr binary;
+        binary.kind = this->tokens.at(this->pos++)[0];
+        binary.args.push_back(expr);
+        binary.args.push_back(this->primary());
+        expr = binary;
+    }
+    return expr;
+}
+
+VerilogNetlist::VerilogNetlist(const string& text){
+    /*------------------------------------------------------------------------------------------
+    Splits the text into tokens, parses every module and elaborates the last one.
+
+    Param : text (string), the verilog file.
+    ------------------------------------------------------------------------------------------*/
+    for(size_t i = 0; i < text.size();){
+        char c = text[i];
+        if(isspace(c)){
+            i++;
+        }
+        else if(text.compare(i, 2, "//") == 0){
+            i = text.find('\n', i);
+        }
+        else if(isalnum(c) || c == '_' || c == '\''){
+            size_t start = i;
+            while(i < text.size() && (isalnum(text[i]) || text[i] == '_' || text[i] == '\'' || text[i] == '$')){
+                i++;
+            }
+            this->tokens.push_back(text.substr(start, i - start));
+        }
+        else{
+            size_t size = text.compare(i, 2, "<=") == 0 ? 2 : 1;
+            this->tokens.push_back(text.substr(i, size));
+            i += size;
+        }
+    }
+    this->tokens.push_back("");
+
+    while(this->pos < this->tokens.size() && this->tokens[this->pos] == "module"){
+        Module module;
+        module.name = this->tokens.at(this->pos + 1);
+        this->pos += 3;
+        while(this->tokens.at(this->pos) != ")"){
+            if(this->tokens.at(this->pos) != ","){
+                module.ports.push_back(this->tokens.at(this->pos));
+            }
+            this->pos++;
+        }
+        this->pos += 2;
+        while(this->tokens.at(this->pos) != "endmodule"){
+            string keyword = this->tokens.at(this->pos++);
+            Statement statement;
+            if(keyword == "input" || keyword == "output" || keyword == "inout" || keyword == "wire" || keyword == "reg"){
+                statement.kind = 'd';
+                statement.is_input = keyword == "input" || keyword == "inout";
+                statement.is_output = keyword == "output" || keyword == "inout";
+                if(this->tokens.at(this->pos) == "reg"){
+                    this->pos++;
+                }
+                if(this->tokens.at(this->pos) == "["){
+                    statement.msb = stoi(this->tokens.at(this->pos + 1));
+                    statement.lsb = stoi(this->tokens.at(this->pos + 3));
+                    this->pos += 5;
+                }
+                while(this->tokens.at(this->pos - 1) != ";"){
+                    statement.name = this->tokens.at(this->pos);
+                    module.statements.push_back(statement);
+                    this->pos += 2;
+                }
+            }
+            else if(keyword == "assign"){
+                statement.kind = 'a';
+                if(this->tokens.at(this->pos) == "#"){
+                    statement.delay = stoi(this->tokens.at(this->pos + 1));
+                    this->pos += 2;
+                }
+                statement.args.push_back(this->expression());
+                check(this->tokens.at(this->pos++) == "=", "malformed assign in " + module.name);
+                statement.args.push_back(this->expression());
+                this->pos++;
+                module.statements.push_back(statement);
+            }
+            else if(keyword == "always"){
+                check(this->tokens.at(this->pos) == "@" && this->tokens.at(this->pos + 2) == "posedge", "only flipflops are supported, in " + module.name);
+                this->pos += 5;
+                bool block = this->tokens.at(this->pos) == "begin";
+                this->pos += block;
+                do{
+                    Statement flop;
+                    flop.kind = 'f';
+                    flop.args.push_back(this->expression());
+                    check(this->tokens.at(this->pos++) == "<=", "malformed flipflop in " + module.name);
+                    if(this->tokens.at(this->pos) == "#"){
+                        flop.delay = stoi(this->tokens.at(this->pos + 1));
+                        this->pos += 2;
+                    }
+                    flop.args.push_back(this->expression());
+                    this->pos++;
+                    module.statements.push_back(flop);
+                } while(block && this->tokens.at(this->pos) != "end");
+                this->pos += block;
+            }
+            else{
+                statement.kind = 'i';
+                statement.name = keyword;
+                check(this->tokens.at(this->pos + 1) == "(", "unsupported statement " + keyword + " in " + module.name);
+                this->pos += 2;
+                while(this->tokens.at(this->pos) != ")"){
+                    statement.args.push_back(this->expression());
+                    if(this->tokens.at(this->pos) == ","){
+                        this->pos++;
+                    }
+                }
+                this->pos += 2;
+                module.statements.push_back(statement);
+            }
+        }
+        this->pos++;
+        this->module_index[module.name] = this->modules.size();
+        this->modules.push_back(module);
+    }
+    check(!this->modules.empty(), "no module in the verilog text");
+
+    this->node();
+    this->node();
+    this->elaborate(this->modules.back(), {}, true);
+
+    /*------------------------------------------------------------------------------------------
+    Resolve the aliases, then order the gates fanin first.
+    ------------------------------------------------------------------------------------------*/
+    vector<int> driver(this->parent.size(), -1);
+    for(size_t g = 0; g < this->gates.size(); g++){
+        Gate& gate = this->gates[g];
+        gate.a = this->find(gate.a);
+        gate.b = gate.b < 0 ? -1 : this->find(gate.b);
+        gate.out = this->find(gate.out);
+        check(gate.out > 1 && driver[gate.out] == -1, "net driven twice");
+        driver[gate.out] = g;
+    }
+    /*------------------------------------------------------------------------------------------
+    The pipelined carry look ahead adder joins the flopped carry of its first bit to the constant
+    carry in, the flipflop only ever stores that constant and is dropped.
+    ------------------------------------------------------------------------------------------*/
+    vector<pair<int, int>> kept;
+    vector<int> kept_delay;
+    for(size_t i = 0; i < this->flops.size(); i++){
+        int q = this->find(this->flops[i].first);
+        check(driver[q] == -1, "flipflop output driven twice");
+        if(q > 1){
+            kept.push_back({q, this->find(this->flops[i].second)});
+            kept_delay.push_back(this->flop_delay[i]);
+        }
+    }
+    this->flops.swap(kept);
+    this->flop_delay.swap(kept_delay);
+    for(size_t i = 0; i < this->input_nodes.size(); i++){
+        this->input_nodes[i] = this->find(this->input_nodes[i]);
+    }
+    for(size_t i = 0; i < this->output_nodes.size(); i++){
+        this->output_nodes[i] = this->find(this->output_nodes[i]);
+    }
+
+    vector<Gate> ordered;
+    vector<char> state(this->gates.size(), 0);
+    for(size_t root = 0; root < this->gates.size(); root++){
+        vector<pair<int, int>> stack = {{(int)root, 0}};
+        while(!stack.empty()){
+            int g = stack.back().first;
+            int& next = stack.back().second;
+            if(next == 0 && state[g] != 0){
+                stack.pop_back();
+                continue;
+            }
+            state[g] = 1;
+            int input = next == 0 ? this->gates[g].a : next == 1 ? this->gates[g].b : -2;
+            if(input != -2){
+                next++;
+                int d = input < 0 ? -1 : driver[input];
+                check(d == -1 || state[d] != 1, "combinational loop");
+                if(d != -1 && state[d] == 0){
+                    stack.push_back({d, 0});
+                }
+                continue;
+            }
+            state[g] = 2;
+            ordered.push_back(this->gates[g]);
+            stack.pop_back();
+        }
+    }
+    this->gates.swap(ordered);
+
+    this->values.assign(this->parent.size(), 0);
+    this->values[1] = ~0ULL;
+}
+
+vector<int> VerilogNetlist::evaluate(const Expr& expr, unordered_map<string, Net>& scope, int delay){
+    /*------------------------------------------------------------------------------------------
+    The bits of an expression, least significant first. Operators become gates, the outermost
+    one gets the delay of the statement.
+    ------------------------------------------------------------------------------------------*/
+    vector<int> bits;
+    if(expr.kind == 'n'){
+        Net& net = scope[expr.name];
+        int msb = expr.msb < 0 ? net.lsb + (int)net.bits.size() - 1 : expr.msb;
+        int lsb = expr.msb < 0 ? net.lsb : expr.lsb;
+        while(max(msb, lsb) - net.lsb >= (int)net.bits.size()){
+            net.bits.push_back(this->node());
+        }
+        for(int i = min(msb, lsb); i <= max(msb, lsb); i++){
+            bits.push_back(net.bits.at(i - net.lsb));
+        }
+    }
+    else if(expr.kind == 'c'){
+        if(expr.bits.empty()){
+            bits.push_back(expr.msb & 1);
+        }
+        for(string::const_reverse_iterator c = expr.bits.rbegin(); c != expr.bits.rend(); c++){
+            bits.push_back(*c == '1');
+        }
+    }
+    else if(expr.kind == '{'){
+        for(vector<Expr>::const_reverse_iterator arg = expr.args.rbegin(); arg != expr.args.rend(); arg++){
+            vector<int> part = this->evaluate(*arg, scope, 0);
+            bits.insert(bits.end(), part.begin(), part.end());
+        }
+    }
+    else{
+        vector<int> a = this->evaluate(expr.args.at(0), scope, 0);
+        vector<int> b = expr.kind == '~' ? vector<int>(a.size(), -1) : this->evaluate(expr.args.at(1), scope, 0);
+        check(a.size() == b.size(), "operands of different widths");
+        for(size_t i = 0; i < a.size(); i++){
+            bits.push_back(this->node());
+            this->gates.push_back({expr.kind, a[i], b[i], bits.back(), delay});
+        }
+    }
+    return bits;
+}
+
+void VerilogNetlist::elaborate(const Module& module, const vector<vector<int>>& bindings, bool top){
+    /*------------------------------------------------------------------------------------------
+    Adds the nets, gates and flipflops of one instance of a module. bindings are the bits of
+    the expressions bound to its ports, in port order.
+    ------------------------------------------------------------------------------------------*/
+    unordered_map<string, Net> scope;
+    for(vector<Statement>::const_iterator s = module.statements.begin(); s != module.statements.end(); s++){
+        if(s->kind != 'd' || scope.count(s->name)){
+            continue;
+        }
+        Net& net = scope[s->name];
+        net.lsb = min(s->msb, s->lsb);
+        for(int i = 0; i <= abs(s->msb - s->lsb); i++){
+            net.bits.push_back(this->node());
+        }
+        if(top && (s->is_input || s->is_output)){
+            for(int i = 0; i < (int)net.bits.size(); i++){
+                string name = s->msb == s->lsb ? s->name : s->name + "[" + to_string(net.lsb + i) + "]";
+                (s->is_input ? this->inputs : this->outputs).push_back(name);
+                (s->is_input ? this->input_nodes : this->output_nodes).push_back(net.bits[i]);
+            }
+        }
+    }
+    check(top || bindings.size() == module.ports.size(), module.name + " bound to " + to_string(bindings.size()) + " nets");
+    for(size_t p = 0; p < bindings.size(); p++){
+        const vector<int>& port = scope.at(module.ports[p]).bits;
+        for(size_t i = 0; i < min(port.size(), bindings[p].size()); i++){
+            this->unite(port[i], bindings[p][i]);
+        }
+    }
+
+    for(vector<Statement>::const_iterator s = module.statements.begin(); s != module.statements.end(); s++){
+        if(s->kind == 'a'){
+            vector<int> lhs = this->evaluate(s->args[0], scope, 0);
+            vector<int> rhs = this->evaluate(s->args[1], scope, s->delay);
+            rhs.resize(lhs.size(), 0);
+            for(size_t i = 0; i < lhs.size(); i++){
+                this->unite(lhs[i], rhs[i]);
+            }
+        }
+        else if(s->kind == 'f'){
+            vector<int> q = this->evaluate(s->args[0], scope, 0);
+            vector<int> d = this->evaluate(s->args[1], scope, 0);
+            d.resize(q.size(), 0);
+            for(size_t i = 0; i < q.size(); i++){
+                this->flops.push_back({q[i], d[i]});
+                this->flop_delay.push_back(s->delay);
+            }
+        }
+        else if(s->kind == 'i'){
+            unordered_map<string, size_t>::iterator found = this->module_index.find(s->name);
+            check(found != this->module_index.end(), "unknown module " + s->name);
+            vector<vector<int>> actual;
+            for(vector<Expr>::const_iterator arg = s->args.begin(); arg != s->args.end(); arg++){
+                actual.push_back(this->evaluate(*arg, scope, 0));
+            }
+            this->elaborate(this->modules[found->second], actual, false);
+        }
+    }
+}
+
+vector<uint64_t> VerilogNetlist::step(const vector<uint64_t>& in){
+    for(size_t i = 0; i < this->input_nodes.size(); i++){
+        this->values[this->input_nodes[i]] = in[i];
+    }
+    for(vector<Gate>::iterator gate = this->gates.begin(); gate != this->gates.end(); gate++){
+        uint64_t a = this->values[gate->a];
+        uint64_t b = gate->b < 0 ? 0 : this->values[gate->b];
+        this->values[gate->out] = gate->op == '&' ? a & b : gate->op == '|' ? a | b : gate->op == '^' ? a ^ b : ~a;
+    }
+    vector<uint64_t> out;
+    for(vector<int>::iterator n = this->output_nodes.begin(); n != this->output_nodes.end(); n++){
+        out.push_back(this->values[*n]);
+    }
+    vector<uint64_t> next;
+    for(vector<pair<int, int>>::iterator flop = this->flops.begin(); flop != this->flops.end(); flop++){
+        next.push_back(this->values[flop->second]);
+    }
+    for(size_t i = 0; i < next.size(); i++){
+        this->values[this->flops[i].first] = next[i];
+    }
+    return out;
+}
+
+int VerilogNetlist::period() const{
+    vector<int> arrival(this->parent.size(), 0);
+    for(size_t i = 0; i < this->flops.size(); i++){
+        arrival[this->flops[i].first] = this->flop_delay[i];
+    }
+    for(vector<Gate>::const_iterator gate = this->gates.begin(); gate != this->gates.end(); gate++){
+        arrival[gate->out] = max(arrival[gate->a], gate->b < 0 ? 0 : arrival[gate->b]) + gate->delay;
+    }
+    int period = 0;
+    for(vector<int>::const_iterator n = this->output_nodes.begin(); n != this->output_nodes.end(); n++){
+        period = max(period, arrival[*n]);
+    }
+    for(vector<pair<int, int>>::const_iterator flop = this->flops.begin(); flop != this->flops.end(); flop++){
+        period = max(period, arrival[flop->second]);
+    }
+    return period;
+}
+
+static VerilogNetlist emitted(Chip& chip, const EmitOptions& options){
+    ostringstream out;
+    chip.write_verilog(out, options);
+    return VerilogNetlist(out.str());
+}
+
+void add_flatten_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"flat verilog simulation, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            VerilogNetlist hierarchical = emitted(*chip, EmitOptions());
+            int latency = simulate(hierarchical, design.op);
+
+            EmitOptions options;
+            options.flatten = true;
+            VerilogNetlist flat = emitted(*chip, options);
+            check(flat.num_modules() == 1, to_string(flat.num_modules()) + " modules in the flat verilog");
+            check(simulate(flat, design.op) == latency, "the flat module changes the latency");
+            check(flat.period() == hierarchical.period(), "the flat module changes the critical path");
+
+            options.max_depth = 0;
+            VerilogNetlist shallow = emitted(*chip, options);
+            check(shallow.num_modules() > 1, "--flat-depth 0 inlined every module");
+            check(simulate(shallow, design.op) == latency, "--flat-depth 0 changes the latency");
+
+            options.max_depth = INT_MAX;
+            options.max_instances = 2;
+            VerilogNetlist small = emitted(*chip, options);
+            check(small.num_modules() > 1, "--flat-size 2 inlined every module");
+            check(simulate(small, design.op) == latency, "--flat-size 2 changes the latency");
+        }});
+    }
+
+    tests.push_back({"flat verilog of generate_code.out, cold and warm module cache, file names", []() {
+        string cache = temporary_directory("cache");
+        check(run_generator("-n 8 -k 2 --flat") == EXIT_SUCCESS, "generate_code.out failed");
+        string flat = read_file("generated_codes/wtm_8_bits_k_2_flat.v");
+        check(run_generator("-n 8 -k 2 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        check(run_generator("-n 8 -k 2 -c " + cache + " --flat") == EXIT_SUCCESS, "generate_code.out failed");
+        bool same = read_file("generated_codes/wtm_8_bits_k_2_flat.v") == flat;
+        filesystem::remove_all(cache);
+        check(same, "the flat verilog depends on the module cache");
+
+        check(run_generator("-n 8 -k 2 --flat-depth 1 --flat-size 100") == EXIT_SUCCESS, "generate_code.out failed");
+        check(filesystem::exists("generated_codes/wtm_8_bits_k_2_flat_depth_1_size_100.v"), "no _flat_depth_1_size_100 file");
+        check(read_file("generated_codes/wtm_8_bits_k_2_flat.v") == flat, "--flat-depth overwrote the --flat file");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                    JOIN Elimination
+                                    ================
+------------------------------------------------------------------------------------------*/
+
+static size_t join_instances(const string& verilog){
+    istringstream in(verilog);
+    string line;
+    size_t count = 0;
+    while(getline(in, line)){
+        istringstream words(line);
+        string type;
+        words >> type;
+        count += type.compare(0, 4, "JOIN") == 0;
+    }
+    return count;
+}
+
+void add_join_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"JOIN elimination, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            ostringstream plain, nojoin;
+            chip->write_verilog(plain);
+            EmitOptions options;
+            options.eliminate_joins = true;
+            size_t removed = chip->write_verilog(nojoin, options);
+
+            check(join_instances(nojoin.str()) == 0, to_string(join_instances(nojoin.str())) + " JOIN instances left");
+            check(removed == join_instances(plain.str()), to_string(removed) + " JOIN instances reported removed, the verilog had " +
+                  to_string(join_instances(plain.str())));
+            VerilogNetlist before(plain.str()), after(nojoin.str());
+            int latency = simulate(before, design.op);
+            check(simulate(after, design.op) == latency, "removing the JOIN instances changes the latency");
+            check(after.period() == before.period(), "removing the JOIN instances changes the critical path");
+        }});
+    }
+
+    tests.push_back({"JOIN elimination of generate_code.out, cold and warm module cache", []() {
+        string cache = temporary_directory("cache");
+        string cold, warm;
+        check(run_generator("-n 8 -k 2 --eliminate-joins", &cold) == EXIT_SUCCESS, "generate_code.out failed");
+        string expected = read_file("generated_codes/wtm_8_bits_k_2_nojoin.v");
+        check(run_generator("-n 8 -k 2 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        check(run_generator("-n 8 -k 2 -c " + cache + " --eliminate-joins", &warm) == EXIT_SUCCESS, "generate_code.out failed");
+        string verilog = read_file("generated_codes/wtm_8_bits_k_2_nojoin.v");
+        filesystem::remove_all(cache);
+
+        string report = "[INFO] 37 JOIN instances removed";
+        check(cold.find(report) != string::npos, "no \"" + report + "\" in the cold run");
+        check(warm.find(report) != string::npos, "no \"" + report + "\" in the warm run");
+        check(join_instances(verilog) == 0, "the warm run left JOIN instances");
+        check(verilog == expected, "the JOIN free verilog depends on the module cache");
+    }});
+
+    tests.push_back({"JOIN elimination of a design loaded from the module cache throws", []() {
+        /*------------------------------------------------------------------------------------------
+        Runs in a child process, the modules loaded from the cache stay in the module registry
+        and the other tests need their netlists.
+        ------------------------------------------------------------------------------------------*/
+        string cache = temporary_directory("cache");
+        check(run_generator("-n 6 -k 1 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        pid_t child = fork();
+        check(child >= 0, "unable to fork");
+        if(child == 0){
+            ModuleCache::global().open(cache);
+            try{
+                WALLACE_TREE_MULTIPLIER_PIPELINED chip("test", {"input_1", "input_2", "clk"}, "outputs", 6, 1);
+                EmitOptions options;
+                options.eliminate_joins = true;
+                ostringstream out;
+                chip.write_verilog(out, options);
+            }
+            catch(invalid_argument&){
+                _exit(EXIT_SUCCESS);
+            }
+            _exit(EXIT_FAILURE);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        filesystem::remove_all(cache);
+        check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS, "the JOIN instances of cached modules were silently kept");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Optimization
+                                        ============
+------------------------------------------------------------------------------------------*/
+
+static int header_number(const string& verilog, const string& label){
+    /*------------------------------------------------------------------------------------------
+    The first number after label in the verilog, example header_number(text, "Critical path : ").
+    ------------------------------------------------------------------------------------------*/
+    size_t found = verilog.find(label);
+    check(found != string::npos, "no \"" + label + "\" in the verilog");
+    return stoi(verilog.substr(found + label.size()));
+}
+
+void add_optimize_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"optimized simulation and critical path, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            VerilogNetlist plain = emitted(*chip, EmitOptions());
+            int latency = simulate(plain, design.op);
+
+            EmitOptions options;
+            options.optimize = true;
+            ostringstream out;
+            chip->write_verilog(out, options);
+            VerilogNetlist optimized(out.str());
+            check(simulate(optimized, design.op) == latency, "the optimized verilog changes the latency");
+            check(export_latency(*chip, design.op, options) == latency, "the optimized BLIF and AIGER change the latency");
+            int critical_path = header_number(out.str(), "Critical path : ");
+            check(critical_path == optimized.period(), "the header reports a critical path of " + to_string(critical_path) +
+                  ", the optimized verilog has " + to_string(optimized.period()));
+            check(optimized.period() <= plain.period(), "the optimized critical path is longer");
+        }});
+    }
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Retiming
+                                        ========
+------------------------------------------------------------------------------------------*/
+
+void add_retime_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"retimed simulation and clock period, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            EmitOptions options;
+            options.optimize = true;
+            VerilogNetlist optimized = emitted(*chip, options);
+            int latency = simulate(optimized, design.op);
+
+            options.retime = true;
+            ostringstream out;
+            chip->write_verilog(out, options);
+            VerilogNetlist retimed(out.str());
+            check(simulate(retimed, design.op) == latency, "retiming changes the latency");
+            check(export_latency(*chip, design.op, options) == latency, "the retimed BLIF and AIGER change the latency");
+
+            int critical_path = header_number(out.str(), "Critical path : ");
+            check(critical_path == retimed.period(), "the header reports a critical path of " + to_string(critical_path) +
+                  ", the retimed verilog has " + to_string(retimed.period()));
+            if(design.pipelined){
+                check(header_number(out.str(), "clock period ") == optimized.period(), "the header reports another period before retiming");
+                check(header_number(out.str(), "-> ") == retimed.period(), "the header reports another period after retiming");
+            }
+            check(retimed.period() <= optimized.period(), "retiming made the clock period longer");
+        }});
+    }
+}
+
+/*------------------------------------------------------------------------------------------
+                                  Static Timing Analysis
+                                  ======================
+------------------------------------------------------------------------------------------*/
+
+void add_timing_tests(vector<Test>& tests){
+    vector<Design> all = designs();
+    for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+        tests.push_back({"static timing analysis against simulation, " + design->name, [design = *design]() {
+            unique_ptr<Chip> chip(design.build());
+            VerilogNetlist netlist = emitted(*chip, EmitOptions());
+            int latency = simulate(netlist, design.op);
+            TimingReport timing = analyze_timing(*chip->module_def());
+            check(timing.period == netlist.period(), "clock period " + to_string(timing.period) + ", the longest path of the verilog is " +
+                  to_string(netlist.period()));
+            check(timing.latency == latency, "latency " + to_string(timing.latency) + ", the verilog simulates to " + to_string(latency));
+            check((int)timing.stages.size() == latency + 1, to_string(timing.stages.size()) + " stages for a latency of " + to_string(latency));
+        }});
+    }
+
+    tests.push_back({"static timing analysis of generate_code.out, critical path numbers", []() {
+        string output;
+        check(run_generator("-n 8 -k 2 --timing", &output) == EXIT_SUCCESS, "generate_code.out failed");
+        VerilogNetlist netlist(read_file("generated_codes/wtm_8_bits_k_2.v"));
+        check(netlist.period() == 20, "the verilog has a longest path of " + to_string(netlist.period()));
+        check(output.find("[TIMING] clock period       20 units") != string::npos, "no clock period of 20 units in the report");
+        check(output.find("[TIMING] latency             5 cycles") != string::npos, "no latency of 5 cycles in the report");
+        check(output.find("[TIMING] stage 6             6 units          0 registers   P[0]") != string::npos,
+              "the last stage is not the flipflop delay to P[0]");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                  Clock Period Placement
+                                  ======================
+------------------------------------------------------------------------------------------*/
+
+void add_clock_period_tests(vector<Test>& tests){
+    vector<Design> all = {
+        {"cla_pipelined n=16 period=", '+', true, NULL},
+        {"wtm n=16 period=", 'x', true, NULL},
+    };
+    vector<vector<int>> periods = {{20, 30, 60}, {30, 40, 80}};
+    for(size_t i = 0; i < all.size(); i++){
+        for(vector<int>::iterator period = periods[i].begin(); period != periods[i].end(); period++){
+            Design design = all[i];
+            design.name += to_string(*period);
+            int clock_period = *period;
+            if(design.op == '+'){
+                design.build = [clock_period]() -> Chip*{
+                    return new CARRY_LOOK_AHEAD_ADDER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 16, 1, clock_period);
+                };
+            }
+            else{
+                design.build = [clock_period]() -> Chip*{
+                    return new WALLACE_TREE_MULTIPLIER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 16, 1, clock_period);
+                };
+            }
+            tests.push_back({"clock period placement, " + design.name, [design, clock_period]() {
+                unique_ptr<Chip> chip(design.build());
+                VerilogNetlist netlist = emitted(*chip, EmitOptions());
+                int latency = simulate(netlist, design.op);
+                TimingReport timing = analyze_timing(*chip->module_def());
+                check(timing.period <= clock_period, "clock period " + to_string(timing.period));
+                check(netlist.period() <= clock_period, "the verilog has a longest path of " + to_string(netlist.period()));
+                check(timing.latency == latency, "latency " + to_string(timing.latency) + ", the verilog simulates to " + to_string(latency));
+            }});
+        }
+    }
+
+    tests.push_back({"clock period placement, cla_pipelined n=16 period=30 input_delay=10", []() {
+        CARRY_LOOK_AHEAD_ADDER_PIPELINED chip("test", {"input_1", "input_2", "clk"}, "outputs", 16, 1, 30, 10);
+        VerilogNetlist netlist = emitted(chip, EmitOptions());
+        simulate(netlist, '+');
+        TimingReport timing = analyze_timing(*chip.module_def());
+        check(timing.stages.at(0).worst + 10 <= 30, "the first stage takes " + to_string(timing.stages.at(0).worst) + " after the input delay");
+        check(timing.period <= 30, "clock period " + to_string(timing.period));
+    }});
+
+    tests.push_back({"clock period placement, a longer period needs fewer stages", []() {
+        int last = INT_MAX;
+        for(int period = 20; period <= 80; period += 10){
+            WALLACE_TREE_MULTIPLIER_PIPELINED chip("test", {"input_1", "input_2", "clk"}, "outputs", 16, 1, period);
+            int latency = analyze_timing(*chip.module_def()).latency;
+            check(latency <= last, "latency " + to_string(latency) + " at a clock period of " + to_string(period) + ", " + to_string(last) + " before");
+            last = latency;
+        }
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                    Prefix Topologies
+                                    =================
+------------------------------------------------------------------------------------------*/
+
+static const vector<PrefixTopology> TOPOLOGIES = {
+    PrefixTopology::KOGGE_STONE, PrefixTopology::SKLANSKY, PrefixTopology::BRENT_KUNG,
+    PrefixTopology::HAN_CARLSON, PrefixTopology::LADNER_FISCHER, PrefixTopology::SPARSE
+};
+
+static size_t instances_of(const string& verilog, const string& type){
+    istringstream in(verilog);
+    string line;
+    size_t count = 0;
+    while(getline(in, line)){
+        istringstream words(line);
+        string word;
+        words >> word;
+        count += word == type;
+    }
+    return count;
+}
+
+void add_topology_tests(vector<Test>& tests){
+    for(vector<PrefixTopology>::const_iterator t = TOPOLOGIES.begin(); t != TOPOLOGIES.end(); t++){
+        PrefixTopology topology = *t;
+        string name = prefix_info(topology).name;
+        vector<Design> all = {
+            {"cla n=16 " + name, '+', false, [topology]() -> Chip*{
+                return new CARRY_LOOK_AHEAD_ADDER("test", {"input_1", "input_2"}, "outputs", 16, topology);
+            }},
+            {"cla_pipelined n=16 k=2 " + name, '+', true, [topology]() -> Chip*{
+                return new CARRY_LOOK_AHEAD_ADDER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 16, 2, 0, 0, topology);
+            }},
+            {"wtm n=8 k=2 " + name, 'x', true, [topology]() -> Chip*{
+                return new WALLACE_TREE_MULTIPLIER_PIPELINED("test", {"input_1", "input_2", "clk"}, "outputs", 8, 2, 0, topology);
+            }},
+        };
+        for(vector<Design>::iterator design = all.begin(); design != all.end(); design++){
+            tests.push_back({"prefix topology simulation, " + design->name, [design = *design]() {
+                unique_ptr<Chip> chip(design.build());
+                VerilogNetlist netlist = emitted(*chip, EmitOptions());
+                int latency = simulate(netlist, design.op);
+                check((latency > 0) == design.pipelined, "latency " + to_string(latency));
+                check(analyze_timing(*chip->module_def()).period == netlist.period(), "the static timing analysis disagrees with the verilog");
+            }});
+        }
+
+        tests.push_back({"prefix network, " + name, [topology, name]() {
+            PrefixTopology parsed;
+            check(parse_prefix_topology(name, &parsed) && parsed == topology, "the command line name does not parse back");
+
+            CARRY_LOOK_AHEAD_ADDER chip("test", {"input_1", "input_2"}, "outputs", 16, topology);
+            ostringstream out;
+            chip.write_verilog(out);
+            PrefixNetwork network = prefix_network(16, topology);
+            size_t stars = instances_of(out.str(), "CLA_STAR");
+            check((long long)stars == network.stars, to_string(stars) + " CLA_STAR instances, the network has " + to_string(network.stars));
+
+            map<PrefixTopology, int> fanout = {
+                {PrefixTopology::KOGGE_STONE, 2}, {PrefixTopology::SKLANSKY, 16 / 2 + 1}, {PrefixTopology::BRENT_KUNG, 2},
+                {PrefixTopology::HAN_CARLSON, 2}, {PrefixTopology::LADNER_FISCHER, 16 / 4 + 1}, {PrefixTopology::SPARSE, 2}
+            };
+            check(network.max_fanout == fanout[topology], "fanout " + to_string(network.max_fanout) + ", expected " + to_string(fanout[topology]));
+        }});
+    }
+}
+
+/*------------------------------------------------------------------------------------------
+                                    Dadda Reduction
+                                    ===============
+------------------------------------------------------------------------------------------*/
+
+void add_dadda_tests(vector<Test>& tests){
+    for(int n = 4; n <= 16; n *= 2){
+        for(int k = 1; k <= 3; k++){
+            tests.push_back({"dadda simulation, n=" + to_string(n) + " k=" + to_string(k), [n, k]() {
+                WALLACE_TREE_MULTIPLIER_PIPELINED dadda("test", {"input_1", "input_2", "clk"}, "outputs", n, k, 0, PrefixTopology::KOGGE_STONE,
+                                                        ReductionSchedule::DADDA);
+                VerilogNetlist netlist = emitted(dadda, EmitOptions());
+                int latency = simulate(netlist, 'x');
+                check(latency > 0, "latency " + to_string(latency));
+                check(analyze_timing(*dadda.module_def()).latency == latency, "the static timing analysis disagrees with the simulation");
+                check(export_latency(dadda, 'x', EmitOptions()) == latency, "the BLIF and AIGER have another latency");
+            }});
+        }
+    }
+
+    tests.push_back({"dadda simulation, n=16 period=40", []() {
+        WALLACE_TREE_MULTIPLIER_PIPELINED dadda("test", {"input_1", "input_2", "clk"}, "outputs", 16, 1, 40, PrefixTopology::KOGGE_STONE,
+                                                ReductionSchedule::DADDA);
+        VerilogNetlist netlist = emitted(dadda, EmitOptions());
+        simulate(netlist, 'x');
+        check(analyze_timing(*dadda.module_def()).period <= 40, "the clock period is not met");
+    }});
+
+    tests.push_back({"dadda uses fewer gates than wallace, n=16 k=2", []() {
+        WALLACE_TREE_MULTIPLIER_PIPELINED wallace("test", {"input_1", "input_2", "clk"}, "outputs", 16, 2);
+        WALLACE_TREE_MULTIPLIER_PIPELINED dadda("test", {"input_1", "input_2", "clk"}, "outputs", 16, 2, 0, PrefixTopology::KOGGE_STONE,
+                                                ReductionSchedule::DADDA);
+        size_t wallace_gates = emitted(wallace, EmitOptions()).num_gates(), dadda_gates = emitted(dadda, EmitOptions()).num_gates();
+        check(dadda_gates < wallace_gates, to_string(dadda_gates) + " gates, wallace has " + to_string(wallace_gates));
+        int wallace_latency = analyze_timing(*wallace.module_def()).latency;
+        check(analyze_timing(*dadda.module_def()).latency == wallace_latency, "dadda has another latency than wallace");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                      Module Cache
+                                      ============
+------------------------------------------------------------------------------------------*/
+
+static int cache_count(const string& output, const string& what){
+    /*------------------------------------------------------------------------------------------
+    The hits or misses in the "Module cache: N hits, M misses" line of generate_code.out.
+    ------------------------------------------------------------------------------------------*/
+    size_t line = output.find("[INFO] Module cache: ");
+    check(line != string::npos, "no module cache line in the output");
+    size_t end = output.find(" " + what, line);
+    check(end != string::npos, "no " + what + " in the module cache line");
+    size_t start = output.rfind(' ', end - 1) + 1;
+    return stoi(output.substr(start, end - start));
+}
+
+void add_cache_tests(vector<Test>& tests){
+    vector<pair<string, string>> runs = {
+        {"-n 8 -k 2", "generated_codes/wtm_8_bits_k_2.v"},
+        {"-n 16 -g cla -t sklansky", "generated_codes/cla_16_bits_sklansky.v"},
+        {"-n 8 -g cra", "generated_codes/cra_8_bits.v"},
+    };
+    for(vector<pair<string, string>>::iterator run = runs.begin(); run != runs.end(); run++){
+        tests.push_back({"module cache, cold and warm run of " + run->first, [run = *run]() {
+            string cache = temporary_directory("cache");
+            string cold, warm;
+            check(run_generator(run.first) == EXIT_SUCCESS, "generate_code.out failed");
+            string expected = read_file(run.second);
+            check(run_generator(run.first + " -c " + cache, &cold) == EXIT_SUCCESS, "generate_code.out failed");
+            string stored = read_file(run.second);
+            check(run_generator(run.first + " -c " + cache, &warm) == EXIT_SUCCESS, "generate_code.out failed");
+            string loaded = read_file(run.second);
+            filesystem::remove_all(cache);
+
+            check(cache_count(cold, "hits") == 0 && cache_count(cold, "misses") > 0, "the cold run did not fill the cache");
+            check(cache_count(warm, "hits") > 0 && cache_count(warm, "misses") == 0, "the warm run missed the cache");
+            check(stored == expected, "the verilog of the cold run differs from the run without cache");
+            check(loaded == expected, "the verilog of the warm run differs from the run without cache");
+        }});
+    }
+
+    tests.push_back({"module cache, corrupt entries are misses", []() {
+        string cache = temporary_directory("cache");
+        check(run_generator("-n 8 -k 2 -c " + cache) == EXIT_SUCCESS, "generate_code.out failed");
+        string expected = read_file("generated_codes/wtm_8_bits_k_2.v");
+        bool truncate = false;
+        for(filesystem::directory_iterator entry(cache); entry != filesystem::directory_iterator(); entry++){
+            if(truncate){
+                filesystem::resize_file(entry->path(), filesystem::file_size(entry->path()) / 2);
+            }
+            else{
+                ofstream(entry->path(), ios::binary | ios::trunc) << "garbage";
+            }
+            truncate = !truncate;
+        }
+        string output;
+        int status = run_generator("-n 8 -k 2 -c " + cache, &output);
+        string verilog = read_file("generated_codes/wtm_8_bits_k_2.v");
+        filesystem::remove_all(cache);
+        check(status == EXIT_SUCCESS, "generate_code.out failed on a corrupt cache");
+        check(cache_count(output, "hits") == 0, "a corrupt entry was hit");
+        check(verilog == expected, "the verilog differs after a corrupt cache");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                       Batch Mode
+                                       ==========
+------------------------------------------------------------------------------------------*/
+
+static string config_file(const string& directory, const string& lines){
+    string file_name = directory + "/configs.txt";
+    ofstream(file_name) << lines;
+    return file_name;
+}
+
+void add_batch_tests(vector<Test>& tests){
+    tests.push_back({"batch mode, configuration file with comments and -t", []() {
+        string directory = temporary_directory("batch");
+        string file_name = config_file(directory, "# n k generator\n\n8 2\n16 1 cla\n8\n");
+        string output;
+        filesystem::remove("generated_codes/cla_16_bits_brent_kung.v");
+        int status = run_generator("-f " + file_name + " -t brent_kung", &output);
+        filesystem::remove_all(directory);
+        check(status == EXIT_SUCCESS, "exit code " + to_string(status));
+        check(output.find("[INFO] 3 of 3 configurations written.") != string::npos, "not every configuration was written");
+        check(filesystem::exists("generated_codes/cla_16_bits_brent_kung.v"), "-t is not applied to the configuration lines");
+        check(output.find("wtm_8_bits_k_2_brent_kung.v written") != string::npos, "no wtm_8_bits_k_2_brent_kung.v");
+        check(output.find("wtm_8_bits_k_1_brent_kung.v written") != string::npos, "a line without k does not default to k = 1");
+    }});
+
+    vector<pair<string, string>> bad = {
+        {"a missing file", ""},
+        {"a letter for k", "8 x\n"},
+        {"a letter for n", "x 8\n"},
+        {"an unknown generator", "8 2 booth\n"},
+        {"a trailing field", "8 2 wtm 4\n"},
+    };
+    for(vector<pair<string, string>>::iterator config = bad.begin(); config != bad.end(); config++){
+        tests.push_back({"batch mode, configuration file with " + config->first + " fails", [config = *config]() {
+            string directory = temporary_directory("batch");
+            string file_name = config.second.empty() ? directory + "/missing.txt" : config_file(directory, config.second);
+            string output;
+            int status = run_generator("-f " + file_name, &output);
+            filesystem::remove_all(directory);
+            check(status == EXIT_FAILURE, "exit code " + to_string(status));
+            check(output.find("[ERROR] Unable to read the configuration file") != string::npos, "no configuration file error");
+            check(output.find("written successfully") == string::npos, "a configuration was written");
+        }});
+    }
+
+    tests.push_back({"batch mode, a failed configuration is counted once and fails the run", []() {
+        string directory = temporary_directory("batch");
+        string file_name = config_file(directory, "11 1 cra\n12 1 cra\n");
+        string blocked = "generated_codes/cra_11_bits.v";
+        filesystem::remove_all(blocked);
+        filesystem::create_directory(blocked);
+        string output;
+        int status = run_generator("-f " + file_name + " --snapshot --blif", &output);
+        filesystem::remove_all(blocked);
+        filesystem::remove_all(directory);
+        check(status == EXIT_FAILURE, "exit code " + to_string(status));
+        check(output.find("[INFO] 1 of 2 configurations written.") != string::npos, "the failed configuration is not counted once");
+    }});
+}
+
+/*------------------------------------------------------------------------------------------
+                                       Statistics
+                                       ==========
+------------------------------------------------------------------------------------------*/
+
+void add_stats_tests(vector<Test>& tests){
+#if DOTV_STATS
+    tests.push_back({"statistics, counters of an elaboration and its verilog", []() {
+        ElaborationStats before = Stats::global().snapshot();
+        CARRY_RIPPLE_ADDER chip("test", {"input_1", "input_2"}, "outputs", 13);
+        ElaborationStats built = Stats::global().snapshot();
+        check(built.counters[INSTANCES_CREATED] >= before.counters[INSTANCES_CREATED] + 13, "fewer instances than full adders");
+        check(built.counters[UNIQUE_MODULES] > before.counters[UNIQUE_MODULES], "the new adder was not counted as a module");
+        check(built.counters[WIRES_DECLARED] > before.counters[WIRES_DECLARED], "no wires counted");
+        check(built.counters[PEAK_TREE_SIZE] > 0, "no peak tree size");
+
+        ostringstream out;
+        EmitOptions options;
+        options.eliminate_joins = true;
+        size_t removed = chip.write_verilog(out, options);
+        ElaborationStats written = Stats::global().snapshot();
+        check(written.counters[BYTES_EMITTED] - built.counters[BYTES_EMITTED] == out.str().size(),
+              to_string(written.counters[BYTES_EMITTED] - built.counters[BYTES_EMITTED]) + " bytes counted, " + to_string(out.str().size()) + " written");
+        check(written.counters[JOINS_REMOVED] - built.counters[JOINS_REMOVED] == removed,
+              to_string(written.counters[JOINS_REMOVED] - built.counters[JOINS_REMOVED]) + " joins counted, " + to_string(removed) + " removed");
+        check(written.seconds[PHASE_RENDER] >= built.seconds[PHASE_RENDER], "the render time went down");
+    }});
+
+    tests.push_back({"statistics, --stats of generate_code.out", []() {
+        string output;
+        check(run_generator("-n 8 -k 2 --stats", &output) == EXIT_SUCCESS, "generate_code.out failed");
+        size_t bytes = filesystem::file_size("generated_codes/wtm_8_bits_k_2.v") - 1;
+        size_t line = output.find("[STATS] bytes emitted");
+        check(line != string::npos, "no bytes emitted line");
+        check(stoull(output.substr(line + string("[STATS] bytes emitted").size())) == bytes, "the bytes emitted are not the size of the verilog");
+        check(output.find("[STATS] unique modules") != string::npos && output.find("[STATS] elaborate") != string::npos,
+              "counters or phases missing from the report");
+    }});
+#else
+    tests.push_back({"statistics, compiled out", []() {
+        CARRY_RIPPLE_ADDER chip("test", {"input_1", "input_2"}, "outputs", 13);
+        ostringstream out;
+        chip.write_verilog(out);
+        ElaborationStats stats = Stats::global().snapshot();
+        for(int counter = 0; counter < NUM_COUNTERS; counter++){
+            check(stats.counters[counter] == 0, string(ElaborationStats::counter_name((Counter)counter)) + " is counted with DOTV_STATS=0");
+        }
+    }});
+#endif
+}
+
+/*------------------------------------------------------------------------------------------
+                                       User Chips
+                                       ==========
+------------------------------------------------------------------------------------------*/
+
+class UserChip : public Chip{
+    /*------------------------------------------------------------------------------------------
+    The chip of the README, OUT = A & (B ^ C), or OUT = A & (B | C) under the same module name.
+    -----------------------------------------------------------------------------------------*/
+    public:
+        UserChip(string name, vector<wire> input_wires, wire output_wire, bool use_or){
+            this->name = name;
+            this->inputs = input_wires;
+            this->outputs.push_back(output_wire);
+            this->declare("A", CHIP_INPUTS);
+            this->declare("B", CHIP_INPUTS);
+            this->declare("C", CHIP_INPUTS);
+            this->declare("OUT", CHIP_OUTPUTS);
+            wire temp_wire = "temp_wire";
+            this->add_wire(temp_wire);
+            if(use_or){
+                this->add_submodule(OR("TestUserChipOR", {"B", "C"}, temp_wire));
+            }
+            else{
+                this->add_submodule(XOR("TestUserChipXOR", {"B", "C"}, temp_wire));
+            }
+            this->add_submodule(AND("TestUserChipAND", {temp_wire, "A"}, "OUT"));
+            this->definition = this->auto_gen("module TEST_USER_CHIP");
+        }
+};
+
+void add_user_chip_tests(vector<Test>& tests){
+    tests.push_back({"user chips, same name and contents share the module", []() {
+        UserChip first("first", {"a", "b", "c"}, "out", false);
+        UserChip second("second", {"d", "e", "f"}, "out", false);
+        check(first.module_def() == second.module_def(), "two identical chips got two modules");
+    }});
+
+    tests.push_back({"user chips, same name and other contents throw", []() {
+        UserChip xor_chip("xor_chip", {"a", "b", "c"}, "out", false);
+        xor_chip.module_def();
+        bool thrown = false;
+        try{
+            UserChip or_chip("or_chip", {"a", "b", "c"}, "out", true);
+            or_chip.module_def();
+        }
+        catch(invalid_argument&){
+            thrown = true;
+        }
+        check(thrown, "the second TEST_USER_CHIP silently reused the first definition");
+    }});
+}
+
+int main(){
+    vector<Test> tests;
+    add_snapshot_tests(tests);
+    add_export_tests(tests);
+    add_flatten_tests(tests);
+    add_join_tests(tests);
+    add_optimize_tests(tests);
+    add_retime_tests(tests);
+    add_timing_tests(tests);
+    add_clock_period_tests(tests);
+    add_topology_tests(tests);
+    add_dadda_tests(tests);
+    add_cache_tests(tests);
+    add_batch_tests(tests);
+    add_stats_tests(tests);
+    add_user_chip_tests(tests);
+
+    int failed = 0;
+    for(vector<Test>::iterator test = tests.begin(); test != tests.end(); test++){
+        try{
+            test->run();
+            printf("[PASS] %s\n", test->name.c_str());
+        }
+        catch(const exception& error){
+            printf("[FAIL] %s : %s\n", test->name.c_str(), error.what());
+            failed++;
+        }
+        fflush(stdout);
+    }
+    printf("%zu tests, %d failed\n", tests.size(), failed);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,177 @@
+#include <thread_pool.h>
+#include <stdlib.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+Index of the queue owned by the current thread. Threads outside the pool use the last queue.
+------------------------------------------------------------------------------------------*/
+static thread_local int queue_index = -1;
+
+ThreadPool::ThreadPool(int num_threads){
+    /*------------------------------------------------------------------------------------------
+    Starts num_threads - 1 workers, the thread calling parallel_for(...) is the last one.
+
+    Param: num_threads (int), total number of threads running tasks.
+    ------------------------------------------------------------------------------------------*/
+    this->queued = 0;
+    if(num_threads < 1) num_threads = 1;
+    for(int i = 0; i < num_threads; i++){
+        this->queues.emplace_back(new Queue());
+    }
+    for(int i = 0; i + 1 < num_threads; i++){
+        this->workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        lock_guard<mutex> guard(this->sleep_lock);
+        this->stop = true;
+    }
+    this->wake.notify_all();
+    for(vector<thread>::iterator i = this->workers.begin(); i != this->workers.end(); i++){
+        i->join();
+    }
+}
+
+ThreadPool& ThreadPool::global(){
+    /*------------------------------------------------------------------------------------------
+    Returns the shared pool, sized by DOTV_THREADS or the number of cores.
+    ------------------------------------------------------------------------------------------*/
+    static ThreadPool pool([](){
+        const char* env = getenv("DOTV_THREADS");
+        if(env != NULL && atoi(env) > 0){
+            return atoi(env);
+        }
+        return max(1, (int)thread::hardware_concurrency());
+    }());
+    return pool;
+}
+
+int ThreadPool::size() const{
+    return this->queues.size();
+}
+
+void ThreadPool::push(function<void()> task){
+    /*------------------------------------------------------------------------------------------
+    Pushes a task to the front of the current thread's own queue.
+    ------------------------------------------------------------------------------------------*/
+    int index = (queue_index < 0) ? this->queues.size() - 1 : queue_index;
+    {
+        lock_guard<mutex> guard(this->queues.at(index)->lock);
+        this->queues.at(index)->tasks.push_front(std::move(task));
+    }
+    this->queued++;
+    {
+        lock_guard<mutex> guard(this->sleep_lock);
+    }
+    this->wake.notify_one();
+}
+
+bool ThreadPool::run_one(){
+    /*------------------------------------------------------------------------------------------
+    Runs one task, taking the newest task of the own queue first and otherwise stealing the old-
+    est task of another queue.
+
+    Returns: true if a task was run.
+    ------------------------------------------------------------------------------------------*/
+    int own = (queue_index < 0) ? this->queues.size() - 1 : queue_index;
+    int n = this->queues.size();
+    for(int k = 0; k < n; k++){
+        Queue& queue = *this->queues.at((own + k) % n);
+        function<void()> task;
+        {
+            lock_guard<mutex> guard(queue.lock);
+            if(queue.tasks.empty()){
+                continue;
+            }
+            if(k == 0){
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            else{
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+        }
+        this->queued--;
+        task();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(int index){
+    queue_index = index;
+    while(true){
+        if(this->run_one()){
+            continue;
+        }
+        unique_lock<mutex> guard(this->sleep_lock);
+        this->wake.wait(guard, [this](){ return this->stop || this->queued > 0; });
+        if(this->stop){
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const function<void(size_t)>& body){
+    /*------------------------------------------------------------------------------------------
+    Runs body(i) for every i in [0, count). The range is split into a few chunks per thread so
+    that stealing can balance uneven work. The calling thread runs tasks while it waits.
+
+    Param: count (size_t), number of iterations.
+    Param: body (function<void(size_t)>), the loop body. It must only write state owned by its
+           own index, results are merged by the caller afterwards.
+    ------------------------------------------------------------------------------------------*/
+    if(count == 0){
+        return;
+    }
+    if(this->size() == 1 || count == 1){
+        for(size_t i = 0; i < count; i++){
+            body(i);
+        }
+        return;
+    }
+
+    size_t chunks = min(count, (size_t)this->size() * 4);
+    atomic<size_t> remaining(chunks);
+    exception_ptr error;
+    mutex error_lock;
+
+    for(size_t c = 0; c < chunks; c++){
+        size_t begin = count * c / chunks;
+        size_t end = count * (c + 1) / chunks;
+        this->push([&, begin, end](){
+            try{
+                for(size_t i = begin; i < end; i++){
+                    body(i);
+                }
+            }
+            catch(...){
+                lock_guard<mutex> guard(error_lock);
+                if(!error) error = current_exception();
+            }
+            remaining--;
+        });
+    }
+
+    while(remaining > 0){
+        if(!this->run_one()){
+            this_thread::yield();
+        }
+    }
+    if(error){
+        rethrow_exception(error);
+    }
+}
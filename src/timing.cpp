@@ -0,0 +1,561 @@
+#include <timing.h>
+#include <bit_classes.h>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                Static Timing Analysis
+                                ======================
+
+See timing.h. Every module is analysed on its net bits: a bit is a (net, bit) pair of the module
+and the bits tied by JOIN instances are one node. The instances of a module are walked in topo-
+logical order, so every input of an instance has its arrival before the instance is reached.
+------------------------------------------------------------------------------------------*/
+
+typedef struct{
+    int stage;
+    int time;
+} Arrival;
+
+static const Arrival UNREACHED = {-1, 0};
+
+static Arrival later(Arrival a, Arrival b){
+    /*------------------------------------------------------------------------------------------
+    The later of two arrivals. Constants and undriven nets never arrive. Inputs launched in dif-
+    ferent stages only meet in unbalanced pipelines, the result is the conservative one.
+    ------------------------------------------------------------------------------------------*/
+    if(a.stage < 0){
+        return b;
+    }
+    if(b.stage < 0){
+        return a;
+    }
+    return {max(a.stage, b.stage), max(a.time, b.time)};
+}
+
+static Arrival delayed(Arrival a, int delay){
+    return a.stage < 0 ? a : Arrival{a.stage, a.time + delay};
+}
+
+typedef vector<pair<uint32_t, int>> Delays;
+
+static void merge_delays(Delays& out, const Delays& in, int delay){
+    /*------------------------------------------------------------------------------------------
+    out = max(out, in + delay), both are sorted by input bit.
+    ------------------------------------------------------------------------------------------*/
+    Delays merged;
+    merged.reserve(out.size() + in.size());
+    Delays::const_iterator a = out.begin(), b = in.begin();
+    while(a != out.end() || b != in.end()){
+        if(b == in.end() || (a != out.end() && a->first < b->first)){
+            merged.push_back(*a++);
+        }
+        else if(a == out.end() || b->first < a->first){
+            merged.push_back({b->first, b->second + delay});
+            b++;
+        }
+        else{
+            merged.push_back({a->first, max(a->second, b->second + delay)});
+            a++;
+            b++;
+        }
+    }
+    out.swap(merged);
+}
+
+struct ModuleTiming{
+    /*------------------------------------------------------------------------------------------
+    The bit level view of a module built of submodules.
+
+        1. nodes : Number of node ids, a node is a class of net bits tied by joins.
+        2. ports : The node of every bit of every port, lsb first.
+        3. bits, bindings, first_binding : The nodes bound to port p of instance i are bits
+                [bindings[first_binding[i] + p], bindings[first_binding[i] + p + 1]).
+        4. order : The instances except the joins, every driver before its readers. Instances in
+                a combinational loop come last, in their original order.
+    -----------------------------------------------------------------------------------------*/
+    uint32_t nodes = 0;
+    vector<vector<uint32_t>> ports;
+    vector<uint32_t> bits;
+    vector<uint32_t> bindings;
+    vector<uint32_t> first_binding;
+    vector<uint32_t> order;
+
+    const uint32_t* begin(size_t i, size_t p) const { return this->bits.data() + this->bindings[this->first_binding[i] + p]; }
+    size_t size(size_t i, size_t p) const { return this->bindings[this->first_binding[i] + p + 1] - this->bindings[this->first_binding[i] + p]; }
+};
+
+struct ArcModel{
+    /*------------------------------------------------------------------------------------------
+    The delays through a combinational module. Inputs and outputs are numbered bit by bit over
+    the input and the output ports in port order. The arcs of output o are the (input, delay)
+    pairs in [offsets[o], offsets[o + 1]), for the inputs it depends on.
+    -----------------------------------------------------------------------------------------*/
+    vector<uint32_t> offsets;
+    Delays arcs;
+};
+
+class TimingAnalysis{
+    public:
+        TimingReport run(const ModuleDef& top);
+
+    private:
+        const ModuleTiming& prepare(const ModuleDef& module);
+        bool sequential(const ModuleDef& module);
+        const ArcModel& arcs(const ModuleDef& module);
+        void evaluate(const ModuleDef& module, const vector<Arrival>& inputs, vector<Arrival>& outputs, const string& prefix);
+        void capture(Arrival arrival, const string& name);
+
+        unordered_map<const ModuleDef*, unique_ptr<ModuleTiming>> prepared;
+        unordered_map<const ModuleDef*, unique_ptr<ArcModel>> models;
+        unordered_map<const ModuleDef*, bool> sequential_modules;
+        TimingReport result;
+};
+
+const ModuleTiming& TimingAnalysis::prepare(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Builds the bit level view of a module once.
+    ------------------------------------------------------------------------------------------*/
+    unordered_map<const ModuleDef*, unique_ptr<ModuleTiming>>::iterator found = this->prepared.find(&module);
+    if(found != this->prepared.end()){
+        return *found->second;
+    }
+    if(module.from_cache){
+        throw invalid_argument("Timing needs the netlist of " + module.name + ", it was loaded from the module cache without it.");
+    }
+    if(!module.extras.empty() || (module.op == Op::NONE && !module.behaviours.empty())){
+        throw invalid_argument("Timing needs the netlist of " + module.name + ".");
+    }
+
+    unordered_map<Symbol, pair<int, int>> ranges;
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        ranges[i->net.id()] = {i->net.msb(), i->net.lsb()};
+    }
+    for(vector<wire>::const_iterator i = module.wires.begin(); i != module.wires.end(); i++){
+        ranges[i->id()] = {i->msb(), i->lsb()};
+    }
+    for(vector<reg>::const_iterator i = module.regs.begin(); i != module.regs.end(); i++){
+        ranges[i->id()] = {i->msb(), i->lsb()};
+    }
+    auto bits = [&](const wire& net, vector<uint64_t>& out){
+        int hi = net.msb(), lo = net.lsb();
+        if(net.form() == wire::NAME || net.form() == wire::DECL){
+            unordered_map<Symbol, pair<int, int>>::const_iterator range = ranges.find(net.id());
+            hi = range == ranges.end() ? 0 : range->second.first;
+            lo = range == ranges.end() ? 0 : range->second.second;
+        }
+        out.clear();
+        for(int bit = lo; bit <= hi; bit++){
+            out.push_back(bit_key(net.id(), bit));
+        }
+    };
+
+    /*------------------------------------------------------------------------------------------
+    Tie the joined bits first, so every bit gets the node of its class below.
+    ------------------------------------------------------------------------------------------*/
+    const InstanceTable& instances = module.submodules;
+    BitClasses classes;
+    vector<uint64_t> a, b;
+    for(size_t i = 0; i < instances.size(); i++){
+        if(instances.module(i)->op == Op::JOIN && instances.num_bindings(i) == 2){
+            bits(instances.bindings(i)[0], a);
+            bits(instances.bindings(i)[1], b);
+            for(size_t bit = 0; bit < a.size() && bit < b.size(); bit++){
+                classes.unite(a[bit], b[bit]);
+            }
+        }
+    }
+
+    unique_ptr<ModuleTiming> timing(new ModuleTiming());
+    for(vector<Port>::const_iterator i = module.ports.begin(); i != module.ports.end(); i++){
+        bits(wire(i->net.name(), 1), a);
+        timing->ports.push_back(vector<uint32_t>());
+        for(vector<uint64_t>::iterator bit = a.begin(); bit != a.end(); bit++){
+            timing->ports.back().push_back(classes.find(*bit));
+        }
+    }
+    for(size_t i = 0; i < instances.size(); i++){
+        timing->first_binding.push_back(timing->bindings.size());
+        for(size_t p = 0; p < instances.num_bindings(i); p++){
+            timing->bindings.push_back(timing->bits.size());
+            bits(instances.bindings(i)[p], a);
+            for(vector<uint64_t>::iterator bit = a.begin(); bit != a.end(); bit++){
+                timing->bits.push_back(classes.find(*bit));
+            }
+        }
+    }
+    timing->bindings.push_back(timing->bits.size());
+    timing->first_binding.push_back(timing->bindings.size() - 1);
+    timing->nodes = classes.size();
+
+    /*------------------------------------------------------------------------------------------
+    Order the instances, Kahn's algorithm on the edges from the driver of a node to its readers.
+    ------------------------------------------------------------------------------------------*/
+    vector<int64_t> driver(timing->nodes, -1);
+    for(size_t i = 0; i < instances.size(); i++){
+        const ModuleDef* sub = instances.module(i);
+        for(size_t p = 0; p < instances.num_bindings(i) && sub->op != Op::JOIN; p++){
+            if(p < sub->ports.size() && sub->ports.at(p).is_output()){
+                for(size_t bit = 0; bit < timing->size(i, p); bit++){
+                    driver[timing->begin(i, p)[bit]] = i;
+                }
+            }
+        }
+    }
+    vector<uint32_t> pending(instances.size(), 0), first_reader(instances.size() + 1, 0), readers;
+    for(int pass = 0; pass < 2; pass++){
+        for(size_t i = 0; i < instances.size(); i++){
+            const ModuleDef* sub = instances.module(i);
+            for(size_t p = 0; p < instances.num_bindings(i) && sub->op != Op::JOIN; p++){
+                if(p < sub->ports.size() && sub->ports.at(p).is_output()){
+                    continue;
+                }
+                for(size_t bit = 0; bit < timing->size(i, p); bit++){
+                    int64_t from = driver[timing->begin(i, p)[bit]];
+                    if(from < 0 || from == (int64_t)i){
+                        continue;
+                    }
+                    if(pass == 0){
+                        first_reader[from + 1]++;
+                        pending[i]++;
+                    }
+                    else{
+                        readers[first_reader[from]++] = i;
+                    }
+                }
+            }
+        }
+        if(pass == 0){
+            for(size_t i = 0; i < instances.size(); i++){
+                first_reader[i + 1] += first_reader[i];
+            }
+            readers.resize(first_reader[instances.size()]);
+        }
+        else{
+            for(size_t i = instances.size(); i > 0; i--){
+                first_reader[i] = first_reader[i - 1];
+            }
+            first_reader[0] = 0;
+        }
+    }
+    vector<bool> placed(instances.size(), false);
+    for(size_t i = 0; i < instances.size(); i++){
+        if(pending[i] == 0 && instances.module(i)->op != Op::JOIN){
+            timing->order.push_back(i);
+            placed[i] = true;
+        }
+    }
+    for(size_t next = 0; next < timing->order.size(); next++){
+        uint32_t i = timing->order[next];
+        for(uint32_t r = first_reader[i]; r < first_reader[i + 1]; r++){
+            if(--pending[readers[r]] == 0){
+                timing->order.push_back(readers[r]);
+                placed[readers[r]] = true;
+            }
+        }
+    }
+    for(size_t i = 0; i < instances.size(); i++){
+        if(!placed[i] && instances.module(i)->op != Op::JOIN){
+            timing->order.push_back(i);
+        }
+    }
+
+    return *this->prepared.emplace(&module, move(timing)).first->second;
+}
+
+bool TimingAnalysis::sequential(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Returns true if there is a flipflop in the module or anywhere below it.
+    ------------------------------------------------------------------------------------------*/
+    if(module.op != Op::NONE){
+        return module.op == Op::FLIP_FLOP;
+    }
+    unordered_map<const ModuleDef*, bool>::iterator found = this->sequential_modules.find(&module);
+    if(found != this->sequential_modules.end()){
+        return found->second;
+    }
+    bool is_sequential = false;
+    for(vector<const ModuleDef*>::const_iterator i = module.dependencies.begin(); i != module.dependencies.end() && !is_sequential; i++){
+        is_sequential = this->sequential(**i);
+    }
+    this->sequential_modules[&module] = is_sequential;
+    return is_sequential;
+}
+
+const ArcModel& TimingAnalysis::arcs(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    The delays through a combinational module, computed once. Every node carries the delays from
+    the input bits it depends on.
+    ------------------------------------------------------------------------------------------*/
+    unordered_map<const ModuleDef*, unique_ptr<ArcModel>>::iterator found = this->models.find(&module);
+    if(found != this->models.end()){
+        return *found->second;
+    }
+    const ModuleTiming& timing = this->prepare(module);
+    const InstanceTable& instances = module.submodules;
+    vector<Delays> value(timing.nodes);
+    uint32_t input = 0;
+    for(size_t p = 0; p < module.ports.size(); p++){
+        for(size_t bit = 0; bit < timing.ports[p].size() && !module.ports[p].is_output(); bit++){
+            merge_delays(value[timing.ports[p][bit]], {{input++, 0}}, 0);
+        }
+    }
+
+    Delays merged;
+    vector<const Delays*> sub_inputs;
+    for(vector<uint32_t>::const_iterator i = timing.order.begin(); i != timing.order.end(); i++){
+        const ModuleDef* sub = instances.module(*i);
+        size_t bindings = min(instances.num_bindings(*i), sub->ports.size());
+        if(is_gate(sub->op)){
+            int delay = gate_info(sub->op).delay;
+            for(size_t p = 0; p < bindings; p++){
+                for(size_t bit = 0; bit < timing.size(*i, p) && sub->ports[p].is_output(); bit++){
+                    merged.clear();
+                    for(size_t q = 0; q < bindings; q++){
+                        if(!sub->ports[q].is_output() && bit < timing.size(*i, q)){
+                            merge_delays(merged, value[timing.begin(*i, q)[bit]], delay);
+                        }
+                    }
+                    merge_delays(value[timing.begin(*i, p)[bit]], merged, 0);
+                }
+            }
+            continue;
+        }
+
+        const ArcModel& model = this->arcs(*sub);
+        const ModuleTiming& sub_timing = this->prepare(*sub);
+        static const Delays none;
+        sub_inputs.clear();
+        for(size_t p = 0; p < sub->ports.size(); p++){
+            for(size_t bit = 0; bit < sub_timing.ports[p].size() && !sub->ports[p].is_output(); bit++){
+                sub_inputs.push_back(p < bindings && bit < timing.size(*i, p) ? &value[timing.begin(*i, p)[bit]] : &none);
+            }
+        }
+        uint32_t output = 0;
+        for(size_t p = 0; p < sub->ports.size(); p++){
+            for(size_t bit = 0; bit < sub_timing.ports[p].size() && sub->ports[p].is_output(); bit++, output++){
+                if(p >= bindings || bit >= timing.size(*i, p)){
+                    continue;
+                }
+                merged.clear();
+                for(uint32_t arc = model.offsets[output]; arc < model.offsets[output + 1]; arc++){
+                    merge_delays(merged, *sub_inputs[model.arcs[arc].first], model.arcs[arc].second);
+                }
+                merge_delays(value[timing.begin(*i, p)[bit]], merged, 0);
+            }
+        }
+    }
+
+    unique_ptr<ArcModel> model(new ArcModel());
+    model->offsets.push_back(0);
+    for(size_t p = 0; p < module.ports.size(); p++){
+        for(size_t bit = 0; bit < timing.ports[p].size() && module.ports[p].is_output(); bit++){
+            const Delays& delays = value[timing.ports[p][bit]];
+            model->arcs.insert(model->arcs.end(), delays.begin(), delays.end());
+            model->offsets.push_back(model->arcs.size());
+        }
+    }
+    return *this->models.emplace(&module, move(model)).first->second;
+}
+
+void TimingAnalysis::capture(Arrival arrival, const string& name){
+    /*------------------------------------------------------------------------------------------
+    Ends a path at a register input or an output.
+    ------------------------------------------------------------------------------------------*/
+    if(arrival.stage < 0){
+        return;
+    }
+    if((size_t)arrival.stage >= this->result.stages.size()){
+        this->result.stages.resize(arrival.stage + 1);
+    }
+    StageTiming& stage = this->result.stages[arrival.stage];
+    if(arrival.time > stage.worst){
+        stage.worst = arrival.time;
+        stage.endpoint = name;
+    }
+}
+
+void TimingAnalysis::evaluate(const ModuleDef& module, const vector<Arrival>& inputs, vector<Arrival>& outputs, const string& prefix){
+    /*------------------------------------------------------------------------------------------
+    Propagates the arrivals at the input bits of one instance of a module to its output bits. The
+    paths ending at the flipflops inside are captured on the way.
+
+    Param : module (ModuleDef), a module built of submodules.
+    Param : inputs (vector<Arrival>), one per input bit, bit by bit over the input ports.
+    Param : outputs (vector<Arrival>), set to one per output bit.
+    Param : prefix (string), the instance path, example "WTM_CLA."
+    ------------------------------------------------------------------------------------------*/
+    const ModuleTiming& timing = this->prepare(module);
+    const InstanceTable& instances = module.submodules;
+    vector<Arrival> arrival(timing.nodes, UNREACHED);
+    size_t input = 0;
+    for(size_t p = 0; p < module.ports.size(); p++){
+        for(size_t bit = 0; bit < timing.ports[p].size() && !module.ports[p].is_output(); bit++, input++){
+            arrival[timing.ports[p][bit]] = later(arrival[timing.ports[p][bit]], input < inputs.size() ? inputs[input] : UNREACHED);
+        }
+    }
+
+    vector<Arrival> sub_inputs, sub_outputs;
+    for(vector<uint32_t>::const_iterator i = timing.order.begin(); i != timing.order.end(); i++){
+        const ModuleDef* sub = instances.module(*i);
+        size_t bindings = min(instances.num_bindings(*i), sub->ports.size());
+        if(is_gate(sub->op)){
+            int delay = gate_info(sub->op).delay;
+            for(size_t p = 0; p < bindings; p++){
+                for(size_t bit = 0; bit < timing.size(*i, p) && sub->ports[p].is_output(); bit++){
+                    Arrival in = UNREACHED;
+                    for(size_t q = 0; q < bindings; q++){
+                        if(!sub->ports[q].is_output() && bit < timing.size(*i, q)){
+                            in = later(in, arrival[timing.begin(*i, q)[bit]]);
+                        }
+                    }
+                    uint32_t out = timing.begin(*i, p)[bit];
+                    arrival[out] = later(arrival[out], delayed(in, delay));
+                }
+            }
+            continue;
+        }
+
+        if(sub->op == Op::FLIP_FLOP){
+            /*------------------------------------------------------------------------------------------
+            The first port is the data input, the last one the state. The clock is ideal.
+            ------------------------------------------------------------------------------------------*/
+            size_t q = bindings - 1;
+            size_t width = min(timing.size(*i, 0), timing.size(*i, q));
+            for(size_t bit = 0; bit < width; bit++){
+                Arrival d = arrival[timing.begin(*i, 0)[bit]];
+                string name = prefix + string(instances.name(*i));
+                if(sub->width > 1 || width > 1){
+                    name += "[" + to_string(bit) + "]";
+                }
+                this->capture(d, name);
+                this->result.registers++;
+                if(d.stage >= 0){
+                    this->result.stages[d.stage].registers++;
+                }
+                uint32_t out = timing.begin(*i, q)[bit];
+                arrival[out] = later(arrival[out], d.stage < 0 ? UNREACHED : Arrival{d.stage + 1, FLIP_FLOP_DELAY});
+            }
+            continue;
+        }
+
+        /*------------------------------------------------------------------------------------------
+        Modules built of submodules: combinational ones through their arc model, the others are
+        walked for this instance.
+        ------------------------------------------------------------------------------------------*/
+        const ModuleTiming& sub_timing = this->prepare(*sub);
+        sub_inputs.clear();
+        for(size_t p = 0; p < sub->ports.size(); p++){
+            for(size_t bit = 0; bit < sub_timing.ports[p].size() && !sub->ports[p].is_output(); bit++){
+                sub_inputs.push_back(p < bindings && bit < timing.size(*i, p) ? arrival[timing.begin(*i, p)[bit]] : UNREACHED);
+            }
+        }
+        if(this->sequential(*sub)){
+            vector<Arrival> walked;
+            this->evaluate(*sub, vector<Arrival>(sub_inputs), walked, prefix + string(instances.name(*i)) + ".");
+            sub_outputs.swap(walked);
+        }
+        else{
+            const ArcModel& model = this->arcs(*sub);
+            sub_outputs.assign(model.offsets.size() - 1, UNREACHED);
+            for(size_t o = 0; o + 1 < model.offsets.size(); o++){
+                for(uint32_t arc = model.offsets[o]; arc < model.offsets[o + 1]; arc++){
+                    sub_outputs[o] = later(sub_outputs[o], delayed(sub_inputs[model.arcs[arc].first], model.arcs[arc].second));
+                }
+            }
+        }
+        size_t output = 0;
+        for(size_t p = 0; p < sub->ports.size(); p++){
+            for(size_t bit = 0; bit < sub_timing.ports[p].size() && sub->ports[p].is_output(); bit++, output++){
+                if(p < bindings && bit < timing.size(*i, p)){
+                    uint32_t out = timing.begin(*i, p)[bit];
+                    arrival[out] = later(arrival[out], sub_outputs[output]);
+                }
+            }
+        }
+    }
+
+    outputs.clear();
+    for(size_t p = 0; p < module.ports.size(); p++){
+        for(size_t bit = 0; bit < timing.ports[p].size() && module.ports[p].is_output(); bit++){
+            outputs.push_back(arrival[timing.ports[p][bit]]);
+        }
+    }
+}
+
+TimingReport TimingAnalysis::run(const ModuleDef& top){
+    /*------------------------------------------------------------------------------------------
+    Every input bit of the top module arrives at time 0 of stage 0 and every output bit ends a
+    path.
+    ------------------------------------------------------------------------------------------*/
+    this->result = TimingReport();
+    this->result.module = top.name;
+    if(top.op != Op::NONE){
+        throw invalid_argument("Timing needs a module built of submodules, " + top.name + " is a primitive.");
+    }
+
+    const ModuleTiming& timing = this->prepare(top);
+    size_t inputs = 0;
+    for(size_t p = 0; p < top.ports.size(); p++){
+        inputs += top.ports[p].is_output() ? 0 : timing.ports[p].size();
+    }
+    vector<Arrival> outputs;
+    this->evaluate(top, vector<Arrival>(inputs, Arrival{0, 0}), outputs, "");
+
+    size_t output = 0;
+    for(size_t p = 0; p < top.ports.size(); p++){
+        int lsb = top.ports[p].net.lsb();
+        for(size_t bit = 0; bit < timing.ports[p].size() && top.ports[p].is_output(); bit++, output++){
+            string name(top.ports[p].net.name());
+            if(timing.ports[p].size() > 1){
+                name += "[" + to_string(lsb + bit) + "]";
+            }
+            this->capture(outputs[output], name);
+            this->result.latency = max(this->result.latency, outputs[output].stage);
+        }
+    }
+    for(vector<StageTiming>::iterator i = this->result.stages.begin(); i != this->result.stages.end(); i++){
+        this->result.period = max(this->result.period, i->worst);
+    }
+    return this->result;
+}
+
+TimingReport analyze_timing(const ModuleDef& module){
+    /*------------------------------------------------------------------------------------------
+    Static timing analysis of a module, see timing.h.
+
+    Param : module (ModuleDef), the top module, example *wtm.module_def()
+    Returns : The worst path of every pipeline stage, the clock period and the latency.
+    ------------------------------------------------------------------------------------------*/
+    TimingAnalysis analysis;
+    return analysis.run(module);
+}
+
+string TimingReport::report() const{
+    /*------------------------------------------------------------------------------------------
+    Returns a printable table, one line per stage with its worst path, the registers capturing it
+    and the endpoint of the worst path.
+    ------------------------------------------------------------------------------------------*/
+    string text = "[TIMING] " + this->module + "\n";
+    char line[128];
+    for(size_t i = 0; i < this->stages.size(); i++){
+        const StageTiming& stage = this->stages[i];
+        snprintf(line, sizeof(line), "[TIMING] stage %-8zu %6d units %10lld registers   ", i + 1, stage.worst, stage.registers);
+        text += line + stage.endpoint + "\n";
+    }
+    snprintf(line, sizeof(line), "[TIMING] %-14s %6d units\n", "clock period", this->period);
+    text += line;
+    snprintf(line, sizeof(line), "[TIMING] %-14s %6d cycles\n", "latency", this->latency);
+    text += line;
+    snprintf(line, sizeof(line), "[TIMING] %-14s %6lld\n", "registers", this->registers);
+    text += line;
+    return text;
+}
@@ -7,78 +7,279 @@
 #include <stdexcept>
 #include <cmath>
 #include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+#include <thread_pool.h>
+#include <module_cache.h>
+#include <stats.h>
 
 using namespace std;
 
 wire wire_name(wire full_name){
     /*------------------------------------------------------------------------------------------
-    This is a very usefull function to extract the wire name from a wire declaration string.
+    This is a very usefull function to extract the wire name from a wire declaration.
 
     Params : full_name (wire), full name including width. Example : "[9:0] my_wire"
-    Returns : Parsed string, if input contains infomration about widths. Example : "my_wire"                      
+    Returns : The wire without any width or slice. Example : "my_wire"                      
     ------------------------------------------------------------------------------------------*/
-    string delim = "] ";
-    size_t index;
-    if(string::npos != (index = full_name.find(delim, 0))){
-        return full_name.substr(index + 2);
+    return wire(full_name.name(), 1);
+}
+
+string module_name(string definition){
+    /*------------------------------------------------------------------------------------------
+    Extracts the module name from a module definition string.
+
+    Params : definition (string), module definition. Example : "module FULL_ADDER (A, B, ...);"
+    Returns : Parsed module name. Example : "FULL_ADDER"
+    ------------------------------------------------------------------------------------------*/
+    size_t start = definition.find("module ");
+    if(start == string::npos){
+        return definition;
     }
-    else{
-        return full_name;
+    start += 7;
+    size_t end = definition.find_first_of(" (", start);
+    return definition.substr(start, end - start);
+}
+
+static void collect_headers(const ModuleDef* module, unordered_set<const ModuleDef*>& visited, vector<const ModuleDef*>& all_headers){
+    /*------------------------------------------------------------------------------------------
+    Depth first walk over the unique dependencies. A module is appended only after all of its
+    dependencies, which gives a deterministic, dependency ordered list.
+    ------------------------------------------------------------------------------------------*/
+    if(!visited.insert(module).second){
+        return;
     }
+    for(vector<const ModuleDef*>::const_iterator dep = module->dependencies.begin(); dep != module->dependencies.end(); dep++){
+        collect_headers(*dep, visited, all_headers);
+    }
+    all_headers.push_back(module);
 }
 
-string Chip::generate_verilog(){
+string Chip::generate_verilog(const EmitOptions& options){
     /*------------------------------------------------------------------------------------------
     This function generates a formated output string verilog code.       
 
-    Params : None
+    Params : options (EmitOptions), optional, see EmitOptions.
     Returns : code (string), output verilog code                          
     ------------------------------------------------------------------------------------------*/
-    string code = "// Generated code\n// Sooryakiran P\n// ME17B174\n";
-    set<string> headers = this->define_headers();
-    for (set<string>::iterator i = headers.begin(); i != headers.end(); i++){
-        code += "\n" + *i + "\n";
+    ostringstream code;
+    this->write_verilog(code, options);
+    return code.str();
+}
+
+static void write_flat(ostream& out, const ModuleDef* module, const EmitOptions& options, unordered_set<const ModuleDef*>& visited){
+    /*------------------------------------------------------------------------------------------
+    Writes a module flattened, after the modules it still instantiates. Modules that can not be
+    flattened are written as they are, after their dependencies. Modules loaded from the module
+    cache have no netlist, they throw rather than leave hierarchy in a flat design.
+    ------------------------------------------------------------------------------------------*/
+    if(!visited.insert(module).second){
+        return;
+    }
+    if(module->from_cache){
+        throw invalid_argument(module->name + " was loaded from the module cache without its netlist and can not be flattened.");
+    }
+    string text;
+    vector<const ModuleDef*> dependencies;
+    if(module->op == Op::NONE && can_flatten(*module)){
+        text = verilog_flat_definition(*module, options, dependencies);
+    }
+    else{
+        text = module->definition.empty() ? verilog_definition(*module) : module->definition;
+        dependencies = module->dependencies;
+    }
+    for(vector<const ModuleDef*>::iterator dep = dependencies.begin(); dep != dependencies.end(); dep++){
+        write_flat(out, *dep, options, visited);
     }
-    return code;
+    out << "\n" << text << "\n";
+    DOTV_COUNT(BYTES_EMITTED, text.size() + 2);
 }
 
+static size_t eliminate_joins(vector<const ModuleDef*>& headers, vector<shared_ptr<const ModuleDef>>& rewritten){
+    /*------------------------------------------------------------------------------------------
+    Replaces every module with joins by its alias free copy, and drops the JOIN modules that are
+    no longer instantiated by any of them. The copies are held in rewritten. Returns the number
+    of JOIN instances removed.
+    ------------------------------------------------------------------------------------------*/
+    rewritten.assign(headers.size(), nullptr);
+    atomic<size_t> removed(0);
+    ThreadPool::global().parallel_for(headers.size(), [&](size_t i){
+        size_t count;
+        rewritten.at(i) = headers.at(i)->eliminate_aliases(count);
+        removed += count;
+    });
+    DOTV_COUNT(JOINS_REMOVED, removed);
+
+    unordered_set<const ModuleDef*> used;
+    for(size_t i = 0; i < headers.size(); i++){
+        const ModuleDef* module = rewritten.at(i) ? rewritten.at(i).get() : headers.at(i);
+        used.insert(module->dependencies.begin(), module->dependencies.end());
+    }
+    vector<const ModuleDef*> kept;
+    for(size_t i = 0; i < headers.size(); i++){
+        if(headers.at(i)->op == Op::JOIN && !used.count(headers.at(i))){
+            continue;
+        }
+        kept.push_back(rewritten.at(i) ? rewritten.at(i).get() : headers.at(i));
+    }
+    headers.swap(kept);
+    return removed;
+}
 
-set<string> Chip::define_headers(){
+size_t Chip::write_verilog(ostream& out, const EmitOptions& options){
     /*------------------------------------------------------------------------------------------
-    This function recursively iterates through all the submodules if any to generate a set of
-    module definitions.         
+    This function streams the formated verilog code to the given output stream. Modules are wr-
+    itten one by one in dependency order, so the whole design is never held as a single string.
 
-    Params : None
-    Returns : all_headers (set<string>), a set of all module and submodule definitions.                          
+    Params : out (ostream), output stream. Example : a FileSink or cout
+    Params : options (EmitOptions), optional. With options.flatten the hierarchy is inlined, with
+             options.optimize it is also optimized (options.retime also retimed) and with options.eliminate_joins the JOIN instances are removed, see EmitOptions.
+    Returns : The number of JOIN instances removed by options.eliminate_joins, 0 without it.
     ------------------------------------------------------------------------------------------*/
-    set<string> all_headers;
-    all_headers.insert(this->definition);
+    const char* banner = "// Generated code\n// Sooryakiran P\n// ME17B174\n";
+    out << banner;
+    DOTV_COUNT(BYTES_EMITTED, strlen(banner));
+
+    if(options.flatten || options.optimize || options.retime){
+        DOTV_TIMER(PHASE_RENDER);
+        unordered_set<const ModuleDef*> visited;
+        write_flat(out, this->module_def().get(), options, visited);
+        return 0;
+    }
 
-    for(vector<Chip>::iterator sub = this->submodules.begin();
-                               sub != this->submodules.end();
-                               sub++){
-        set<string> sub_header = sub->define_headers();
-        all_headers.insert(sub_header.begin(), sub_header.end());
+    vector<const ModuleDef*> headers = this->define_headers();
+    vector<shared_ptr<const ModuleDef>> rewritten;
+    size_t joins_removed = 0;
+    if(options.eliminate_joins){
+        DOTV_TIMER(PHASE_RENDER);
+        joins_removed = eliminate_joins(headers, rewritten);
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Module texts are independent, so a batch of them is rendered on the thread pool and then wr-
+    itten in dependency order. Only one batch of text is held in memory at a time. Modules that
+    were not loaded from the module cache are stored in it on the way, unless they were rewrit-
+    ten by the options.
+    ------------------------------------------------------------------------------------------*/
+    ThreadPool& pool = ThreadPool::global();
+    ModuleCache& cache = ModuleCache::global();
+    size_t batch = pool.size() * 16;
+    vector<string> texts(batch);
+    for(size_t start = 0; start < headers.size(); start += batch){
+        size_t count = min(batch, headers.size() - start);
+        {
+            DOTV_TIMER(PHASE_RENDER);
+            pool.parallel_for(count, [&](size_t i){
+                const ModuleDef* module = headers.at(start + i);
+                if(module->definition.empty()){
+                    texts.at(i) = verilog_definition(*module);
+                }
+            });
+        }
+        DOTV_TIMER(PHASE_WRITE);
+        for(size_t i = 0; i < count; i++){
+            const ModuleDef* module = headers.at(start + i);
+            const string& text = module->definition.empty() ? texts.at(i) : module->definition;
+            out << "\n" << text << "\n";
+            DOTV_COUNT(BYTES_EMITTED, text.size() + 2);
+            if(cache.enabled() && !options.eliminate_joins){
+                cache.store(*module, text);
+            }
+            texts.at(i).clear();
+        }
     }
+    return joins_removed;
+}
+
+void Chip::write_blif(ostream& out, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Streams the design as one flat BLIF model, see blif_definition(...).
+
+    Params : out (ostream), output stream. Example : a FileSink or cout
+    Params : options (EmitOptions), optional, only optimize and retime are used.
+    Returns : None
+    ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_RENDER);
+    string text = "# Generated code\n# Sooryakiran P\n# ME17B174\n\n" + blif_definition(*this->module_def(), options);
+    out << text;
+    DOTV_COUNT(BYTES_EMITTED, text.size());
+}
+
+void Chip::write_aiger(ostream& out, const EmitOptions& options){
+    /*------------------------------------------------------------------------------------------
+    Streams the design as a binary AIGER file, see aiger_definition(...).
+
+    Params : out (ostream), output stream. Example : a FileSink or cout
+    Params : options (EmitOptions), optional, only optimize and retime are used.
+    Returns : None
+    ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_RENDER);
+    string text = aiger_definition(*this->module_def(), options);
+    out << text;
+    DOTV_COUNT(BYTES_EMITTED, text.size());
+}
 
+vector<const ModuleDef*> Chip::define_headers(){
+    /*------------------------------------------------------------------------------------------
+    This function walks the registered module definitions once to generate a list of all unique
+    module definitions used by this chip, including its own.
+
+    Params : None
+    Returns : all_headers (vector<const ModuleDef*>), dependency ordered module definitions.
+    ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_DEFINE_HEADERS);
+    vector<const ModuleDef*> all_headers;
+    unordered_set<const ModuleDef*> visited;
+    collect_headers(this->module_def().get(), visited, all_headers);
     return all_headers;
 }
 
+shared_ptr<const ModuleDef> Chip::module_def() const{
+    /*------------------------------------------------------------------------------------------
+    Returns the shared module definition of this chip, registering it if needed.
+    ------------------------------------------------------------------------------------------*/
+    return ModuleDef::intern(*this);
+}
+
+bool Chip::reuse_module(ModuleKey key){
+    /*------------------------------------------------------------------------------------------
+    Sets the module key of this chip and looks it up in the registry, then in the on-disk module
+    cache if it is enabled. If the module was already elaborated, this chip points to it and the
+    constructor can skip building the module body.
+
+    Param : key (ModuleKey), generator and parameters of the module.
+    Returns : true if the module is already registered or was loaded from the cache.
+    ------------------------------------------------------------------------------------------*/
+    this->key = key;
+    this->module = ModuleRegistry::global().find(key);
+    if(!this->module && ModuleCache::global().enabled()){
+        this->module = ModuleCache::global().load(key);
+    }
+    return this->module != nullptr;
+}
+
 int Chip::num_transistors(){
     /*------------------------------------------------------------------------------------------
-    This function recursively iterates through all the submodules and behaviours if any to count
-    the number of transistors required to create an instance.
+    This function sums up the cached transistor counts of all the submodules and behaviours if
+    any to count the number of transistors required to create an instance.
 
     Params : None
     Returns : total (int), transitor count.                         
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_NUM_TRANSISTORS);
+    if(this->module){
+        return this->module->num_transistors();
+    }
+
     int total = this->transistors;
     
-    for(vector<Chip>::iterator sub = this->submodules.begin();
-                               sub != this->submodules.end();
-                               sub++){
-
-        total += sub->num_transistors();
+    for(size_t sub = 0; sub < this->submodules.size(); sub++){
+        total += this->submodules.module(sub)->num_transistors();
     }
 
     for(vector<BehaviourModel>::iterator sub = this->behaviours.begin();
@@ -104,31 +305,7 @@ void Chip::declare(wire e, int type){
             and 3 for CHIP_OUTPUT_REG.
     Returns : None
     ------------------------------------------------------------------------------------------*/
-   
-    string pre = "";
-    if(this->n_bits > 1){
-        pre = "[" + to_string(this->n_bits -1) + ": 0] ";
-    } 
-    
-    if(type == CHIP_INPUTS){
-        this->input_names.push_back(pre + e);
-        this->is_input_reg.push_back(false);
-    }
-    else if(type == CHIP_OUTPUTS){
-        this->output_names.push_back(pre + e);
-        this->is_output_reg.push_back(false);
-    }
-    else if(type == CHIP_INPUTS_REG){
-        this->input_names.push_back(pre + e);
-        this->is_input_reg.push_back(true);
-    }
-    else if(type == CHIP_OUTPUTS_REG){
-        this->output_names.push_back(pre + e);
-        this->is_output_reg.push_back(true);
-    }
-    else{
-        throw invalid_argument( "Invalid type for port." );
-    }
+    this->declare(e, type, this->n_bits);
 }
 
 void Chip::declare(wire e, int type, int width){
@@ -141,47 +318,31 @@ void Chip::declare(wire e, int type, int width){
     
 
     Param : c (wire), a port/wire name.
-    Param : type (int), port type, 0 for CHIP_INPUTS, 1 for CHIP_OUTPUTS, 2 for CHIP_INPUT_REG 
-            and 3 for CHIP_OUTPUT_REG.
+    Param : type (int), port type, 0 for CHIP_INPUTS, 1 for CHIP_OUTPUTS, 2 for CHIP_INPUT_REG,
+            3 for CHIP_OUTPUT_REG and 4 for CHIP_INOUT.
     Param : width (int), Bit width of port. If no width is specified, it is assumed to be of the
             parent Chip's width.
     Returns : None
     ------------------------------------------------------------------------------------------*/ 
+    DOTV_COUNT(WIRES_DECLARED, 1);
     
-    string pre = "";
-    if(width>1){
-        pre = "[" + to_string(width -1) + ": 0] ";
-    }
-    
-    if(type == CHIP_INPUTS){
-        this->input_names.push_back(pre + e);
-        this->is_input_reg.push_back(false);
-    }
-    else if(type == CHIP_OUTPUTS){
-        this->output_names.push_back(pre + e);
-        this->is_output_reg.push_back(false);
-    }
-    else if(type == CHIP_INPUTS_REG){
-        this->input_names.push_back(pre + e);
-        this->is_input_reg.push_back(true);
-    }
-    else if(type == CHIP_OUTPUTS_REG){
-        this->output_names.push_back(pre + e);
-        this->is_output_reg.push_back(true);
-    }
-    else{
+    if(type < CHIP_INPUTS || type > CHIP_INOUT){
         throw invalid_argument( "Invalid type for port." );
     }
+    this->ports.push_back({wire(e.name(), width), type});
 }
 
-void Chip::add_submodule(Chip sub){
+void Chip::add_submodule(const Chip& sub){
     /*------------------------------------------------------------------------------------------
-    Adds a new chip as a submodule for the current chip.
+    Adds a new chip as a submodule for the current chip. Only the instance name and the port
+    bindings are stored, the module definition is shared through ModuleDef::intern(...).
 
     Param : sub (Chip), a submodule chip.
     Returns : None
     ------------------------------------------------------------------------------------------*/
-    this->submodules.push_back(sub);
+    DOTV_TIMER(PHASE_ADD_SUBMODULE);
+    DOTV_COUNT(INSTANCES_CREATED, 1);
+    this->submodules.add(sub.name, ModuleDef::intern(sub), sub.inputs, sub.outputs, sub.generate);
 }
 
 void Chip::add_submodule(BehaviourModel behaviour){
@@ -202,6 +363,7 @@ void Chip::add_wire(wire new_wire){
     Param : new_wire (wire), a wire.
     Returns : None
     ------------------------------------------------------------------------------------------*/
+    DOTV_COUNT(WIRES_DECLARED, 1);
     this->wires.push_back(new_wire);
 }
 
@@ -226,194 +388,66 @@ void Chip::verilog(string e){
     this->extras.push_back(e);
 }
 
-string Chip::auto_gen(string head){
-    /*------------------------------------------------------------------------------------------
-    Automatically generates the chip module header definition
-
-    Param : head (string), a module name.
-    Returns : head_def
-
-    Example if head = "module MY_CHIP"
-    ------------------------------------------------------------------------------------------*/
-
-    string head_def = head + " (";
-
-    /*------------------------------------------------------------------------------------------
-    head_def will be "module MY_CHIP("
-
-    The next stage checks for any input declarations and head def will be appended
-    ------------------------------------------------------------------------------------------*/
-
-    for(vector<string>::iterator i = this->input_names.begin(); i != this->input_names.end(); i++){
-        if(i!=this->input_names.begin()){
-            head_def += ", ";
-        }
-        string input = *i;
-        head_def += wire_name(input);
-    }
-
+void Chip::merge(Chip& part){
     /*------------------------------------------------------------------------------------------
-    The next stage checks for any output declarations and head def will be appended
-    ------------------------------------------------------------------------------------------*/
-    for(vector<string>::iterator i = this->output_names.begin(); i != this->output_names.end(); i++){
-        string input = *i;
-        head_def += ", " + wire_name(input);
-    }
-    head_def += ");";
+    Moves everything wired into part over to this chip, keeping the order. The ports of part are
+    ignored.
 
-    /*------------------------------------------------------------------------------------------
-    At this stage head_def will be "module MY_CHIP(my_input_1, my_input_2, my_output);"
+    Param : part (Chip), a chip used only as a container for wires and submodules.
+    Returns : None
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ADD_SUBMODULE);
+    this->wires.insert(this->wires.end(), part.wires.begin(), part.wires.end());
+    this->regs.insert(this->regs.end(), part.regs.begin(), part.regs.end());
+    this->assigns.insert(this->assigns.end(), part.assigns.begin(), part.assigns.end());
+    this->extras.insert(this->extras.end(), make_move_iterator(part.extras.begin()), make_move_iterator(part.extras.end()));
+    this->behaviours.insert(this->behaviours.end(), part.behaviours.begin(), part.behaviours.end());
+    this->submodules.append(std::move(part.submodules));
+    part = Chip();
+}
 
-    // string pre = "";
-    // if(this->n_bits > 1){
-    //     pre = "[" + to_string(this->n_bits -1) + ": 0] ";
-    // } 
-    
-    head_def += "\n\t// Transistor count : " + to_string(this->num_transistors()) + "\n";
+void Chip::assign(wire lhs, int value){
     /*------------------------------------------------------------------------------------------
-    In the next stage we again write these inputs and outputs inside the module. We also checked
-    for the bit width to make appropriate declarations.
-    ------------------------------------------------------------------------------------------*/
-    head_def += "\n\t// Inputs\n\n";
-
-    for(int i=0; i < this->input_names.size(); i++){
-        if(this->is_input_reg.at(i))
-            head_def += "\tinput reg "  + this->input_names.at(i) + ";\n";
-        else
-            head_def += "\tinput "  + this->input_names.at(i) + ";\n";
-    }
-
-    head_def += "\n\t// Outputs\n\n";
-    for(int i=0; i < this->output_names.size(); i++){
-        if(this->is_output_reg.at(i))
-            head_def += "\toutput reg "  + this->output_names.at(i) + ";\n";
-        else
-            head_def += "\toutput "  + this->output_names.at(i) + ";\n";
-    }
+    Ties a net (or a slice of it) to a constant. Example : assign(carry[0], 0)
 
-    /*------------------------------------------------------------------------------------------
-    At this stage head_def will be assuming 8 bit width
-    """
-    module MY_CHIP(my_input_1, my_input_2, my_output);
-        // Inputs
-        input [7:0] my_input_1;
-        input [7:0] my_input_2;
-        // Outputs
-        output [7:0] my_output;
-    """
+    Param : lhs (wire), the driven net.
+    Param : value (int), the constant.
+    Returns : None
     ------------------------------------------------------------------------------------------*/
+    this->assigns.push_back({lhs, value});
+}
 
+string Chip::auto_gen(string head){
     /*------------------------------------------------------------------------------------------
-    Now we add any wires and reg declared.
-    ------------------------------------------------------------------------------------------*/
-    head_def += "\n\t// Wires\n\n";
-    for(vector<string>::iterator i = this->wires.begin(); i != this->wires.end(); i++){
-        head_def += "\twire " + *i + ";\n";
-    }
+    Automatically generates the chip module definition. The chip is interned as a netlist and the
+    definition is rendered from it by the verilog backend (see verilog_definition(...)).
 
-    head_def += "\n\t// Regs\n\n";
-    for(vector<string>::iterator i = this->regs.begin(); i != this->regs.end(); i++){
-        head_def += "\treg " + *i + ";\n";
-    }
-
-    /*------------------------------------------------------------------------------------------
-    Embed any verilog codes.
-    ------------------------------------------------------------------------------------------*/
-    head_def += "\n\t// Extras\n\n";
-    for(vector<string>::iterator i = this->extras.begin(); i != this->extras.end(); i++){
-        head_def += "\t"+ *i + "\n";
-    }
+    Param : head (string), a module name.
+    Returns : head_def
 
-    /*------------------------------------------------------------------------------------------
-    At this stage head_def will be something like
+    Example if head = "module MY_CHIP"
     """
-    module MY_CHIP(my_input_1, my_input_2, my_output);
+    module MY_CHIP (my_input_1, my_input_2, my_output);
         // Inputs
-        input [7:0] my_input_1;
-        input [7:0] my_input_2;
-
-        // Outputs
-        output [7:0] my_output;
-
-        // Wires
-        wire my_wire_1;
-        wire my_wire_2;
-        wire [7:0] my_wide_wire;
-
-        // Extras
-        assign my_wire_1 = 0;
-
+        input [7: 0] my_input_1;
+        ...
+    endmodule
     """
     ------------------------------------------------------------------------------------------*/
+    this->type_name = module_name(head);
+    return verilog_definition(*this->module_def());
+}
 
+void Chip::lazy_gen(string head){
     /*------------------------------------------------------------------------------------------
-    Now add submodule instances.
-    ------------------------------------------------------------------------------------------*/
-
-    head_def += "\n\t// Sub Modules\n\n";
-    for(vector<Chip>::iterator i = this->submodules.begin(); i != this->submodules.end(); i++){
-        head_def += "\t" + i->generate + "\n";
-    }
-
-    /*------------------------------------------------------------------------------------------
-    Now we add the behaviours specified
-    ------------------------------------------------------------------------------------------*/
-
-    head_def += "\n\t// Behaviours\n\n";
-    for(vector<BehaviourModel>::iterator i = this->behaviours.begin(); i != this->behaviours.end(); i++){
-        string code = i->code();
-        size_t index = 0;
-        while(string::npos != (index = code.find('\n', index))){
-            code.replace(index, 1, "\n\t");
-            index +=2;
-        }
-        
-
-        head_def += "\t" + code + "\n";
-    }
-
-    head_def += "\nendmodule\n";
-
-    /*------------------------------------------------------------------------------------------
-    At this stage head_def will be something like
-    """
-    module MY_CHIP(my_input_1, my_input_2, my_output);
-        // Inputs
-        input [7:0] my_input_1;
-        input [7:0] my_input_2;
-
-        // Outputs
-        output [7:0] my_output;
-
-        // Wires
-        wire my_wire_1;
-        wire my_wire_2;
-        wire [7:0] my_wide_wire;
-
-        // Regs
-        reg a;
-
-        // Extras
-        assign my_wire_1 = 0;
-
-        // Submodules
-        AND_GATE my_and_1(my_input_1[0], my_input_2[0], my_wire_1);
-        ...
-
-        // Behaviours
-        
-        always @(posedge my_input_1);
-        begin;
-            a <= ~my_input_2;
-        end;
-
-        ...
+    Registers the chip module without rendering its definition. The text is rendered once per
+    unique module by write_verilog(...), where all the modules are rendered in parallel.
 
-    endmodule
-    """
+    Param : head (string), a module name. Example : "module MY_CHIP"
+    Returns : None
     ------------------------------------------------------------------------------------------*/
-    return head_def;
+    this->type_name = module_name(head);
+    this->module_def();
 }
 
 /*------------------------------------------------------------------------------------------
@@ -444,7 +478,7 @@ void BehaviourModel::add(string lhs, string rhs, bool is_blocking){
     this->statements.push_back(expr);
 }
 
-string BehaviourModel::code(){
+string BehaviourModel::code() const{
     /*------------------------------------------------------------------------------------------
     TReturns the verilog code for the current behaviour as string.
 
@@ -452,7 +486,7 @@ string BehaviourModel::code(){
     ------------------------------------------------------------------------------------------*/
     string outs = "always @(";
     
-    for(vector<string>::iterator i = this->sensitivity_list.begin(); i != this->sensitivity_list.end(); i++){
+    for(vector<string>::const_iterator i = this->sensitivity_list.begin(); i != this->sensitivity_list.end(); i++){
         if(i != this->sensitivity_list.begin()){
             outs += " or ";
         }
@@ -460,7 +494,7 @@ string BehaviourModel::code(){
     }
     outs += ")\nbegin";
 
-    for(vector<string>::iterator i = this->statements.begin(); i != this->statements.end(); i++){
+    for(vector<string>::const_iterator i = this->statements.begin(); i != this->statements.end(); i++){
         outs += "\n\t" + *i + ";";
     }
     outs +="\nend";
@@ -468,289 +502,6 @@ string BehaviourModel::code(){
 }
 
 
-/*------------------------------------------------------------------------------------------
-                                    JOINING 2 WIRES
-                                    ===============
-    Disclaimer : IThe trick to join 2 wires is taken from this page. 
-    https://groups.google.com/g/comp.lang.verilog/c/b3-6XMA8KA4/m/b-7zIz0bW6gJ
-------------------------------------------------------------------------------------------*/
-
-JOIN::JOIN(string name, wire a, wire b){
-    this->name = name;
-    this->inputs.push_back(a);
-    this->inputs.push_back(b);
-    this->transistors = 0;
-    this->definition = "module JOIN(a, a);\n"
-                       "\t inout a;\n"
-                       "endmodule";
-    this->generate = "JOIN " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ");";
-}
-
-JOIN_N_BIT::JOIN_N_BIT(string name, wire a, wire b, int n_bits){
-    this->name = name;
-    this->inputs.push_back(a);
-    this->inputs.push_back(b);
-    this->transistors = 0;
-    this->n_bits = n_bits;
-    this->definition = "module JOIN_" + to_string(n_bits) + "_BIT (a, a);\n"
-                       "\t inout [" + to_string(n_bits - 1) + ":0] a;\n"
-                       "endmodule";
-    this->generate = "JOIN_" + to_string(n_bits) + "_BIT " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        AND GATE
-                                        ========
-------------------------------------------------------------------------------------------*/
-
-AND::AND(string name, vector<wire> input_wires, wire output_wire){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = AND_TRANSISTORS;
-    this->definition = "module AND_GATE(a, b, c);\n"
-                       "\t input a, b;\n"
-                       "\t output c;\n"
-                       "\t assign #" + to_string(AND_DELAY) + " c = a & b;\n"
-                       "endmodule";
-    this->generate = "AND_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                    AND GATE N BIT
-                                    ==============
-------------------------------------------------------------------------------------------*/
-
-AND_N_BIT::AND_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = AND_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module AND_GATE_" + to_string(n_bits) + "_BIT(a, b, c);\n"
-                       "\t input " + array_def + " a, b;\n"
-                       "\t output " + array_def + " c;\n"
-                       "\t assign #" + to_string(AND_DELAY) + " c = a & b;\n"
-                       "endmodule";    
-
-    this->generate =  "AND_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        XOR GATE
-                                        ========
-------------------------------------------------------------------------------------------*/
-
-XOR::XOR(string name, vector<wire> input_wires, wire output_wire){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = XOR_TRANSISTORS;
-    this->definition = "module XOR_GATE(a, b, c);\n"
-                    "\t input a, b;\n"
-                    "\t output c;\n"
-                    "\t assign #" + to_string(XOR_DELAY) + " c = a ^ b;\n"
-                    "endmodule";
-
-    this->generate =  "XOR_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-/*------------------------------------------------------------------------------------------
-                                    XOR GATE N BIT
-                                    ==============
-------------------------------------------------------------------------------------------*/
-
-XOR_N_BIT::XOR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = XOR_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module XOR_GATE_" + to_string(n_bits) + "_BIT(a, b, c);\n"
-                       "\t input " + array_def + " a, b;\n"
-                       "\t output " + array_def + " c;\n"
-                       "\t assign #" + to_string(XOR_DELAY) + "  c = a ^ b;\n"
-                       "endmodule";    
-
-    this->generate =  "XOR_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        OR GATE
-                                        =======
-------------------------------------------------------------------------------------------*/
-
-OR::OR(string name, vector<wire> input_wires, wire output_wire){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = OR_TRANSISTORS;
-    this->definition = "module OR_GATE(a, b, c);\n"
-                    "\t input a, b;\n"
-                    "\t output c;\n"
-                    "\t assign #" + to_string(OR_DELAY) + "  c = a | b;\n"
-                    "endmodule";
-
-    this->generate =  "OR_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-/*------------------------------------------------------------------------------------------
-                                    OR GATE N BIT
-                                    =============
-------------------------------------------------------------------------------------------*/
-
-OR_N_BIT::OR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = OR_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module OR_GATE_" + to_string(n_bits) + "_BIT(a, b, c);\n"
-                       "\t input " + array_def + " a, b;\n"
-                       "\t output " + array_def + " c;\n"
-                       "\t assign #" + to_string(OR_DELAY) + "  c = a | b;\n"
-                       "endmodule";    
-
-    this->generate =  "OR_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        NAND GATE
-                                        =========
-------------------------------------------------------------------------------------------*/
-
-NAND::NAND(string name, vector<wire> input_wires, wire output_wire){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = NAND_TRANSISTORS;
-    this->definition = "module NAND_GATE(a, b, c);\n"
-                    "\t input a, b;\n"
-                    "\t output c;\n"
-                    "\t assign #" + to_string(NAND_DELAY) + "  c = ~(a & b);\n"
-                    "endmodule";
-
-    this->generate = "NAND_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                    NAND GATE N BIT
-                                    ===============
-------------------------------------------------------------------------------------------*/
-
-NAND_N_BIT::NAND_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = NAND_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module NAND_GATE_" + to_string(n_bits) + "_BIT(a, b, c);\n"
-                       "\t input " + array_def + " a, b;\n"
-                       "\t output " + array_def + " c;\n"
-                       "\t assign #" + to_string(NAND_DELAY) + "  c = ~(a & b);\n"
-                       "endmodule";    
-
-    this->generate = "NAND_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        NOR GATE
-                                        ========
-------------------------------------------------------------------------------------------*/
-
-NOR::NOR(string name, vector<wire> input_wires, wire output_wire){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = NOR_TRANSISTORS;
-    this->definition = "module NOR_GATE(a, b, c);\n"
-                    "\t input a, b;\n"
-                    "\t output c;\n"
-                    "\t assign #" + to_string(NOR_DELAY) + "  c = ~(a | b);\n"
-                    "endmodule";
-
-    this->generate = "NOR_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-/*------------------------------------------------------------------------------------------
-                                    NOR GATE N BIT
-                                    ==============
-------------------------------------------------------------------------------------------*/
-
-NOR_N_BIT::NOR_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs = input_wires;
-    this->outputs.push_back(output_wire);
-    this->transistors = NOR_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module NOR_GATE_" + to_string(n_bits) + "_BIT(a, b, c);\n"
-                       "\t input " + array_def + " a, b;\n"
-                       "\t output " + array_def + " c;\n"
-                       "\t assign #" + to_string(NOR_DELAY) + "  c = ~(a | b);\n"
-                       "endmodule";    
-
-    this->generate =  "NOR_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
-}
-
-
-/*------------------------------------------------------------------------------------------
-                                        NOT GATE
-                                        ========
-------------------------------------------------------------------------------------------*/
-
-NOT::NOT(string name, wire input_wire, wire output_wire){
-    this->name = name;
-    this->inputs.push_back(input_wire);
-    this->outputs.push_back(output_wire);
-    this->transistors = NOT_TRANSISTORS;
-    this->definition = "module NOT_GATE(in, out);\n"
-                    "\t input in;\n"
-                    "\t output out;\n"
-                    "\t assign #" + to_string(NOT_DELAY) + "  out = ~in;\n"
-                    "endmodule";
-
-    this->generate =  "NOT_GATE " + this->name + " (" + this->inputs.at(0) + ", " + this->outputs.at(0) + ");";
-}
-
-/*------------------------------------------------------------------------------------------
-                                    NOT GATE N BIT
-                                    ==============
-------------------------------------------------------------------------------------------*/
-
-NOT_N_BIT::NOT_N_BIT(string name, wire input_wire, wire output_wire, int n_bits){
-    this->name = name;
-    this->inputs.push_back(input_wire);
-    this->outputs.push_back(output_wire);
-    this->transistors = NOT_TRANSISTORS*n_bits;
-    this->n_bits = n_bits;
-
-    string array_def = "[" + to_string(n_bits -1) + ":0]";
-    this->definition = "module NOT_GATE_" + to_string(n_bits) + "_BIT(in, out);\n"
-                       "\t input " + array_def + " in;\n"
-                       "\t output " + array_def + " out;\n"
-                       "\t assign #" + to_string(NOT_DELAY) + "  out = ~in;\n"
-                       "endmodule";    
-
-    this->generate =  "NOT_GATE_" + to_string(this->n_bits) + "_BIT " + this->name + + " (" + this->inputs.at(0) + ", " + this->outputs.at(0) + ");";
-}
-
 /*------------------------------------------------------------------------------------------
                                     FULL ADDER CIRCUIT
                                     ==================
@@ -766,9 +517,11 @@ FULL_ADDER::FULL_ADDER(string name, vector<wire> input_wires, vector<wire> outpu
     In our case the input_wires will be {"A", "B", "Cin"}
     and the output_wires will be {"S", "Cout"}  
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs = output_wires;
+    if(this->reuse_module({"FULL_ADDER", {}})) return;
 
 
     /*------------------------------------------------------------------------------------------
@@ -839,15 +592,51 @@ FULL_ADDER::FULL_ADDER(string name, vector<wire> input_wires, vector<wire> outpu
     this->add_submodule(or_2);
 
     /*------------------------------------------------------------------------------------------
-    After building the module we can use the auto_gen() funtion to automatically generate the m-
+    After building the module we can use the lazy_gen() funtion to automatically generate the m-
     odule definition.
     ------------------------------------------------------------------------------------------*/
-    this->definition = this->auto_gen("module FULL_ADDER");
+    this->lazy_gen("module FULL_ADDER");
 
     /*------------------------------------------------------------------------------------------
-    Then we can instruct how each instance has to be generated.
+    Instances are written from their port bindings, so we do not need a generate string.
     ------------------------------------------------------------------------------------------*/
-    this->generate =  "FULL_ADDER " + this->name  + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->inputs.at(2) + ", " + this->outputs.at(0) + "," + this->outputs.at(1) + ");";
+}
+
+
+/*------------------------------------------------------------------------------------------
+                                    HALF ADDER CIRCUIT
+                                    ==================
+
+S = A xor B, Cout = AB. Used where a column needs to lose only one bit, see
+WALLACE_TREE_MULTIPLIER_PIPELINED::dadda_level(...).
+------------------------------------------------------------------------------------------*/
+
+HALF_ADDER::HALF_ADDER(string name, vector<wire> input_wires, vector<wire> output_wires){
+    /*------------------------------------------------------------------------------------------
+    The input_wires will be {"A", "B"} and the output_wires will be {"S", "Cout"}
+    ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
+    this->name = name;
+    this->inputs = input_wires;
+    this->outputs = output_wires;
+    if(this->reuse_module({"HALF_ADDER", {}})) return;
+
+    this->declare("A", CHIP_INPUTS);
+    this->declare("B", CHIP_INPUTS);
+    this->declare("S", CHIP_OUTPUTS);
+    this->declare("Cout", CHIP_OUTPUTS);
+
+    XOR xor_1("HA_XOR_1",
+            {"A", "B"},
+            "S");
+    AND and_1("HA_AND_1",
+            {"A", "B"},
+            "Cout");
+
+    this->add_submodule(xor_1);
+    this->add_submodule(and_1);
+
+    this->lazy_gen("module HALF_ADDER");
 }
 
 
@@ -865,10 +654,12 @@ CARRY_RIPPLE_ADDER::CARRY_RIPPLE_ADDER(string name, vector<wire> input_wires, wi
 
     We also set up the bit width and name of the instance.    
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
     this->n_bits = n_bits;
+    if(this->reuse_module({"CARRY_RIPPLE_ADDER", {n_bits}})) return;
 
     /*------------------------------------------------------------------------------------------
     Now we declare input and output ports. Note that these are generic input ports and instance
@@ -883,38 +674,37 @@ CARRY_RIPPLE_ADDER::CARRY_RIPPLE_ADDER(string name, vector<wire> input_wires, wi
     d not input/output. This is because the bit width of input/output are expected to be equal to
     the bit width. 
     ------------------------------------------------------------------------------------------*/
-    wire carry_wire = "CRA_carry_wire";
-    this->add_wire("[" + to_string(n_bits) + ":0] " + carry_wire);
+    wire carry_wire("CRA_carry_wire", n_bits + 1);
+    this->add_wire(carry_wire);
 
     /*------------------------------------------------------------------------------------------
-    We need to assign the first bit of the carry wire to be zero. We use verilog("") function to
-    embed verilog code inside our module.
+    We need to assign the first bit of the carry wire to be zero. We use assign(...) to tie it to
+    a constant.
     ------------------------------------------------------------------------------------------*/
-    this->verilog("assign " + carry_wire + "[0] = 0;");
+    this->assign(carry_wire[0], 0);
 
     /*------------------------------------------------------------------------------------------
     Now we configure wiring for each bits
     ------------------------------------------------------------------------------------------*/
+    wire A = "A";
+    wire B = "B";
+    wire out = "out";
     for(int i =0; i< n_bits; i++){
-        string slice = "["+ to_string(i) + "]";
-        string next_slice = "[" + to_string(i+1) + "]";
-
         FULL_ADDER fa("CRA_FA_" + to_string(i),
-                      {"A" + slice, "B" + slice, carry_wire + slice},
-                      {"out" + slice, carry_wire + next_slice});
+                      {A[i], B[i], carry_wire[i]},
+                      {out[i], carry_wire[i+1]});
         this->add_submodule(fa);
     }
 
     /*------------------------------------------------------------------------------------------
-    After building the module we can use the auto_gen() funtion to automatically generate the m-
+    After building the module we can use the lazy_gen() funtion to automatically generate the m-
     odule definition.
     ------------------------------------------------------------------------------------------*/
-    this->definition = this->auto_gen("module CARRY_RIPPLE_ADDER_" + to_string(this->n_bits) + "_BIT");
+    this->lazy_gen("module CARRY_RIPPLE_ADDER_" + to_string(this->n_bits) + "_BIT");
 
     /*------------------------------------------------------------------------------------------
-    Then we can instruct how each instance has to be generated.
+    Instances are written from their port bindings, so we do not need a generate string.
     ------------------------------------------------------------------------------------------*/
-    this->generate =  "CARRY_RIPPLE_ADDER_" + to_string(this->n_bits) + "_BIT " + this->name  + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
 }
 
 /*------------------------------------------------------------------------------------------
@@ -924,14 +714,149 @@ CARRY_RIPPLE_ADDER::CARRY_RIPPLE_ADDER(string name, vector<wire> input_wires, wi
 This is an implimentation of the CLA adder.
 ------------------------------------------------------------------------------------------*/
 
-CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_wires, wire output_wire, int n_bits){
+PrefixNetwork prefix_network(int n_bits, PrefixTopology topology){
+    /*------------------------------------------------------------------------------------------
+    Builds the prefix network of an n bit CLA. State i (0 <= i <= n_bits) starts as the kill,
+    propagate or generate of bit i - 1 and has to end as the combined state of 0 .. i, the carry
+    into bit i. A star at level l combines state i with state partners[l][i], which has to cover
+    the bits right below the ones state i covers so far.
+
+    Param : n_bits (int), adder width.
+    Param : topology (PrefixTopology), see CARRY_LOOK_AHEAD_ADDER.
+    Returns : network (PrefixNetwork), levels without a star are left out.
+    ------------------------------------------------------------------------------------------*/
+    int states = n_bits + 1;
+    int levels = ceil(log2(states));
+    PrefixNetwork network;
+    vector<vector<int>>& partners = network.partners;
+    auto level = [&]() -> vector<int>&{
+        partners.push_back(vector<int>(states, -1));
+        return partners.back();
+    };
+
+    switch(topology){
+        case PrefixTopology::KOGGE_STONE :
+            for(int l = 0; l < levels; l++){
+                vector<int>& partner = level();
+                for(int i = 1 << l; i < states; i++){
+                    partner.at(i) = i - (1 << l);
+                }
+            }
+            break;
+        case PrefixTopology::SKLANSKY :
+            for(int l = 0; l < levels; l++){
+                vector<int>& partner = level();
+                for(int i = 0; i < states; i++){
+                    if((i >> l) & 1){
+                        partner.at(i) = ((i >> l) << l) - 1;
+                    }
+                }
+            }
+            break;
+        case PrefixTopology::BRENT_KUNG :
+            for(int l = 0; l < levels; l++){
+                vector<int>& partner = level();
+                for(int i = (2 << l) - 1; i < states; i += 2 << l){
+                    partner.at(i) = i - (1 << l);
+                }
+            }
+            for(int l = levels - 2; l >= 0; l--){
+                vector<int>& partner = level();
+                for(int i = 3*(1 << l) - 1; i < states; i += 2 << l){
+                    partner.at(i) = i - (1 << l);
+                }
+            }
+            break;
+        default :
+            /*------------------------------------------------------------------------------------------
+            Han-Carlson, Ladner-Fischer and the sparse tree pair up the states first, run Kogge-
+            Stone or Sklansky on the odd states (the sparse tree on every fourth one) and fill in
+            the rest at the end.
+            ------------------------------------------------------------------------------------------*/
+            int sparsity = topology == PrefixTopology::SPARSE ? 4 : 2;
+            for(int l = 0; (1 << l) < sparsity; l++){
+                vector<int>& partner = level();
+                for(int i = (2 << l) - 1; i < states; i += 2 << l){
+                    partner.at(i) = i - (1 << l);
+                }
+            }
+            for(int l = sparsity == 4 ? 2 : 1; l < levels; l++){
+                vector<int>& partner = level();
+                for(int i = sparsity - 1; i < states; i += sparsity){
+                    int group = i/sparsity, span = 1 << (l - (sparsity == 4 ? 2 : 1));
+                    if(topology == PrefixTopology::LADNER_FISCHER && (group/span) % 2 == 1){
+                        partner.at(i) = (group/span)*span*sparsity - 1;
+                    }
+                    else if(topology != PrefixTopology::LADNER_FISCHER && group >= span){
+                        partner.at(i) = i - span*sparsity;
+                    }
+                }
+            }
+            for(int l = sparsity == 4 ? 1 : 0; l >= 0; l--){
+                vector<int>& partner = level();
+                for(int i = 3*(1 << l) - 1; i < states; i += 2 << l){
+                    partner.at(i) = i - (1 << l);
+                }
+            }
+            break;
+    }
+
+    /*------------------------------------------------------------------------------------------
+    Drop the empty levels and count the stars. Every state of a level is read by its own bit of
+    the next level (a star or the wire passing it down) and by the stars taking it as partner.
+    ------------------------------------------------------------------------------------------*/
+    for(vector<vector<int>>::iterator l = partners.begin(); l != partners.end(); ){
+        vector<int> fanout(states, 1);
+        int stars = 0;
+        for(vector<int>::iterator i = l->begin(); i != l->end(); i++){
+            if(*i >= 0){
+                stars++;
+                network.max_fanout = max(network.max_fanout, ++fanout.at(*i));
+            }
+        }
+        if(stars == 0){
+            l = partners.erase(l);
+            continue;
+        }
+        network.stars += stars;
+        l++;
+    }
+    network.transistors = network.stars*CLA_STAR_TRANSISTORS;
+    network.depth = partners.size()*CLA_STAR_DELAY;
+    return network;
+}
+
+bool parse_prefix_topology(const string& name, PrefixTopology* topology){
+    /*------------------------------------------------------------------------------------------
+    Finds a prefix topology by its name, see prefix_info(...).
+
+    Param : name (string), example "sklansky".
+    Param : topology (&PrefixTopology), set if the name is known.
+    Returns : true if the name is known.
+    ------------------------------------------------------------------------------------------*/
+    for(int i = 0; i <= (int)PrefixTopology::SPARSE; i++){
+        if(name == prefix_info((PrefixTopology)i).name){
+            *topology = (PrefixTopology)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_wires, wire output_wire, int n_bits, PrefixTopology topology){
     /*------------------------------------------------------------------------------------------
     We do the basic setups.
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
     this->n_bits = n_bits;
+    if(topology == PrefixTopology::KOGGE_STONE){
+        if(this->reuse_module({"CARRY_LOOK_AHEAD_ADDER", {n_bits}})) return;
+    }
+    else if(this->reuse_module({"CARRY_LOOK_AHEAD_ADDER", {n_bits, (int)topology}})) return;
 
     /*------------------------------------------------------------------------------------------
     We declare input and output ports.
@@ -941,9 +866,10 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
     this->declare("out", CHIP_OUTPUTS);
 
     /*------------------------------------------------------------------------------------------
-    Find the number of levels for our Prefix computation
+    Find the levels of our Prefix computation, see prefix_network(...)
     ------------------------------------------------------------------------------------------*/
-    int levels = ceil(log2(n_bits + 1));
+    PrefixNetwork network = prefix_network(n_bits, topology);
+    int levels = network.partners.size();
 
     /*------------------------------------------------------------------------------------------
     Wire naming convention
@@ -954,30 +880,36 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
     wire_matrix[L][N] points to the state at level L, bit N.
     We initialize the first state to be kill.
     ------------------------------------------------------------------------------------------*/
-    wire always_zero_wire = "s_level_0_bit_0";
-    this->add_wire("[1:0] " + always_zero_wire);
-    this->verilog("assign " + always_zero_wire + " = 0;");
+    wire always_zero_wire("s_level_0_bit_0", 2);
+    this->add_wire(always_zero_wire);
+    this->assign(always_zero_wire, 0);
 
-    wire wire_matrix[levels + 1][n_bits + 1];
+    vector<vector<wire>> wire_matrix(levels + 1, vector<wire>(n_bits + 1));
     wire_matrix[0][0] = always_zero_wire;
 
     /*------------------------------------------------------------------------------------------
-    We calculate the level 0 states and fill the first row of the matrix.
+    We calculate the level 0 states and fill the first row of the matrix. Every bit is independ-
+    ent, so the bits are wired into separate parts on the thread pool and merged in order.
     ------------------------------------------------------------------------------------------*/
-    for(int i=1; i<= n_bits; i++){
-        string curr_slice = "[" + to_string(i - 1) + "]";
-        
-        wire current_wire = "s_level_0_bit_" + to_string(i);
-        this->add_wire("[1:0] " + current_wire);
+    wire A = "A";
+    wire B = "B";
+    vector<Chip> parts(n_bits + 1);
+    ThreadPool::global().parallel_for(n_bits, [&](size_t index){
+        int i = index + 1;
+        wire current_wire("s_level_0_bit_" + to_string(i), 2);
+        parts.at(i).add_wire(current_wire);
         AND and_pre("CLA_and_pre_bit_" + to_string(i),
-                    {"A" + curr_slice, "B" + curr_slice},
-                    current_wire + "[1]");
+                    {A[i - 1], B[i - 1]},
+                    current_wire[1]);
         OR or_pre("CLA_or_pre_bit_" + to_string(i),
-                 {"A" + curr_slice, "B" + curr_slice},
-                 current_wire + "[0]");
+                 {A[i - 1], B[i - 1]},
+                 current_wire[0]);
         wire_matrix[0][i] = current_wire;
-        this->add_submodule(and_pre);
-        this->add_submodule(or_pre);
+        parts.at(i).add_submodule(and_pre);
+        parts.at(i).add_submodule(or_pre);
+    });
+    for(int i=1; i<= n_bits; i++){
+        this->merge(parts.at(i));
     }
     
     /*------------------------------------------------------------------------------------------
@@ -989,24 +921,39 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
 
     We also assign the 0th bit of carry_final to be zero.
     ------------------------------------------------------------------------------------------*/
-    wire carry_final = "carry_final";
-    this->add_wire("[" + to_string(n_bits) + ":0] " + carry_final);
-    verilog("assign carry_final[0] = 0;");
+    wire carry_final("carry_final", n_bits + 1);
+    this->add_wire(carry_final);
+    this->assign(carry_final[0], 0);
     
     /*------------------------------------------------------------------------------------------
-    Now we wire up the prefix computation
+    Now we wire up the prefix computation. last_level is the level of the last star of each bit.
     ------------------------------------------------------------------------------------------*/
+    vector<int> last_level(n_bits + 1, -1);
+    for(int level=0; level<levels; level++){
+        for(int bit = 0; bit <= n_bits; bit++){
+            if(network.partners[level][bit] >= 0){
+                last_level[bit] = level;
+            }
+        }
+    }
     for(int level=0; level<levels; level++){
         /*------------------------------------------------------------------------------------------
         In each level, ignore the part that already got computed and just drop down the states,
-        compute the new states for others. done_bits is the number of bits from the end who is done.
+        compute the new states for others. partner is the bit whose state is combined with ours,
+        -1 if our state only drops down.
         ------------------------------------------------------------------------------------------*/
-        int done_bits = pow(2, level);
-        for(int bit = 0; bit <= n_bits; bit++){
+        const vector<int>& partner = network.partners[level];
+
+        /*------------------------------------------------------------------------------------------
+        The bits of one level only read the previous level, so they are wired in parallel.
+        ------------------------------------------------------------------------------------------*/
+        ThreadPool::global().parallel_for(n_bits + 1, [&](size_t index){
             /*------------------------------------------------------------------------------------------
             For each bit:
             ------------------------------------------------------------------------------------------*/
-            if (bit < done_bits){
+            int bit = index;
+            Chip& part = parts.at(bit);
+            if (partner[bit] < 0){
                 /*------------------------------------------------------------------------------------------
                 Just drop down the values for bits that are done
                 ------------------------------------------------------------------------------------------*/
@@ -1018,33 +965,36 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
 
                 First we add a new wire and put it in our wire_matrix. Then we do the star(*) operation.
                 ------------------------------------------------------------------------------------------*/
-                wire new_wire = "s_level_" + to_string(level + 1) + "_bit_" + to_string(bit);
-                this->add_wire("[1:0] " + new_wire);
+                wire new_wire("s_level_" + to_string(level + 1) + "_bit_" + to_string(bit), 2);
+                part.add_wire(new_wire);
                 wire_matrix[level + 1][bit] = new_wire;
 
-                if(pow(2, level + 1) <= bit){
+                if(level < last_level[bit]){
                     CLA_STAR star_operator("CLA_level_" + to_string(level+1) + "_bit_" + to_string(bit),
-                                        {wire_matrix[level][bit - done_bits] + "[0]", wire_matrix[level][bit - done_bits] + "[1]", wire_matrix[level][bit] + "[0]", wire_matrix[level][bit] + "[1]"},
-                                        {wire_matrix[level+1][bit] + "[0]", wire_matrix[level+1][bit] + "[1]"}
+                                        {wire_matrix[level][partner[bit]][0], wire_matrix[level][partner[bit]][1], wire_matrix[level][bit][0], wire_matrix[level][bit][1]},
+                                        {wire_matrix[level+1][bit][0], wire_matrix[level+1][bit][1]}
                                         );
-                    this->add_submodule(star_operator);
+                    part.add_submodule(star_operator);
                 }
                 else{
                     /*------------------------------------------------------------------------------------------
                     If no more computations are required for the current bit, we join the wire with carry_final[N]
                     ------------------------------------------------------------------------------------------*/
                     CLA_STAR star_operator("CLA_level_" + to_string(level+1) + "_bit_" + to_string(bit),
-                                        {wire_matrix[level][bit - done_bits] + "[0]", wire_matrix[level][bit - done_bits] + "[1]", wire_matrix[level][bit] + "[0]", wire_matrix[level][bit] + "[1]"},
-                                        {carry_final + "[" + to_string(bit) + "]", wire_matrix[level+1][bit] + "[1]"}
+                                        {wire_matrix[level][partner[bit]][0], wire_matrix[level][partner[bit]][1], wire_matrix[level][bit][0], wire_matrix[level][bit][1]},
+                                        {carry_final[bit], wire_matrix[level+1][bit][1]}
                                         );
                     JOIN joint("CLA_WIRE_JOINT_" + to_string(level+1) + "_bit_" + to_string(bit),
-                              carry_final + "[" + to_string(bit) + "]",
-                              wire_matrix[level+1][bit] + "[0]");
+                              carry_final[bit],
+                              wire_matrix[level+1][bit][0]);
                     
-                    this->add_submodule(joint);
-                    this->add_submodule(star_operator);
+                    part.add_submodule(joint);
+                    part.add_submodule(star_operator);
                 }
             }
+        });
+        for(int bit = 0; bit <= n_bits; bit++){
+            this->merge(parts.at(bit));
         }
     }
 
@@ -1052,8 +1002,8 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
     Now we have everything, n bit A, n bit B, n bit carry_final. We do A xor B xor carry_final
     to get the sum.
     ------------------------------------------------------------------------------------------*/
-    wire xor_temp_wire = "CLA_xor_temp_wire";
-    this->add_wire("[" + to_string(n_bits -1) + ":0] " + xor_temp_wire);
+    wire xor_temp_wire("CLA_xor_temp_wire", n_bits);
+    this->add_wire(xor_temp_wire);
 
     XOR_N_BIT xor_1("CLA_XOR_1",
                     {"A", "B"},
@@ -1061,7 +1011,7 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
                     n_bits);
 
     XOR_N_BIT xor_2("CLA_XOR_2",
-                    {xor_temp_wire, carry_final + "[" + to_string(n_bits-1) + ":0]" },
+                    {xor_temp_wire, carry_final.slice(n_bits - 1, 0)},
                     "out",
                     n_bits);
     
@@ -1069,10 +1019,9 @@ CARRY_LOOK_AHEAD_ADDER::CARRY_LOOK_AHEAD_ADDER(string name, vector<wire> input_w
     this->add_submodule(xor_2);
 
     /*------------------------------------------------------------------------------------------
-    The wiring is complete, now we use auto_gen to automaically generate the definitions.
+    The wiring is complete, now we use lazy_gen to automaically generate the definitions.
     ------------------------------------------------------------------------------------------*/
-    this->definition = this->auto_gen("module CARRY_LOOK_AHEAD_ADDER_" + to_string(n_bits) + "_BIT");
-    this->generate =  "CARRY_LOOK_AHEAD_ADDER_" + to_string(this->n_bits) + "_BIT " + this->name  + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + ");";
+    this->lazy_gen("module CARRY_LOOK_AHEAD_ADDER_" + to_string(n_bits) + "_BIT" + prefix_info(topology).suffix);
 }
 
 /*------------------------------------------------------------------------------------------
@@ -1084,9 +1033,11 @@ CLA_STAR::CLA_STAR(string name, vector<wire> input_wires, vector<wire> output_wi
     /*------------------------------------------------------------------------------------------
     We do the basic setups.
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs = output_wires;
+    if(this->reuse_module({"CLA_STAR", {}})) return;
 
     /*------------------------------------------------------------------------------------------
     We declare the inputs.
@@ -1143,10 +1094,9 @@ CLA_STAR::CLA_STAR(string name, vector<wire> input_wires, vector<wire> output_wi
     this->add_submodule(or_1);
     
     /*------------------------------------------------------------------------------------------
-    We use auto_gen() function to automatically generate module definintions
+    We use lazy_gen() function to automatically generate module definintions
     ------------------------------------------------------------------------------------------*/
-    this->definition = this->auto_gen("module CLA_STAR");
-    this->generate =  "CLA_STAR " + this->name  + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->inputs.at(2) + ", " + this->inputs.at(3) + ", " + this->outputs.at(0) + ", " + this->outputs.at(1) + ");";
+    this->lazy_gen("module CLA_STAR");
 }
 
 /*------------------------------------------------------------------------------------------
@@ -1155,9 +1105,12 @@ CLA_STAR::CLA_STAR(string name, vector<wire> input_wires, vector<wire> output_wi
 ------------------------------------------------------------------------------------------*/
 
 FLIP_FLOP::FLIP_FLOP(string name, vector<wire> input_wires, wire output_wire){
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
+    if(this->reuse_module({"FLIP_FLOP", {}})) return;
+    this->op = Op::FLIP_FLOP;
 
     this->declare("A", CHIP_INPUTS);
     this->declare("CLK", CHIP_INPUTS);
@@ -1169,16 +1122,18 @@ FLIP_FLOP::FLIP_FLOP(string name, vector<wire> input_wires, wire output_wire){
 
     this->add_submodule(flipflop);
 
-    this->definition = this->auto_gen("module FLIP_FLOP");
-    this->generate = "FLIP_FLOP " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + " );";
+    this->lazy_gen("module FLIP_FLOP");
 
 }
 
 FLIP_FLOP_N_BIT::FLIP_FLOP_N_BIT(string name, vector<wire> input_wires, wire output_wire, int n_bits){
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
     this->n_bits = n_bits;
+    if(this->reuse_module({"FLIP_FLOP_N_BIT", {n_bits}})) return;
+    this->op = Op::FLIP_FLOP;
     
     this->declare("A", CHIP_INPUTS);
     this->declare("CLK", CHIP_INPUTS, 1);
@@ -1190,8 +1145,7 @@ FLIP_FLOP_N_BIT::FLIP_FLOP_N_BIT(string name, vector<wire> input_wires, wire out
 
     this->add_submodule(flipflop);
 
-    this->definition = this->auto_gen("module FLIP_FLOP_" + to_string(n_bits) + "_BIT");
-    this->generate = "FLIP_FLOP_" + to_string(n_bits) + "_BIT " + this->name + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->outputs.at(0) + " );";
+    this->lazy_gen("module FLIP_FLOP_" + to_string(n_bits) + "_BIT");
 
 }
 
@@ -1202,14 +1156,72 @@ FLIP_FLOP_N_BIT::FLIP_FLOP_N_BIT(string name, vector<wire> input_wires, wire out
 This is an implimentation of the CLA adder with pipelining.
 ------------------------------------------------------------------------------------------*/
 
-CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k){
+bool CARRY_LOOK_AHEAD_ADDER_PIPELINED::plan_registers(int n_bits, int clock_period, int input_delay, RegisterPlan *plan, PrefixTopology topology){
+    /*------------------------------------------------------------------------------------------
+    Places the register stages of the adder by delay. The carries go through the AND/OR of the
+    first states and one CLA_STAR per prefix level, the sum through the XOR of A and B, and both
+    meet in the final XOR. A stage is closed after a prefix level only when the next level (or
+    the final XOR) would not fit in the period anymore. Every stage registers the same bits, so
+    the fewest stages are also the fewest registers.
+
+    Param : n_bits (int), adder width.
+    Param : clock_period (int), the period every stage has to meet.
+    Param : input_delay (int), arrival time of A and B in the first stage.
+    Param : plan (&RegisterPlan), registers[level] is set for a register stage after prefix
+            level level. stages and register_bits count them, the output register included in
+            the bits.
+    Param : topology (PrefixTopology), the prefix network, its depth sets the levels.
+    Returns : false if a single prefix level does not fit in the period.
+    ------------------------------------------------------------------------------------------*/
+    int levels = prefix_network(n_bits, topology).partners.size();
+    plan->registers.assign(levels, false);
+    plan->stages = 0;
+
+    int carry = input_delay + max(AND_DELAY, OR_DELAY);
+    int sum = input_delay + XOR_DELAY;
+    for(int level = 0; level < levels; level++){
+        carry += CLA_STAR_DELAY;
+        if(max(carry, sum) > clock_period){
+            return false;
+        }
+        int next = level + 1 < levels ? carry + CLA_STAR_DELAY : max(carry, sum) + XOR_DELAY;
+        if(next > clock_period){
+            plan->registers.at(level) = true;
+            plan->stages++;
+            carry = FLIP_FLOP_DELAY;
+            sum = FLIP_FLOP_DELAY;
+        }
+    }
+    if(max(carry, sum) + XOR_DELAY > clock_period){
+        return false;
+    }
+    plan->register_bits = (long long)plan->stages*(2*(n_bits + 1) + n_bits) + n_bits;
+    return true;
+}
+
+CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name, vector<wire> input_wires, wire output_wire, int n_bits, int pipeline_k, int clock_period, int input_delay, PrefixTopology topology){
     /*------------------------------------------------------------------------------------------
     We do the basic setups.
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs.push_back(output_wire);
     this->n_bits = n_bits;
+    vector<int> key = clock_period > 0 ? vector<int>{n_bits, 0, clock_period, input_delay} : vector<int>{n_bits, pipeline_k};
+    if(topology != PrefixTopology::KOGGE_STONE) key.push_back((int)topology);
+    if(this->reuse_module({"CARRY_LOOK_AHEAD_ADDER_PIPELINED", key})) return;
+
+    /*------------------------------------------------------------------------------------------
+    With a clock period the register stages are planned up front, see plan_registers(...).
+    ------------------------------------------------------------------------------------------*/
+    RegisterPlan plan;
+    if(clock_period < 0 || (clock_period == 0 && pipeline_k < 1)){
+        throw invalid_argument("Pipelined CLA needs pipeline_k >= 1 or a positive clock period.");
+    }
+    if(clock_period > 0 && !plan_registers(n_bits, clock_period, input_delay, &plan, topology)){
+        throw invalid_argument("Clock period " + to_string(clock_period) + " is too short for a " + to_string(n_bits) + " bit pipelined CLA.");
+    }
 
     /*------------------------------------------------------------------------------------------
     We declare input and output ports.
@@ -1220,9 +1232,10 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
     this->declare("out", CHIP_OUTPUTS);
 
     /*------------------------------------------------------------------------------------------
-    Find the number of levels for our Prefix computation
+    Find the levels of our Prefix computation, see prefix_network(...)
     ------------------------------------------------------------------------------------------*/
-    int levels = ceil(log2(n_bits + 1));
+    PrefixNetwork network = prefix_network(n_bits, topology);
+    int levels = network.partners.size();
 
     /*------------------------------------------------------------------------------------------
     Wire naming convention
@@ -1233,30 +1246,36 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
     wire_matrix[L][N] points to the state at level L, bit N.
     We initialize the first state to be kill.
     ------------------------------------------------------------------------------------------*/
-    wire always_zero_wire = "s_level_0_bit_0";
-    this->add_wire("[1:0] " + always_zero_wire);
-    this->verilog("assign " + always_zero_wire + " = 0;");
+    wire always_zero_wire("s_level_0_bit_0", 2);
+    this->add_wire(always_zero_wire);
+    this->assign(always_zero_wire, 0);
 
-    wire wire_matrix[levels + 1][n_bits + 1];
+    vector<vector<wire>> wire_matrix(levels + 1, vector<wire>(n_bits + 1));
     wire_matrix[0][0] = always_zero_wire;
 
     /*------------------------------------------------------------------------------------------
-    We calculate the level 0 states and fill the first row of the matrix.
+    We calculate the level 0 states and fill the first row of the matrix. Every bit is independ-
+    ent, so the bits are wired into separate parts on the thread pool and merged in order.
     ------------------------------------------------------------------------------------------*/
-    for(int i=1; i<= n_bits; i++){
-        string curr_slice = "[" + to_string(i - 1) + "]";
-        
-        wire current_wire = "s_level_0_bit_" + to_string(i);
-        this->add_wire("[1:0] " + current_wire);
+    wire A = "A";
+    wire B = "B";
+    vector<Chip> parts(n_bits + 1);
+    ThreadPool::global().parallel_for(n_bits, [&](size_t index){
+        int i = index + 1;
+        wire current_wire("s_level_0_bit_" + to_string(i), 2);
+        parts.at(i).add_wire(current_wire);
         AND and_pre("CLA_and_pre_bit_" + to_string(i),
-                    {"A" + curr_slice, "B" + curr_slice},
-                    current_wire + "[1]");
+                    {A[i - 1], B[i - 1]},
+                    current_wire[1]);
         OR or_pre("CLA_or_pre_bit_" + to_string(i),
-                 {"A" + curr_slice, "B" + curr_slice},
-                 current_wire + "[0]");
+                 {A[i - 1], B[i - 1]},
+                 current_wire[0]);
         wire_matrix[0][i] = current_wire;
-        this->add_submodule(and_pre);
-        this->add_submodule(or_pre);
+        parts.at(i).add_submodule(and_pre);
+        parts.at(i).add_submodule(or_pre);
+    });
+    for(int i=1; i<= n_bits; i++){
+        this->merge(parts.at(i));
     }
     
     /*------------------------------------------------------------------------------------------
@@ -1268,26 +1287,34 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
 
     We also assign the 0th bit of carry_final to be zero.
     ------------------------------------------------------------------------------------------*/
-    wire carry_final = "carry_final";
-    this->add_wire("[" + to_string(n_bits) + ":0] " + carry_final);
-    verilog("assign carry_final[0] = 0;");
+    wire carry_final("carry_final", n_bits + 1);
+    this->add_wire(carry_final);
+    this->assign(carry_final[0], 0);
     
     /*------------------------------------------------------------------------------------------
     Now we wire up the prefix computation
     ------------------------------------------------------------------------------------------*/
     int num_stages = 0;
     for(int level=0; level<levels; level++){
-        if(level>0 && (level%pipeline_k == 0)) num_stages++;
+        bool register_level = clock_period > 0 ? plan.registers.at(level) : level>0 && (level%pipeline_k == 0);
+        if(register_level) num_stages++;
         /*------------------------------------------------------------------------------------------
         In each level, ignore the part that already got computed and just drop down the states,
-        compute the new states for others. done_bits is the number of bits from the end who is done.
+        compute the new states for others. partner is the bit whose state is combined with ours,
+        -1 if our state only drops down.
         ------------------------------------------------------------------------------------------*/
-        int done_bits = pow(2, level);
-        for(int bit = 0; bit <= n_bits; bit++){
+        const vector<int>& partner = network.partners[level];
+
+        /*------------------------------------------------------------------------------------------
+        The bits of one level only read the previous level, so they are wired in parallel.
+        ------------------------------------------------------------------------------------------*/
+        ThreadPool::global().parallel_for(n_bits + 1, [&](size_t index){
             /*------------------------------------------------------------------------------------------
             For each bit:
             ------------------------------------------------------------------------------------------*/
-            if (bit < done_bits){
+            int bit = index;
+            Chip& part = parts.at(bit);
+            if (partner[bit] < 0){
                 /*------------------------------------------------------------------------------------------
                 Just drop down the values for bits that are done
                 ------------------------------------------------------------------------------------------*/
@@ -1299,22 +1326,22 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
 
                 First we add a new wire and put it in our wire_matrix. Then we do the star(*) operation.
                 ------------------------------------------------------------------------------------------*/
-                wire new_wire = "s_level_" + to_string(level + 1) + "_bit_" + to_string(bit);
-                this->add_wire("[1:0] " + new_wire);
+                wire new_wire("s_level_" + to_string(level + 1) + "_bit_" + to_string(bit), 2);
+                part.add_wire(new_wire);
                 wire_matrix[level + 1][bit] = new_wire;
 
                 CLA_STAR star_operator("CLA_level_" + to_string(level+1) + "_bit_" + to_string(bit),
-                                    {wire_matrix[level][bit - done_bits] + "[0]", wire_matrix[level][bit - done_bits] + "[1]", wire_matrix[level][bit] + "[0]", wire_matrix[level][bit] + "[1]"},
-                                    {wire_matrix[level+1][bit] + "[0]", wire_matrix[level+1][bit] + "[1]"}
+                                    {wire_matrix[level][partner[bit]][0], wire_matrix[level][partner[bit]][1], wire_matrix[level][bit][0], wire_matrix[level][bit][1]},
+                                    {wire_matrix[level+1][bit][0], wire_matrix[level+1][bit][1]}
                                     );
-                this->add_submodule(star_operator);
+                part.add_submodule(star_operator);
             }
 
             /*------------------------------------------------------------------------------------------
-            For each bit in current level if level is multiple of k, we add a registor
+            For each bit in current level if level is multiple of k (or planned), we add a registor
             ------------------------------------------------------------------------------------------*/
             
-            if(level>0 && (level%pipeline_k == 0)){
+            if(register_level){
 
                 /*------------------------------------------------------------------------------------------
                 We take the "wire_matrix[level +1][bit]" wire from wire matrix
@@ -1322,14 +1349,14 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
                 ANd the we take the output of the flipflop and put it to the wire matrix
                 ------------------------------------------------------------------------------------------*/
                 
-                wire flipflop_out = "CLA_STAR_PIPELINED_FLIPFLOP_LEVEL_" + to_string(level) + "_BIT_" + to_string(bit) + "_reg";
+                wire flipflop_out("CLA_STAR_PIPELINED_FLIPFLOP_LEVEL_" + to_string(level) + "_BIT_" + to_string(bit) + "_reg", 2);
                 FLIP_FLOP_N_BIT curr_flipflop("CLA_STAR_PIPELINED_FLIPFLOP_LEVEL_" + to_string(level) + "_BIT_" + to_string(bit),
                                              {wire_matrix[level +1][bit], "CLK"},
                                              flipflop_out,
                                              2);
                 wire_matrix[level+1][bit] = flipflop_out;
-                this->add_wire("[1:0] " + flipflop_out);
-                this->add_submodule(curr_flipflop);
+                part.add_wire(flipflop_out);
+                part.add_submodule(curr_flipflop);
             }
 
             /*------------------------------------------------------------------------------------------
@@ -1337,19 +1364,21 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
             ------------------------------------------------------------------------------------------*/
             if(level + 1 == levels){
                 JOIN joint("CLA_WIRE_JOINT_" + to_string(level+1) + "_bit_" + to_string(bit),
-                            carry_final + "[" + to_string(bit) + "]",
-                            wire_matrix[level+1][bit] + "[0]");
-                this->add_submodule(joint);
+                            carry_final[bit],
+                            wire_matrix[level+1][bit][0]);
+                part.add_submodule(joint);
             }
-
+        });
+        for(int bit = 0; bit <= n_bits; bit++){
+            this->merge(parts.at(bit));
         }
     }
     /*------------------------------------------------------------------------------------------
     Now we have everything, n bit A, n bit B, n bit carry_final. We do A xor B xor carry_final
     to get the sum.
     ------------------------------------------------------------------------------------------*/
-    wire xor_temp_wire = "CLA_xor_temp_wire";
-    this->add_wire("[" + to_string(n_bits -1) + ":0] " + xor_temp_wire);
+    wire xor_temp_wire("CLA_xor_temp_wire", n_bits);
+    this->add_wire(xor_temp_wire);
 
 
     XOR_N_BIT xor_1("CLA_XOR_1",
@@ -1361,21 +1390,21 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
     We need to add a few more registers as empty stages to balance out stuffs.
     ------------------------------------------------------------------------------------------*/
     for(int k=0; k < num_stages; k++){
-        wire curr_wire = "CLA_xor_temp_wire_" + to_string(k);
+        wire curr_wire("CLA_xor_temp_wire_" + to_string(k), n_bits);
         FLIP_FLOP_N_BIT curr_flip("CLA_XOR_EMPTY_STAGE_" + to_string(k),
                                  {xor_temp_wire, "CLK"},
                                  curr_wire, n_bits);
-        this->add_wire("[" + to_string(n_bits-1) + ":0] " + curr_wire);
+        this->add_wire(curr_wire);
         this->add_submodule(curr_flip);
         xor_temp_wire = curr_wire;
     }
     
-    wire final_output = "CLA_PIPELINE_FINAL";
+    wire final_output("CLA_PIPELINE_FINAL", n_bits);
     XOR_N_BIT xor_2("CLA_XOR_2",
-                    {xor_temp_wire, carry_final + "[" + to_string(n_bits-1) + ":0]" },
+                    {xor_temp_wire, carry_final.slice(n_bits - 1, 0)},
                     final_output,
                     n_bits);
-    this->add_wire("["+ to_string(this->n_bits - 1) +":0] " +final_output);
+    this->add_wire(final_output);
     this->add_submodule(xor_1);
     this->add_submodule(xor_2);
 
@@ -1385,10 +1414,14 @@ CARRY_LOOK_AHEAD_ADDER_PIPELINED::CARRY_LOOK_AHEAD_ADDER_PIPELINED(string name,
 
     this->add_submodule(last_flipflop);
     /*------------------------------------------------------------------------------------------
-    The wiring is complete, now we use auto_gen to automaically generate the definitions.
+    The wiring is complete, now we use lazy_gen to automaically generate the definitions.
     ------------------------------------------------------------------------------------------*/
-    this->definition = this->auto_gen("module CARRY_LOOK_AHEAD_ADDER_PIPELINED_" + to_string(n_bits) + "_BIT_" + to_string(pipeline_k) + "_PIPELINED");
-    this->generate =  "CARRY_LOOK_AHEAD_ADDER_PIPELINED_" + to_string(n_bits) + "_BIT_" + to_string(pipeline_k) + "_PIPELINED " + this->name  + " (" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->inputs.at(2) + ", " + this->outputs.at(0) + ");";
+    if(clock_period > 0){
+        this->lazy_gen("module CARRY_LOOK_AHEAD_ADDER_PIPELINED_" + to_string(n_bits) + "_BIT_PERIOD_" + to_string(clock_period)
+                       + (input_delay > 0 ? "_DELAY_" + to_string(input_delay) : "") + prefix_info(topology).suffix);
+        return;
+    }
+    this->lazy_gen("module CARRY_LOOK_AHEAD_ADDER_PIPELINED_" + to_string(n_bits) + "_BIT_" + to_string(pipeline_k) + "_PIPELINED" + prefix_info(topology).suffix);
 }
 
 /*------------------------------------------------------------------------------------------
@@ -1400,10 +1433,12 @@ CARRY_SAVE_ADDER::CARRY_SAVE_ADDER(string name, vector<wire> input_wires, vector
     /*------------------------------------------------------------------------------------------
     A Carry Save Adder is constructed by stacking Full Adders together.
     ------------------------------------------------------------------------------------------*/
+    DOTV_TIMER(PHASE_ELABORATE);
     this->name = name;
     this->inputs = input_wires;
     this->outputs = output_wires;
     this->n_bits = n_bits;
+    if(this->reuse_module({"CARRY_SAVE_ADDER", {n_bits}})) return;
 
     this->declare("A", CHIP_INPUTS);
     this->declare("B", CHIP_INPUTS);
@@ -1412,25 +1447,29 @@ CARRY_SAVE_ADDER::CARRY_SAVE_ADDER(string name, vector<wire> input_wires, vector
     this->declare("Cout", CHIP_OUTPUTS);
     this->declare("Overflow", CHIP_OUTPUTS, 1);
 
-    this->verilog("assign Cout[0] = 0;");
+    wire A = "A";
+    wire B = "B";
+    wire Cin = "Cin";
+    wire SUM = "SUM";
+    wire Cout = "Cout";
+
+    this->assign(Cout[0], 0);
     for(int n=0; n<n_bits; n++){
-        string slice = "[" + to_string(n) + "]";
         if(n + 1 != n_bits){
             FULL_ADDER curr_full_adder("CSA_FA_" + to_string(n),
-                                    {"A" + slice, "B" + slice, "Cin" + slice},
-                                    {"SUM" + slice, "Cout[" + to_string(n+1) + "]"});
+                                    {A[n], B[n], Cin[n]},
+                                    {SUM[n], Cout[n+1]});
             this->add_submodule(curr_full_adder);
         }
         else{
             FULL_ADDER curr_full_adder("CSA_FA_" + to_string(n),
-                                    {"A" + slice, "B" + slice, "Cin" + slice},
-                                    {"SUM" + slice, "Overflow"});
+                                    {A[n], B[n], Cin[n]},
+                                    {SUM[n], "Overflow"});
             
             this->add_submodule(curr_full_adder);
         }
     }
 
-    this->definition = this->auto_gen("module CARRY_SAVE_ADDER_" + to_string(n_bits) + "_BIT");
-    this->generate = "CARRY_SAVE_ADDER_" + to_string(n_bits) + "_BIT " + this->name + "(" + this->inputs.at(0) + ", " + this->inputs.at(1) + ", " + this->inputs.at(2) + ", " + this->outputs.at(0) + ", " + this->outputs.at(1) + ", " + this->outputs.at(2) + ");";
+    this->lazy_gen("module CARRY_SAVE_ADDER_" + to_string(n_bits) + "_BIT");
 
 }
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include <wire.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+/*------------------------------------------------------------------------------------------
+                                        Arena
+                                        =====
+------------------------------------------------------------------------------------------*/
+
+Arena::Arena(size_t block_size){
+    this->block_size = block_size;
+    this->used = block_size;
+}
+
+char* Arena::allocate(size_t size){
+    /*------------------------------------------------------------------------------------------
+    Returns size bytes from the current block, starting a new block when it is full. Requests
+    larger than a block get a block of their own.
+    ------------------------------------------------------------------------------------------*/
+    if(this->used + size > this->block_size){
+        size_t new_block = max(size, this->block_size);
+        this->blocks.emplace_back(new char[new_block]);
+        this->total += new_block;
+        if(new_block > this->block_size){
+            return this->blocks.back().get();
+        }
+        this->used = 0;
+    }
+    char* ptr = this->blocks.back().get() + this->used;
+    this->used += size;
+    return ptr;
+}
+
+void Arena::release(){
+    /*------------------------------------------------------------------------------------------
+    Frees every block at once.
+    ------------------------------------------------------------------------------------------*/
+    this->blocks.clear();
+    this->used = this->block_size;
+    this->total = 0;
+}
+
+size_t Arena::bytes() const{
+    return this->total;
+}
+
+/*------------------------------------------------------------------------------------------
+                                    Symbol Table
+                                    ============
+------------------------------------------------------------------------------------------*/
+
+SymbolTable::SymbolTable(){
+    this->chunks.reset(new unique_ptr<string_view[]>[MAX_CHUNKS]);
+    this->generation = 0;
+    this->count = 0;
+    this->insert(string_view());
+}
+
+SymbolTable& SymbolTable::global(){
+    static SymbolTable table;
+    return table;
+}
+
+struct SymbolCache{
+    /*------------------------------------------------------------------------------------------
+    The per thread cache of interned names. It is dropped when the table is released.
+    ------------------------------------------------------------------------------------------*/
+    const SymbolTable* table = nullptr;
+    uint64_t generation = 0;
+    unordered_map<string_view, Symbol> ids;
+};
+
+static thread_local SymbolCache cache;
+
+Symbol SymbolTable::intern(string_view name){
+    /*------------------------------------------------------------------------------------------
+    Returns the id of the given name. New names are copied into the arena once.
+
+    Param: name (string_view), a wire name.
+    Returns: id (Symbol), the interned id.
+    ------------------------------------------------------------------------------------------*/
+    if(name.empty()){
+        return 0;
+    }
+    if(cache.table != this || cache.generation != this->generation){
+        cache.ids.clear();
+        cache.table = this;
+        cache.generation = this->generation;
+    }
+    unordered_map<string_view, Symbol>::iterator cached = cache.ids.find(name);
+    if(cached != cache.ids.end()){
+        return cached->second;
+    }
+
+    lock_guard<mutex> guard(this->lock);
+    Symbol id;
+    unordered_map<string_view, Symbol>::iterator found = this->ids.find(name);
+    if(found != this->ids.end()){
+        id = found->second;
+    }
+    else{
+        id = this->insert(name);
+    }
+    cache.ids.emplace(this->name(id), id);
+    return id;
+}
+
+Symbol SymbolTable::insert(string_view name){
+    /*------------------------------------------------------------------------------------------
+    Copies a new name into the arena and gives it the next id. Called with the lock held.
+    ------------------------------------------------------------------------------------------*/
+    string_view stored;
+    if(!name.empty()){
+        char* text = this->arena.allocate(name.size());
+        memcpy(text, name.data(), name.size());
+        stored = string_view(text, name.size());
+    }
+
+    Symbol id = this->count;
+    if((id >> CHUNK_BITS) >= MAX_CHUNKS){
+        throw length_error("Too many wire names.");
+    }
+    unique_ptr<string_view[]>& chunk = this->chunks[id >> CHUNK_BITS];
+    if(!chunk){
+        chunk.reset(new string_view[CHUNK_SIZE]);
+    }
+    chunk[id & (CHUNK_SIZE - 1)] = stored;
+    if(id != 0){
+        this->ids.emplace(stored, id);
+    }
+    this->count = id + 1;
+    return id;
+}
+
+string_view SymbolTable::name(Symbol id) const{
+    if(id >= this->count){
+        throw out_of_range("Unknown wire symbol.");
+    }
+    return this->chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)];
+}
+
+size_t SymbolTable::size() const{
+    return this->count;
+}
+
+void SymbolTable::release(){
+    /*------------------------------------------------------------------------------------------
+    Frees all the interned names at once. No other thread may use the table meanwhile.
+    ------------------------------------------------------------------------------------------*/
+    lock_guard<mutex> guard(this->lock);
+    this->ids.clear();
+    for(size_t i = 0; i < MAX_CHUNKS && this->chunks[i]; i++){
+        this->chunks[i].reset();
+    }
+    this->arena.release();
+    this->count = 0;
+    this->generation++;
+    this->insert(string_view());
+}
+
+/*------------------------------------------------------------------------------------------
+                                        Wires
+                                        =====
+------------------------------------------------------------------------------------------*/
+
+static bool parse_int(string_view text, size_t& pos, int& value){
+    /*------------------------------------------------------------------------------------------
+    Parses a non negative integer starting at pos, skipping spaces around it.
+    ------------------------------------------------------------------------------------------*/
+    while(pos < text.size() && text[pos] == ' ') pos++;
+    if(pos >= text.size() || text[pos] < '0' || text[pos] > '9'){
+        return false;
+    }
+    value = 0;
+    while(pos < text.size() && text[pos] >= '0' && text[pos] <= '9'){
+        value = value*10 + (text[pos] - '0');
+        pos++;
+    }
+    while(pos < text.size() && text[pos] == ' ') pos++;
+    return true;
+}
+
+static bool parse_range(string_view text, int& hi, int& lo, bool& is_range){
+    /*------------------------------------------------------------------------------------------
+    Parses "7:0" or "3" (the part between the brackets).
+    ------------------------------------------------------------------------------------------*/
+    size_t pos = 0;
+    if(!parse_int(text, pos, hi)){
+        return false;
+    }
+    is_range = false;
+    lo = hi;
+    if(pos < text.size() && text[pos] == ':'){
+        pos++;
+        if(!parse_int(text, pos, lo)){
+            return false;
+        }
+        is_range = true;
+    }
+    return pos == text.size();
+}
+
+wire::wire(){
+}
+
+wire::wire(const char* text){
+    this->parse(string_view(text));
+}
+
+wire::wire(const string& text){
+    this->parse(string_view(text));
+}
+
+wire::wire(string_view name, int width){
+    /*------------------------------------------------------------------------------------------
+    Creates a wire declaration of the given width. Single bit wires are plain names.
+
+    Param: name (string_view), the net name.
+    Param: width (int), bit width.
+    ------------------------------------------------------------------------------------------*/
+    this->symbol = SymbolTable::global().intern(name);
+    if(width > 1){
+        this->kind = DECL;
+        this->hi = width - 1;
+        this->lo = 0;
+    }
+}
+
+void wire::parse(string_view text){
+    /*------------------------------------------------------------------------------------------
+    Parses the string forms "A", "A[3]", "A[7:0]" and "[7:0] A". Anything else is kept as a
+    plain name so that it is written back unchanged.
+    ------------------------------------------------------------------------------------------*/
+    while(!text.empty() && text.front() == ' ') text.remove_prefix(1);
+    while(!text.empty() && text.back() == ' ') text.remove_suffix(1);
+
+    bool is_range;
+    int h, l;
+    if(!text.empty() && text.front() == '['){
+        size_t close = text.find(']');
+        if(close != string_view::npos && parse_range(text.substr(1, close - 1), h, l, is_range)){
+            string_view rest = text.substr(close + 1);
+            while(!rest.empty() && rest.front() == ' ') rest.remove_prefix(1);
+            this->symbol = SymbolTable::global().intern(rest);
+            this->kind = DECL;
+            this->hi = h;
+            this->lo = l;
+            return;
+        }
+    }
+    else if(!text.empty() && text.back() == ']'){
+        size_t open = text.rfind('[');
+        if(open != string_view::npos && open > 0 && parse_range(text.substr(open + 1, text.size() - open - 2), h, l, is_range)){
+            this->symbol = SymbolTable::global().intern(text.substr(0, open));
+            this->kind = is_range ? RANGE : BIT;
+            this->hi = h;
+            this->lo = l;
+            return;
+        }
+    }
+    this->symbol = SymbolTable::global().intern(text);
+    this->kind = NAME;
+}
+
+wire wire::operator[](int bit) const{
+    /*------------------------------------------------------------------------------------------
+    Returns a single bit. Bits are counted from the lsb of ranges and declarations.
+    ------------------------------------------------------------------------------------------*/
+    wire result = *this;
+    result.kind = BIT;
+    if(this->kind == RANGE || this->kind == DECL){
+        result.hi = result.lo = this->lo + bit;
+    }
+    else if(this->kind == BIT){
+        result.hi = result.lo = this->hi + bit;
+    }
+    else{
+        result.hi = result.lo = bit;
+    }
+    return result;
+}
+
+wire wire::slice(int hi, int lo) const{
+    /*------------------------------------------------------------------------------------------
+    Returns the bit range [hi:lo]. Bits are counted from the lsb of ranges and declarations.
+    ------------------------------------------------------------------------------------------*/
+    wire result = *this;
+    result.kind = RANGE;
+    int offset = (this->kind == NAME) ? 0 : this->lo;
+    result.hi = offset + hi;
+    result.lo = offset + lo;
+    return result;
+}
+
+int wire::width() const{
+    if(this->kind == RANGE || this->kind == DECL){
+        return this->hi - this->lo + 1;
+    }
+    return 1;
+}
+
+string_view wire::name() const{
+    return SymbolTable::global().name(this->symbol);
+}
+
+void wire::write(string& out) const{
+    /*------------------------------------------------------------------------------------------
+    Appends the verilog reference to out. Declarations are referenced by their name.
+    ------------------------------------------------------------------------------------------*/
+    out.append(this->name());
+    if(this->kind == BIT){
+        out += '[';
+        out += to_string(this->hi);
+        out += ']';
+    }
+    else if(this->kind == RANGE){
+        out += '[';
+        out += to_string(this->hi);
+        out += ':';
+        out += to_string(this->lo);
+        out += ']';
+    }
+}
+
+string wire::str() const{
+    string out;
+    this->write(out);
+    return out;
+}
+
+string wire::declaration() const{
+    /*------------------------------------------------------------------------------------------
+    Returns the declaration text, example "[7:0] A". Plain names are declared as single bits.
+    ------------------------------------------------------------------------------------------*/
+    if(this->kind == DECL){
+        return "[" + to_string(this->hi) + ":" + to_string(this->lo) + "] " + string(this->name());
+    }
+    return this->str();
+}
+
+bool wire::operator==(const wire& other) const{
+    return this->symbol == other.symbol && this->kind == other.kind && this->hi == other.hi && this->lo == other.lo;
+}
+
+string operator+(const string& lhs, const wire& rhs){
+    string out = lhs;
+    rhs.write(out);
+    return out;
+}
+
+string operator+(string&& lhs, const wire& rhs){
+    rhs.write(lhs);
+    return std::move(lhs);
+}
+
+string operator+(const wire& lhs, const string& rhs){
+    string out = lhs.str();
+    out += rhs;
+    return out;
+}
+
+string operator+(const char* lhs, const wire& rhs){
+    string out = lhs;
+    rhs.write(out);
+    return out;
+}
+
+string operator+(const wire& lhs, const char* rhs){
+    string out = lhs.str();
+    out += rhs;
+    return out;
+}
+
+ostream& operator<<(ostream& out, const wire& w){
+    return out << w.str();
+}